@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "AdaptiveThrottle.h"
+#include "DirReader.h"
+
+using namespace std;
+
+
+const char* AdaptiveThrottle::DEFAULT_PRESSURE_PATH = "/proc/pressure/io";
+const char* AdaptiveThrottle::DEFAULT_BLOCK_DIR = "/sys/block";
+
+static const double LATENCY_WEIGHT = 0.2;
+static const double LEVEL_STEP = 0.1;
+static const double BACKOFF = 0.5;
+// signals under this fraction of their target count as idle
+static const double IDLE_FRACTION = 0.5;
+
+
+AdaptiveThrottle::AdaptiveThrottle(const string& pressure_path,
+                                   const string& block_dir,
+                                   double pressure_target,
+                                   double util_target,
+                                   double latency_target,
+                                   double update_interval) :
+    _pressure_path(pressure_path),
+    _block_dir(block_dir),
+    _pressure_target(pressure_target),
+    _util_target(util_target),
+    _latency_target(latency_target),
+    _update_interval(update_interval),
+    _level(0.5),
+    _latency(0.0),
+    _last_update(0.0),
+    _last_pressure(0.0),
+    _last_util(0.0) {
+    pthread_mutex_init(&_lock, NULL);
+}
+
+AdaptiveThrottle::~AdaptiveThrottle() {
+    pthread_mutex_destroy(&_lock);
+}
+
+void AdaptiveThrottle::record_latency(double seconds) {
+    pthread_mutex_lock(&_lock);
+    if (_latency == 0.0) {
+        _latency = seconds;
+    } else {
+        _latency += LATENCY_WEIGHT * (seconds - _latency);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+double AdaptiveThrottle::level() const {
+    pthread_mutex_lock(&_lock);
+    const double level = _level;
+    pthread_mutex_unlock(&_lock);
+    return level;
+}
+
+double AdaptiveThrottle::rate(double floor, double ceiling) const {
+    return floor + (ceiling - floor) * level();
+}
+
+double AdaptiveThrottle::pressure() const {
+    pthread_mutex_lock(&_lock);
+    const double pressure = _last_pressure;
+    pthread_mutex_unlock(&_lock);
+    return pressure;
+}
+
+double AdaptiveThrottle::util() const {
+    pthread_mutex_lock(&_lock);
+    const double util = _last_util;
+    pthread_mutex_unlock(&_lock);
+    return util;
+}
+
+double AdaptiveThrottle::latency() const {
+    pthread_mutex_lock(&_lock);
+    const double latency = _latency;
+    pthread_mutex_unlock(&_lock);
+    return latency;
+}
+
+/**
+ * The "some avg10" figure: percentage of the last 10 seconds in which at
+ * least one task was stalled on io. 0 if the kernel has no PSI.
+ */
+double AdaptiveThrottle::_read_pressure() const {
+    FILE* f = ::fopen(_pressure_path.c_str(), "r");
+    if (f == NULL) {
+        return 0.0;
+    }
+
+    double avg10 = 0.0;
+    char line[256];
+    while (::fgets(line, sizeof(line), f) != NULL) {
+        if (::sscanf(line, "some avg10=%lf", &avg10) == 1) {
+            break;
+        }
+    }
+    ::fclose(f);
+    return avg10;
+}
+
+/**
+ * Busy fraction of the busiest block device since the last call, from
+ * the io_ticks field (milliseconds spent doing io) of its stat file.
+ */
+double AdaptiveThrottle::_read_util(double elapsed) {
+    DirReader dir;
+    if (!dir.open(_block_dir)) {
+        return 0.0;
+    }
+    DirReaderCloser closer(dir);
+
+    double busiest = 0.0;
+    const char* name;
+    while ((name = dir.next()) != NULL) {
+        if (strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0) {
+            continue;
+        }
+
+        string stat_path = _block_dir + "/" + name + "/stat";
+        FILE* f = ::fopen(stat_path.c_str(), "r");
+        if (f == NULL) {
+            continue;
+        }
+        unsigned long fields[10];
+        int count = ::fscanf(f, "%lu %lu %lu %lu %lu %lu %lu %lu %lu %lu",
+                             &fields[0], &fields[1], &fields[2], &fields[3],
+                             &fields[4], &fields[5], &fields[6], &fields[7],
+                             &fields[8], &fields[9]);
+        ::fclose(f);
+        if (count != 10) {
+            continue;
+        }
+
+        const unsigned long io_ticks = fields[9];
+        map<string, unsigned long>::iterator it = _io_ticks.find(name);
+        if (it != _io_ticks.end()) {
+            if (elapsed > 0.0 && io_ticks >= it->second) {
+                double util = (io_ticks - it->second) / (elapsed * 1000.0);
+                if (util > busiest) {
+                    busiest = util;
+                }
+            }
+            it->second = io_ticks;
+        } else {
+            _io_ticks[name] = io_ticks;
+        }
+    }
+
+    return busiest;
+}
+
+/**
+ * Every worker calls this after each object; the first to find the
+ * interval over re-evaluates, under the lock, and the rest see false.
+ */
+bool AdaptiveThrottle::update(double now) {
+    pthread_mutex_lock(&_lock);
+    const double elapsed = now - _last_update;
+    if (_last_update > 0.0 && elapsed < _update_interval) {
+        pthread_mutex_unlock(&_lock);
+        return false;
+    }
+    const bool first = (_last_update == 0.0);
+    _last_update = now;
+
+    _last_pressure = _read_pressure();
+    _last_util = _read_util(first ? 0.0 : elapsed);
+    if (first) {
+        // utilisation needs two samples
+        pthread_mutex_unlock(&_lock);
+        return false;
+    }
+
+    double load = 0.0;
+    if (_pressure_target > 0.0) {
+        load = max(load, _last_pressure / _pressure_target);
+    }
+    if (_util_target > 0.0) {
+        load = max(load, _last_util / _util_target);
+    }
+    if (_latency_target > 0.0) {
+        load = max(load, _latency / _latency_target);
+    }
+
+    if (load > 1.0) {
+        _level *= BACKOFF;
+    } else if (load < IDLE_FRACTION) {
+        _level = min(1.0, _level + LEVEL_STEP);
+    }
+    pthread_mutex_unlock(&_lock);
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef ADAPTIVETHROTTLE_H
+#define ADAPTIVETHROTTLE_H
+
+#include <pthread.h>
+#include <string>
+#include <map>
+
+
+/**
+ * Picks how hard the auditor may push the disks. Every update interval
+ * it looks at the kernel's io pressure (/proc/pressure/io), the busiest
+ * block device's utilisation (/sys/block/<dev>/stat) and the auditor's
+ * own chunk read latency, and moves a level between 0 and 1: halved when
+ * any signal is over its target, raised a step when all of them are well
+ * under. Rates are then interpolated between a floor and a ceiling.
+ *
+ * Both paths are settable so a test can point them at plain files.
+ *
+ * One throttle is shared by all the workers of a process, so every call
+ * takes its lock.
+ */
+class AdaptiveThrottle {
+
+private:
+    std::string _pressure_path;
+    std::string _block_dir;
+    double _pressure_target;
+    double _util_target;
+    double _latency_target;
+    double _update_interval;
+
+    double _level;
+    double _latency;
+    double _last_update;
+    double _last_pressure;
+    double _last_util;
+    std::map<std::string, unsigned long> _io_ticks;
+    mutable pthread_mutex_t _lock;
+
+    // disallow copies
+    AdaptiveThrottle(const AdaptiveThrottle&);
+    AdaptiveThrottle& operator=(const AdaptiveThrottle&);
+
+    double _read_pressure() const;
+    double _read_util(double elapsed);
+
+
+public:
+    static const char* DEFAULT_PRESSURE_PATH;
+    static const char* DEFAULT_BLOCK_DIR;
+
+
+    // pressure_target is the io "some avg10" percentage, util_target the
+    // device busy fraction (0-1) and latency_target the seconds per
+    // chunk read above which the auditor backs off.
+    AdaptiveThrottle(const std::string& pressure_path,
+                     const std::string& block_dir,
+                     double pressure_target,
+                     double util_target,
+                     double latency_target,
+                     double update_interval);
+    ~AdaptiveThrottle();
+
+    // time taken to read (and hash) one chunk
+    void record_latency(double seconds);
+
+    // Re-evaluate the level if the update interval has passed; returns
+    // true if it was re-evaluated.
+    bool update(double now);
+
+    double level() const;
+    double rate(double floor, double ceiling) const;
+    double pressure() const;
+    double util() const;
+    double latency() const;
+};
+
+#endif
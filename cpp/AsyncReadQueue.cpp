@@ -0,0 +1,290 @@
+#include <errno.h>
+
+#include "AsyncReadQueue.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+
+AsyncReadQueue::AsyncReadQueue(int depth, int chunk_size) :
+    _depth(depth),
+    _chunk_size(chunk_size),
+    _buffers(chunk_size, BUFFER_ALIGNMENT),
+    _next_seq(0) {
+
+    if (!_ring.setup(depth)) {
+        return;
+    }
+
+    _slots.resize(depth);
+    for (int i = 0; i < depth; ++i) {
+        Slot& slot = _slots[i];
+        slot.buffer = _buffers.acquire();
+        slot.stream = -1;
+        slot.offset = 0;
+        slot.state = SLOT_FREE;
+        slot.result = 0;
+        slot.orphaned = false;
+    }
+}
+
+AsyncReadQueue::~AsyncReadQueue() {
+    // the kernel may still be writing into buffers of reads in flight
+    bool in_flight = true;
+    while (in_flight) {
+        in_flight = false;
+        for (size_t i = 0; i < _slots.size(); ++i) {
+            if (_slots[i].state == SLOT_IN_FLIGHT) {
+                in_flight = true;
+                break;
+            }
+        }
+        if (in_flight) {
+            _reap(true);
+        }
+    }
+
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        _buffers.release(_slots[i].buffer);
+    }
+}
+
+int AsyncReadQueue::open_stream(int fd, uint64_t offset, uint64_t end) {
+    int stream_id = -1;
+    for (size_t i = 0; i < _streams.size(); ++i) {
+        if (!_streams[i].open) {
+            stream_id = (int) i;
+            break;
+        }
+    }
+    if (stream_id < 0) {
+        stream_id = (int) _streams.size();
+        _streams.push_back(Stream());
+    }
+
+    Stream& stream = _streams[stream_id];
+    stream.open = true;
+    stream.fd = fd;
+    stream.next_submit = offset;
+    stream.next_consume = offset;
+    stream.end = end;
+    stream.consumed_slot = -1;
+    stream.seq = _next_seq++;
+
+    _fill();
+    _reap(false);
+    return stream_id;
+}
+
+bool AsyncReadQueue::next_chunk(int stream_id,
+                                const char*& data,
+                                int& length) {
+    Stream& stream = _streams[stream_id];
+    _release_consumed(stream);
+
+    while (true) {
+        if (stream.next_consume >= stream.end) {
+            return false;
+        }
+
+        _fill();
+
+        int index = _find_slot(stream_id, stream.next_consume);
+        if (index < 0) {
+            // an older stream has the slots; read this chunk anyway if
+            // one is free
+            for (size_t i = 0; i < _slots.size(); ++i) {
+                Slot& slot = _slots[i];
+                if (slot.state != SLOT_FREE) {
+                    continue;
+                }
+                unsigned read_length =
+                    _read_length(stream.end - stream.next_consume);
+                if (!_ring.queue_read(stream.fd, slot.buffer, read_length,
+                                      stream.next_consume, i)) {
+                    // the submission queue is full of reads that are
+                    // in flight; wait for one of them below
+                    break;
+                }
+                slot.stream = stream_id;
+                slot.offset = stream.next_consume;
+                slot.state = SLOT_IN_FLIGHT;
+                slot.orphaned = false;
+                if (stream.next_submit < stream.end) {
+                    stream.next_submit = stream.next_consume + _chunk_size;
+                }
+                index = (int) i;
+                break;
+            }
+        }
+
+        if (index < 0) {
+            bool any_in_flight = false;
+            for (size_t i = 0; i < _slots.size(); ++i) {
+                if (_slots[i].state == SLOT_IN_FLIGHT) {
+                    any_in_flight = true;
+                    break;
+                }
+            }
+            if (!any_in_flight) {
+                // every buffer holds data of another stream that nobody
+                // is consuming
+                throw OSError(ENOBUFS);
+            }
+            _reap(true);
+            continue;
+        }
+
+        Slot& slot = _slots[index];
+        while (slot.state == SLOT_IN_FLIGHT) {
+            _reap(true);
+        }
+
+        if (slot.result < 0) {
+            slot.state = SLOT_FREE;
+            throw OSError(-slot.result);
+        }
+
+        const uint64_t expected = stream.end - slot.offset;
+        if ((uint64_t) slot.result < expected &&
+            slot.result < _chunk_size) {
+            // file is shorter than expected; stop at what we got
+            stream.end = slot.offset + slot.result;
+            for (size_t i = 0; i < _slots.size(); ++i) {
+                Slot& other = _slots[i];
+                if (other.stream != stream_id || (int) i == index ||
+                    other.offset < stream.end) {
+                    continue;
+                }
+                if (other.state == SLOT_IN_FLIGHT) {
+                    other.orphaned = true;
+                } else if (other.state == SLOT_DONE) {
+                    other.state = SLOT_FREE;
+                }
+            }
+            if (slot.result == 0) {
+                slot.state = SLOT_FREE;
+                return false;
+            }
+        }
+
+        slot.state = SLOT_CONSUMED;
+        stream.consumed_slot = index;
+        stream.next_consume += slot.result;
+        data = slot.buffer;
+        length = slot.result;
+        return true;
+    }
+}
+
+void AsyncReadQueue::close_stream(int stream_id) {
+    Stream& stream = _streams[stream_id];
+    _release_consumed(stream);
+
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        Slot& slot = _slots[i];
+        if (slot.stream != stream_id) {
+            continue;
+        }
+        if (slot.state == SLOT_IN_FLIGHT) {
+            slot.orphaned = true;
+        } else {
+            slot.state = SLOT_FREE;
+            slot.stream = -1;
+        }
+    }
+
+    stream.open = false;
+}
+
+void AsyncReadQueue::_release_consumed(Stream& stream) {
+    if (stream.consumed_slot > -1) {
+        Slot& slot = _slots[stream.consumed_slot];
+        slot.state = SLOT_FREE;
+        slot.stream = -1;
+        stream.consumed_slot = -1;
+    }
+}
+
+int AsyncReadQueue::_oldest_stream_needing_reads() const {
+    int oldest = -1;
+    for (size_t i = 0; i < _streams.size(); ++i) {
+        const Stream& stream = _streams[i];
+        if (!stream.open || stream.next_submit >= stream.end) {
+            continue;
+        }
+        if (oldest < 0 || stream.seq < _streams[oldest].seq) {
+            oldest = (int) i;
+        }
+    }
+    return oldest;
+}
+
+void AsyncReadQueue::_fill() {
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        Slot& slot = _slots[i];
+        if (slot.state != SLOT_FREE) {
+            continue;
+        }
+
+        int stream_id = _oldest_stream_needing_reads();
+        if (stream_id < 0) {
+            return;
+        }
+
+        Stream& stream = _streams[stream_id];
+        unsigned read_length = _read_length(stream.end - stream.next_submit);
+
+        if (!_ring.queue_read(stream.fd, slot.buffer, read_length,
+                              stream.next_submit, i)) {
+            return;
+        }
+
+        slot.stream = stream_id;
+        slot.offset = stream.next_submit;
+        slot.state = SLOT_IN_FLIGHT;
+        slot.orphaned = false;
+        stream.next_submit += _chunk_size;
+    }
+}
+
+void AsyncReadQueue::_reap(bool wait) {
+    uint64_t user_data;
+    int result;
+
+    while (_ring.next_completion(wait, user_data, result)) {
+        Slot& slot = _slots[(size_t) user_data];
+        if (slot.orphaned) {
+            slot.state = SLOT_FREE;
+            slot.stream = -1;
+            slot.orphaned = false;
+        } else {
+            slot.state = SLOT_DONE;
+            slot.result = result;
+        }
+        wait = false;
+    }
+}
+
+unsigned AsyncReadQueue::_read_length(uint64_t remaining) const {
+    if (remaining >= (uint64_t) _chunk_size) {
+        return _chunk_size;
+    }
+    // the tail read covers whole blocks too, so it works on O_DIRECT
+    // descriptors; the kernel stops it at the end of the file
+    return (unsigned) (((remaining + BUFFER_ALIGNMENT - 1) /
+                        BUFFER_ALIGNMENT) * BUFFER_ALIGNMENT);
+}
+
+int AsyncReadQueue::_find_slot(int stream_id, uint64_t offset) const {
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        const Slot& slot = _slots[i];
+        if (slot.stream == stream_id &&
+            slot.offset == offset &&
+            !slot.orphaned &&
+            (slot.state == SLOT_IN_FLIGHT || slot.state == SLOT_DONE)) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,104 @@
+#ifndef ASYNCREADQUEUE_H
+#define ASYNCREADQUEUE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "BufferPool.h"
+#include "IoUring.h"
+
+
+/**
+ * Per-device read-ahead queue on top of io_uring. Each object being read
+ * is a stream of fixed size chunks; the queue keeps up to depth chunk
+ * reads in flight and hands chunks back in file order, so the caller can
+ * hash one chunk while the next ones are being read. Free slots go to the
+ * oldest open stream first, and once all of its remaining reads are
+ * queued they start on the next stream, so a reader that opens the next
+ * object before finishing the current one keeps the disk busy across
+ * the boundary.
+ */
+class AsyncReadQueue {
+
+private:
+    enum SlotState {
+        SLOT_FREE,
+        SLOT_IN_FLIGHT,
+        SLOT_DONE,
+        SLOT_CONSUMED
+    };
+
+    class Slot {
+    public:
+        char* buffer;
+        int stream;
+        uint64_t offset;
+        int state;
+        int result;
+        bool orphaned;
+    };
+
+    class Stream {
+    public:
+        bool open;
+        int fd;
+        uint64_t next_submit;
+        uint64_t next_consume;
+        uint64_t end;
+        int consumed_slot;
+        int seq;
+    };
+
+    IoUring _ring;
+    int _depth;
+    int _chunk_size;
+    BufferPool _buffers;
+    int _next_seq;
+    std::vector<Slot> _slots;
+    std::vector<Stream> _streams;
+
+    // disallow copies
+    AsyncReadQueue(const AsyncReadQueue&);
+    AsyncReadQueue& operator=(const AsyncReadQueue&);
+
+    void _release_consumed(Stream& stream);
+    void _fill();
+    int _oldest_stream_needing_reads() const;
+    void _reap(bool wait);
+    unsigned _read_length(uint64_t remaining) const;
+    int _find_slot(int stream, uint64_t offset) const;
+
+
+public:
+    static const int BUFFER_ALIGNMENT = 4096;
+
+
+    AsyncReadQueue(int depth, int chunk_size);
+    ~AsyncReadQueue();
+
+    // false if io_uring isn't usable here; callers should then read
+    // the blocking way
+    bool available() const {
+        return _ring.is_open();
+    }
+
+    int chunk_size() const {
+        return _chunk_size;
+    }
+
+    // Start reading [offset, end) of fd; returns a stream id. Reads start
+    // right away if slots are free. For O_DIRECT descriptors offset and
+    // chunk_size must be multiples of BUFFER_ALIGNMENT.
+    int open_stream(int fd, uint64_t offset, uint64_t end);
+
+    // Next chunk of the stream in file order. Returns false at the end of
+    // the stream. data stays valid until the next call for this stream or
+    // close_stream. Throws OSError if a read failed.
+    bool next_chunk(int stream, const char*& data, int& length);
+
+    // Discard the rest of the stream. Reads still in flight are dropped
+    // when they complete.
+    void close_stream(int stream);
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef AUDITASSIGNMENTHOOK_H
+#define AUDITASSIGNMENTHOOK_H
+
+
+class AuditAssignment;
+class AuditResult;
+
+
+class AuditAssignmentHook {
+
+public:
+    virtual ~AuditAssignmentHook() {}
+
+    // Runs inside a pool process for each assignment it is sent; fills in
+    // result, which is sent back to the parent.
+    virtual void runAssignment(const AuditAssignment& assignment,
+                               AuditResult& result) = 0;
+
+};
+
+#endif
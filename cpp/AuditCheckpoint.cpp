@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "AuditCheckpoint.h"
+#include "Time.h"
+
+using namespace std;
+
+
+static const int CHECKPOINT_BUFFER_SIZE = 128;
+
+
+AuditCheckpoint::AuditCheckpoint(int dir_fd, const string& auditor_type) :
+    _filename(checkpoint_filename(auditor_type)),
+    _dir_fd(dir_fd),
+    _partition(NO_PARTITION),
+    _suffix(NO_SUFFIX),
+    _last_saved(0) {
+}
+
+string AuditCheckpoint::checkpoint_filename(const string& auditor_type) {
+    return string("auditor_status_") + auditor_type + ".json";
+}
+
+bool AuditCheckpoint::load() {
+    _partition = NO_PARTITION;
+    _suffix = NO_SUFFIX;
+
+    int fd = ::openat(_dir_fd, _filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[CHECKPOINT_BUFFER_SIZE];
+    ssize_t bytes_read = ::read(fd, buffer, sizeof(buffer) - 1);
+    ::close(fd);
+    if (bytes_read <= 0) {
+        return false;
+    }
+    buffer[bytes_read] = '\0';
+
+    long partition;
+    char suffix[4];
+    if (sscanf(buffer, "{\"partition\": %ld, \"suffix\": \"%3[0-9a-f]\"}",
+               &partition, suffix) != 2) {
+        return false;
+    }
+
+    if (partition < 0) {
+        return false;
+    }
+
+    _partition = partition;
+    _suffix = (int) strtol(suffix, NULL, 16);
+    return true;
+}
+
+bool AuditCheckpoint::update(long partition, int suffix, int interval) {
+    _partition = partition;
+    _suffix = suffix;
+
+    if (interval <= 0) {
+        return true;
+    }
+
+    if (Time::time() - _last_saved >= interval) {
+        return save();
+    }
+    return true;
+}
+
+/**
+Write data to a temp file, fsync it, rename it over filename and fsync
+the directory so the rename itself is durable.
+*/
+bool AuditCheckpoint::write_atomically(int dir_fd,
+                                       const string& filename,
+                                       const char* data,
+                                       int length) {
+    const string tmp_filename = filename + ".tmp";
+    int fd = ::openat(dir_fd, tmp_filename.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    ssize_t written = ::write(fd, data, length);
+    if ((written != length) || (::fsync(fd) != 0)) {
+        int err = (written < 0 || written == length) ? errno : EIO;
+        ::close(fd);
+        ::unlinkat(dir_fd, tmp_filename.c_str(), 0);
+        errno = err;
+        return false;
+    }
+    ::close(fd);
+
+    if (::renameat(dir_fd, tmp_filename.c_str(),
+                   dir_fd, filename.c_str()) != 0) {
+        int err = errno;
+        ::unlinkat(dir_fd, tmp_filename.c_str(), 0);
+        errno = err;
+        return false;
+    }
+    ::fsync(dir_fd);
+    return true;
+}
+
+/**
+A failed save counts as a save for the interval, so a full or read-only
+disk is retried once per interval rather than once per suffix.
+*/
+bool AuditCheckpoint::save() {
+    if ((_partition == NO_PARTITION) || (_suffix == NO_SUFFIX)) {
+        return true;
+    }
+    _last_saved = Time::time();
+
+    char buffer[CHECKPOINT_BUFFER_SIZE];
+    int length = snprintf(buffer, sizeof(buffer),
+                          "{\"partition\": %ld, \"suffix\": \"%03x\"}\n",
+                          _partition, _suffix);
+    return write_atomically(_dir_fd, _filename, buffer, length);
+}
+
+bool AuditCheckpoint::clear() {
+    _partition = NO_PARTITION;
+    _suffix = NO_SUFFIX;
+    return (::unlinkat(_dir_fd, _filename.c_str(), 0) == 0) ||
+           (errno == ENOENT);
+}
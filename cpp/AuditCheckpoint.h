@@ -0,0 +1,84 @@
+#ifndef AUDITCHECKPOINT_H
+#define AUDITCHECKPOINT_H
+
+#include <string>
+
+
+/**
+ * Durable sweep cursor for one auditor type on one device and policy.
+ * The checkpoint lives in the policy's data dir (e.g.
+ * /srv/node/sda/objects-1/auditor_status_ALL.json) and records the
+ * partition currently being swept plus the last suffix within it that
+ * was completed. Partitions are swept in ascending numeric order and
+ * suffixes in ascending hex order, so everything before the cursor has
+ * been audited. The file is replaced atomically (write temp, fsync,
+ * rename, fsync dir) so a crash never leaves a torn checkpoint behind.
+ */
+class AuditCheckpoint {
+
+private:
+    std::string _filename;
+    int _dir_fd;
+    long _partition;
+    int _suffix;
+    double _last_saved;
+
+    // disallow copies
+    AuditCheckpoint(const AuditCheckpoint&);
+    AuditCheckpoint& operator=(const AuditCheckpoint&);
+
+
+public:
+    static const long NO_PARTITION = -1;
+    static const int NO_SUFFIX = -1;
+    static const int ALL_SUFFIXES = 0xfff;
+
+
+    // dir_fd is an open descriptor of the policy data dir; filename is
+    // relative to it
+    AuditCheckpoint(int dir_fd, const std::string& auditor_type);
+
+    static std::string checkpoint_filename(const std::string& auditor_type);
+
+    // Replace filename in dir_fd with data so that a crash leaves either
+    // the old or the new contents. Returns false with errno set.
+    static bool write_atomically(int dir_fd,
+                                 const std::string& filename,
+                                 const char* data,
+                                 int length);
+
+    // Returns false if there is no usable checkpoint. A corrupt file is
+    // treated the same as a missing one.
+    bool load();
+
+    // true if the partition was fully swept before the checkpoint
+    bool partition_done(long partition) const {
+        return (_partition != NO_PARTITION) && (partition < _partition);
+    }
+
+    // true if the suffix of the checkpointed partition was already swept
+    bool suffix_done(long partition, int suffix) const {
+        return (partition == _partition) && (suffix <= _suffix);
+    }
+
+    // Advance the cursor; saves if at least interval seconds have passed
+    // since the last save. Returns false, with errno set, if that save
+    // failed; the cursor is still advanced.
+    bool update(long partition, int suffix, int interval);
+
+    // Both return false with errno set when the file can't be written or
+    // removed (EROFS, ENOSPC, ...). A checkpoint is only an optimization,
+    // so the caller logs that and carries on auditing.
+    bool save();
+    bool clear();
+
+    long partition() const {
+        return _partition;
+    }
+
+    int suffix() const {
+        return _suffix;
+    }
+};
+
+#endif
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#include "AuditIndex.h"
+#include "Exceptions.h"
+#include "OSUtils.h"
+
+using namespace std;
+
+
+const string AuditIndex::INDEX_FILENAME = "auditor_index.bin";
+
+static const char INDEX_MAGIC[4] = { 'A', 'I', 'D', 'X' };
+static const uint32_t INDEX_VERSION = 1;
+
+// the overflow is merged once it is as big as the sorted array, but
+// never while it is smaller than this
+static const size_t MIN_MERGE = 1024;
+
+
+class AuditIndexHeader {
+public:
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+};
+
+
+bool AuditIndexEntry::operator<(const AuditIndexEntry& other) const {
+    return memcmp(hash, other.hash, sizeof(hash)) < 0;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool read_fully(int fd, void* buffer, size_t length) {
+    char* p = (char*) buffer;
+    while (length > 0) {
+        ssize_t rc = ::read(fd, p, length);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        p += rc;
+        length -= rc;
+    }
+    return true;
+}
+
+static bool write_fully(int fd, const void* buffer, size_t length) {
+    const char* p = (const char*) buffer;
+    while (length > 0) {
+        ssize_t rc = ::write(fd, p, length);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        p += rc;
+        length -= rc;
+    }
+    return true;
+}
+
+/**
+Read the index file open on fd into entries. Returns false, with entries
+empty, if the file isn't a whole, sorted index.
+*/
+static bool read_index(int fd, vector<AuditIndexEntry>& entries) {
+    entries.clear();
+
+    AuditIndexHeader header;
+    struct stat st;
+    if (!read_fully(fd, &header, sizeof(header)) ||
+        memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header.version != INDEX_VERSION ||
+        ::fstat(fd, &st) != 0) {
+        return false;
+    }
+
+    // a count that doesn't match the file's length is corrupt (or the
+    // file truncated); start over rather than trust part of it, and
+    // before allocating whatever the count asks for
+    const uint64_t body = (uint64_t) st.st_size - sizeof(header);
+    if (body % sizeof(AuditIndexEntry) != 0 ||
+        body / sizeof(AuditIndexEntry) != header.count) {
+        return false;
+    }
+
+    entries.resize(header.count);
+    if (header.count > 0 &&
+        !read_fully(fd, &entries[0],
+                    header.count * sizeof(AuditIndexEntry))) {
+        entries.clear();
+        return false;
+    }
+
+    // lookups are binary searches
+    for (size_t i = 1; i < entries.size(); ++i) {
+        if (!(entries[i - 1] < entries[i])) {
+            entries.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+AuditIndex::AuditIndex(const string& datadir_path) :
+    _datadir_path(datadir_path),
+    _path(OSUtils::path_join(datadir_path, INDEX_FILENAME)),
+    _pruned_before(0),
+    _dirty(false) {
+}
+
+bool AuditIndex::parse_hash(const char* hash_dir_name, unsigned char* hash) {
+    for (int i = 0; i < 16; ++i) {
+        int high = hex_value(hash_dir_name[i * 2]);
+        if (high < 0) {
+            return false;
+        }
+        int low = hex_value(hash_dir_name[i * 2 + 1]);
+        if (low < 0) {
+            return false;
+        }
+        hash[i] = (unsigned char) ((high << 4) | low);
+    }
+    return hash_dir_name[32] == '\0';
+}
+
+void AuditIndex::load() {
+    _entries.clear();
+    _pending.clear();
+    _pruned_before = 0;
+    _dirty = false;
+
+    int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    read_index(fd, _entries);
+    ::close(fd);
+}
+
+/**
+Merge the entries saved by other writers since this index was loaded into
+this one. For a hash both have, the later verification wins (this index's
+on a tie), and what this index has pruned stays pruned.
+*/
+void AuditIndex::_merge_saved() {
+    int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    vector<AuditIndexEntry> saved;
+    read_index(fd, saved);
+    ::close(fd);
+    if (saved.empty()) {
+        return;
+    }
+
+    vector<AuditIndexEntry> merged;
+    merged.reserve(std::max(_entries.size(), saved.size()));
+    vector<AuditIndexEntry>::const_iterator it = _entries.begin();
+    const vector<AuditIndexEntry>::const_iterator itEnd = _entries.end();
+    vector<AuditIndexEntry>::const_iterator itSaved = saved.begin();
+    const vector<AuditIndexEntry>::const_iterator itSavedEnd = saved.end();
+
+    while (it != itEnd || itSaved != itSavedEnd) {
+        if (itSaved == itSavedEnd || (it != itEnd && *it < *itSaved)) {
+            merged.push_back(*it);
+            ++it;
+        } else if (it == itEnd || *itSaved < *it) {
+            if ((*itSaved).last_verified >= _pruned_before) {
+                merged.push_back(*itSaved);
+            }
+            ++itSaved;
+        } else {
+            merged.push_back((*itSaved).last_verified > (*it).last_verified ?
+                             *itSaved : *it);
+            ++it;
+            ++itSaved;
+        }
+    }
+    _entries.swap(merged);
+}
+
+/**
+Write the index to a unique temp file next to it, fsync, and rename it
+into place so a crash leaves either the old or the new index. Other
+workers, threads or pool processes, can hold an index of the same
+datadir, so the save is done under a lock on the datadir and takes in
+whatever they saved since this index was loaded.
+*/
+void AuditIndex::save() {
+    _merge_pending();
+
+    const int dir_fd = ::open(_datadir_path.c_str(),
+                              O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        throw OSError(errno);
+    }
+    if (::flock(dir_fd, LOCK_EX) != 0) {
+        const int err = errno;
+        ::close(dir_fd);
+        throw OSError(err);
+    }
+
+    _merge_saved();
+
+    string tmp_path = _path + ".XXXXXX";
+    vector<char> tmp_name(tmp_path.begin(), tmp_path.end());
+    tmp_name.push_back('\0');
+    int fd = ::mkstemp(&tmp_name[0]);
+    if (fd < 0) {
+        const int err = errno;
+        ::close(dir_fd);
+        throw OSError(err);
+    }
+    tmp_path = &tmp_name[0];
+
+    AuditIndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.count = _entries.size();
+
+    bool ok = write_fully(fd, &header, sizeof(header));
+    if (ok && !_entries.empty()) {
+        ok = write_fully(fd, &_entries[0],
+                         _entries.size() * sizeof(AuditIndexEntry));
+    }
+    if (ok) {
+        ok = (::fchmod(fd, 0644) == 0 && ::fsync(fd) == 0);
+    }
+
+    int err = errno;
+    ::close(fd);
+
+    if (!ok || ::rename(tmp_path.c_str(), _path.c_str()) != 0) {
+        if (ok) {
+            err = errno;
+        }
+        ::unlink(tmp_path.c_str());
+        ::close(dir_fd);
+        throw OSError(err);
+    }
+
+    // closing the datadir drops the lock
+    ::close(dir_fd);
+    _dirty = false;
+}
+
+void AuditIndex::prune(uint32_t verified_before) {
+    _merge_pending();
+    _pruned_before = std::max(_pruned_before, verified_before);
+
+    vector<AuditIndexEntry>::iterator itKeep = _entries.begin();
+    const vector<AuditIndexEntry>::const_iterator itEnd = _entries.end();
+    vector<AuditIndexEntry>::iterator it = _entries.begin();
+
+    for (; it != itEnd; ++it) {
+        if ((*it).last_verified >= verified_before) {
+            *itKeep = *it;
+            ++itKeep;
+        }
+    }
+
+    if (itKeep != _entries.end()) {
+        _entries.erase(itKeep, _entries.end());
+        _dirty = true;
+    }
+}
+
+const AuditIndexEntry* AuditIndex::find(const unsigned char* hash) {
+    AuditIndexEntry key;
+    memcpy(key.hash, hash, sizeof(key.hash));
+
+    vector<AuditIndexEntry>::iterator it =
+        std::lower_bound(_entries.begin(), _entries.end(), key);
+    if (it != _entries.end() &&
+        memcmp((*it).hash, hash, sizeof(key.hash)) == 0) {
+        return &(*it);
+    }
+
+    const set<AuditIndexEntry>::const_iterator itPending =
+        _pending.find(key);
+    if (itPending != _pending.end()) {
+        return &(*itPending);
+    }
+
+    return NULL;
+}
+
+void AuditIndex::update(const unsigned char* hash,
+                        uint64_t inode,
+                        int64_t mtime_ns,
+                        uint64_t size,
+                        uint32_t last_verified) {
+    AuditIndexEntry entry;
+    memcpy(entry.hash, hash, sizeof(entry.hash));
+    entry.inode = inode;
+    entry.mtime_ns = mtime_ns;
+    entry.size = size;
+    entry.last_verified = last_verified;
+    entry.reserved = 0;
+    _dirty = true;
+
+    vector<AuditIndexEntry>::iterator it =
+        std::lower_bound(_entries.begin(), _entries.end(), entry);
+    if (it != _entries.end() &&
+        memcmp((*it).hash, hash, sizeof(entry.hash)) == 0) {
+        *it = entry;
+        return;
+    }
+
+    pair<set<AuditIndexEntry>::iterator, bool> inserted =
+        _pending.insert(entry);
+    if (!inserted.second) {
+        // only the hash orders the set, so the rest can change in place
+        *const_cast<AuditIndexEntry*>(&(*inserted.first)) = entry;
+    }
+
+    if (_pending.size() >= std::max(MIN_MERGE, _entries.size())) {
+        _merge_pending();
+    }
+}
+
+void AuditIndex::_merge_pending() {
+    if (_pending.empty()) {
+        return;
+    }
+
+    // the overflow is already in order
+    const size_t sorted_count = _entries.size();
+    _entries.insert(_entries.end(), _pending.begin(), _pending.end());
+    std::inplace_merge(_entries.begin(),
+                       _entries.begin() + sorted_count,
+                       _entries.end());
+    _pending.clear();
+}
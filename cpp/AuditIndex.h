@@ -0,0 +1,96 @@
+#ifndef AUDITINDEX_H
+#define AUDITINDEX_H
+
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <vector>
+
+
+class AuditIndexEntry {
+
+public:
+    unsigned char hash[16];
+    uint64_t inode;
+    int64_t mtime_ns;
+    uint64_t size;
+    uint32_t last_verified;
+    uint32_t reserved;
+
+
+    bool operator<(const AuditIndexEntry& other) const;
+};
+
+
+/**
+ * Incremental audit index for one device and policy. Maps each hash dir
+ * (by its 16 byte binary hash) to the inode and mtime of the hash dir,
+ * the object size and the time its data was last fully verified. The
+ * index lives next to the partitions in the policy data dir as
+ * auditor_index.bin and is kept in memory as a sorted array, with new
+ * hash dirs collected in an ordered overflow. The overflow is merged in
+ * when it has grown as big as the array (so each entry is merged an
+ * amortized constant number of times) and before the index is saved or
+ * pruned at the end of a sweep. Several workers can keep an index of
+ * the same datadir; each save merges in the ones saved before it.
+ */
+class AuditIndex {
+
+private:
+    std::string _datadir_path;
+    std::string _path;
+    std::vector<AuditIndexEntry> _entries;
+    std::set<AuditIndexEntry> _pending;
+    uint32_t _pruned_before;
+    bool _dirty;
+
+    // disallow copies
+    AuditIndex(const AuditIndex&);
+    AuditIndex& operator=(const AuditIndex&);
+
+    void _merge_pending();
+    void _merge_saved();
+
+
+public:
+    static const std::string INDEX_FILENAME;
+
+
+    AuditIndex(const std::string& datadir_path);
+
+    // Convert a 32 character hex hash dir name to its binary key. Returns
+    // false if the name isn't a valid hash.
+    static bool parse_hash(const char* hash_dir_name, unsigned char* hash);
+
+    // A missing or corrupt index file results in an empty index.
+    void load();
+    // Entries other writers of the datadir saved since the load are kept.
+    void save();
+
+    // Drop entries not verified since verified_before. Objects that still
+    // exist are re-verified at least every full verify age, so anything
+    // older belongs to a hash dir that has gone away.
+    void prune(uint32_t verified_before);
+
+    const AuditIndexEntry* find(const unsigned char* hash);
+
+    void update(const unsigned char* hash,
+                uint64_t inode,
+                int64_t mtime_ns,
+                uint64_t size,
+                uint32_t last_verified);
+
+    size_t size() const {
+        return _entries.size() + _pending.size();
+    }
+
+    bool dirty() const {
+        return _dirty;
+    }
+
+    const std::string& path() const {
+        return _path;
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef AUDITITEM_H
+#define AUDITITEM_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+
+#include "AuditLocation.h"
+#include "DiskFile.h"
+#include "DiskFileReader.h"
+
+
+/**
+ * One object on its way through an audit: opened, read, then verified
+ * and accounted for. Carries everything the later steps need so they can
+ * run on different threads than the earlier ones.
+ */
+class AuditItem {
+
+private:
+    // disallow copies
+    AuditItem(const AuditItem&);
+    AuditItem& operator=(const AuditItem&);
+
+
+public:
+    enum Outcome {
+        OPENING,       // not opened yet
+        READ,          // opened, data still to be read
+        HASH,          // data read into the buffer, not hashed yet
+        VERIFIED,      // data read and matched its metadata
+        PASSED,        // passed without its data being read
+        NOT_FOUND,     // gone before it could be audited
+        QUARANTINED,
+        FAILED
+    };
+
+    AuditLocation location;
+    int outcome;
+    std::string message;
+    // both owned by the item; the reader goes first
+    DiskFile* df;
+    DiskFileReader* reader;
+    long obj_size;
+    long bytes_read;
+    char* data;
+    double started;
+    // seconds per chunk read, for the throttle; 0 if nothing was read
+    double read_latency;
+
+    // hash dir state for the incremental index
+    bool indexed;
+    unsigned char hash[16];
+    uint64_t inode;
+    int64_t mtime_ns;
+
+
+    AuditItem(const AuditLocation& location_value) :
+        location(location_value),
+        outcome(OPENING),
+        df(NULL),
+        reader(NULL),
+        obj_size(-1),
+        bytes_read(0),
+        data(NULL),
+        started(0.0),
+        read_latency(0.0),
+        indexed(false),
+        inode(0),
+        mtime_ns(0) {
+    }
+
+    ~AuditItem() {
+        if (reader != NULL) {
+            delete reader;
+        }
+        if (df != NULL) {
+            delete df;
+        }
+        if (data != NULL) {
+            free(data);
+        }
+    }
+};
+
+#endif
+
@@ -0,0 +1,146 @@
+#include <algorithm>
+
+#include "AuditPartitionClassifier.h"
+#include "Exceptions.h"
+#include "OSUtils.h"
+#include "Ring.h"
+#include "StrUtils.h"
+#include "Time.h"
+
+
+using namespace std;
+
+
+AuditPartitionClassifier::AuditPartitionClassifier(const string& swift_dir,
+                                                   const string& bind_ip,
+                                                   int bind_port,
+                                                   const string& handoff_mode,
+                                                   int reload_time,
+                                                   bool measure_skipped) :
+    _swift_dir(swift_dir),
+    _bind_port(bind_port),
+    _handoff_mode(parse_handoff_mode(handoff_mode)),
+    _reload_time(reload_time),
+    _measure_skipped(measure_skipped),
+    _my_ips(OSUtils::whataremyips(bind_ip)) {
+    pthread_mutex_init(&_rings_lock, NULL);
+}
+
+AuditPartitionClassifier::~AuditPartitionClassifier() {
+    const map<int, Ring*>::const_iterator itEnd = _rings.end();
+    map<int, Ring*>::const_iterator it = _rings.begin();
+    for (; it != itEnd; ++it) {
+        delete it->second;
+    }
+    pthread_mutex_destroy(&_rings_lock);
+}
+
+int AuditPartitionClassifier::parse_handoff_mode(const string& handoff_mode) {
+    if (handoff_mode == "audit") {
+        return AUDIT;
+    }
+    if (handoff_mode == "defer") {
+        return DEFER;
+    }
+    if (handoff_mode == "skip") {
+        return SKIP;
+    }
+    throw ValueError(string("Invalid handoff audit mode: ") + handoff_mode);
+}
+
+/**
+ * Loads the policy's object ring the first time it's asked for. A ring
+ * that fails to load counts as missing until reload_time has passed, so
+ * it isn't retried for every partition range but is picked up once it
+ * has been put in place.
+ */
+Ring* AuditPartitionClassifier::_ring_for(int policy) {
+    pthread_mutex_lock(&_rings_lock);
+    map<int, Ring*>::const_iterator it = _rings.find(policy);
+    if (it != _rings.end()) {
+        Ring* ring = it->second;
+        pthread_mutex_unlock(&_rings_lock);
+        return ring;
+    }
+
+    const double now = Time::time();
+    map<int, double>::const_iterator itFailed = _failed_at.find(policy);
+    if (itFailed != _failed_at.end() &&
+        now - itFailed->second < _reload_time) {
+        pthread_mutex_unlock(&_rings_lock);
+        return NULL;
+    }
+
+    const string ring_name = policy == 0 ?
+        string("object") :
+        string("object-") + StrUtils::toString(policy);
+    Ring* ring = NULL;
+    try {
+        ring = new Ring(_swift_dir, ring_name, _reload_time);
+        _rings[policy] = ring;
+        _failed_at.erase(policy);
+    } catch (const BaseException&) {
+        ring = NULL;
+        _failed_at[policy] = now;
+    }
+    pthread_mutex_unlock(&_rings_lock);
+    return ring;
+}
+
+bool AuditPartitionClassifier::classify(int policy,
+                                        const string& device,
+                                        const vector<long>& partitions,
+                                        vector<long>& primaries,
+                                        vector<long>& handoffs) {
+    primaries.clear();
+    handoffs.clear();
+
+    Ring* ring = NULL;
+    if (_handoff_mode != AUDIT) {
+        ring = this->_ring_for(policy);
+    }
+
+    int dev_id = -1;
+    if (ring != NULL) {
+        // only held while splitting, so a reload isn't kept waiting for
+        // the sweep
+        Ring::SnapshotGuard snapshot(ring->snapshots());
+        const RingData& ring_data = snapshot->ring_data;
+        const vector<StorageDevice>& devs = ring_data.devs();
+        const vector<StorageDevice>::const_iterator itDevEnd = devs.end();
+        vector<StorageDevice>::const_iterator itDev = devs.begin();
+        for (; itDev != itDevEnd; ++itDev) {
+            if (itDev->dev_id < 0 || itDev->device != device ||
+                (_bind_port > 0 && itDev->port != _bind_port)) {
+                continue;
+            }
+            if (find(_my_ips.begin(), _my_ips.end(), itDev->ip) !=
+                    _my_ips.end() ||
+                find(_my_ips.begin(), _my_ips.end(),
+                     itDev->replication_ip) != _my_ips.end()) {
+                dev_id = itDev->dev_id;
+                break;
+            }
+        }
+
+        if (dev_id >= 0) {
+            const long partition_count = ring_data.partition_count();
+            const vector<long>::const_iterator itPartEnd = partitions.end();
+            vector<long>::const_iterator itPart = partitions.begin();
+            for (; itPart != itPartEnd; ++itPart) {
+                // a partition past the end of the ring is left over from
+                // an older part power; no device is its primary
+                if (*itPart < partition_count &&
+                    ring_data.replica_of((uint32_t) *itPart, dev_id) >= 0) {
+                    primaries.push_back(*itPart);
+                } else {
+                    handoffs.push_back(*itPart);
+                }
+            }
+            return true;
+        }
+    }
+
+    primaries = partitions;
+    return false;
+}
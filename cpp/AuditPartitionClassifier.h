@@ -0,0 +1,91 @@
+#ifndef AUDITPARTITIONCLASSIFIER_H
+#define AUDITPARTITIONCLASSIFIER_H
+
+#include <pthread.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+class Ring;
+
+
+/**
+ * Splits the partitions found on a device into primaries (the ring
+ * assigns them to this device) and handoffs (they are only here until
+ * the replicator moves them to their primaries). Auditing a handoff is
+ * mostly wasted reads, so the audit sweep can put them after the
+ * primaries or leave them out altogether.
+ *
+ * The object ring of each policy is loaded from swift_dir the first time
+ * that policy is seen, so a forked child loads (and reloads) its own. A
+ * ring that fails to load is tried again once reload_time has passed.
+ * The local device is the one in the ring with the device's name on one
+ * of this host's addresses (and on bind_port, if that is set). When a
+ * ring or the device in it can't be found every partition counts as a
+ * primary, which is just the sweep without the classifier.
+ */
+class AuditPartitionClassifier {
+
+public:
+    enum HandoffMode {
+        AUDIT,      // sweep all partitions in order, as without a ring
+        DEFER,      // primaries first, then the handoffs still there
+        SKIP        // primaries only
+    };
+
+
+private:
+    std::string _swift_dir;
+    int _bind_port;
+    int _handoff_mode;
+    int _reload_time;
+    bool _measure_skipped;
+    std::vector<std::string> _my_ips;
+    std::map<int, Ring*> _rings;
+    // when each policy whose ring couldn't be loaded last failed
+    std::map<int, double> _failed_at;
+    pthread_mutex_t _rings_lock;
+
+    // disallow copies
+    AuditPartitionClassifier(const AuditPartitionClassifier&);
+    AuditPartitionClassifier& operator=(const AuditPartitionClassifier&);
+
+    Ring* _ring_for(int policy);
+
+
+public:
+    // handoff_mode is "audit", "defer" or "skip"; measure_skipped has
+    // the sweep list the skipped handoffs to report what they hold
+    AuditPartitionClassifier(const std::string& swift_dir,
+                             const std::string& bind_ip,
+                             int bind_port,
+                             const std::string& handoff_mode,
+                             int reload_time=DEFAULT_RELOAD_TIME,
+                             bool measure_skipped=false);
+    ~AuditPartitionClassifier();
+
+    static const int DEFAULT_RELOAD_TIME = 15;
+
+
+    static int parse_handoff_mode(const std::string& handoff_mode);
+
+    int handoff_mode() const {
+        return _handoff_mode;
+    }
+
+    bool measure_skipped() const {
+        return _measure_skipped;
+    }
+
+    // Splits partitions (ascending) into primaries and handoffs, both
+    // ascending. Returns false, with every partition a primary, when the
+    // policy's ring or the device in it isn't known.
+    bool classify(int policy,
+                  const std::string& device,
+                  const std::vector<long>& partitions,
+                  std::vector<long>& primaries,
+                  std::vector<long>& handoffs);
+};
+
+#endif
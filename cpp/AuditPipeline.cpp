@@ -0,0 +1,367 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include "AuditPipeline.h"
+#include "AuditorWorker.h"
+#include "BufferPool.h"
+#include "DiskFileReadHook.h"
+#include "Exceptions.h"
+#include "MD5MultiBuffer.h"
+#include "Time.h"
+
+using namespace std;
+
+
+/**
+ * Read hook of the read threads. Each chunk is charged to the byte rate
+ * limits as it comes in, so the limits hold back the reads themselves;
+ * the bytes and the time taken per chunk (not counting the rate limit
+ * sleep) are only counted, and the verify thread accounts for them (and
+ * feeds the latency to the throttle) once the object is done.
+ */
+class PipelineReadHook : public DiskFileReadHook {
+
+public:
+    AuditorWorker* worker;
+    int device_slot;
+    long bytes;
+    long chunks;
+    double read_time;
+    double chunk_started;
+
+    explicit PipelineReadHook(AuditorWorker* worker_value) :
+        worker(worker_value),
+        device_slot(-1),
+        bytes(0),
+        chunks(0),
+        read_time(0.0),
+        chunk_started(0.0) {
+    }
+
+    void start(int device_slot_value) {
+        device_slot = device_slot_value;
+        bytes = 0;
+        chunks = 0;
+        read_time = 0.0;
+        chunk_started = Time::time();
+    }
+
+    void onFileRead(const string& chunk) {
+        onChunkRead(chunk.data(), chunk.length());
+    }
+
+    void onChunkRead(const char* data, size_t length) {
+        read_time += Time::time() - chunk_started;
+        chunks += 1;
+        bytes += length;
+        worker->limit_bytes(device_slot, length);
+        chunk_started = Time::time();
+    }
+};
+
+
+AuditPipeline::AuditPipeline(AuditorWorker* worker,
+                             int open_workers,
+                             int read_workers,
+                             int depth,
+                             int chunk_size,
+                             long small_object_size) :
+    _worker(worker),
+    _open_workers(open_workers > 0 ? open_workers : 1),
+    _read_workers(read_workers > 0 ? read_workers : 1),
+    _chunk_size(chunk_size),
+    _small_object_size(small_object_size),
+    _max_batch(MD5MultiBuffer::lanes(MD5MultiBuffer::engine()) * 2),
+    _to_open(depth),
+    _to_read(depth),
+    _to_verify(depth),
+    _small_buffers(small_object_size > 0 ? small_object_size : 1),
+    _submitted(0),
+    _finished(0),
+    _stopping(0) {
+    pthread_mutex_init(&this->_small_buffers_lock, NULL);
+}
+
+AuditPipeline::~AuditPipeline() {
+    this->drain();
+    this->_stop();
+    pthread_mutex_destroy(&this->_small_buffers_lock);
+}
+
+void* AuditPipeline::open_main(void* arg) {
+    ((AuditPipeline*) arg)->_open_stage();
+    return NULL;
+}
+
+void* AuditPipeline::read_main(void* arg) {
+    ((AuditPipeline*) arg)->_read_stage();
+    return NULL;
+}
+
+void* AuditPipeline::verify_main(void* arg) {
+    ((AuditPipeline*) arg)->_verify_stage();
+    return NULL;
+}
+
+/**
+ * Threads are started on the first submit rather than on construction,
+ * so a worker built before the auditor forks doesn't carry threads
+ * across the fork.
+ */
+void AuditPipeline::_start() {
+    __atomic_store_n(&this->_stopping, 0, __ATOMIC_RELEASE);
+
+    pthread_t tid;
+    for (int i = 0; i < this->_open_workers; ++i) {
+        if (pthread_create(&tid, NULL, open_main, this) != 0) {
+            throw OSError(errno);
+        }
+        this->_threads.push_back(tid);
+    }
+    for (int i = 0; i < this->_read_workers; ++i) {
+        if (pthread_create(&tid, NULL, read_main, this) != 0) {
+            throw OSError(errno);
+        }
+        this->_threads.push_back(tid);
+    }
+    if (pthread_create(&tid, NULL, verify_main, this) != 0) {
+        throw OSError(errno);
+    }
+    this->_threads.push_back(tid);
+}
+
+void AuditPipeline::_stop() {
+    __atomic_store_n(&this->_stopping, 1, __ATOMIC_RELEASE);
+    this->_to_open.not_empty.notify_all();
+    this->_to_read.not_empty.notify_all();
+    this->_to_verify.not_empty.notify_all();
+
+    vector<pthread_t>::const_iterator it = this->_threads.begin();
+    const vector<pthread_t>::const_iterator itEnd = this->_threads.end();
+    for (; it != itEnd; ++it) {
+        pthread_join(*it, NULL);
+    }
+    this->_threads.clear();
+}
+
+void AuditPipeline::submit(const AuditLocation& location) {
+    if (this->_threads.empty()) {
+        this->_start();
+    }
+
+    AuditItem* item = new AuditItem(location);
+    item->started = Time::time();
+    this->_submitted += 1;
+    this->_push(this->_to_open, item);
+}
+
+void AuditPipeline::drain() {
+    while (__atomic_load_n(&this->_finished, __ATOMIC_ACQUIRE) <
+           this->_submitted) {
+        this->_progress.prepare_wait();
+        if (__atomic_load_n(&this->_finished, __ATOMIC_ACQUIRE) >=
+            this->_submitted) {
+            this->_progress.cancel_wait();
+            break;
+        }
+        this->_progress.wait();
+    }
+}
+
+void AuditPipeline::_push(Channel& channel, AuditItem* item) {
+    // a full queue means the next stage is behind; wait for it
+    while (!channel.queue.try_push(item)) {
+        channel.not_full.prepare_wait();
+        if (channel.queue.try_push(item)) {
+            channel.not_full.cancel_wait();
+            break;
+        }
+        channel.not_full.wait();
+    }
+    channel.not_empty.notify_one();
+}
+
+/**
+ * Wait for the next item of channel. Returns false once the pipeline is
+ * stopping, which only happens after it has been drained.
+ */
+bool AuditPipeline::_pop(Channel& channel, AuditItem*& item) {
+    while (!channel.queue.try_pop(item)) {
+        channel.not_empty.prepare_wait();
+        if (channel.queue.try_pop(item)) {
+            channel.not_empty.cancel_wait();
+            break;
+        }
+        if (__atomic_load_n(&this->_stopping, __ATOMIC_ACQUIRE)) {
+            channel.not_empty.cancel_wait();
+            return false;
+        }
+        channel.not_empty.wait();
+    }
+    channel.not_full.notify_one();
+    return true;
+}
+
+void AuditPipeline::_open_stage() {
+    AuditItem* item;
+
+    while (this->_pop(this->_to_open, item)) {
+        try {
+            this->_worker->open_for_audit(*item);
+        } catch (const exception& e) {
+            item->outcome = AuditItem::FAILED;
+            item->message = e.what();
+        }
+
+        if (item->outcome == AuditItem::READ) {
+            this->_push(this->_to_read, item);
+        } else {
+            this->_push(this->_to_verify, item);
+        }
+    }
+}
+
+void AuditPipeline::_read_stage() {
+    // chunk buffers are only ever used by this thread
+    BufferPool buffers(this->_chunk_size);
+    PipelineReadHook hook(this->_worker);
+    AuditItem* item;
+
+    while (this->_pop(this->_to_read, item)) {
+        hook.start(this->_worker->device_rate_slot(item->location.device));
+        try {
+            if (item->obj_size <= this->_small_object_size) {
+                // read it whole; the verify thread hashes it along
+                // with other small objects
+                item->data = this->_acquire_small_buffer();
+                // one read, so one chunk as far as the throttle goes
+                item->bytes_read = item->reader->read_whole(item->data,
+                                                            item->obj_size);
+                hook.onChunkRead(item->data, item->bytes_read);
+                item->read_latency = hook.read_time;
+                item->outcome = AuditItem::HASH;
+            } else {
+                item->reader->set_buffer_pool(&buffers);
+                this->_worker->read_for_audit(*item, &hook);
+                item->bytes_read = hook.bytes;
+                if (hook.chunks > 0) {
+                    item->read_latency = hook.read_time / hook.chunks;
+                }
+            }
+        } catch (const exception& e) {
+            item->outcome = AuditItem::FAILED;
+            item->message = e.what();
+            try {
+                item->reader->close();
+            } catch (const exception&) {
+            }
+        }
+
+        this->_push(this->_to_verify, item);
+    }
+}
+
+void AuditPipeline::_verify_stage() {
+    vector<AuditItem*> batch;
+    AuditItem* item;
+
+    batch.reserve(this->_max_batch);
+    while (this->_pop(this->_to_verify, item)) {
+        // take whatever else is already waiting so small objects can be
+        // hashed side by side
+        batch.push_back(item);
+        while (batch.size() < this->_max_batch &&
+               this->_to_verify.queue.try_pop(item)) {
+            batch.push_back(item);
+        }
+        this->_to_verify.not_full.notify_all();
+        this->_verify_batch(batch);
+        batch.clear();
+    }
+}
+
+void AuditPipeline::_verify_batch(vector<AuditItem*>& batch) {
+    vector<MD5Job> jobs;
+    vector<AuditItem*> hashed;
+
+    vector<AuditItem*>::iterator it = batch.begin();
+    const vector<AuditItem*>::const_iterator itEnd = batch.end();
+    for (; it != itEnd; ++it) {
+        AuditItem* item = *it;
+        if (item->outcome == AuditItem::HASH) {
+            // a file longer than its metadata only had obj_size bytes kept;
+            // the reader quarantines it on the length alone
+            jobs.push_back(MD5Job(item->data,
+                                  min(item->bytes_read, item->obj_size)));
+            hashed.push_back(item);
+        }
+    }
+
+    if (!jobs.empty()) {
+        MD5MultiBuffer::digest_jobs(&jobs[0], jobs.size());
+    }
+
+    char hex[MD5Hash::DIGEST_SIZE * 2];
+    for (size_t i = 0; i < hashed.size(); ++i) {
+        AuditItem* item = hashed[i];
+        MD5Hash::to_hex(jobs[i].digest, hex);
+        item->reader->set_read_md5(string(hex, sizeof(hex)));
+        this->_release_small_buffer(item);
+        try {
+            // closing checks the digest and quarantines on a mismatch
+            item->reader->close();
+            item->outcome = AuditItem::VERIFIED;
+        } catch (const DiskFileQuarantined& err) {
+            item->outcome = AuditItem::QUARANTINED;
+            item->message = err.toString();
+        } catch (const exception& e) {
+            item->outcome = AuditItem::FAILED;
+            item->message = e.what();
+        }
+    }
+
+    for (it = batch.begin(); it != itEnd; ++it) {
+        AuditItem* item = *it;
+        try {
+            this->_worker->finish_audit(*item);
+        } catch (const exception& e) {
+            item->outcome = AuditItem::FAILED;
+            item->message = e.what();
+            this->_worker->finish_audit(*item);
+        }
+        if (item->read_latency > 0.0) {
+            this->_worker->record_read_latency(item->read_latency);
+        }
+        // the read threads already held the bytes to the rate limits
+        this->_worker->count_bytes(item->bytes_read);
+        this->_worker->object_done(item->location, item->started);
+        // a read that failed part way can leave its buffer behind
+        this->_release_small_buffer(item);
+        delete item;
+        __atomic_add_fetch(&this->_finished, 1, __ATOMIC_RELEASE);
+    }
+    this->_progress.notify_one();
+}
+
+char* AuditPipeline::_acquire_small_buffer() {
+    pthread_mutex_lock(&this->_small_buffers_lock);
+    char* buffer = NULL;
+    try {
+        buffer = this->_small_buffers.acquire();
+    } catch (const OSError&) {
+        pthread_mutex_unlock(&this->_small_buffers_lock);
+        throw;
+    }
+    pthread_mutex_unlock(&this->_small_buffers_lock);
+    return buffer;
+}
+
+void AuditPipeline::_release_small_buffer(AuditItem* item) {
+    if (item->data == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&this->_small_buffers_lock);
+    this->_small_buffers.release(item->data);
+    pthread_mutex_unlock(&this->_small_buffers_lock);
+    item->data = NULL;
+}
@@ -0,0 +1,104 @@
+#ifndef AUDITPIPELINE_H
+#define AUDITPIPELINE_H
+
+#include <pthread.h>
+#include <vector>
+
+#include "AuditItem.h"
+#include "AuditLocation.h"
+#include "BoundedQueue.h"
+#include "BufferPool.h"
+#include "EventCount.h"
+
+class AuditorWorker;
+
+
+/**
+ * Runs the audit of one worker as a pipeline of stages connected by
+ * bounded queues, so the directory and metadata I/O of opening objects
+ * overlaps with reading the data of others:
+ *
+ *   walk -> open (N threads) -> read (M threads) -> verify (1 thread)
+ *
+ * The walk stage is the location generator on the caller's thread. Open
+ * threads open the diskfile and check its metadata. Read threads stream
+ * large objects through the reader (which hashes as it goes) and read
+ * small ones whole. The verify thread hashes the small objects together,
+ * settles quarantines and does all of the worker's accounting, so the
+ * worker's counters are only ever touched by one thread.
+ *
+ * A stage with nothing to do (or nowhere to put its output) sleeps on an
+ * EventCount of its queue, so idle stages cost no CPU.
+ */
+class AuditPipeline {
+
+private:
+    AuditorWorker* _worker;
+    int _open_workers;
+    int _read_workers;
+    int _chunk_size;
+    long _small_object_size;
+    size_t _max_batch;
+    class Channel {
+    public:
+        BoundedQueue<AuditItem*> queue;
+        EventCount not_empty;
+        EventCount not_full;
+
+        explicit Channel(size_t depth) :
+            queue(depth) {
+        }
+    };
+
+    Channel _to_open;
+    Channel _to_read;
+    Channel _to_verify;
+    // buffers small objects are read whole into: taken by the read
+    // threads, given back by the verify thread
+    BufferPool _small_buffers;
+    pthread_mutex_t _small_buffers_lock;
+    EventCount _progress;
+    std::vector<pthread_t> _threads;
+    long _submitted;
+    long _finished;
+    int _stopping;
+
+    // disallow copies
+    AuditPipeline(const AuditPipeline&);
+    AuditPipeline& operator=(const AuditPipeline&);
+
+    static void* open_main(void* arg);
+    static void* read_main(void* arg);
+    static void* verify_main(void* arg);
+
+    void _start();
+    void _stop();
+    void _push(Channel& channel, AuditItem* item);
+    bool _pop(Channel& channel, AuditItem*& item);
+    void _open_stage();
+    void _read_stage();
+    void _verify_stage();
+    void _verify_batch(std::vector<AuditItem*>& batch);
+    char* _acquire_small_buffer();
+    void _release_small_buffer(AuditItem* item);
+
+
+public:
+    AuditPipeline(AuditorWorker* worker,
+                  int open_workers,
+                  int read_workers,
+                  int depth,
+                  int chunk_size,
+                  long small_object_size);
+    ~AuditPipeline();
+
+    // walk stage: queue location for auditing, waiting while the
+    // pipeline is full
+    void submit(const AuditLocation& location);
+
+    // wait until everything submitted has been verified
+    void drain();
+};
+
+#endif
+
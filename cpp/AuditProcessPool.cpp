@@ -0,0 +1,304 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "AuditProcessPool.h"
+#include "Exceptions.h"
+#include "OSUtils.h"
+#include "Time.h"
+
+using namespace std;
+
+
+// false on end of file
+static bool read_full(int fd, void* buffer, size_t length) {
+    char* p = (char*) buffer;
+    while (length > 0) {
+        ssize_t n = ::read(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw OSError(errno);
+        }
+        if (n == 0) {
+            return false;
+        }
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+static void write_full(int fd, const void* buffer, size_t length) {
+    const char* p = (const char*) buffer;
+    while (length > 0) {
+        ssize_t n = ::write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw OSError(errno);
+        }
+        p += n;
+        length -= n;
+    }
+}
+
+
+AuditProcessPool::AuditProcessPool(AuditAssignmentHook* hook) :
+    _hook(hook) {
+}
+
+AuditProcessPool::~AuditProcessPool() {
+    stop();
+}
+
+void AuditProcessPool::start(int size) {
+    // a process that died shows up as EPIPE on assign, not as a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    while ((int) _processes.size() < size) {
+        Process process;
+        process.pid = -1;
+        process.command_fd = -1;
+        process.result_fd = -1;
+        process.busy = false;
+        _processes.push_back(process);
+    }
+
+    for (int i = 0; i < (int) _processes.size(); ++i) {
+        if (_processes[i].pid < 0) {
+            _spawn(i);
+        }
+    }
+}
+
+void AuditProcessPool::_spawn(int index) {
+    int command_pipe[2];
+    int result_pipe[2];
+    if (::pipe(command_pipe) != 0) {
+        throw OSError(errno);
+    }
+    if (::pipe(result_pipe) != 0) {
+        int err = errno;
+        ::close(command_pipe[0]);
+        ::close(command_pipe[1]);
+        throw OSError(err);
+    }
+
+    int pid = OSUtils::fork();
+    if (pid < 0) {
+        int err = errno;
+        ::close(command_pipe[0]);
+        ::close(command_pipe[1]);
+        ::close(result_pipe[0]);
+        ::close(result_pipe[1]);
+        throw OSError(err);
+    }
+
+    if (pid == 0) {
+        signal(SIGTERM, SIG_DFL);
+        // the other processes' pipes belong to the parent
+        for (size_t i = 0; i < _processes.size(); ++i) {
+            if (_processes[i].command_fd > -1) {
+                ::close(_processes[i].command_fd);
+            }
+            if (_processes[i].result_fd > -1) {
+                ::close(_processes[i].result_fd);
+            }
+        }
+        ::close(command_pipe[1]);
+        ::close(result_pipe[0]);
+        _child_main(command_pipe[0], result_pipe[1]);
+        _exit(0);
+    }
+
+    ::close(command_pipe[0]);
+    ::close(result_pipe[1]);
+    Process& process = _processes[index];
+    process.pid = pid;
+    process.command_fd = command_pipe[1];
+    process.result_fd = result_pipe[0];
+    process.busy = false;
+}
+
+void AuditProcessPool::_child_main(int command_fd, int result_fd) {
+    AuditAssignment assignment;
+    AuditResult result;
+
+    try {
+        while (read_full(command_fd, &assignment, sizeof(assignment))) {
+            if (assignment.cancel_delay) {
+                // came after the delay it was meant for was over
+                continue;
+            }
+            assignment.device[AuditAssignment::MAX_DEVICE - 1] = '\0';
+            memset(&result, 0, sizeof(result));
+            if (assignment.delay > 0 &&
+                !_delay(command_fd, assignment.delay)) {
+                AuditAssignment cancel;
+                if (!read_full(command_fd, &cancel, sizeof(cancel))) {
+                    break;
+                }
+                result.status = AuditResult::CANCELLED;
+                write_full(result_fd, &result, sizeof(result));
+                continue;
+            }
+            try {
+                _hook->runAssignment(assignment, result);
+            } catch (const std::exception& e) {
+                result.status = AuditResult::FAILED;
+            }
+            write_full(result_fd, &result, sizeof(result));
+        }
+    } catch (const OSError& err) {
+        // parent went away; nothing left to report to
+    }
+}
+
+/**
+ * Waits on the command pipe rather than sleeping, so the parent can end
+ * the wait with cancel_delay (or by closing the pipe). Returns false if
+ * it was ended that way.
+ */
+bool AuditProcessPool::_delay(int command_fd, int seconds) {
+    const double until = Time::time() + seconds;
+    struct pollfd pfd;
+    pfd.fd = command_fd;
+    pfd.events = POLLIN;
+
+    while (true) {
+        const double left = until - Time::time();
+        if (left <= 0) {
+            return true;
+        }
+        pfd.revents = 0;
+        int rc = ::poll(&pfd, 1, (int) (left * 1000) + 1);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw OSError(errno);
+        }
+        if (rc > 0) {
+            return false;
+        }
+    }
+}
+
+void AuditProcessPool::_reap(int index) {
+    Process& process = _processes[index];
+    if (process.command_fd > -1) {
+        ::close(process.command_fd);
+        process.command_fd = -1;
+    }
+    if (process.result_fd > -1) {
+        ::close(process.result_fd);
+        process.result_fd = -1;
+    }
+    if (process.pid > 0) {
+        while (::waitpid(process.pid, NULL, 0) < 0 && errno == EINTR) {
+        }
+    }
+    process.pid = -1;
+    process.busy = false;
+}
+
+void AuditProcessPool::stop() {
+    // closing every command pipe first lets them all exit in parallel
+    for (size_t i = 0; i < _processes.size(); ++i) {
+        if (_processes[i].command_fd > -1) {
+            ::close(_processes[i].command_fd);
+            _processes[i].command_fd = -1;
+        }
+    }
+    for (size_t i = 0; i < _processes.size(); ++i) {
+        _reap(i);
+    }
+    _processes.clear();
+}
+
+bool AuditProcessPool::any_busy() const {
+    for (size_t i = 0; i < _processes.size(); ++i) {
+        if (_processes[i].busy) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AuditProcessPool::assign(int index, const AuditAssignment& assignment) {
+    Process& process = _processes[index];
+    try {
+        write_full(process.command_fd, &assignment, sizeof(assignment));
+    } catch (const OSError& err) {
+        if (err._errno != EPIPE) {
+            throw;
+        }
+        // died while idle; report it through wait_result
+    }
+    process.busy = true;
+}
+
+void AuditProcessPool::cancel_delay(int index) {
+    Process& process = _processes[index];
+    if (!process.busy) {
+        return;
+    }
+    AuditAssignment cancel;
+    memset(&cancel, 0, sizeof(cancel));
+    cancel.cancel_delay = 1;
+    try {
+        write_full(process.command_fd, &cancel, sizeof(cancel));
+    } catch (const OSError& err) {
+        if (err._errno != EPIPE) {
+            throw;
+        }
+        // died; wait_result reports it
+    }
+}
+
+int AuditProcessPool::wait_result(AuditResult& result) {
+    vector<struct pollfd> fds;
+    vector<int> indexes;
+    for (size_t i = 0; i < _processes.size(); ++i) {
+        if (_processes[i].busy) {
+            struct pollfd pfd;
+            pfd.fd = _processes[i].result_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            fds.push_back(pfd);
+            indexes.push_back(i);
+        }
+    }
+    if (fds.empty()) {
+        return -1;
+    }
+
+    while (::poll(&fds[0], fds.size(), -1) < 0) {
+        if (errno != EINTR) {
+            throw OSError(errno);
+        }
+    }
+
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+        const int index = indexes[i];
+        Process& process = _processes[index];
+        process.busy = false;
+        if (!read_full(process.result_fd, &result, sizeof(result))) {
+            memset(&result, 0, sizeof(result));
+            result.status = AuditResult::DIED;
+            _reap(index);
+        }
+        return index;
+    }
+    return -1;
+}
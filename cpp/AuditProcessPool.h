@@ -0,0 +1,120 @@
+#ifndef AUDITPROCESSPOOL_H
+#define AUDITPROCESSPOOL_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "AuditAssignmentHook.h"
+
+
+// Sent from the parent to a pool process. Fixed size and smaller than
+// PIPE_BUF, so each write arrives whole.
+class AuditAssignment {
+
+public:
+    static const int MAX_DEVICE = 64;
+    // caps partitions_per_range for the pool
+    static const int MAX_PARTITIONS = 256;
+
+    int32_t zero_byte_fps;
+    // seconds to wait before starting, e.g. between ZBF passes; see
+    // AuditProcessPool::cancel_delay
+    int32_t delay;
+    int64_t partition_lo;
+    int64_t partition_hi;
+    // empty for all devices
+    char device[MAX_DEVICE];
+    // the range's partitions, see AuditWorkRange
+    int32_t partition_count;
+    // set on a message that only cuts short the delay of the assignment
+    // the process is already working on
+    int32_t cancel_delay;
+    int64_t partitions[MAX_PARTITIONS];
+};
+
+
+// Sent back by a pool process when an assignment is finished.
+class AuditResult {
+
+public:
+    enum {
+        COMPLETED,
+        FAILED,
+        DIED,       // set by the parent when the process went away
+        CANCELLED   // the delay was cut short; nothing was audited
+    };
+
+    int32_t status;
+    int32_t reserved;
+    int64_t files_processed;
+    int64_t bytes_processed;
+};
+
+
+/**
+ * Fixed set of forked auditor processes that live across audit passes.
+ * Each has a command pipe on which it receives AuditAssignments and a
+ * result pipe on which it answers with an AuditResult; the work itself is
+ * done by the AuditAssignmentHook, whose state (workers, routers, read
+ * queues) therefore stays warm from one assignment to the next. A process
+ * exits when its command pipe is closed.
+ */
+class AuditProcessPool {
+
+private:
+    class Process {
+    public:
+        int pid;
+        int command_fd;
+        int result_fd;
+        bool busy;
+    };
+
+    AuditAssignmentHook* _hook;
+    std::vector<Process> _processes;
+
+    // disallow copies
+    AuditProcessPool(const AuditProcessPool&);
+    AuditProcessPool& operator=(const AuditProcessPool&);
+
+    void _spawn(int index);
+    void _child_main(int command_fd, int result_fd);
+    bool _delay(int command_fd, int seconds);
+    void _reap(int index);
+
+
+public:
+    AuditProcessPool(AuditAssignmentHook* hook);
+    ~AuditProcessPool();
+
+    // Make sure size processes are running, forking any that are missing
+    // or have died. Processes already running are left alone.
+    void start(int size);
+
+    // Close every command pipe and wait for the processes to exit.
+    void stop();
+
+    int size() const {
+        return (int) _processes.size();
+    }
+
+    bool busy(int index) const {
+        return _processes[index].busy;
+    }
+
+    // true if any process is working on an assignment
+    bool any_busy() const;
+
+    void assign(int index, const AuditAssignment& assignment);
+
+    // Cut short the delay of the process's assignment; it then reports
+    // CANCELLED. An assignment already past its delay is left to finish.
+    void cancel_delay(int index);
+
+    // Wait for a busy process to finish; returns its index. If the
+    // process died instead, result.status is DIED and the slot is
+    // restarted by the next start().
+    int wait_result(AuditResult& result);
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "AuditRangeCheckpoint.h"
+#include "AuditCheckpoint.h"
+#include "Time.h"
+
+using namespace std;
+
+
+static const int CHECKPOINT_BUFFER_SIZE = 128;
+
+
+AuditRangeCheckpoint::AuditRangeCheckpoint(int dir_fd,
+                                           const string& auditor_type) :
+    _filename(checkpoint_filename(auditor_type)),
+    _dir_fd(dir_fd),
+    _done_below(NO_PARTITION),
+    _done_from(NO_PARTITION),
+    _last_saved(0) {
+}
+
+string AuditRangeCheckpoint::checkpoint_filename(const string& auditor_type) {
+    return string("auditor_ranges_") + auditor_type + ".json";
+}
+
+bool AuditRangeCheckpoint::load() {
+    _done_below = NO_PARTITION;
+    _done_from = NO_PARTITION;
+
+    int fd = ::openat(_dir_fd, _filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[CHECKPOINT_BUFFER_SIZE];
+    ssize_t bytes_read = ::read(fd, buffer, sizeof(buffer) - 1);
+    ::close(fd);
+    if (bytes_read <= 0) {
+        return false;
+    }
+    buffer[bytes_read] = '\0';
+
+    long done_below;
+    long done_from;
+    if (sscanf(buffer, "{\"done_below\": %ld, \"done_from\": %ld}",
+               &done_below, &done_from) != 2) {
+        return false;
+    }
+
+    if (done_below < 0 || done_from < done_below) {
+        return false;
+    }
+
+    _done_below = done_below;
+    _done_from = done_from;
+    return true;
+}
+
+bool AuditRangeCheckpoint::update(long done_below,
+                                  long done_from,
+                                  int interval) {
+    _done_below = done_below;
+    _done_from = done_from;
+
+    if (interval <= 0) {
+        return true;
+    }
+
+    if (Time::time() - _last_saved >= interval) {
+        return save();
+    }
+    return true;
+}
+
+// as with AuditCheckpoint, a failed save waits for the next interval
+bool AuditRangeCheckpoint::save() {
+    if (_done_below == NO_PARTITION) {
+        return true;
+    }
+    _last_saved = Time::time();
+
+    char buffer[CHECKPOINT_BUFFER_SIZE];
+    int length = snprintf(buffer, sizeof(buffer),
+                          "{\"done_below\": %ld, \"done_from\": %ld}\n",
+                          _done_below, _done_from);
+    return AuditCheckpoint::write_atomically(_dir_fd, _filename,
+                                             buffer, length);
+}
+
+bool AuditRangeCheckpoint::clear() {
+    _done_below = NO_PARTITION;
+    _done_from = NO_PARTITION;
+    return (::unlinkat(_dir_fd, _filename.c_str(), 0) == 0) ||
+           (errno == ENOENT);
+}
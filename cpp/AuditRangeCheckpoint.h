@@ -0,0 +1,68 @@
+#ifndef AUDITRANGECHECKPOINT_H
+#define AUDITRANGECHECKPOINT_H
+
+#include <string>
+
+
+/**
+ * Durable progress of one device's partition ranges in a threaded or
+ * multi-process pass (see AuditWorkQueue). Ranges are taken from the
+ * front of the device by its home workers and stolen from the back by
+ * the others, so what has been audited is the partitions below one
+ * cursor plus those from a second cursor on; the ranges in between may
+ * be partly done and are audited again after a restart. The checkpoint
+ * lives in the device dir (e.g. /srv/node/sda/auditor_ranges_ALL.json)
+ * because a range covers the partition of every policy on the device.
+ */
+class AuditRangeCheckpoint {
+
+private:
+    std::string _filename;
+    int _dir_fd;
+    long _done_below;
+    long _done_from;
+    double _last_saved;
+
+    // disallow copies
+    AuditRangeCheckpoint(const AuditRangeCheckpoint&);
+    AuditRangeCheckpoint& operator=(const AuditRangeCheckpoint&);
+
+
+public:
+    static const long NO_PARTITION = -1;
+
+
+    // dir_fd is an open descriptor of the device dir; filename is
+    // relative to it
+    AuditRangeCheckpoint(int dir_fd, const std::string& auditor_type);
+
+    static std::string checkpoint_filename(const std::string& auditor_type);
+
+    // Returns false if there is no usable checkpoint. A corrupt file is
+    // treated the same as a missing one.
+    bool load();
+
+    // true if the partition was audited before the checkpoint
+    bool partition_done(long partition) const {
+        return (_done_below != NO_PARTITION) &&
+               (partition < _done_below || partition >= _done_from);
+    }
+
+    // Partitions below done_below and from done_from on have been
+    // audited; saves if at least interval seconds have passed since the
+    // last save. Returns false, with errno set, if that save failed.
+    bool update(long done_below, long done_from, int interval);
+
+    bool save();
+    bool clear();
+
+    long done_below() const {
+        return _done_below;
+    }
+
+    long done_from() const {
+        return _done_from;
+    }
+};
+
+#endif
@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <algorithm>
+
+#include "AuditWorkQueue.h"
+#include "AuditRangeCheckpoint.h"
+#include "DirReader.h"
+#include "OSUtils.h"
+
+using namespace std;
+
+
+static const char* DATADIR_BASE = "objects";
+
+
+static bool parse_partition(const char* name, long& partition) {
+    char* end;
+    if (!isdigit((unsigned char) name[0])) {
+        return false;
+    }
+    partition = strtol(name, &end, 10);
+    return *end == '\0';
+}
+
+
+AuditWorkQueue::AuditWorkQueue(int device_limit, int checkpoint_interval) :
+    _device_limit(device_limit > 0 ? device_limit : 1),
+    _checkpoint_interval(checkpoint_interval) {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_changed, NULL);
+}
+
+AuditWorkQueue::~AuditWorkQueue() {
+    for (size_t i = 0; i < _devices.size(); ++i) {
+        if (_devices[i].checkpoint != NULL) {
+            delete _devices[i].checkpoint;
+            ::close(_devices[i].dir_fd);
+        }
+    }
+    pthread_cond_destroy(&_changed);
+    pthread_mutex_destroy(&_lock);
+}
+
+int AuditWorkQueue::add_device(const string& devices_path,
+                               const string& device,
+                               int partitions_per_range) {
+    const string dev_path = OSUtils::path_join(devices_path, device);
+    DirReader dev_reader(4096);
+    DirReader part_reader;
+    vector<long> partitions;
+
+    if (!dev_reader.open(dev_path)) {
+        return 0;
+    }
+    DirReaderCloser dev_closer(dev_reader);
+
+    // every policy's datadir shares the same partition numbers
+    const char* dir_name;
+    while ((dir_name = dev_reader.next()) != NULL) {
+        if (strncmp(dir_name, DATADIR_BASE, strlen(DATADIR_BASE)) != 0 ||
+            !part_reader.openat(dev_reader.fd(), dir_name)) {
+            continue;
+        }
+        DirReaderCloser part_closer(part_reader);
+
+        const char* part_name;
+        while ((part_name = part_reader.next()) != NULL) {
+            long part_num;
+            if (!part_reader.entry_is_not_dir() &&
+                parse_partition(part_name, part_num)) {
+                partitions.push_back(part_num);
+            }
+        }
+    }
+
+    std::sort(partitions.begin(), partitions.end());
+    partitions.erase(std::unique(partitions.begin(), partitions.end()),
+                     partitions.end());
+
+    AuditRangeCheckpoint* checkpoint = NULL;
+    int dir_fd = -1;
+    if (_checkpoint_interval > 0) {
+        dir_fd = ::open(dev_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (dir_fd > -1) {
+        checkpoint = new AuditRangeCheckpoint(dir_fd, "ALL");
+        if (checkpoint->load()) {
+            size_t kept = 0;
+            for (size_t i = 0; i < partitions.size(); ++i) {
+                if (!checkpoint->partition_done(partitions[i])) {
+                    partitions[kept++] = partitions[i];
+                }
+            }
+            partitions.resize(kept);
+        }
+    }
+
+    if (partitions.empty()) {
+        // nothing here, or the interrupted pass had finished it
+        if (checkpoint != NULL) {
+            checkpoint->clear();
+            delete checkpoint;
+            ::close(dir_fd);
+        }
+        return 0;
+    }
+    if (partitions_per_range < 1) {
+        partitions_per_range = 1;
+    }
+
+    DeviceWork work;
+    work.device = device;
+    work.head = 0;
+    work.active = 0;
+    work.checkpoint = checkpoint;
+    work.dir_fd = dir_fd;
+    const int device_index = (int) _devices.size();
+
+    for (size_t i = 0; i < partitions.size(); i += partitions_per_range) {
+        const size_t last = min(i + partitions_per_range,
+                                partitions.size()) - 1;
+        AuditWorkRange range;
+        range.device = device_index;
+        range.index = (int) work.ranges.size();
+        range.partition_lo = partitions[i];
+        range.partition_hi = partitions[last] + 1;
+        range.partitions.assign(partitions.begin() + i,
+                                partitions.begin() + last + 1);
+        work.ranges.push_back(range);
+    }
+    work.tail = work.ranges.size();
+    work.retried.assign(work.ranges.size(), false);
+    work.done.assign(work.ranges.size(), false);
+    work.done_low = 0;
+    work.done_high = work.ranges.size();
+
+    pthread_mutex_lock(&_lock);
+    _devices.push_back(work);
+    pthread_mutex_unlock(&_lock);
+    return (int) work.ranges.size();
+}
+
+bool AuditWorkQueue::_any_left() const {
+    for (size_t i = 0; i < _devices.size(); ++i) {
+        if (_devices[i].left() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AuditWorkQueue::next(int& home, AuditWorkRange& range, bool wait) {
+    pthread_mutex_lock(&_lock);
+
+    while (true) {
+        if (home > -1 && home < (int) _devices.size()) {
+            DeviceWork& work = _devices[home];
+            if (work.left() > 0 && work.active < _device_limit) {
+                range = work.take(true);
+                work.active++;
+                pthread_mutex_unlock(&_lock);
+                return true;
+            }
+        }
+
+        // steal from the device with the most left that has room
+        int victim = -1;
+        size_t most_left = 0;
+        for (size_t i = 0; i < _devices.size(); ++i) {
+            const DeviceWork& work = _devices[i];
+            const size_t left = work.left();
+            if (left > most_left && work.active < _device_limit) {
+                victim = (int) i;
+                most_left = left;
+            }
+        }
+
+        if (victim > -1) {
+            DeviceWork& work = _devices[victim];
+            range = work.take(false);
+            work.active++;
+            home = victim;
+            pthread_mutex_unlock(&_lock);
+            return true;
+        }
+
+        if (!wait || !_any_left()) {
+            pthread_mutex_unlock(&_lock);
+            return false;
+        }
+
+        // what is left is on devices already at their limit
+        pthread_cond_wait(&_changed, &_lock);
+    }
+}
+
+/**
+ * The checkpoint is saved under the lock; that happens at most once per
+ * checkpoint_interval per device, and keeps two saves of one device from
+ * racing on its temp file.
+ */
+bool AuditWorkQueue::done(const AuditWorkRange& range) {
+    bool saved = true;
+    int err = 0;
+
+    pthread_mutex_lock(&_lock);
+    DeviceWork& work = _devices[range.device];
+    work.active--;
+    work.done[range.index] = true;
+    while (work.done_low < work.done_high && work.done[work.done_low]) {
+        work.done_low++;
+    }
+    while (work.done_high > work.done_low && work.done[work.done_high - 1]) {
+        work.done_high--;
+    }
+
+    if (work.checkpoint != NULL) {
+        if (work.done_low == work.done_high) {
+            // the device is finished; the next pass starts over
+            saved = work.checkpoint->clear();
+        } else {
+            saved = work.checkpoint->update(
+                work.ranges[work.done_low].partition_lo,
+                work.ranges[work.done_high - 1].partition_hi,
+                _checkpoint_interval);
+        }
+        err = errno;
+    }
+    pthread_cond_broadcast(&_changed);
+    pthread_mutex_unlock(&_lock);
+
+    if (!saved) {
+        errno = err;
+    }
+    return saved;
+}
+
+bool AuditWorkQueue::retry(const AuditWorkRange& range) {
+    pthread_mutex_lock(&_lock);
+    DeviceWork& work = _devices[range.device];
+    if (work.retried[range.index]) {
+        pthread_mutex_unlock(&_lock);
+        return false;
+    }
+    work.retried[range.index] = true;
+    work.requeued.push_back(range.index);
+    work.active--;
+    pthread_cond_broadcast(&_changed);
+    pthread_mutex_unlock(&_lock);
+    return true;
+}
+
+bool AuditWorkQueue::finished() {
+    pthread_mutex_lock(&_lock);
+    bool finished = !_any_left();
+    for (size_t i = 0; finished && i < _devices.size(); ++i) {
+        if (_devices[i].active > 0) {
+            finished = false;
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    return finished;
+}
@@ -0,0 +1,134 @@
+#ifndef AUDITWORKQUEUE_H
+#define AUDITWORKQUEUE_H
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+
+class AuditRangeCheckpoint;
+
+
+class AuditWorkRange {
+
+public:
+    int device;
+    // position among the device's ranges
+    int index;
+    long partition_lo;
+    long partition_hi;
+    // the partitions found in [partition_lo, partition_hi), ascending, so
+    // the range can be audited without listing the datadirs again
+    std::vector<long> partitions;
+
+    AuditWorkRange() :
+        device(-1),
+        index(-1),
+        partition_lo(-1),
+        partition_hi(-1) {
+    }
+};
+
+
+/**
+ * Shared work list for the threaded auditor. Each device's partitions are
+ * cut into ranges of a few partitions. A thread works through its home
+ * device from the front; once that runs dry it steals from the back of
+ * the device with the most ranges left, so a pass no longer ends with one
+ * thread alone on the biggest or slowest disk. No device ever has more
+ * than device_limit threads on it at once.
+ *
+ * With a checkpoint_interval, each device's progress is saved in an
+ * AuditRangeCheckpoint as ranges are done, and a device added again after
+ * a restart leaves out the partitions the checkpoint says were audited.
+ */
+class AuditWorkQueue {
+
+private:
+    class DeviceWork {
+    public:
+        std::string device;
+        std::vector<AuditWorkRange> ranges;
+        size_t head;
+        size_t tail;
+        // indexes of ranges handed out again by retry()
+        std::vector<int> requeued;
+        std::vector<bool> retried;
+        int active;
+        // ranges before done_low and from done_high on are all done
+        std::vector<bool> done;
+        size_t done_low;
+        size_t done_high;
+        // NULL without a checkpoint_interval; owned, as is dir_fd
+        AuditRangeCheckpoint* checkpoint;
+        int dir_fd;
+
+        size_t left() const {
+            return tail - head + requeued.size();
+        }
+
+        // requeued ranges go first, so a retry isn't put off to the end
+        const AuditWorkRange& take(bool front) {
+            if (!requeued.empty()) {
+                const int index = requeued.back();
+                requeued.pop_back();
+                return ranges[index];
+            }
+            return front ? ranges[head++] : ranges[--tail];
+        }
+    };
+
+    pthread_mutex_t _lock;
+    pthread_cond_t _changed;
+    std::vector<DeviceWork> _devices;
+    int _device_limit;
+    int _checkpoint_interval;
+
+    // disallow copies
+    AuditWorkQueue(const AuditWorkQueue&);
+    AuditWorkQueue& operator=(const AuditWorkQueue&);
+
+    bool _any_left() const;
+
+
+public:
+    AuditWorkQueue(int device_limit, int checkpoint_interval=0);
+    ~AuditWorkQueue();
+
+    // List the partitions of every datadir on the device and queue them
+    // in ranges of partitions_per_range, leaving out those a checkpoint
+    // of an interrupted pass says were audited. Returns the number of
+    // ranges.
+    int add_device(const std::string& devices_path,
+                   const std::string& device,
+                   int partitions_per_range);
+
+    int device_count() const {
+        return (int) _devices.size();
+    }
+
+    const std::string& device_name(int device) const {
+        return _devices[device].device;
+    }
+
+    // Next range to audit, preferring the home device and moving home to
+    // the device stolen from. If wait is true, blocks while the only work
+    // left is on devices at their limit; returns false once nothing is
+    // left (or, without wait, nothing can be handed out right now).
+    bool next(int& home, AuditWorkRange& range, bool wait=true);
+
+    // Must be called once the range from next() has been audited. Returns
+    // false, with errno set, if the device's checkpoint couldn't be
+    // saved; the range is done all the same.
+    bool done(const AuditWorkRange& range);
+
+    // Instead of done(): hand the range out again, e.g. because the
+    // process auditing it died. Returns false, and the range must be
+    // given to done(), if it was retried once already.
+    bool retry(const AuditWorkRange& range);
+
+    // true once every range has been handed out and audited
+    bool finished();
+};
+
+#endif
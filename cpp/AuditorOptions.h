@@ -2,6 +2,9 @@
 #define AUDITOROPTIONS_H
 
 #include <string>
+#include <vector>
+
+class AuditPartitionClassifier;
 
 
 class AuditorOptions {
@@ -13,11 +16,26 @@ public:
     std::string override_devices;
     bool zero_byte_fps;
     bool mount_check;
+    int checkpoint_interval;
+    // only audit partitions in [partition_lo, partition_hi); -1 leaves
+    // that end open
+    long partition_lo;
+    long partition_hi;
+    // if not empty, only these partitions (ascending) are audited; their
+    // dirs are opened directly instead of listing each datadir
+    std::vector<long> partitions;
+    // puts handoff partitions after the primaries, or skips them; NULL
+    // sweeps every partition in order. Not owned.
+    AuditPartitionClassifier* partition_classifier;
 
 
     AuditorOptions() :
         zero_byte_fps(false),
-        mount_check(false) {
+        mount_check(false),
+        checkpoint_interval(0),
+        partition_lo(-1),
+        partition_hi(-1),
+        partition_classifier(NULL) {
     }
 
     AuditorOptions(const AuditorOptions& copy) :
@@ -26,7 +44,12 @@ public:
         device_dirs(copy.device_dirs),
         override_devices(copy.override_devices),
         zero_byte_fps(copy.zero_byte_fps),
-        mount_check(copy.mount_check) {
+        mount_check(copy.mount_check),
+        checkpoint_interval(copy.checkpoint_interval),
+        partition_lo(copy.partition_lo),
+        partition_hi(copy.partition_hi),
+        partitions(copy.partitions),
+        partition_classifier(copy.partition_classifier) {
     }
 
     AuditorOptions& operator=(const AuditorOptions& copy) {
@@ -40,6 +63,11 @@ public:
         override_devices = copy.override_devices;
         zero_byte_fps = copy.zero_byte_fps;
         mount_check = copy.mount_check;
+        checkpoint_interval = copy.checkpoint_interval;
+        partition_lo = copy.partition_lo;
+        partition_hi = copy.partition_hi;
+        partitions = copy.partitions;
+        partition_classifier = copy.partition_classifier;
 
         return *this;
     }
@@ -1,6 +1,9 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <sys/stat.h>
 
 #include "AuditorWorker.h"
+#include "AuditPipeline.h"
 #include "DiskFile.h"
 #include "DiskFileManager.h"
 #include "DiskFileReader.h"
@@ -11,16 +14,45 @@
 using namespace std;
 
 
+static int64_t stat_mtime_ns(const struct stat& st) {
+    return (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
 AuditorWorker::AuditorWorker(Config conf,
                              Logger* logger,
                              const string& rcache,
                              const string& devices,
                              bool zero_byte_only_at_fps) {
+    this->_init(conf, logger, rcache, devices, zero_byte_only_at_fps, NULL);
+}
+
+AuditorWorker::AuditorWorker(Config conf,
+                             Logger* logger,
+                             const string& rcache,
+                             const string& devices,
+                             bool zero_byte_only_at_fps,
+                             DiskFileRouter* diskfile_router) {
+    this->_init(conf, logger, rcache, devices, zero_byte_only_at_fps,
+                diskfile_router);
+}
+
+void AuditorWorker::_init(Config conf,
+                          Logger* logger,
+                          const string& rcache,
+                          const string& devices,
+                          bool zero_byte_only_at_fps,
+                          DiskFileRouter* diskfile_router) {
 
     this->conf = conf;
     this->logger = logger;
     this->devices = devices;
-    this->diskfile_router = DiskFileRouter(conf, this->logger);
+    if (diskfile_router != NULL) {
+        this->diskfile_router = diskfile_router;
+        this->owns_diskfile_router = false;
+    } else {
+        this->diskfile_router = new DiskFileRouter(conf, this->logger);
+        this->owns_diskfile_router = true;
+    }
     this->max_files_per_second = atof(conf.get("files_per_second", "20"));
     this->max_bytes_per_second = atof(conf.get("bytes_per_second",
                                                "10000000"));
@@ -34,19 +66,152 @@ AuditorWorker::AuditorWorker(Config conf,
     this->last_logged = 0;
     this->files_running_time = 0;
     this->bytes_running_time = 0;
+    pthread_mutex_init(&this->bytes_rate_lock, NULL);
     this->bytes_processed = 0;
     this->total_bytes_processed = 0;
     this->total_files_processed = 0;
     this->passes = 0;
     this->quarantines = 0;
     this->errors = 0;
+    this->reported = 0;
+    this->total_quarantines = 0;
+    this->total_errors = 0;
+    this->time_auditing = 0;
     this->rcache = rcache;
+    // incremental mode only re-reads an object whose hash dir changed or
+    // whose data hasn't been verified within full_verify_age seconds
+    this->incremental = SwiftUtils::config_true_value(
+        conf.get("incremental_audit", "false"));
+    this->full_verify_age = atoi(conf.get("full_verify_age", "2592000"));
+    pthread_mutex_init(&this->audit_index_lock, NULL);
+    // reads of an object are queued this many chunks ahead through
+    // io_uring; 0 reads one chunk at a time
+    this->disk_chunk_size = atoi(conf.get("disk_chunk_size", "65536"));
+    this->audit_io_depth = atoi(conf.get("audit_io_depth", "4"));
+    // read object data with O_DIRECT so auditing doesn't evict the
+    // object server's hot pages from the page cache
+    this->direct_io = SwiftUtils::config_true_value(
+        conf.get("audit_direct_io", "false"));
+    // shared by every reader so chunk buffers are reused across objects
+    this->chunk_buffers = new BufferPool(this->disk_chunk_size);
+    this->rate_limiter = NULL;
+    this->rate_slot = -1;
+    // adaptive mode moves the rates between a floor and a ceiling
+    // depending on how busy the disks are; the throttle is the process's
+    // (see set_throttle)
+    this->throttle = NULL;
+    this->chunk_started = 0;
+    this->files_per_second_floor = atof(
+        conf.get("files_per_second_floor", "1"));
+    this->files_per_second_ceiling = atof(
+        conf.get("files_per_second_ceiling", "100"));
+    this->bytes_per_second_floor = atof(
+        conf.get("bytes_per_second_floor", "1000000"));
+    this->bytes_per_second_ceiling = atof(
+        conf.get("bytes_per_second_ceiling", "50000000"));
+    // run opens, reads and verification on separate threads so metadata
+    // I/O of some objects overlaps with the data reads of others
+    this->pipeline = NULL;
+    if (!this->zero_byte_only_at_fps &&
+        SwiftUtils::config_true_value(conf.get("audit_pipeline", "false"))) {
+        this->pipeline = new AuditPipeline(
+            this,
+            atoi(conf.get("pipeline_open_workers", "2")),
+            atoi(conf.get("pipeline_read_workers", "2")),
+            atoi(conf.get("pipeline_depth", "64")),
+            this->disk_chunk_size,
+            atol(conf.get("pipeline_small_object_size",
+                          conf.get("disk_chunk_size", "65536"))));
+    }
     vector<string> stat_sizes =
         SwiftUtils::list_from_csv(conf.get("object_size_stats"));
     this->stats_sizes = sorted(
         [int(s) for s in stat_sizes]);
 }
 
+AuditorWorker::~AuditorWorker() {
+    // the pipeline's threads call back into this worker; stop them first
+    if (this->pipeline != NULL) {
+        delete this->pipeline;
+    }
+    map<string, AuditIndex*>::iterator itIndex = this->audit_indexes.begin();
+    const map<string, AuditIndex*>::const_iterator itIndexEnd =
+        this->audit_indexes.end();
+    for (; itIndex != itIndexEnd; itIndex++) {
+        delete itIndex->second;
+    }
+
+    map<string, AsyncReadQueue*>::iterator it = this->read_queues.begin();
+    const map<string, AsyncReadQueue*>::const_iterator itEnd =
+        this->read_queues.end();
+    for (; it != itEnd; it++) {
+        if (it->second != NULL) {
+            delete it->second;
+        }
+    }
+
+    delete this->chunk_buffers;
+    if (this->owns_diskfile_router) {
+        delete this->diskfile_router;
+    }
+    pthread_mutex_destroy(&this->audit_index_lock);
+    pthread_mutex_destroy(&this->bytes_rate_lock);
+}
+
+/**
+ * Draw from node-wide (and per-device) budgets shared with the other
+ * auditor processes instead of this worker's own running times. The ZBF
+ * scanner has its own files/sec and keeps limiting itself locally.
+ */
+void AuditorWorker::set_rate_limiter(SharedRateLimiter* rate_limiter) {
+    this->rate_limiter = rate_limiter;
+    if (this->throttle != NULL) {
+        this->_apply_throttle();
+    }
+}
+
+/**
+ * Move the rates with throttle, which every worker of the process shares.
+ * The ZBF scanner keeps its own fixed files/sec.
+ */
+void AuditorWorker::set_throttle(AdaptiveThrottle* throttle) {
+    if (this->zero_byte_only_at_fps) {
+        return;
+    }
+    this->throttle = throttle;
+    if (this->throttle != NULL) {
+        this->_apply_throttle();
+    }
+}
+
+void AuditorWorker::_apply_throttle() {
+    this->max_files_per_second =
+        this->throttle->rate(this->files_per_second_floor,
+                             this->files_per_second_ceiling);
+    this->max_bytes_per_second =
+        this->throttle->rate(this->bytes_per_second_floor,
+                             this->bytes_per_second_ceiling);
+    if (this->rate_limiter != NULL) {
+        this->rate_limiter->set_rates(this->max_files_per_second,
+                                      this->max_bytes_per_second);
+    }
+    this->logger->set_counter("adaptive_files_per_second",
+                              (long) this->max_files_per_second);
+    this->logger->set_counter("adaptive_bytes_per_second",
+                              (long) this->max_bytes_per_second);
+}
+
+int AuditorWorker::_rate_slot_for(const string& device) {
+    if (this->rate_limiter == NULL) {
+        return -1;
+    }
+    if (device != this->rate_device) {
+        this->rate_device = device;
+        this->rate_slot = this->rate_limiter->device_slot(device);
+    }
+    return this->rate_slot;
+}
+
 /*
 void AuditorWorker::create_recon_nested_dict(top_level_key,
                                              device_list,
@@ -61,14 +226,40 @@ void AuditorWorker::create_recon_nested_dict(top_level_key,
 */
 
 void AuditorWorker::auditObject(const AuditLocation& audit_location) {
+    if (this->pipeline != NULL) {
+        // the pipeline calls object_done once the object is through
+        this->_walk_into(audit_location);
+        this->pipeline->submit(audit_location);
+        return;
+    }
+
+    this->_walk_into(audit_location);
     double loop_time = Time::time();
+    this->_rate_slot_for(audit_location.device);
     this->failsafe_object_audit(audit_location);
+    this->object_done(audit_location, loop_time);
+}
+
+/**
+ * Account for one more object audited: rate limiting, the throttle and
+ * the periodic stats report.
+ */
+void AuditorWorker::object_done(const AuditLocation& location,
+                                double loop_time) {
+    const int slot = this->_rate_slot_for(location.device);
     this->logger->timing_since("timing", loop_time);
-    this->files_running_time =
-        SwiftUtils::ratelimit_sleep(this->files_running_time,
-                                    this->max_files_per_second);
+    if (this->rate_limiter != NULL && !this->zero_byte_only_at_fps) {
+        this->rate_limiter->files_done(slot);
+    } else {
+        this->files_running_time =
+            SwiftUtils::ratelimit_sleep(this->files_running_time,
+                                        this->max_files_per_second);
+    }
     this->total_files_processed += 1;
     double now = Time::time();
+    if (this->throttle != NULL && this->throttle->update(now)) {
+        this->_apply_throttle();
+    }
     if (now - this->last_logged >= this->log_time) {
         /*
         this->logger->info(_(
@@ -95,16 +286,40 @@ void AuditorWorker::auditObject(const AuditLocation& audit_location) {
              'start_time': reported, 'audit_time': time_auditing})
         dump_recon_cache(cache_entry, this->rcache, this->logger);
         */
-        reported = now;
-        total_quarantines += this->quarantines;
-        total_errors += this->errors;
+        this->reported = now;
+        this->total_quarantines += this->quarantines;
+        this->total_errors += this->errors;
         this->passes = 0;
         this->quarantines = 0;
         this->errors = 0;
         this->bytes_processed = 0;
         this->last_logged = now;
+        pthread_mutex_lock(&this->audit_index_lock);
+        this->_save_audit_indexes(false);
+        pthread_mutex_unlock(&this->audit_index_lock);
+    }
+    this->time_auditing += (now - loop_time);
+}
+
+/**
+ * Audit the locations selected by options (devices, partition range)
+ * without the begin/end reporting of audit_all_objects; the threaded
+ * auditor calls this once per partition range.
+ */
+void AuditorWorker::audit_locations(const AuditorOptions& options) {
+    // every manager walks the datadirs of all policies, so policy 0's
+    // does the whole device (see audit_all_objects)
+    DiskFileManager* disk_file_manager = (*this->diskfile_router)[0];
+    disk_file_manager->object_audit_location_generator(options,
+                                                       this->logger,
+                                                       this);
+    if (this->pipeline != NULL) {
+        this->pipeline->drain();
     }
-    time_auditing += (now - loop_time);
+    // the next range may be of the same datadir, so its index is kept
+    pthread_mutex_lock(&this->audit_index_lock);
+    this->_save_audit_indexes(false);
+    pthread_mutex_unlock(&this->audit_index_lock);
 }
 
 void AuditorWorker::audit_all_objects(const AuditorOptions& options) {
@@ -124,13 +339,13 @@ void AuditorWorker::audit_all_objects(const AuditorOptions& options) {
                        this->auditor_type +
                        description +
                        ")");
-    double reported = Time::time();
-    double begin = reported;
+    this->reported = Time::time();
+    double begin = this->reported;
     this->total_bytes_processed = 0;
     this->total_files_processed = 0;
-    int total_quarantines = 0;
-    int total_errors = 0;
-    double time_auditing = 0;
+    this->total_quarantines = 0;
+    this->total_errors = 0;
+    this->time_auditing = 0;
     // TODO: we should move audit-location generation to the storage policy,
     // as we may (conceivably) have a different filesystem layout for each.
     // We'd still need to generate the policies to audit from the actual
@@ -143,9 +358,7 @@ void AuditorWorker::audit_all_objects(const AuditorOptions& options) {
     //all_locs = (this->diskfile_router[POLICIES[0]]
     //            .object_audit_location_generator(device_dirs=device_dirs));
 
-    //TODO: hook up DiskFileManager
-    DiskFileManager* disk_file_manager = NULL;
-    disk_file_manager->object_audit_location_generator(options, this);
+    this->audit_locations(options);
 
 
     // Avoid divide by zero during very short runs
@@ -160,11 +373,12 @@ void AuditorWorker::audit_all_objects(const AuditorOptions& options) {
         'Rate: %(audit_rate).2f') % {
             'type': '%s%s' % (this->auditor_type, description),
             'mode': mode, 'elapsed': elapsed,
-            'quars': total_quarantines + this->quarantines,
-            'errors': total_errors + this->errors,
+            'quars': this->total_quarantines + this->quarantines,
+            'errors': this->total_errors + this->errors,
             'frate': this->total_files_processed / elapsed,
             'brate': this->total_bytes_processed / elapsed,
-            'audit': time_auditing, 'audit_rate': time_auditing / elapsed})
+            'audit': this->time_auditing,
+            'audit_rate': this->time_auditing / elapsed})
     */
     if (this->stats_sizes.size() > 0) {
         this->logger->info(
@@ -198,54 +412,329 @@ void AuditorWorker::failsafe_object_audit(const AuditLocation& location) {
     }
 }
 
+// hash dir path is <datadir>/<partition>/<suffix>/<hash>
+static string::size_type datadir_length(const string& hash_dir_path) {
+    string::size_type datadir_len = string::npos;
+    for (int i = 0; i < 3; ++i) {
+        datadir_len = hash_dir_path.rfind('/', datadir_len - 1);
+    }
+    return datadir_len;
+}
+
+/**
+Return the incremental index for the device and policy of location,
+loading it the first time. It is kept, and saved only now and then, until
+the walk has left its datadir (see _walk_into), whichever thread asks.
+Called with audit_index_lock held.
+*/
+AuditIndex* AuditorWorker::_audit_index_for(const AuditLocation& location) {
+    const string datadir(location.path, 0, datadir_length(location.path));
+
+    map<string, AuditIndex*>::const_iterator it =
+        this->audit_indexes.find(datadir);
+    if (it != this->audit_indexes.end()) {
+        return it->second;
+    }
+
+    AuditIndex* index = new AuditIndex(datadir);
+    index->load();
+    this->audit_indexes[datadir] = index;
+    return index;
+}
+
+/**
+Save the indexes with changes; drop saves them all and frees them.
+Called with audit_index_lock held.
+*/
+void AuditorWorker::_save_audit_indexes(bool drop) {
+    map<string, AuditIndex*>::iterator it = this->audit_indexes.begin();
+    const map<string, AuditIndex*>::const_iterator itEnd =
+        this->audit_indexes.end();
+    for (; it != itEnd; it++) {
+        AuditIndex* index = it->second;
+        if (index->dirty()) {
+            try {
+                index->prune(
+                    (uint32_t) (Time::time() - 2 * this->full_verify_age));
+                index->save();
+            } catch (const OSError& err) {
+                this->logger->error(string("ERROR saving audit index ") +
+                                    index->path() + ": " +
+                                    err.toString());
+            }
+        }
+        if (drop) {
+            delete index;
+        }
+    }
+    if (drop) {
+        this->audit_indexes.clear();
+    }
+}
+
+/**
+ * Called by the walk for every location. The generator walks one device
+ * and policy at a time, so when it moves on to the next datadir the
+ * previous ones are done: once everything of them is through the
+ * pipeline their indexes are saved and dropped, and only the current
+ * datadir's is held in memory.
+ */
+void AuditorWorker::_walk_into(const AuditLocation& location) {
+    if (!this->incremental || this->zero_byte_only_at_fps) {
+        return;
+    }
+    const string::size_type datadir_len = datadir_length(location.path);
+    if (this->walk_datadir.length() == datadir_len &&
+        location.path.compare(0, datadir_len, this->walk_datadir) == 0) {
+        return;
+    }
+
+    if (this->pipeline != NULL) {
+        this->pipeline->drain();
+    }
+    pthread_mutex_lock(&this->audit_index_lock);
+    this->_save_audit_indexes(true);
+    pthread_mutex_unlock(&this->audit_index_lock);
+    this->walk_datadir.assign(location.path, 0, datadir_len);
+}
+
+/**
+ * Each device gets its own queue so one slow disk doesn't hold up reads
+ * of the others. Returns NULL if queued reads are turned off or io_uring
+ * isn't available, in which case the reader falls back to blocking reads.
+ */
+AsyncReadQueue* AuditorWorker::_read_queue_for(const AuditLocation& location) {
+    if (this->audit_io_depth < 1) {
+        return NULL;
+    }
+
+    map<string, AsyncReadQueue*>::iterator it =
+        this->read_queues.find(location.device);
+    if (it != this->read_queues.end()) {
+        return it->second;
+    }
+
+    AsyncReadQueue* queue = new AsyncReadQueue(this->audit_io_depth,
+                                               this->disk_chunk_size);
+    if (!queue->available()) {
+        this->logger->info(string("io_uring not available, using blocking ") +
+                           "reads for device " + location.device);
+        delete queue;
+        queue = NULL;
+    }
+    this->read_queues[location.device] = queue;
+    return queue;
+}
+
 void AuditorWorker::onQuarantine(const string& msg) {
     throw DiskFileQuarantined(msg);
 }
 
+void AuditorWorker::onFileRead(const string& chunk) {
+    this->onChunkRead(chunk.data(), chunk.length());
+}
+
+void AuditorWorker::onChunkRead(const char* data, size_t length) {
+    if (this->throttle != NULL) {
+        // time since the previous chunk was handed back, not counting
+        // any rate limit sleep
+        this->throttle->record_latency(Time::time() - this->chunk_started);
+    }
+    // the reader has already hashed the chunk; just account for it
+    this->account_bytes(length);
+    if (this->throttle != NULL) {
+        this->chunk_started = Time::time();
+    }
+}
+
+void AuditorWorker::account_bytes(size_t length) {
+    this->limit_bytes(this->rate_slot, length);
+    this->count_bytes(length);
+}
+
+/**
+ * Slot of device in the shared rate limiter, or -1 without one. Unlike
+ * _rate_slot_for nothing is cached, so any thread may ask.
+ */
+int AuditorWorker::device_rate_slot(const string& device) {
+    if (this->rate_limiter == NULL) {
+        return -1;
+    }
+    return this->rate_limiter->device_slot(device);
+}
+
+/**
+ * Sleep until the byte rate allows length more bytes of the device with
+ * device_slot. The shared limiter is safe to call from any thread; the
+ * local running time is guarded for the pipeline's read threads.
+ */
+void AuditorWorker::limit_bytes(int device_slot, size_t length) {
+    if (this->rate_limiter != NULL) {
+        this->rate_limiter->bytes_done(device_slot, length);
+    } else {
+        pthread_mutex_lock(&this->bytes_rate_lock);
+        this->bytes_running_time =
+            SwiftUtils::ratelimit_sleep(this->bytes_running_time,
+                                        this->max_bytes_per_second,
+                                        length);
+        pthread_mutex_unlock(&this->bytes_rate_lock);
+    }
+}
+
+void AuditorWorker::count_bytes(size_t length) {
+    this->bytes_processed += length;
+    this->total_bytes_processed += length;
+}
+
+// the pipeline's read threads time their chunks; it is recorded here, on
+// the verify thread, which owns the throttle
+void AuditorWorker::record_read_latency(double seconds) {
+    if (this->throttle != NULL) {
+        this->throttle->record_latency(seconds);
+    }
+}
+
 void AuditorWorker::object_audit(const AuditLocation& location) {
+    AuditItem item(location);
 
+    this->open_for_audit(item);
+    if (item.outcome == AuditItem::READ) {
+        item.reader->set_read_queue(this->_read_queue_for(location));
+        item.reader->set_buffer_pool(this->chunk_buffers);
+        // chunks come back through onChunkRead
+        this->chunk_started = Time::time();
+        this->read_for_audit(item, this);
+    }
+    this->finish_audit(item);
+}
+
+/**
+ * Open the diskfile of item and check its metadata. Leaves item READ with
+ * a reader if its data still has to be read.
+ */
+void AuditorWorker::open_for_audit(AuditItem& item) {
+    const AuditLocation& location = item.location;
     DiskFileManager* diskfile_mgr =
-        this->diskfile_router[location.policy];
-    DiskFile* df;
-    DiskFileReader* reader = NULL;
+        (*this->diskfile_router)[location.policy];
+    struct stat hash_dir_stat;
 
-    try {
-        df = diskfile_mgr->get_diskfile_from_audit_location(location);
-        {
-            OpenedDiskFile odf(df->open());
-            metadata = df->get_metadata();
-            int obj_size = atoi(metadata["Content-Length"]);
-            if (this->stats_sizes.size() > 0) {
-                this->record_stats(obj_size);
-            }
-            if (this->zero_byte_only_at_fps && obj_size) {
-                this->passes += 1;
-                return;
-            }
-            reader = df->reader(this);
+    if (this->incremental && !this->zero_byte_only_at_fps) {
+        const string::size_type pos = location.path.rfind('/');
+        if (AuditIndex::parse_hash(location.path.c_str() + pos + 1,
+                                   item.hash) &&
+            ::stat(location.path.c_str(), &hash_dir_stat) == 0) {
+            item.indexed = true;
+            item.inode = hash_dir_stat.st_ino;
+            item.mtime_ns = stat_mtime_ns(hash_dir_stat);
         }
-        //TODO: change 'with' to RAII to close reader
-        with closing(reader):
-            for (chunk in reader) {
-                int chunk_len = chunk.size();
-                this->bytes_running_time =
-                    SwiftUtils::ratelimit_sleep(
-                        this->bytes_running_time,
-                        this->max_bytes_per_second,
-                        incr_by=chunk_len);
-                this->bytes_processed += chunk_len;
-                this->total_bytes_processed += chunk_len;
-            }
-    } catch (const DiskFileNotExist& dfne) {
+    }
+
+    item.df = diskfile_mgr->get_diskfile_from_audit_location(location);
+    // missing, deleted, expired and quarantined objects come back as a
+    // status; they're too common to pay for an exception each
+    const DiskFileStatus status = item.df->try_open();
+    if (status.not_found()) {
+        item.outcome = AuditItem::NOT_FOUND;
+        return;
+    }
+    if (status.code == DiskFileStatus::QUARANTINED) {
+        item.outcome = AuditItem::QUARANTINED;
+        item.message = status.message;
+        return;
+    }
+    if (!status.ok()) {
+        item.outcome = AuditItem::FAILED;
+        item.message = status.message;
         return;
+    }
+
+    DiskFileCloser closer(item.df);
+    // opening checked Content-Length against the size of the data file
+    item.obj_size = item.df->content_length();
+    if (this->zero_byte_only_at_fps && item.obj_size) {
+        item.outcome = AuditItem::PASSED;
+        return;
+    }
+    if (item.indexed && this->_index_is_current(item)) {
+        this->logger->increment("incremental_skips");
+        item.outcome = AuditItem::PASSED;
+        return;
+    }
+    item.reader = item.df->reader(this);
+    item.reader->set_direct_io(this->direct_io);
+    item.outcome = AuditItem::READ;
+}
+
+/**
+ * Opening the diskfile already validated the metadata against the data
+ * file. If the hash dir is unchanged since the data was last verified,
+ * and that wasn't too long ago, there's no need to read it.
+ */
+bool AuditorWorker::_index_is_current(const AuditItem& item) {
+    pthread_mutex_lock(&this->audit_index_lock);
+    const AuditIndexEntry* entry =
+        this->_audit_index_for(item.location)->find(item.hash);
+    const bool current = entry != NULL &&
+        entry->inode == item.inode &&
+        entry->mtime_ns == item.mtime_ns &&
+        entry->size == (uint64_t) item.obj_size &&
+        Time::time() - entry->last_verified < this->full_verify_age;
+    pthread_mutex_unlock(&this->audit_index_lock);
+    return current;
+}
+
+/**
+ * Read the data of item, handing the chunks to dfr_hook. The reader
+ * closes itself at the end, which quarantines the object on an etag
+ * mismatch.
+ */
+void AuditorWorker::read_for_audit(AuditItem& item,
+                                   DiskFileReadHook* dfr_hook) {
+    try {
+        item.reader->__iter__(dfr_hook);
+        item.outcome = AuditItem::VERIFIED;
+    } catch (const DiskFileNotExist& dfne) {
+        item.outcome = AuditItem::NOT_FOUND;
     } catch (const DiskFileQuarantined& err) {
+        item.outcome = AuditItem::QUARANTINED;
+        item.message = err.toString();
+    }
+}
+
+void AuditorWorker::finish_audit(AuditItem& item) {
+    if (item.outcome == AuditItem::NOT_FOUND) {
+        return;
+    }
+    if (item.obj_size > -1 && this->stats_sizes.size() > 0) {
+        this->record_stats(item.obj_size);
+    }
+
+    if (item.outcome == AuditItem::FAILED) {
+        this->logger->increment("errors");
+        this->errors += 1;
+        this->logger->error(string("ERROR Trying to audit ") +
+                            item.location.toString() + ": " +
+                            item.message);
+        return;
+    }
+
+    if (item.outcome == AuditItem::QUARANTINED) {
         this->quarantines += 1;
         this->logger->error(string("ERROR Object ") +
-                            location.toString() +
+                            item.location.toString() +
                             " failed audit and was quarantined: " +
-                            err.toString());
+                            item.message);
+    } else if (item.outcome == AuditItem::VERIFIED && item.indexed) {
+        // data read and verified without being quarantined
+        pthread_mutex_lock(&this->audit_index_lock);
+        this->_audit_index_for(item.location)->update(
+            item.hash,
+            item.inode,
+            item.mtime_ns,
+            item.obj_size,
+            (uint32_t) Time::time());
+        pthread_mutex_unlock(&this->audit_index_lock);
     }
 
     this->passes += 1;
 }
-
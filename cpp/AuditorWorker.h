@@ -1,21 +1,32 @@
 #ifndef AUDITORWORKER_H
 #define AUDITORWORKER_H
 
+#include <pthread.h>
 #include <string>
 #include <map>
 #include <vector>
 
+#include "AdaptiveThrottle.h"
+#include "AsyncReadQueue.h"
+#include "AuditIndex.h"
+#include "AuditItem.h"
 #include "AuditLocation.h"
 #include "AuditorOptions.h"
+#include "BufferPool.h"
 #include "Config.h"
+#include "DiskFileReadHook.h"
 #include "DiskFileRouter.h"
 #include "Logger.h"
 #include "ObjectAuditHook.h"
 #include "QuarantineHook.h"
+#include "SharedRateLimiter.h"
 #include "StatBuckets.h"
 
+class AuditPipeline;
 
-class AuditorWorker : public QuarantineHook, public ObjectAuditHook
+class AuditorWorker : public QuarantineHook,
+                      public ObjectAuditHook,
+                      public DiskFileReadHook
 {
 
 private:
@@ -36,10 +47,55 @@ private:
     int passes;
     int quarantines;
     int errors;
+    // totals of a whole audit_all_objects pass, kept up by object_done
+    double reported;
+    int total_quarantines;
+    int total_errors;
+    double time_auditing;
     std::vector<int> stats_sizes;
     StatBuckets stats_buckets;
-    DiskFileRouter diskfile_router;
+    DiskFileRouter* diskfile_router;
+    bool owns_diskfile_router;
     std::string rcache;
+    bool incremental;
+    int full_verify_age;
+    // the incremental indexes in use, by datadir
+    std::map<std::string, AuditIndex*> audit_indexes;
+    // datadir the walk is in
+    std::string walk_datadir;
+    int disk_chunk_size;
+    int audit_io_depth;
+    bool direct_io;
+    std::map<std::string, AsyncReadQueue*> read_queues;
+    BufferPool* chunk_buffers;
+    SharedRateLimiter* rate_limiter;
+    std::string rate_device;
+    int rate_slot;
+    // not owned
+    AdaptiveThrottle* throttle;
+    float files_per_second_floor;
+    float files_per_second_ceiling;
+    float bytes_per_second_floor;
+    float bytes_per_second_ceiling;
+    double chunk_started;
+    AuditPipeline* pipeline;
+    pthread_mutex_t audit_index_lock;
+    // bytes_running_time, when the pipeline's read threads limit bytes
+    pthread_mutex_t bytes_rate_lock;
+
+    void _init(Config conf,
+               Logger* logger,
+               const std::string& rcache,
+               const std::string& devices,
+               bool zero_byte_only_at_fps,
+               DiskFileRouter* diskfile_router);
+    AuditIndex* _audit_index_for(const AuditLocation& location);
+    void _save_audit_indexes(bool drop);
+    void _walk_into(const AuditLocation& location);
+    bool _index_is_current(const AuditItem& item);
+    AsyncReadQueue* _read_queue_for(const AuditLocation& location);
+    int _rate_slot_for(const std::string& device);
+    void _apply_throttle();
 
 
 public:
@@ -54,18 +110,58 @@ public:
                   const std::string& devices,
                   bool zero_byte_only_at_fps);
 
+    // uses the given router (shared with other workers) instead of
+    // loading its own
+    AuditorWorker(Config conf,
+                  Logger* logger,
+                  const std::string& rcache,
+                  const std::string& devices,
+                  bool zero_byte_only_at_fps,
+                  DiskFileRouter* diskfile_router);
+
+    ~AuditorWorker();
+
+    void set_rate_limiter(SharedRateLimiter* rate_limiter);
+    void set_throttle(AdaptiveThrottle* throttle);
+
     void audit_all_objects(const AuditorOptions& options);
+    void audit_locations(const AuditorOptions& options);
 
     void record_stats(int obj_size);
 
+    int files_processed() const {
+        return total_files_processed;
+    }
+
+    int bytes_processed_total() const {
+        return total_bytes_processed;
+    }
+
     // QuarantineHook
     void onQuarantine(const std::string& msg);
 
     // ObjectAuditHook
     void auditObject(const AuditLocation& audit_location);
 
+    // DiskFileReadHook
+    void onFileRead(const std::string& chunk);
+    void onChunkRead(const char* data, size_t length);
+
     void failsafe_object_audit(const AuditLocation& location);
     void object_audit(const AuditLocation& location);
+
+    // the steps of object_audit, which the pipeline runs on its own threads
+    void open_for_audit(AuditItem& item);
+    void read_for_audit(AuditItem& item, DiskFileReadHook* dfr_hook);
+    void finish_audit(AuditItem& item);
+    void account_bytes(size_t length);
+    // the two halves of account_bytes: read threads limit, the verify
+    // thread counts
+    int device_rate_slot(const std::string& device);
+    void limit_bytes(int device_slot, size_t length);
+    void count_bytes(size_t length);
+    void record_read_latency(double seconds);
+    void object_done(const AuditLocation& location, double loop_time);
 };
 
 #endif
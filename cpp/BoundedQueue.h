@@ -0,0 +1,124 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+/**
+ * Fixed size lock-free queue for handing work between threads. Any
+ * number of threads may push and pop: each cell carries a sequence
+ * number that tells producers when it is free and consumers when it is
+ * filled, so the only contended writes are the CAS on the head or tail
+ * position. Pushing to a full queue or popping an empty one fails
+ * instead of blocking; callers decide how to wait.
+ */
+template <typename T>
+class BoundedQueue {
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    struct Cell {
+        size_t sequence;
+        T value;
+    };
+
+    std::vector<Cell> _cells;
+    size_t _mask;
+    // producers and consumers each get their own cache line
+    char _pad0[CACHE_LINE];
+    size_t _enqueue_pos;
+    char _pad1[CACHE_LINE - sizeof(size_t)];
+    size_t _dequeue_pos;
+    char _pad2[CACHE_LINE - sizeof(size_t)];
+
+    // disallow copies
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity) :
+        _enqueue_pos(0),
+        _dequeue_pos(0) {
+
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _cells.resize(size);
+        _mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            _cells[i].sequence = i;
+        }
+    }
+
+    size_t capacity() const {
+        return _mask + 1;
+    }
+
+    bool try_push(const T& value) {
+        size_t pos = __atomic_load_n(&_enqueue_pos, __ATOMIC_RELAXED);
+        Cell* cell;
+
+        while (true) {
+            cell = &_cells[pos & _mask];
+            const size_t sequence =
+                __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            const intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&_enqueue_pos, &pos, pos + 1,
+                                                true,
+                                                __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // the consumer hasn't freed this cell yet: full
+                return false;
+            } else {
+                pos = __atomic_load_n(&_enqueue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        cell->value = value;
+        __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        size_t pos = __atomic_load_n(&_dequeue_pos, __ATOMIC_RELAXED);
+        Cell* cell;
+
+        while (true) {
+            cell = &_cells[pos & _mask];
+            const size_t sequence =
+                __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            const intptr_t diff =
+                (intptr_t) sequence - (intptr_t) (pos + 1);
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&_dequeue_pos, &pos, pos + 1,
+                                                true,
+                                                __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // the producer hasn't filled this cell yet: empty
+                return false;
+            } else {
+                pos = __atomic_load_n(&_dequeue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        value = cell->value;
+        __atomic_store_n(&cell->sequence, pos + _mask + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+
+#endif
+
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <errno.h>
+
+#include "BufferPool.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+
+BufferPool::BufferPool(size_t buffer_size, size_t alignment) :
+    _buffer_size(buffer_size),
+    _alignment(alignment),
+    _allocated(0) {
+}
+
+BufferPool::~BufferPool() {
+    vector<char*>::iterator it = _free.begin();
+    const vector<char*>::const_iterator itEnd = _free.end();
+    for (; it != itEnd; it++) {
+        ::free(*it);
+    }
+}
+
+char* BufferPool::acquire() {
+    if (!_free.empty()) {
+        char* buffer = _free.back();
+        _free.pop_back();
+        return buffer;
+    }
+
+    // round up so the tail of a buffer can take a full aligned read
+    const size_t size =
+        ((_buffer_size + _alignment - 1) / _alignment) * _alignment;
+    void* buffer = NULL;
+    if (::posix_memalign(&buffer, _alignment, size) != 0) {
+        throw OSError(ENOMEM);
+    }
+    ++_allocated;
+    return (char*) buffer;
+}
+
+void BufferPool::release(char* buffer) {
+    if (buffer != NULL) {
+        _free.push_back(buffer);
+    }
+}
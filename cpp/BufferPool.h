@@ -0,0 +1,80 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <stddef.h>
+#include <vector>
+
+
+/**
+ * Pool of fixed size, aligned buffers. Buffers are allocated on first use
+ * and reused after release, so a reader that keeps its pool across objects
+ * reads chunk after chunk without touching the heap.
+ */
+class BufferPool {
+
+private:
+    size_t _buffer_size;
+    size_t _alignment;
+    size_t _allocated;
+    std::vector<char*> _free;
+
+    // disallow copies
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+
+public:
+    static const size_t DEFAULT_ALIGNMENT = 4096;
+
+
+    BufferPool(size_t buffer_size, size_t alignment=DEFAULT_ALIGNMENT);
+    ~BufferPool();
+
+    char* acquire();
+    void release(char* buffer);
+
+    size_t buffer_size() const {
+        return _buffer_size;
+    }
+
+    size_t alignment() const {
+        return _alignment;
+    }
+
+    // number of buffers allocated so far, in use or not
+    size_t allocated() const {
+        return _allocated;
+    }
+};
+
+
+// holds one buffer of a pool for the lifetime of a scope
+class PooledBuffer {
+private:
+    BufferPool& _pool;
+    char* _buffer;
+
+    PooledBuffer();
+    PooledBuffer(const PooledBuffer&);
+    PooledBuffer& operator=(const PooledBuffer&);
+
+public:
+    PooledBuffer(BufferPool& pool) :
+        _pool(pool),
+        _buffer(pool.acquire()) {
+    }
+
+    ~PooledBuffer() {
+        _pool.release(_buffer);
+    }
+
+    char* data() {
+        return _buffer;
+    }
+
+    size_t size() const {
+        return _pool.buffer_size();
+    }
+};
+
+#endif
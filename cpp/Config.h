@@ -1,9 +1,41 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <map>
+#include <string>
 
+
+/**
+ * The key/value settings of one config section, as handed to the
+ * workers and disk file managers. Values come back as C strings, ready
+ * for atoi/atof.
+ */
 class Config {
+
+private:
+    std::map<std::string, std::string> values;
+
+public:
+    Config() {
+    }
+
+    explicit Config(const std::map<std::string, std::string>& values) :
+        values(values) {
+    }
+
+    const char* get(const std::string& key,
+                    const char* default_value="") const {
+        const std::map<std::string, std::string>::const_iterator it =
+            values.find(key);
+        if (it == values.end()) {
+            return default_value;
+        }
+        return it->second.c_str();
+    }
+
+    void set(const std::string& key, const std::string& value) {
+        values[key] = value;
+    }
 };
 
 #endif
-
@@ -4,6 +4,8 @@
 #include <string>
 #include <map>
 
+#include "Config.h"
+
 
 class ConfigParser {
 
@@ -13,6 +15,11 @@ private:
 public:
     const std::string& get(const std::string& key,
                            const std::string& default_value) const;
+
+    // the same settings, for the workers and disk file managers
+    Config config() const {
+        return Config(values);
+    }
 };
 
 
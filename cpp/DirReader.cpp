@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+
+#include "DirReader.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+
+// layout of the records returned by the getdents64 system call
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static const int OPEN_FLAGS = O_RDONLY | O_DIRECTORY | O_NOATIME | O_CLOEXEC;
+
+
+DirReader::DirReader(int buffer_size) :
+    _fd(-1),
+    _buffer(NULL),
+    _buffer_size(buffer_size),
+    _buffer_used(0),
+    _buffer_pos(0),
+    _entry_type(DT_UNKNOWN) {
+    _buffer = (char*) ::malloc(_buffer_size);
+}
+
+DirReader::~DirReader() {
+    close();
+    ::free(_buffer);
+}
+
+bool DirReader::open(const string& path) {
+    return openat(AT_FDCWD, path.c_str());
+}
+
+bool DirReader::openat(int parent_fd, const char* name) {
+    close();
+
+    int fd = ::openat(parent_fd, name, OPEN_FLAGS);
+    if ((fd < 0) && (errno == EPERM)) {
+        // O_NOATIME is only permitted for the owner of the file
+        fd = ::openat(parent_fd, name, OPEN_FLAGS & ~O_NOATIME);
+    }
+
+    if (fd < 0) {
+        if ((errno == ENOTDIR) || (errno == ENOENT)) {
+            return false;
+        }
+        throw OSError(errno);
+    }
+
+    _fd = fd;
+    _buffer_used = 0;
+    _buffer_pos = 0;
+    return true;
+}
+
+const char* DirReader::next() {
+    if (_fd < 0) {
+        return NULL;
+    }
+
+    while (true) {
+        if (_buffer_pos >= _buffer_used) {
+            long rc = ::syscall(SYS_getdents64, _fd, _buffer, _buffer_size);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw OSError(errno);
+            }
+            if (rc == 0) {
+                return NULL;
+            }
+            _buffer_used = (int) rc;
+            _buffer_pos = 0;
+        }
+
+        struct linux_dirent64* entry =
+            (struct linux_dirent64*) (_buffer + _buffer_pos);
+        _buffer_pos += entry->d_reclen;
+
+        const char* name = entry->d_name;
+        if ((name[0] == '.') &&
+            ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0')))) {
+            continue;
+        }
+
+        _entry_type = entry->d_type;
+        return name;
+    }
+}
+
+bool DirReader::entry_is_not_dir() const {
+    // DT_UNKNOWN means the filesystem doesn't fill in d_type and DT_LNK
+    // may point at a directory; the caller has to find out by opening it
+    return (_entry_type != DT_DIR) &&
+           (_entry_type != DT_LNK) &&
+           (_entry_type != DT_UNKNOWN);
+}
+
+void DirReader::close() {
+    if (_fd > -1) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _buffer_used = 0;
+    _buffer_pos = 0;
+    _entry_type = DT_UNKNOWN;
+}
@@ -0,0 +1,84 @@
+#ifndef DIRREADER_H
+#define DIRREADER_H
+
+#include <string>
+
+
+/**
+ * Streaming directory reader built on openat/getdents64. Entries are
+ * decoded one at a time out of a buffer that is owned by the reader and
+ * reused for every directory it opens, so memory use does not depend on
+ * the number of entries in a directory.
+ */
+class DirReader {
+
+private:
+    int _fd;
+    char* _buffer;
+    int _buffer_size;
+    int _buffer_used;
+    int _buffer_pos;
+    unsigned char _entry_type;
+
+    // disallow copies
+    DirReader(const DirReader&);
+    DirReader& operator=(const DirReader&);
+
+
+public:
+    static const int DEFAULT_BUFFER_SIZE = 32768;
+
+
+    DirReader(int buffer_size=DEFAULT_BUFFER_SIZE);
+    ~DirReader();
+
+    // Both open methods return false if the path does not exist or is
+    // not a directory, and throw OSError for any other failure.
+    bool open(const std::string& path);
+    bool openat(int parent_fd, const char* name);
+
+    // Returns the next entry name (excluding "." and ".."), or NULL once
+    // the directory is exhausted. The pointer is only valid until the
+    // next call to next() or close().
+    const char* next();
+
+    // d_type of the entry most recently returned by next()
+    unsigned char entry_type() const {
+        return _entry_type;
+    }
+
+    // true if the most recent entry is known not to be a directory
+    bool entry_is_not_dir() const;
+
+    int fd() const {
+        return _fd;
+    }
+
+    bool is_open() const {
+        return _fd > -1;
+    }
+
+    void close();
+};
+
+
+// for scoped closing of a DirReader
+class DirReaderCloser {
+private:
+    DirReader& _reader;
+
+    DirReaderCloser();
+    DirReaderCloser(const DirReaderCloser&);
+    DirReaderCloser& operator=(const DirReaderCloser&);
+
+public:
+    DirReaderCloser(DirReader& reader) :
+        _reader(reader) {
+    }
+
+    ~DirReaderCloser() {
+        _reader.close();
+    }
+};
+
+#endif
@@ -3,11 +3,19 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "DiskFile.h"
+#include "DirReader.h"
 #include "DiskFileWriter.h"
+#include "HashPathEngine.h"
+#include "MD5Hash.h"
+#include "MetadataXattr.h"
 #include "OSUtils.h"
+#include "StrUtils.h"
 #include "SwiftUtils.h"
+#include "Time.h"
 #include "Timestamp.h"
 #include "Exceptions.h"
 #include "errno.h"
@@ -44,7 +52,11 @@ const string& DiskFile::obj() const {
     return this->_obj;
 }
 
-void DiskFile::content_length() const {
+long DiskFile::content_length() const {
+    if (this->_metadata.empty()) {
+        throw DiskFileNotOpen();
+    }
+    return this->_content_length;
 }
 
 Date DiskFile::timestamp() {
@@ -60,28 +72,42 @@ void DiskFile::fragments() {
 }
 
 DiskFile* DiskFile::open() {
+    this->_raise(this->try_open());
+    return this;
+}
+
+/**
+ * Open the diskfile, returning why not instead of throwing when the
+ * object is missing, deleted, expired or quarantined. Exceptions are
+ * left for real failures such as an unreadable directory.
+ */
+DiskFileStatus DiskFile::try_open() {
     vector<string> files;
     // First figure out if the data directory exists
+    DirReader dir_reader(HASH_DIR_BUFFER_SIZE);
     try {
-        files = OSUtils::listdir(this->_datadir);
-    } catch (const OSError& err) {
-        if (err._errno == ENOTDIR) {
+        if (dir_reader.open(this->_datadir)) {
+            const char* name;
+            while ((name = dir_reader.next()) != NULL) {
+                files.push_back(name);
+            }
+        } else if (errno == ENOTDIR) {
             // If there's a file here instead of a directory, quarantine
             // it; something's gone wrong somewhere.
-            throw this->_quarantine(
+            return this->_quarantine_file(
                 // hack: quarantine_renamer actually renames the directory
                 // enclosing the filename you give it, but here we just
                 // want this one file and not its parent.
                 OSUtils::path_join(this->_datadir, "made-up-filename"),
                 string("Expected directory, found file at ") + this->_datadir);
-        } else if (err._errno != ENOENT) {
-            throw DiskFileError(
-                string("Error listing directory ") +
-                    this->_datadir + ": " +
-                    err.toString());
         }
-        // The data directory does not exist, so the object cannot exist.
-        file.clear();
+        // otherwise the data directory does not exist, so the object
+        // cannot exist
+    } catch (const OSError& err) {
+        throw DiskFileError(
+            string("Error listing directory ") +
+                this->_datadir + ": " +
+                err.toString());
     }
 
     // gather info about the valid files to use to open the DiskFile
@@ -89,11 +115,31 @@ DiskFile* DiskFile::open() {
 
     this->_data_file = file_info.get("data_file");
     if (this->_data_file.empty()) {
-        throw this->_construct_exception_from_ts_file(file_info);
+        return this->_status_from_ts_file(file_info.get("ts_file"));
     }
-    this->_fp = this->_construct_from_data_file(file_info);
     // This method must populate the internal _metadata attribute.
-    return this;
+    return this->_construct_from_data_file(this->_data_file,
+                                           file_info.get("meta_file"));
+}
+
+/**
+ * Throw the exception open() has always thrown for status.
+ */
+void DiskFile::_raise(const DiskFileStatus& status) {
+    switch (status.code) {
+    case DiskFileStatus::OK:
+        return;
+    case DiskFileStatus::DELETED:
+        throw DiskFileDeleted();
+    case DiskFileStatus::EXPIRED:
+        throw DiskFileExpired();
+    case DiskFileStatus::QUARANTINED:
+        throw DiskFileQuarantined(status.message);
+    case DiskFileStatus::COLLISION:
+        throw DiskFileCollision();
+    default:
+        throw DiskFileNotExist();
+    }
 }
 
 void DiskFile::close() {
@@ -127,220 +173,280 @@ void DiskFile::__exit__() {
 
 std::exception* DiskFile::_quarantine(const string& data_file,
                                       const string& msg) {
+    this->_quarantine_file(data_file, msg);
+    return new DiskFileQuarantined(msg);
+}
+
+DiskFileStatus DiskFile::_quarantine_file(const string& data_file,
+                                          const string& msg) {
     this->_quarantined_dir = this->_threadpool.run_in_thread(
         this->manager.quarantine_renamer,
         this->_device_path,
-        this->_data_file);
+        data_file);
     this->_logger->warning(string("Quarantined object ") +
-                           this->_data_file +
+                           data_file +
                            ": " +
                            msg);
     this->_logger->increment("quarantines");
-    this->_quarantine_hook(msg);
+    return DiskFileStatus(DiskFileStatus::QUARANTINED, msg);
 }
 
-std::exception DiskFile::_construct_exception_from_ts_file(const string& ts_file) {
+DiskFileStatus DiskFile::_status_from_ts_file(const string& ts_file) {
     if (ts_file.empty()) {
-        return DiskFileNotExist();
-    } else {
-        try {
-            map<string,string> metadata =
-                this->_failsafe_read_metadata(ts_file, ts_file);
-            // All well and good that we have found a tombstone file, but
-            // we don't have a data file so we are just going to raise an
-            // exception that we could not find the object, providing the
-            // tombstone's timestamp.
-            return DiskFileDeleted(metadata);
-        } catch (const DiskFileQuarantined& dfq) {
-            // If the tombstone's corrupted, quarantine it and pretend it
-            // wasn't there
-            return DiskFileNotExist();
-        }
+        return DiskFileStatus(DiskFileStatus::NOT_EXIST);
+    }
+
+    Metadata metadata;
+    DiskFileStatus status =
+        this->_failsafe_read_metadata(ts_file, ts_file, metadata);
+    if (!status.ok()) {
+        // If the tombstone's corrupted, quarantine it and pretend it
+        // wasn't there
+        return DiskFileStatus(DiskFileStatus::NOT_EXIST);
     }
+    // All well and good that we have found a tombstone file, but we don't
+    // have a data file so the object is deleted as of the tombstone's
+    // timestamp.
+    status.code = DiskFileStatus::DELETED;
+    status.timestamp = metadata.get(Metadata::X_TIMESTAMP);
+    return status;
 }
 
-void DiskFile::_verify_name_matches_hash(const string& data_file) {
+DiskFileStatus DiskFile::_verify_name_matches_hash(const string& data_file) {
     const string hash_from_fs = OSUtils::path_basename(this->_datadir);
-    const string hash_from_name =
-        SwiftUtils::hash_path(StrUtils::lstrip(this->_name, "/"),
-                              "",
-                              "",
-                              false);
-    if (hash_from_fs != hash_from_name) {
-        throw this->_quarantine(
+
+    // the name is already "/a/c/o"; hash it in place without the slash
+    const size_t start = this->_name.find_first_not_of('/');
+    HashPathName name;
+    if (start != string::npos) {
+        name.account = this->_name.data() + start;
+        name.account_length = this->_name.length() - start;
+    }
+    unsigned char raw[MD5Hash::DIGEST_SIZE];
+    char hash_from_name[MD5Hash::DIGEST_SIZE * 2];
+    SwiftUtils::hash_path_engine().digest(name, raw);
+    MD5Hash::to_hex(raw, hash_from_name);
+
+    if (hash_from_fs.length() != sizeof(hash_from_name) ||
+        memcmp(hash_from_fs.data(), hash_from_name, sizeof(hash_from_name)) != 0) {
+        return this->_quarantine_file(
             data_file,
             "Hash of name in metadata does not match directory name");
     }
+    return DiskFileStatus();
 }
 
-int DiskFile::_verify_data_file(const string& data_file,
-                                FILE* fp) {
+void DiskFile::_verify_data_file(const string& data_file, FILE* fp) {
+    this->_raise(this->_check_data_file(data_file, fp));
+}
 
-    map<string,string>::it = this->_metadata.find("name");
-    if (it == this->_metadata.end()) {
-        throw this->_quarantine(data_file, "missing name metadata");
+// whole value must be a (possibly negative) decimal integer
+static bool parse_long(const char* value, size_t length, long& result) {
+    size_t i = 0;
+    bool negative = false;
+    if (length > 0 && value[0] == '-') {
+        negative = true;
+        i = 1;
+    }
+    if (i == length) {
+        return false;
     }
 
-    const string& mname = *it;
+    long parsed = 0;
+    for (; i < length; ++i) {
+        if (value[i] < '0' || value[i] > '9') {
+            return false;
+        }
+        parsed = parsed * 10 + (value[i] - '0');
+    }
+    result = negative ? -parsed : parsed;
+    return true;
+}
+
+/**
+ * Check the metadata read by _construct_from_data_file against the name
+ * asked for, the clock and the data file itself.
+ */
+DiskFileStatus DiskFile::_check_data_file(const string& data_file,
+                                          FILE* fp) {
+    const char* value;
+    size_t length;
+
+    if (!this->_metadata.get(Metadata::NAME, value, length)) {
+        return this->_quarantine_file(data_file, "missing name metadata");
+    }
 
-    if (mname != this->_name) {
+    if (this->_name.compare(0, string::npos, value, length) != 0) {
         this->_logger->error(
             string("Client path ") + this->_name + " does not match " +
-             "path stored in object metadata " + mname);
-        throw DiskFileCollision("Client path does not match path "
-                                "stored in object metadata");
+             "path stored in object metadata " + string(value, length));
+        return DiskFileStatus(DiskFileStatus::COLLISION,
+                              "Client path does not match path "
+                              "stored in object metadata");
     }
 
-    it = this->_metadata.find("X-Delete-At");
-    if (it != this->_metadata.end()) {
-        const string& delete_at_str = (*it).second;
-        try {
-            int x_delete_at = Integer::parseInt(delete_at_str);
-            if (x_delete_at <= time.time()) {
-                throw DiskFileExpired(this->_metadata);
-            }
-        } catch (const IllegalValueError& ive) {
+    if (this->_metadata.get(Metadata::X_DELETE_AT, value, length)) {
+        long x_delete_at;
+        if (!parse_long(value, length, x_delete_at)) {
             // Quarantine, the x-delete-at key is present but not an
             // integer.
-            throw this->_quarantine(
-                data_file, "bad metadata x-delete-at value %s" % (
-                    this->_metadata["X-Delete-At"]))
+            return this->_quarantine_file(
+                data_file, string("bad metadata x-delete-at value ") +
+                           string(value, length));
+        }
+        if (x_delete_at <= Time::time()) {
+            return DiskFileStatus(DiskFileStatus::EXPIRED);
         }
     }
 
-    it = this->_metadata.find("Content-Length");
-    if (it == this->_metadata.end()) {
-        throw this->_quarantine(data_file,
-                                "missing content-length in metadata");
+    if (!this->_metadata.get(Metadata::CONTENT_LENGTH, value, length)) {
+        return this->_quarantine_file(data_file,
+                                      "missing content-length in metadata");
     }
 
-    int metadata_size = 0;
-
-    try {
-        metadata_size = Integer::parseInt((*it).second);
-    } catch (const IllegalValueError& ive) {
+    long metadata_size;
+    if (!parse_long(value, length, metadata_size)) {
         // Quarantine, the content-length key is present but not an
         // integer.
-        throw this->_quarantine(
+        return this->_quarantine_file(
             data_file, string("bad metadata content-length value ") +
-                       (*it).second);
+                       string(value, length));
     }
 
-    int fd = ::fileno(fp);
     struct stat statbuf;
-
-    int rc = ::fstat(fd, &statbuf);
-    if (rc != 0) {
+    if (::fstat(::fileno(fp), &statbuf) != 0) {
         // Quarantine, we can't successfully stat the file.
-        throw this->_quarantine(data_file,
-                                string("not stat-able: ") +
-                                err.toString());
+        return this->_quarantine_file(data_file,
+                                      string("not stat-able: ") +
+                                      strerror(errno));
     }
 
-    const int obj_size = statbuf.st_size;
-
-    if (obj_size != metadata_size) {
-        throw this->_quarantine(
-            data_file, string("metadata content-length " +
-                              metadata_size +
-                              "  does not match actual object size " +
-                              statbuf.st_size));
+    if (statbuf.st_size != metadata_size) {
+        return this->_quarantine_file(
+            data_file, string("metadata content-length ") +
+                       StrUtils::toString(metadata_size) +
+                       " does not match actual object size " +
+                       StrUtils::toString((long) statbuf.st_size));
     }
 
-    this->_content_length = obj_size;
-    return obj_size;
+    this->_content_length = statbuf.st_size;
+    return DiskFileStatus();
+}
+
+DiskFileStatus DiskFile::_failsafe_read_metadata(
+        const string& source,
+        const string& quarantine_filename,
+        Metadata& metadata) {
+    return this->_failsafe_read_metadata(NULL, source, quarantine_filename,
+                                         metadata);
+}
+
+DiskFileStatus DiskFile::_failsafe_read_metadata(
+        FILE* fp,
+        const string& quarantine_filename,
+        Metadata& metadata) {
+    return this->_failsafe_read_metadata(fp, quarantine_filename,
+                                         quarantine_filename, metadata);
 }
 
-map<string,string> DiskFile::_failsafe_read_metadata(const string& source,
-                                       const string& quarantine_filename) {
+DiskFileStatus DiskFile::_failsafe_read_metadata(
+        FILE* fp,
+        const string& source,
+        const string& quarantine_filename,
+        Metadata& metadata) {
+    metadata.clear();
     try {
-        return read_metadata(source);
+        if (fp != NULL) {
+            MetadataXattr::read(fileno(fp), metadata);
+        } else {
+            MetadataXattr::read(source, metadata);
+        }
     } catch (const DiskFileXattrNotSupported& dfxns) {
         throw dfxns;
     } catch (const DiskFileNotExist& dfne) {
-        throw dfne;
+        return DiskFileStatus(DiskFileStatus::NOT_EXIST);
+    } catch (const DiskFileQuarantined& dfq) {
+        return this->_quarantine_file(
+            quarantine_filename,
+            string("Exception reading metadata: ") + dfq.message());
     } catch (const exception& err) {
-        throw this->_quarantine(
+        return this->_quarantine_file(
             quarantine_filename,
             string("Exception reading metadata: ") + err.what());
     }
+    return DiskFileStatus();
 }
 
-FILE* DiskFile::_construct_from_data_file(const string& data_file,
-                                          const string& meta_file) {
-    FILE* fp = ::fopen(data_file, "rb");
-    this->_datafile_metadata = this->_failsafe_read_metadata(fp, data_file);
-    this->_metadata.clear();
-    if (meta_file.length() > 0) {
-        this->_metafile_metadata = this->_failsafe_read_metadata(
-            meta_file, meta_file);
-        map<string,string> sys_metadata;
-        map<string,string>::const_iterator it =
-            this->_datafile_metadata.begin();
-        const map<string,string>::const_iterator itEnd =
-            this->_datafile_metadata.end();
-        for (; it != itEnd; ++it) {
-            const string& key = (*it).first;
-            bool add_pair = false;
-
-            // if key.lower in DATAFILE_SYSTEM_META
-            const string lower_key = StrUtils::lower(key);
-            if (DATAFILE_SYSTEM_META.find(lower_key) !=
-                DATAFILE_SYSTEM_META.end()) {
-                add_pair = true;
-            } else {
-                if (is_sys_meta("object", key)) {
-                    add_pair = true;
-                }
-            }
-
-            if (add_pair) {
-                sys_metadata.push_back(key, (*it).second);
-            }
+DiskFileStatus DiskFile::_construct_from_data_file(const string& data_file,
+                                                   const string& meta_file) {
+    FILE* fp = ::fopen(data_file.c_str(), "rb");
+    if (fp == NULL) {
+        if (errno == ENOENT) {
+            // removed since the directory was listed
+            return DiskFileStatus(DiskFileStatus::NOT_EXIST);
         }
+        throw OSError(errno);
+    }
 
+    DiskFileStatus status = this->_failsafe_read_metadata(
+        fp, data_file, this->_datafile_metadata);
+    this->_metadata.clear();
+    if (status.ok() && meta_file.length() > 0) {
+        status = this->_failsafe_read_metadata(meta_file, meta_file,
+                                               this->_metafile_metadata);
+        // the .meta file replaces all user metadata; only the datafile's
+        // system metadata (flagged as it was read) is kept
         this->_metadata.update(this->_metafile_metadata);
-        this->_metadata.update(sys_metadata);
+        this->_metadata.update_system(this->_datafile_metadata);
         // diskfile writer added 'name' to metafile, so remove it here
-        this->_metafile_metadata.pop("name", None);
+        this->_metafile_metadata.erase(Metadata::NAME);
     } else {
         this->_metadata.update(this->_datafile_metadata);
     }
 
-    if (this->_name.empty()) {
+    if (status.ok() && this->_name.empty()) {
         // If we don't know our name, we were just given a hash dir at
         // instantiation, so we'd better validate that the name hashes back
         // to us
-        this->_name = this->_metadata["name"];
-        this->_verify_name_matches_hash(data_file);
+        this->_name = this->_metadata.get(Metadata::NAME);
+        status = this->_verify_name_matches_hash(data_file);
+    }
+
+    if (status.ok()) {
+        status = this->_check_data_file(data_file, fp);
+    }
+    if (!status.ok()) {
+        ::fclose(fp);
+        this->_metadata.clear();
+        return status;
     }
 
-    this->_verify_data_file(data_file, fp);
-    return fp;
+    this->_fp = fp;
+    return status;
 }
 
-map<string,string>& DiskFile::get_metafile_metadata() {
+Metadata& DiskFile::get_metafile_metadata() {
     if (this->_metadata.empty()) {
         throw DiskFileNotOpen();
     }
     return this->_metafile_metadata;
 }
 
-map<string,string>& DiskFile::get_datafile_metadata() {
+Metadata& DiskFile::get_datafile_metadata() {
     if (this->_datafile_metadata.empty()) {
         throw DiskFileNotOpen();
     }
     return this->_datafile_metadata;
 }
 
-map<string,string>& DiskFile::get_metadata() {
+Metadata& DiskFile::get_metadata() {
     if (this->_metadata.empty()) {
         throw DiskFileNotOpen();
     }
     return this->_metadata;
 }
 
-map<string,string>& DiskFile::read_metadata() {
+Metadata& DiskFile::read_metadata() {
     DiskFileCloser closer(this->open());
     return this->get_metadata();
 }
@@ -7,7 +7,9 @@
 #include <exception>
 
 #include "Date.h"
+#include "DiskFileStatus.h"
 #include "Logger.h"
+#include "Metadata.h"
 #include "QuarantineHook.h"
 #include "StoragePolicy.h"
 #include "ThreadPool.h"
@@ -49,11 +51,15 @@ private:
     std::string _device_path;
     int _disk_chunk_size;
     int _bytes_per_sync;
-    std::map<std::string, std::string> _metadata;
-    std::map<std::string, std::string> _datafile_metadata;
-    std::map<std::string, std::string> _metafile_metadata;
+    long _content_length;
+    Metadata _metadata;
+    Metadata _datafile_metadata;
+    Metadata _metafile_metadata;
     FILE* _fp;
 
+    // hash dirs hold a handful of files
+    static const int HASH_DIR_BUFFER_SIZE = 4096;
+
 
 public:
     DiskFile(DiskFileManager* mgr,
@@ -68,13 +74,17 @@ public:
              bool use_splice=false,
              int pipe_size=-1);
 
+    // deleted through this class by whoever took it from the manager
+    virtual ~DiskFile() {
+    }
+
     DiskFileManager* manager();
 
     const std::string& account() const;
     const std::string& container() const;
     const std::string& obj() const;
 
-    void content_length() const;
+    long content_length() const;
 
     Date timestamp();
     Date data_timestamp();
@@ -92,6 +102,7 @@ public:
     */
 
     DiskFile* open();
+    DiskFileStatus try_open();
     void close();
 
     void __enter__();
@@ -101,26 +112,42 @@ public:
 
     std::exception* _quarantine(const std::string& data_file,
                                 const std::string& msg);
+    DiskFileStatus _quarantine_file(const std::string& data_file,
+                                    const std::string& msg);
+    void _raise(const DiskFileStatus& status);
 
     virtual void _get_ondisk_files(std::vector<std::string>& files) = 0;
 
-    std::exception _construct_exception_from_ts_file(const std::string& ts_file);
+    DiskFileStatus _status_from_ts_file(const std::string& ts_file);
 
-    void _verify_name_matches_hash(const std::string& data_file);
+    DiskFileStatus _verify_name_matches_hash(const std::string& data_file);
     void _verify_data_file(const std::string& data_file,
                            FILE* fp);
-
-
-    std::map<std::string, std::string> _failsafe_read_metadata(const std::string& source,
-                                 const std::string& quarantine_filename);
-
-    void _construct_from_data_file(const std::string& data_file,
-                                   const std::string& meta_file);
-
-    std::map<std::string, std::string>& get_metafile_metadata();
-    std::map<std::string, std::string>& get_datafile_metadata();
-    std::map<std::string, std::string>& get_metadata();
-    std::map<std::string, std::string>& read_metadata();
+    DiskFileStatus _check_data_file(const std::string& data_file,
+                                    FILE* fp);
+
+
+    DiskFileStatus _failsafe_read_metadata(
+            const std::string& source,
+            const std::string& quarantine_filename,
+            Metadata& metadata);
+    DiskFileStatus _failsafe_read_metadata(
+            FILE* fp,
+            const std::string& quarantine_filename,
+            Metadata& metadata);
+    DiskFileStatus _failsafe_read_metadata(
+            FILE* fp,
+            const std::string& source,
+            const std::string& quarantine_filename,
+            Metadata& metadata);
+
+    DiskFileStatus _construct_from_data_file(const std::string& data_file,
+                                             const std::string& meta_file);
+
+    Metadata& get_metafile_metadata();
+    Metadata& get_datafile_metadata();
+    Metadata& get_metadata();
+    Metadata& read_metadata();
 
     DiskFileReader* reader(bool keep_cache=false,
                           QuarantineHook* quarantine_hook=NULL);
@@ -1,7 +1,16 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <set>
 #include <algorithm>
 
 #include "DiskFileManager.h"
+#include "AuditCheckpoint.h"
+#include "AuditPartitionClassifier.h"
+#include "DirReader.h"
 #include "ObjectAuditHook.h"
 #include "OSUtils.h"
 #include "PolicyError.h"
@@ -16,6 +25,110 @@ using namespace std;
 static const std::string DATADIR_BASE = "objects";
 
 
+static bool parse_partition(const char* name, long& partition) {
+    char* end;
+    if (!isdigit((unsigned char) name[0])) {
+        return false;
+    }
+    partition = strtol(name, &end, 10);
+    return *end == '\0';
+}
+
+static bool parse_suffix(const char* name, int& suffix) {
+    char* end;
+    if (!isxdigit((unsigned char) name[0]) || strlen(name) != 3) {
+        return false;
+    }
+    suffix = (int) strtol(name, &end, 16);
+    return *end == '\0';
+}
+
+/**
+ * Count the hash dirs of a partition that is skipped, and the bytes of
+ * their .data files, to report the reads saved. This lists the hash dirs
+ * (as auditing them would) but reads no object data; still, it is only
+ * done when the classifier is set to measure_skipped.
+ */
+static void measure_partition(int datadir_fd,
+                              const string& partition,
+                              DirReader& suffix_reader,
+                              DirReader& hash_reader,
+                              DirReader& file_reader,
+                              long& objects,
+                              long& bytes) {
+    if (!suffix_reader.openat(datadir_fd, partition.c_str())) {
+        return;
+    }
+    DirReaderCloser suffix_closer(suffix_reader);
+
+    const char* suffix_name;
+    while ((suffix_name = suffix_reader.next()) != NULL) {
+        if (suffix_reader.entry_is_not_dir() ||
+            !hash_reader.openat(suffix_reader.fd(), suffix_name)) {
+            continue;
+        }
+        DirReaderCloser hash_closer(hash_reader);
+
+        const char* hsh;
+        while ((hsh = hash_reader.next()) != NULL) {
+            if (!file_reader.openat(hash_reader.fd(), hsh)) {
+                continue;
+            }
+            DirReaderCloser file_closer(file_reader);
+            ++objects;
+
+            const char* name;
+            while ((name = file_reader.next()) != NULL) {
+                const size_t length = strlen(name);
+                struct stat st;
+                if (length > 5 && strcmp(name + length - 5, ".data") == 0 &&
+                    ::fstatat(file_reader.fd(), name, &st, 0) == 0) {
+                    bytes += st.st_size;
+                }
+            }
+        }
+    }
+}
+
+// a checkpoint that can't be written only costs a longer sweep after a
+// restart, so it is reported and the sweep goes on
+static void checkpoint_failed(Logger* logger,
+                              const string& device,
+                              const string& datadir) {
+    const int err = errno;
+    if (logger != NULL) {
+        logger->warning(string("Unable to save audit checkpoint of ") +
+                        device + "/" + datadir + ": " + strerror(err));
+    }
+}
+
+
+bool DiskFileManager::_verify_ondisk_files(const OndiskFiles& results) const {
+    const bool have_data = results.data_file() != NULL;
+    const bool have_meta = results.meta_file() != NULL;
+    const bool have_ts = results.ts_file() != NULL;
+
+    if (have_ts) {
+        return !have_data && !have_meta;
+    }
+    return have_data || !have_meta;
+}
+
+void DiskFileManager::_hash_suffix(const string& path,
+                                   int reclaim_age,
+                                   map<int, string>& hashes) {
+    map<int, MD5Hash> md5s;
+    this->_hash_suffix_dir(path, reclaim_age, md5s);
+
+    hashes.clear();
+    const map<int, MD5Hash>::const_iterator itEnd = md5s.end();
+    map<int, MD5Hash>::const_iterator it = md5s.begin();
+    for (; it != itEnd; ++it) {
+        hashes[it->first] = it->second.hexdigest();
+    }
+}
+
+
 /**
     Given a devices path (e.g. "/srv/node"), yield an AuditLocation for all
     objects stored under that directory if device_dirs isn't set.  If
@@ -29,6 +142,18 @@ static const std::string DATADIR_BASE = "objects";
                         on devices
     :param logger: a logger object
     :device_dirs: a list of directories under devices to traverse
+    If options.checkpoint_interval is set, the sweep of each device and
+    policy resumes from its AuditCheckpoint and records progress there.
+    If options.partition_lo/partition_hi are set, only partitions in that
+    range are audited, and if options.partitions is set, only those (the
+    datadirs aren't listed then). Such partial sweeps don't use this
+    checkpoint; the MT and MP drivers keep one per device for their
+    ranges (see AuditWorkQueue).
+    If options.partition_classifier is set, partitions the ring doesn't
+    assign to the device (handoffs) are audited after all of its primaries
+    or not at all. The checkpoint then only follows the primaries: a sweep
+    resumed part way through leaves out the handoffs below its cursor,
+    which the next sweep audits if they are still here.
 */
 void DiskFileManager::object_audit_location_generator(const AuditorOptions& options,
                                                       Logger* logger,
@@ -60,6 +185,23 @@ void DiskFileManager::object_audit_location_generator(const AuditorOptions& opti
         audit_device_dirs.end();
     vector<string>::iterator itDevices = audit_device_dirs.begin();
 
+    DirReader obj_dir_reader(4096);
+    DirReader part_reader;
+    DirReader suffix_reader;
+    DirReader hash_reader;
+    DirReader file_reader(4096);
+    AuditLocation location;
+    vector<long> partitions;
+    vector<long> primaries;
+    vector<long> handoffs;
+    vector<int> suffixes;
+    const string auditor_type = options.zero_byte_fps ? "ZBF" : "ALL";
+    const bool listed = !options.partitions.empty();
+    const bool ranged = listed ||
+                        options.partition_lo > -1 ||
+                        options.partition_hi > -1;
+    const int checkpoint_interval = ranged ? 0 : options.checkpoint_interval;
+
     for (; itDevices != itDevicesEnd; ++itDevices) {
         const string& device = *itDevices;
         if (mount_check &&
@@ -71,14 +213,20 @@ void DiskFileManager::object_audit_location_generator(const AuditorOptions& opti
             continue;
         }
 
-        // loop through object dirs for all policies
-        vector<string> obj_dirs =
-            OSUtils::listdir(OSUtils::path_join(devices, device));
-        const vector<string>::const_iterator itObjDirEnd = obj_dirs.end();
-        vector<string>::iterator itObjDir = obj_dirs.begin();
+        // Each level of the walk has its own reader whose buffer is
+        // reused for every directory visited at that level; nothing below
+        // the device list is ever materialized.
+        string dev_path = OSUtils::path_join(devices, device);
+        if (!obj_dir_reader.open(dev_path)) {
+            continue;
+        }
+        DirReaderCloser obj_dir_closer(obj_dir_reader);
+        location.device = device;
 
-        for (; itObjDir != itObjDirEnd; ++itObjDir) {
-            const string& dir_ = *itObjDir;
+        // loop through object dirs for all policies
+        const char* dir_name;
+        while ((dir_name = obj_dir_reader.next()) != NULL) {
+            const string dir_(dir_name);
             if (!StrUtils::startswith(dir_, DATADIR_BASE)) {
                 continue;
             }
@@ -96,47 +244,133 @@ void DiskFileManager::object_audit_location_generator(const AuditorOptions& opti
                 continue;
             }
 
-            string datadir_path = OSUtils::path_join(devices, device, dir_);
-            vector<string> partitions = SwiftUtils::listdir(datadir_path);
-            const vector<string>::const_iterator itPartEnd = partitions.end();
-            vector<string>::iterator itPart = partitions.begin();
+            if (!part_reader.openat(obj_dir_reader.fd(), dir_name)) {
+                continue;
+            }
+            DirReaderCloser part_closer(part_reader);
+            location.policy = policy;
+
+            // Partitions and suffixes are swept in sorted order so that the
+            // checkpoint can describe everything audited so far with a
+            // single cursor. Only their numbers are kept in memory; hash
+            // dirs are still streamed.
+            AuditCheckpoint checkpoint(part_reader.fd(), auditor_type);
+            if (checkpoint_interval > 0 && checkpoint.load()) {
+                if (logger != NULL) {
+                    logger->info(string("Resuming audit of ") + device +
+                                 "/" + dir_ + " at partition " +
+                                 StrUtils::toString(checkpoint.partition()));
+                }
+            }
+
+            partitions.clear();
+            if (listed) {
+                // a range of a few partitions out of many; one not in
+                // this datadir just fails to open below
+                partitions = options.partitions;
+            } else {
+                const char* part_name;
+                while ((part_name = part_reader.next()) != NULL) {
+                    long part_num;
+                    if (part_reader.entry_is_not_dir() ||
+                        !parse_partition(part_name, part_num) ||
+                        (options.partition_lo > -1 &&
+                         part_num < options.partition_lo) ||
+                        (options.partition_hi > -1 &&
+                         part_num >= options.partition_hi) ||
+                        checkpoint.partition_done(part_num)) {
+                        continue;
+                    }
+                    partitions.push_back(part_num);
+                }
+                std::sort(partitions.begin(), partitions.end());
+            }
+
+            // primaries go first; handoffs, if audited at all, follow them
+            // from handoffs_start on
+            bool classified = false;
+            size_t handoffs_start = partitions.size();
+            long handoffs_skipped = 0;
+            if (options.partition_classifier != NULL &&
+                options.partition_classifier->classify(policy, device,
+                                                       partitions,
+                                                       primaries,
+                                                       handoffs)) {
+                classified = true;
+                partitions.swap(primaries);
+                handoffs_start = partitions.size();
+                if (options.partition_classifier->handoff_mode() ==
+                        AuditPartitionClassifier::SKIP) {
+                    handoffs_skipped = handoffs.size();
+                } else {
+                    partitions.insert(partitions.end(),
+                                      handoffs.begin(), handoffs.end());
+                }
+            }
+            // indexed by whether the partition is a handoff
+            long partitions_audited[2] = {0, 0};
+            long objects_audited[2] = {0, 0};
+            // handoffs moved off the device before their turn came
+            long handoffs_gone = 0;
+
+            string datadir_path = OSUtils::path_join(dev_path, dir_);
+            const vector<long>::const_iterator itPartEnd = partitions.end();
+            const vector<long>::const_iterator itHandoffs =
+                partitions.begin() + handoffs_start;
+            vector<long>::const_iterator itPart = partitions.begin();
 
             for (; itPart != itPartEnd; ++itPart) {
-                const string& partition = *itPart;
-                string part_path = OSUtils::path_join(datadir_path, partition);
-                vector<string> suffixes;
-                try {
-                    suffixes = SwiftUtils::listdir(part_path);
-                } catch (const OSError& e) {
-                    if (e._errno != ENOTDIR) {
-                        throw e;
+                const long part_num = *itPart;
+                const int handoff = itPart >= itHandoffs ? 1 : 0;
+                location.partition = StrUtils::toString(part_num);
+                if (!suffix_reader.openat(part_reader.fd(),
+                                          location.partition.c_str())) {
+                    // a listed range has the partitions of every policy,
+                    // so one missing here may never have been here
+                    if (handoff && !listed) {
+                        ++handoffs_gone;
                     }
                     continue;
                 }
+                DirReaderCloser suffix_closer(suffix_reader);
+                ++partitions_audited[handoff];
 
-                const vector<string>::const_iterator itSuffEnd = suffixes.end();
-                vector<string>::iterator itSuff = suffixes.begin();
+                suffixes.clear();
+                const char* suffix_name;
+                while ((suffix_name = suffix_reader.next()) != NULL) {
+                    int suffix_num;
+                    if (suffix_reader.entry_is_not_dir() ||
+                        !parse_suffix(suffix_name, suffix_num) ||
+                        checkpoint.suffix_done(part_num, suffix_num)) {
+                        continue;
+                    }
+                    suffixes.push_back(suffix_num);
+                }
+                std::sort(suffixes.begin(), suffixes.end());
+
+                string part_path = OSUtils::path_join(datadir_path,
+                                                      location.partition);
+                const vector<int>::const_iterator itSuffEnd = suffixes.end();
+                vector<int>::const_iterator itSuff = suffixes.begin();
 
                 for (; itSuff != itSuffEnd; ++itSuff) {
-                    const string& asuffix = *itSuff;
-                    string suff_path = OSUtils::path_join(part_path, asuffix);
-                    vector<string> hashes;
-                    try {
-                        hashes = OSUtils::listdir(suff_path);
-                    } catch (const OSError& e) {
-                        if (e._errno != ENOTDIR) {
-                            throw e;
-                        }
+                    char asuffix[4];
+                    snprintf(asuffix, sizeof(asuffix), "%03x", *itSuff);
+                    if (!hash_reader.openat(suffix_reader.fd(), asuffix)) {
                         continue;
                     }
+                    DirReaderCloser hash_closer(hash_reader);
 
-                    const vector<string>::const_iterator itHashEnd = hashes.end();
-                    vector<string>::iterator itHash = hashes.begin();
+                    string suff_path = OSUtils::path_join(part_path, asuffix);
+                    suff_path += '/';
+                    const char* hsh;
 
-                    for (; itHash != itHashEnd; ++itHash) {
-                        const string& hsh = *itHash;
-                        string hsh_path = OSUtils::path_join(suff_path, hsh);
-                        AuditLocation location(hsh_path, device, partition, policy);
+                    while ((hsh = hash_reader.next()) != NULL) {
+                        // reuse the location's buffers rather than building
+                        // a new AuditLocation for every hash dir
+                        location.path = suff_path;
+                        location.path += hsh;
+                        ++objects_audited[handoff];
 
                         // In python this is implemented as a generator (yield).
                         // For c++ use object audit hook
@@ -145,8 +379,85 @@ void DiskFileManager::object_audit_location_generator(const AuditorOptions& opti
                         //                    policy);
 
                     }  // for each hash
+
+                    if (!handoff &&
+                        !checkpoint.update(part_num, *itSuff,
+                                           checkpoint_interval)) {
+                        checkpoint_failed(logger, device, dir_);
+                    }
                 }  // for each suffix
+
+                if (!handoff &&
+                    !checkpoint.update(part_num,
+                                       AuditCheckpoint::ALL_SUFFIXES,
+                                       checkpoint_interval)) {
+                    checkpoint_failed(logger, device, dir_);
+                }
             }  // for each partition
+
+            if (classified && logger != NULL) {
+                const bool measured =
+                    options.partition_classifier->measure_skipped();
+                long objects_skipped = 0;
+                long bytes_skipped = 0;
+                if (measured && handoffs_skipped > 0) {
+                    const vector<long>::const_iterator itSkippedEnd =
+                        handoffs.end();
+                    vector<long>::const_iterator itSkipped =
+                        handoffs.begin();
+                    for (; itSkipped != itSkippedEnd; ++itSkipped) {
+                        measure_partition(part_reader.fd(),
+                                          StrUtils::toString(*itSkipped),
+                                          suffix_reader, hash_reader,
+                                          file_reader,
+                                          objects_skipped, bytes_skipped);
+                    }
+                }
+
+                logger->update_stats("primary_partitions_audited",
+                                     partitions_audited[0]);
+                logger->update_stats("primary_objects_audited",
+                                     objects_audited[0]);
+                logger->update_stats("handoff_partitions_audited",
+                                     partitions_audited[1]);
+                logger->update_stats("handoff_objects_audited",
+                                     objects_audited[1]);
+                logger->update_stats("handoff_partitions_skipped",
+                                     handoffs_skipped);
+                if (measured) {
+                    logger->update_stats("handoff_objects_skipped",
+                                         objects_skipped);
+                    logger->update_stats("handoff_bytes_skipped",
+                                         bytes_skipped);
+                }
+                logger->update_stats("handoff_partitions_gone",
+                                     handoffs_gone);
+                logger->info(string("Audited ") + device + "/" + dir_ +
+                             ": " +
+                             StrUtils::toString(partitions_audited[0]) +
+                             " primary partitions (" +
+                             StrUtils::toString(objects_audited[0]) +
+                             " objects), " +
+                             StrUtils::toString(partitions_audited[1]) +
+                             " handoff partitions (" +
+                             StrUtils::toString(objects_audited[1]) +
+                             " objects); not read: " +
+                             StrUtils::toString(handoffs_skipped) +
+                             " handoff partitions skipped" +
+                             (measured ?
+                              " (" + StrUtils::toString(objects_skipped) +
+                              " objects, " +
+                              StrUtils::toString(bytes_skipped) +
+                              " bytes), " : string(", ")) +
+                             StrUtils::toString(handoffs_gone) +
+                             " gone before their turn");
+            }
+
+            // sweep of this device and policy completed; the next one
+            // starts from the beginning
+            if (checkpoint_interval > 0 && !checkpoint.clear()) {
+                checkpoint_failed(logger, device, dir_);
+            }
         }  // loop through object dirs for all policies
     }  // for each device
 }
@@ -12,7 +12,8 @@
 #include "DiskFile.h"
 #include "FileInfo.h"
 #include "Logger.h"
-#include "Mapper.h"
+#include "MD5Hash.h"
+#include "OndiskFiles.h"
 #include "StoragePolicy.h"
 #include "TimeConstants.h"
 #include "Timestamp.h"
@@ -22,10 +23,17 @@ class DiskFile;
 class ObjectAuditHook;
 
 
+/**
+ * Base of the per-policy-type managers. What differs between policy
+ * types is per file (which names are allowed, how a file is hashed), so
+ * it isn't virtual here: PolicyDiskFileManager is instantiated for each
+ * type with its DiskFileRules and overrides the loops over a hash dir or
+ * suffix dir as a whole, leaving one virtual call per directory.
+ */
 class DiskFileManager {
 
 
-private:
+protected:
     Logger* logger;
     std::string devices;
     int disk_chunk_size;
@@ -43,13 +51,11 @@ public:
     DiskFileManager(Config conf, Logger* logger);
     virtual ~DiskFileManager() {}
 
-    virtual void parse_on_disk_filename(const std::string& filename) = 0;
-    virtual void _process_ondisk_files(const std::map<std::string, std::vector<FileInfo> >& exts, const std::map<std::string, std::vector<FileInfo> >& results) = 0;
-    virtual void _hash_suffix(const std::string&path,
-                              int reclaim_age) = 0;
+    // "replication" or "erasure_coding"
+    virtual const char* policy_type() const = 0;
 
-
-    bool _verify_ondisk_files(const std::map<std::string, std::vector<FileInfo> >& results);
+    // a .data or a .ts but not both, and a .meta only with a .data
+    bool _verify_ondisk_files(const OndiskFiles& results) const;
 
     /*
     void _split_list(original_list, condition);
@@ -59,9 +65,12 @@ public:
     void _split_gte_timestamp(file_info_list, Timestamp timestamp);
     */
 
-    void get_ondisk_files(std::vector<std::string>& files,
-                          const std::string& datadir,
-                          bool verify=true);
+    // Classify the listing files of the hash dir datadir. With verify,
+    // returns false if the files chosen break _verify_ondisk_files.
+    virtual bool get_ondisk_files(const std::vector<std::string>& files,
+                                  const std::string& datadir,
+                                  OndiskFiles& results,
+                                  bool verify=true) = 0;
 
     std::map<std::string, std::vector<std::string> > cleanup_ondisk_files(const std::string& hsh_path,
                                  int reclaim_age=TimeConstants::ONE_WEEK);
@@ -69,9 +78,16 @@ public:
     void hash_cleanup_listdir(const std::string& hsh_path,
                               int reclaim_age=TimeConstants::ONE_WEEK);
 
-    void _hash_suffix_dir(const std::string& path,
-                          Mapper* mapper,
-                          int reclaim_age);
+    // Clean up every hash dir of the suffix dir at path and add the
+    // files left to hashes, keyed as in DiskFileRules.h.
+    virtual void _hash_suffix_dir(const std::string& path,
+                                  int reclaim_age,
+                                  std::map<int, MD5Hash>& hashes) = 0;
+
+    // hex digests of _hash_suffix_dir
+    void _hash_suffix(const std::string& path,
+                      int reclaim_age,
+                      std::map<int, std::string>& hashes);
 
     void _get_hashes(const std::string& partition_path,
                      std::vector<std::string>& recalculate,
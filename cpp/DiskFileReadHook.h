@@ -1,6 +1,7 @@
 #ifndef DISKFILEREADHOOK_H
 #define DISKFILEREADHOOK_H
 
+#include <stddef.h>
 #include <string>
 
 
@@ -9,7 +10,14 @@ class DiskFileReadHook {
 public:
     virtual ~DiskFileReadHook() {}
     virtual void onFileRead(const std::string& chunk) = 0;
+
+    // Called by the reader with a view of its own buffer, which is only
+    // valid for the duration of the call. Hooks that can work from the
+    // buffer directly should override this to avoid the copy into a
+    // string.
+    virtual void onChunkRead(const char* data, size_t length) {
+        onFileRead(std::string(data, length));
+    }
 };
 
 #endif
-
@@ -1,7 +1,11 @@
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include "DiskFileReader.h"
+#include "AsyncReadQueue.h"
+#include "BufferPool.h"
 #include "DiskFileManager.h"
 #include "DiskFileReadHook.h"
 #include "DiskFile.h"
@@ -58,15 +62,214 @@ DiskFileReader::DiskFileReader(FILE* fp,
     //this->_md5_of_sent_bytes = null;
     this->_suppress_file_closing = false;
     //this->_quarantined_dir = null;
+    this->_read_queue = NULL;
+    this->_read_stream = -1;
+    this->_buffer_pool = NULL;
+    this->_own_buffer_pool = NULL;
+    this->_direct_io = false;
+    this->_direct_fd = -1;
+    this->_read_offset = 0;
+    this->_read_skip = 0;
+}
+
+DiskFileReader::~DiskFileReader() {
+    this->_disable_direct_io();
+    if (this->_own_buffer_pool != NULL) {
+        delete this->_own_buffer_pool;
+    }
 }
 
 DiskFileManager* DiskFileReader::manager() {
     return this->_diskfile->manager();
 }
 
+/**
+ * Read chunks into buffers of the given pool. A caller that reads many
+ * objects should hand every reader the same pool so chunk buffers are
+ * reused across objects; otherwise the reader makes its own.
+ */
+void DiskFileReader::set_buffer_pool(BufferPool* buffer_pool) {
+    this->_buffer_pool = buffer_pool;
+}
+
+BufferPool* DiskFileReader::_chunk_pool() {
+    if (this->_buffer_pool != NULL &&
+        this->_buffer_pool->buffer_size() >= (size_t) this->_disk_chunk_size) {
+        return this->_buffer_pool;
+    }
+    if (this->_own_buffer_pool == NULL) {
+        this->_own_buffer_pool = new BufferPool(this->_disk_chunk_size);
+    }
+    return this->_own_buffer_pool;
+}
+
+/**
+ * Read the object through the given io_uring queue instead of blocking
+ * reads on the file handle. Ignored if the queue isn't usable.
+ */
+void DiskFileReader::set_read_queue(AsyncReadQueue* read_queue) {
+    this->_read_queue = read_queue;
+}
+
+/**
+ * Read the data file with O_DIRECT so audit reads don't go through (and
+ * push other data out of) the page cache. Needs a disk_chunk_size that is
+ * a multiple of the buffer alignment; if the filesystem refuses O_DIRECT
+ * the reader quietly goes back to buffered reads.
+ */
+void DiskFileReader::set_direct_io(bool direct_io) {
+    this->_direct_io = direct_io &&
+        (this->_disk_chunk_size % BufferPool::DEFAULT_ALIGNMENT) == 0;
+}
+
+bool DiskFileReader::_open_direct() {
+    if (!this->_direct_io) {
+        return false;
+    }
+    if (this->_direct_fd > -1) {
+        return true;
+    }
+
+    this->_direct_fd = ::open(this->_data_file.c_str(),
+                              O_RDONLY | O_DIRECT | O_CLOEXEC);
+    if (this->_direct_fd < 0) {
+        if (errno == EINVAL) {
+            // tmpfs and some fuse filesystems don't do O_DIRECT
+            this->_direct_io = false;
+            return false;
+        }
+        throw OSError(errno);
+    }
+    return true;
+}
+
+void DiskFileReader::_disable_direct_io() {
+    this->_direct_io = false;
+    if (this->_direct_fd > -1) {
+        ::close(this->_direct_fd);
+        this->_direct_fd = -1;
+    }
+}
+
+/**
+ * Start reading from the current position to the end of the file in
+ * the background. Iterating calls this anyway; calling it early lets the
+ * reads of this object overlap with whatever the caller is doing.
+ */
+void DiskFileReader::prefetch() {
+    if (this->_read_queue == NULL || !this->_read_queue->available() ||
+        this->_read_stream > -1) {
+        return;
+    }
+
+    int fd = fileno(this->_fp);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw OSError(errno);
+    }
+    this->_read_offset = ftell(this->_fp);
+    this->_read_skip = 0;
+    long offset = this->_read_offset;
+    if (this->_open_direct()) {
+        // O_DIRECT reads start on an aligned offset; skip up to the
+        // position we were asked for
+        fd = this->_direct_fd;
+        this->_read_skip = offset % BufferPool::DEFAULT_ALIGNMENT;
+        offset -= this->_read_skip;
+    }
+    this->_read_stream = this->_read_queue->open_stream(fd, offset,
+                                                        st.st_size);
+}
+
 void DiskFileReader::__iter__(DiskFileReadHook* dfr_hook) {
     DiskFileReaderCloser dfrc(this, true); // check for suppression
-    int dropped_cache = 0;
+    this->_iter(dfr_hook, -1);
+}
+
+/**
+ * Read the whole object into buffer without hashing it, for callers that
+ * hash many small objects together. Returns the number of bytes the file
+ * holds, which is more than size if the file is longer than expected.
+ * With direct I/O the buffer must be aligned as a BufferPool's and hold
+ * size rounded up to the alignment.
+ * The reader is left open: hand it the digest with set_read_md5 and then
+ * close it, which quarantines the object on a mismatch.
+ */
+long DiskFileReader::read_whole(char* buffer, long size) {
+    this->_bytes_read = 0;
+    this->_started_at_0 = (ftell(this->_fp) == 0);
+    this->_read_to_eof = false;
+
+    if (!this->_started_at_0 || !this->_open_direct() ||
+        !this->_read_whole_direct(buffer, size)) {
+        size_t chunk_len = fread(buffer, 1, size, this->_fp);
+        this->_bytes_read = chunk_len;
+        if ((long) chunk_len == size) {
+            // count (but don't keep) anything past the expected length
+            char overflow[BufferPool::DEFAULT_ALIGNMENT];
+            while ((chunk_len = fread(overflow, 1, sizeof(overflow),
+                                      this->_fp)) > 0) {
+                this->_bytes_read += chunk_len;
+            }
+        }
+        if (ferror(this->_fp)) {
+            throw OSError(errno);
+        }
+    }
+    this->_read_to_eof = true;
+    this->_drop_cache(fileno(this->_fp), 0, this->_bytes_read);
+    return this->_bytes_read;
+}
+
+/**
+ * read_whole through the O_DIRECT descriptor. Returns false, with direct
+ * I/O turned off and nothing read, if the filesystem won't take the reads.
+ */
+bool DiskFileReader::_read_whole_direct(char* buffer, long size) {
+    const long alignment = BufferPool::DEFAULT_ALIGNMENT;
+    const long aligned_size = (size + alignment - 1) / alignment * alignment;
+    char overflow[BufferPool::DEFAULT_ALIGNMENT]
+        __attribute__((aligned(BufferPool::DEFAULT_ALIGNMENT)));
+    long offset = 0;
+
+    while (true) {
+        // past the buffer, anything more is only counted
+        char* target = offset < aligned_size ? buffer + offset : overflow;
+        const long wanted = offset < aligned_size ?
+            aligned_size - offset : alignment;
+        const ssize_t bytes = ::pread(this->_direct_fd, target, wanted,
+                                      offset);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && offset == 0) {
+                this->_disable_direct_io();
+                return false;
+            }
+            throw OSError(errno);
+        }
+        offset += bytes;
+        // a short read is the end of the file; the next offset wouldn't
+        // be aligned anyway
+        if (bytes < wanted) {
+            break;
+        }
+    }
+    this->_bytes_read = offset;
+    return true;
+}
+
+void DiskFileReader::set_read_md5(const string& md5_hexdigest) {
+    this->_md5_of_sent_bytes = md5_hexdigest;
+}
+
+/**
+ * Hand the hook every chunk from the current position up to length bytes
+ * (-1 for the rest of the file). Chunks are passed as views of the
+ * reader's buffers, so nothing is allocated or copied per chunk.
+ */
+void DiskFileReader::_iter(DiskFileReadHook* dfr_hook, long length) {
     this->_bytes_read = 0;
     this->_started_at_0 = false;
     this->_read_to_eof = false;
@@ -75,22 +278,50 @@ void DiskFileReader::__iter__(DiskFileReadHook* dfr_hook) {
         //this->_iter_etag = hashlib.md5();
     }
 
+    if (this->_read_queue != NULL && this->_read_queue->available()) {
+        this->_iter_queued(dfr_hook, length);
+    } else if (this->_open_direct()) {
+        this->_iter_direct(dfr_hook, length);
+    } else {
+        this->_iter_chunked(dfr_hook, length);
+    }
+}
+
+void DiskFileReader::_iter_chunked(DiskFileReadHook* dfr_hook, long length) {
+    int dropped_cache = 0;
+    PooledBuffer buffer(*this->_chunk_pool());
+
     while (true) {
-        string chunk = this->_threadpool.run_in_thread(
-            this->_fp.read, this->_disk_chunk_size);
-        if (chunk.length() > 0) {
+        size_t chunk_size = this->_disk_chunk_size;
+        if (length > -1) {
+            if (length == 0) {
+                break;
+            }
+            if ((size_t) length < chunk_size) {
+                chunk_size = length;
+            }
+        }
+
+        size_t chunk_len = fread(buffer.data(), 1, chunk_size, this->_fp);
+        if (chunk_len > 0) {
             //if (this->_iter_etag) {
-                this->_iter_etag.update(chunk);
+                this->_iter_etag.update(buffer.data(), chunk_len);
             //}
-            this->_bytes_read += chunk.length();
+            this->_bytes_read += chunk_len;
+            if (length > -1) {
+                length -= chunk_len;
+            }
             if (this->_bytes_read - dropped_cache > DROP_CACHE_WINDOW) {
                 this->_drop_cache(fileno(this->_fp),
                                   dropped_cache,
                                   this->_bytes_read - dropped_cache);
                 dropped_cache = this->_bytes_read;
             }
-            dfr_hook->onFileRead(chunk);
+            dfr_hook->onChunkRead(buffer.data(), chunk_len);
         } else {
+            if (ferror(this->_fp)) {
+                throw OSError(errno);
+            }
             this->_read_to_eof = true;
             this->_drop_cache(fileno(this->_fp),
                               dropped_cache,
@@ -100,6 +331,132 @@ void DiskFileReader::__iter__(DiskFileReadHook* dfr_hook) {
     }
 }
 
+void DiskFileReader::_iter_queued(DiskFileReadHook* dfr_hook, long length) {
+    int dropped_cache = 0;
+    const char* data;
+    int chunk_len;
+    bool more;
+
+    // the next chunks are already being read while this one is hashed
+    this->prefetch();
+    while (length != 0) {
+        try {
+            more = this->_read_queue->next_chunk(this->_read_stream,
+                                                 data,
+                                                 chunk_len);
+        } catch (const OSError& err) {
+            if (err._errno != EINVAL || this->_direct_fd < 0) {
+                throw;
+            }
+            // the filesystem took O_DIRECT at open but not the reads;
+            // carry on buffered from where we got to
+            this->_close_read_stream();
+            this->_disable_direct_io();
+            fseek(this->_fp, this->_read_offset + this->_bytes_read,
+                  SEEK_SET);
+            this->prefetch();
+            continue;
+        }
+        if (!more) {
+            this->_read_to_eof = true;
+            break;
+        }
+        if (this->_read_skip > 0) {
+            if (chunk_len <= this->_read_skip) {
+                this->_read_skip -= chunk_len;
+                continue;
+            }
+            data += this->_read_skip;
+            chunk_len -= this->_read_skip;
+            this->_read_skip = 0;
+        }
+        if (length > -1) {
+            if (chunk_len > length) {
+                chunk_len = length;
+            }
+            length -= chunk_len;
+        }
+        this->_iter_etag.update(data, chunk_len);
+        this->_bytes_read += chunk_len;
+        if (this->_bytes_read - dropped_cache > DROP_CACHE_WINDOW) {
+            this->_drop_cache(fileno(this->_fp),
+                              dropped_cache,
+                              this->_bytes_read - dropped_cache);
+            dropped_cache = this->_bytes_read;
+        }
+        dfr_hook->onChunkRead(data, chunk_len);
+    }
+
+    this->_close_read_stream();
+    this->_drop_cache(fileno(this->_fp),
+                      dropped_cache,
+                      this->_bytes_read - dropped_cache);
+}
+
+/**
+ * Blocking O_DIRECT reads. Reads always cover whole aligned blocks, so
+ * an unaligned start is skipped over in the first buffer and the file's
+ * unaligned tail comes back as a short read, which marks the end of file.
+ */
+void DiskFileReader::_iter_direct(DiskFileReadHook* dfr_hook, long length) {
+    PooledBuffer buffer(*this->_chunk_pool());
+    long offset = ftell(this->_fp);
+    long skip = offset % BufferPool::DEFAULT_ALIGNMENT;
+    off_t read_offset = offset - skip;
+
+    while (length != 0) {
+        ssize_t bytes = ::pread(this->_direct_fd,
+                                buffer.data(),
+                                this->_disk_chunk_size,
+                                read_offset);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL) {
+                // the filesystem took O_DIRECT at open but not the reads
+                this->_disable_direct_io();
+                fseek(this->_fp, offset, SEEK_SET);
+                this->_iter_chunked(dfr_hook, length);
+                return;
+            }
+            throw OSError(errno);
+        }
+        if (bytes <= skip) {
+            this->_read_to_eof = true;
+            break;
+        }
+
+        const char* data = buffer.data() + skip;
+        long chunk_len = bytes - skip;
+        const bool at_eof = bytes < this->_disk_chunk_size;
+        if (length > -1) {
+            if (chunk_len > length) {
+                chunk_len = length;
+            }
+            length -= chunk_len;
+        }
+        this->_iter_etag.update(data, chunk_len);
+        this->_bytes_read += chunk_len;
+        offset += chunk_len;
+        read_offset += bytes;
+        skip = 0;
+        dfr_hook->onChunkRead(data, chunk_len);
+
+        if (at_eof && offset == read_offset) {
+            this->_read_to_eof = true;
+            break;
+        }
+    }
+}
+
+void DiskFileReader::_close_read_stream() {
+    if (this->_read_stream > -1) {
+        this->_read_queue->close_stream(this->_read_stream);
+        this->_read_stream = -1;
+    }
+}
+
 bool DiskFileReader::can_zero_copy_send() const {
     return this->_use_splice;
 }
@@ -241,17 +598,9 @@ void DiskFileReader::app_iter_range(DiskFileReadHook* dfr_hook,
     }
 
     DiskFileReaderCloser dfrc(this, true); // check for suppress
-    for (string chunk : this) {
-        if (length > -1) {
-            length -= chunk.length();
-            if (length < 0) {
-                // Chop off the extra:
-                dfr_hook->onFileRead(chunk.substr(0,length));
-                break;
-            }
-        }
-        dfr_hook->onFileRead(chunk);
-    }
+    // the last chunk is cut short at the end of the range rather than
+    // read whole and chopped
+    this->_iter(dfr_hook, length);
 }
 
 /*
@@ -281,7 +630,8 @@ void DiskFileReader::app_iter_ranges(DiskFileReadHook* dfr_hook,
 void DiskFileReader::_drop_cache(int fd,
                                  unsigned long offset,
                                  unsigned long length) {
-    if (!this->_keep_cache) {
+    // nothing to drop if the reads bypassed the page cache
+    if (!this->_keep_cache && this->_direct_fd < 0) {
         SwiftUtils::drop_buffer_cache(fd, offset, length);
     }
 }
@@ -299,7 +649,8 @@ void DiskFileReader::_quarantine(const string& msg) {
 }
 
 void DiskFileReader::_handle_close_quarantine() {
-    if (this->_iter_etag.length() > 0 &&
+    // an object read from 0 to EOF was hashed whole, even when it's empty
+    if (this->_started_at_0 && this->_read_to_eof &&
         this->_md5_of_sent_bytes.length() == 0) {
         this->_md5_of_sent_bytes = this->_iter_etag.hexdigest();
     }
@@ -322,6 +673,8 @@ void DiskFileReader::_handle_close_quarantine() {
 }
 
 void DiskFileReader::close() {
+    // drop any reads still queued for this file before it goes away
+    this->_close_read_stream();
     if (NULL != this->_fp) {
         DiskFileReaderCloser closer(this, false); // don't check for suppress
         try {
@@ -8,6 +8,8 @@
 #include "MD5Hash.h"
 #include "ThreadPool.h"
 
+class AsyncReadQueue;
+class BufferPool;
 class DiskFile;
 class DiskFileManager;
 class DiskFileReadHook;
@@ -38,6 +40,28 @@ private:
     std::string _md5_of_sent_bytes;
     bool _suppress_file_closing;
     std::string _quarantined_dir;
+    AsyncReadQueue* _read_queue;
+    int _read_stream;
+    BufferPool* _buffer_pool;
+    BufferPool* _own_buffer_pool;
+    bool _direct_io;
+    int _direct_fd;
+    long _read_offset;
+    int _read_skip;
+
+    // disallow copies
+    DiskFileReader(const DiskFileReader&);
+    DiskFileReader& operator=(const DiskFileReader&);
+
+    BufferPool* _chunk_pool();
+    void _iter(DiskFileReadHook* dfr_hook, long length);
+    void _iter_chunked(DiskFileReadHook* dfr_hook, long length);
+    void _iter_queued(DiskFileReadHook* dfr_hook, long length);
+    void _iter_direct(DiskFileReadHook* dfr_hook, long length);
+    bool _read_whole_direct(char* buffer, long size);
+    void _close_read_stream();
+    bool _open_direct();
+    void _disable_direct_io();
 
 
 public:
@@ -55,9 +79,16 @@ public:
                    int pipe_size,
                    DiskFile* diskfile,
                    bool keep_cache);
+    ~DiskFileReader();
 
     DiskFileManager* manager();
+    void set_buffer_pool(BufferPool* buffer_pool);
+    void set_read_queue(AsyncReadQueue* read_queue);
+    void set_direct_io(bool direct_io);
+    void prefetch();
     void __iter__(DiskFileReadHook* dfr_hook);
+    long read_whole(char* buffer, long size);
+    void set_read_md5(const std::string& md5_hexdigest);
 
     bool can_zero_copy_send() const;
     void zero_copy_send(int wsockfd);
@@ -0,0 +1,61 @@
+#include "DiskFileRouter.h"
+#include "DiskFileRules.h"
+#include "PolicyDiskFileManager.h"
+#include "StoragePolicy.h"
+
+
+using namespace std;
+
+
+DiskFileRouter::DiskFileRouter(Config config, Logger* logger) :
+    config(config),
+    logger(logger) {
+    this->add_policy(0, ReplicationRules::policy_type());
+}
+
+DiskFileRouter::DiskFileRouter(Config config,
+                               Logger* logger,
+                               const vector<StoragePolicy*>& policies) :
+    config(config),
+    logger(logger) {
+    const vector<StoragePolicy*>::const_iterator itEnd = policies.end();
+    vector<StoragePolicy*>::const_iterator it = policies.begin();
+    for (; it != itEnd; ++it) {
+        const StoragePolicy* policy = *it;
+        // policies from before there were types are replicated
+        this->add_policy(policy->_idx,
+                         policy->_policy_type.empty() ?
+                             string(ReplicationRules::policy_type()) :
+                             policy->_policy_type);
+    }
+}
+
+DiskFileRouter::~DiskFileRouter() {
+    const vector<DiskFileManager*>::const_iterator itEnd = _managers.end();
+    vector<DiskFileManager*>::const_iterator it = _managers.begin();
+    for (; it != itEnd; ++it) {
+        delete *it;
+    }
+}
+
+void DiskFileRouter::add_policy(int policy_index, const string& policy_type) {
+    if (policy_index < 0) {
+        throw PolicyError("Invalid index", policy_index);
+    }
+
+    DiskFileManager* manager;
+    if (policy_type == ReplicationRules::policy_type()) {
+        manager = new ReplicationDiskFileManager(this->config, this->logger);
+    } else if (policy_type == ECRules::policy_type()) {
+        manager = new ECDiskFileManager(this->config, this->logger);
+    } else {
+        throw PolicyError(string("Unknown policy type ") + policy_type,
+                          policy_index);
+    }
+
+    if ((size_t) policy_index >= _managers.size()) {
+        _managers.resize(policy_index + 1, NULL);
+    }
+    delete _managers[policy_index];
+    _managers[policy_index] = manager;
+}
@@ -1,22 +1,60 @@
 #ifndef DISKFILEROUTER_H
 #define DISKFILEROUTER_H
 
+#include <string>
+#include <vector>
 
 #include "Config.h"
+#include "DiskFileManager.h"
 #include "Logger.h"
+#include "PolicyError.h"
+#include "StrUtils.h"
 
+class StoragePolicy;
 
+
+/**
+ * The DiskFileManager of each policy, in a vector indexed by policy
+ * index; policy indexes are small and dense, so a lookup is a bounds
+ * check and a load. Each manager is a PolicyDiskFileManager of its
+ * policy's type.
+ */
 class DiskFileRouter {
 
 private:
     Config config;
     Logger* logger;
+    // NULL where no policy has that index
+    std::vector<DiskFileManager*> _managers;
+
+    // disallow copies
+    DiskFileRouter(const DiskFileRouter&);
+    DiskFileRouter& operator=(const DiskFileRouter&);
 
 
 public:
+    // just the legacy policy 0, a replication policy
     DiskFileRouter(Config config, Logger* logger);
+    DiskFileRouter(Config config,
+                   Logger* logger,
+                   const std::vector<StoragePolicy*>& policies);
+    ~DiskFileRouter();
+
+    // policy_type is "replication" or "erasure_coding"; replaces any
+    // manager the index already had
+    void add_policy(int policy_index, const std::string& policy_type);
+
+    DiskFileManager* operator[](int policy_index) const {
+        if (policy_index < 0 ||
+            (size_t) policy_index >= _managers.size() ||
+            _managers[policy_index] == NULL) {
+            throw PolicyError(std::string("No policy with index ") +
+                              StrUtils::toString(policy_index),
+                              policy_index);
+        }
+        return _managers[policy_index];
+    }
 
 };
 
 #endif
-
@@ -0,0 +1,88 @@
+#ifndef DISKFILERULES_H
+#define DISKFILERULES_H
+
+#include <stddef.h>
+#include <map>
+#include <string>
+
+#include "FileInfo.h"
+#include "MD5Hash.h"
+#include "OndiskFiles.h"
+
+
+/**
+ * What a policy type allows in a hash dir and how its suffix hashes are
+ * made. These are the per-file steps of listing and rehashing, so they
+ * are given to PolicyDiskFileManager as a template argument and inlined
+ * into its loops instead of being called through virtuals.
+ *
+ * Suffix hashes are kept per key: -1 (None in swift) for files hashed by
+ * name, a fragment index for EC fragments.
+ */
+class ReplicationRules {
+
+public:
+    static const bool DATA_NEEDS_DURABLE = false;
+
+    static const char* policy_type() {
+        return "replication";
+    }
+
+    // no fragment indexes and no .durable files
+    static bool parse_on_disk_filename(const char* name,
+                                       size_t length,
+                                       FileInfo& info) {
+        return OndiskFiles::parse_filename(name, length, info) &&
+               info.frag_index == -1 &&
+               info.ext != FileInfo::DURABLE;
+    }
+
+    static void hash_file(const FileInfo& info,
+                          const std::string& name,
+                          std::map<int, MD5Hash>& hashes) {
+        hashes[-1].update(name);
+    }
+
+    // an empty suffix still has a (blank) hash
+    static void finish_hashes(std::map<int, MD5Hash>& hashes) {
+        hashes[-1];
+    }
+};
+
+
+class ECRules {
+
+public:
+    static const bool DATA_NEEDS_DURABLE = true;
+
+    static const char* policy_type() {
+        return "erasure_coding";
+    }
+
+    // every .data is a fragment and says which
+    static bool parse_on_disk_filename(const char* name,
+                                       size_t length,
+                                       FileInfo& info) {
+        return OndiskFiles::parse_filename(name, length, info) &&
+               (info.ext != FileInfo::DATA || info.frag_index > -1);
+    }
+
+    // A fragment counts towards its own index by timestamp, so nodes
+    // holding different fragments of the same object still agree.
+    static void hash_file(const FileInfo& info,
+                          const std::string& name,
+                          std::map<int, MD5Hash>& hashes) {
+        if (info.frag_index < 0) {
+            hashes[-1].update(name);
+            return;
+        }
+        char timestamp[Timestamp::INTERNAL_LENGTH + 8];
+        hashes[info.frag_index].update(
+            timestamp, info.timestamp.format_internal(timestamp));
+    }
+
+    static void finish_hashes(std::map<int, MD5Hash>& hashes) {
+    }
+};
+
+#endif
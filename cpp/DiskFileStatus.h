@@ -0,0 +1,74 @@
+#ifndef DISKFILESTATUS_H
+#define DISKFILESTATUS_H
+
+#include <string>
+
+
+/**
+ * Outcome of opening or verifying a diskfile. Objects that are gone,
+ * deleted, expired or quarantined are routine on a busy node; returning
+ * them as a status instead of throwing keeps exception unwinding off the
+ * per-object path. DiskFile::open() still throws the matching exception
+ * for callers that prefer it.
+ */
+class DiskFileStatus {
+
+public:
+    enum Code {
+        OK,
+        NOT_EXIST,
+        DELETED,      // only a tombstone is left
+        EXPIRED,      // X-Delete-At has passed
+        QUARANTINED,
+        COLLISION     // name in metadata isn't the one asked for
+    };
+
+    int code;
+    std::string message;
+    // X-Timestamp of the tombstone for DELETED
+    std::string timestamp;
+
+
+    DiskFileStatus() :
+        code(OK) {
+    }
+
+    DiskFileStatus(int code_value) :
+        code(code_value) {
+    }
+
+    DiskFileStatus(int code_value, const std::string& message_value) :
+        code(code_value),
+        message(message_value) {
+    }
+
+    DiskFileStatus(const DiskFileStatus& copy) :
+        code(copy.code),
+        message(copy.message),
+        timestamp(copy.timestamp) {
+    }
+
+    DiskFileStatus& operator=(const DiskFileStatus& copy) {
+        if (this == &copy) {
+            return *this;
+        }
+
+        code = copy.code;
+        message = copy.message;
+        timestamp = copy.timestamp;
+
+        return *this;
+    }
+
+    bool ok() const {
+        return code == OK;
+    }
+
+    // gone one way or another: nothing there to audit or serve
+    bool not_found() const {
+        return code == NOT_EXIST || code == DELETED || code == EXPIRED;
+    }
+};
+
+#endif
+
@@ -1,4 +1,16 @@
 #include "DiskFileWriter.h"
+#include "MetadataXattr.h"
 
+using namespace std;
 
 
+/**
+ * Pickle metadata onto the xattrs of fd, the temp file of the put. Done
+ * before the file is renamed into place so readers never see a data
+ * file without its metadata.
+ */
+void DiskFileWriter::write_metadata(int fd,
+                                    const map<string, string>& metadata) {
+    MetadataXattr::write(fd, metadata);
+}
+
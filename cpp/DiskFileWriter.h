@@ -1,6 +1,9 @@
 #ifndef DISKFILEWRITER_H
 #define DISKFILEWRITER_H
 
+#include <map>
+#include <string>
+
 
 class DiskFileWriter {
 
@@ -19,8 +22,10 @@ public:
         put_succeeded(false) {
     }
 
+    void write_metadata(int fd,
+                        const std::map<std::string, std::string>& metadata);
+
 };
 
 #endif
 
-
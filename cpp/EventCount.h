@@ -0,0 +1,92 @@
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#include <pthread.h>
+
+
+/**
+ * Lets a thread sleep until a lock-free structure (e.g. a BoundedQueue)
+ * changes, without a lock on its fast path. A waiter calls
+ * prepare_wait(), checks its condition once more and then either
+ * cancel_wait() or wait(). A thread that changes the structure calls
+ * notify_one() or notify_all(), which only take the lock when somebody
+ * is registered as waiting.
+ *
+ *   while (!queue.try_pop(item)) {
+ *       not_empty.prepare_wait();
+ *       if (queue.try_pop(item)) {
+ *           not_empty.cancel_wait();
+ *           break;
+ *       }
+ *       not_empty.wait();
+ *   }
+ *
+ * The fences keep a change made just before notify() and a waiter
+ * registered just before its second check from missing each other.
+ */
+class EventCount {
+
+private:
+    pthread_mutex_t _lock;
+    pthread_cond_t _cond;
+    int _waiters;
+
+    // disallow copies
+    EventCount(const EventCount&);
+    EventCount& operator=(const EventCount&);
+
+    void _notify(bool all) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&_waiters, __ATOMIC_RELAXED) == 0) {
+            return;
+        }
+        pthread_mutex_lock(&_lock);
+        if (all) {
+            pthread_cond_broadcast(&_cond);
+        } else {
+            pthread_cond_signal(&_cond);
+        }
+        pthread_mutex_unlock(&_lock);
+    }
+
+
+public:
+    EventCount() :
+        _waiters(0) {
+        pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_cond, NULL);
+    }
+
+    ~EventCount() {
+        pthread_cond_destroy(&_cond);
+        pthread_mutex_destroy(&_lock);
+    }
+
+    // holds the lock until cancel_wait() or wait() returns
+    void prepare_wait() {
+        pthread_mutex_lock(&_lock);
+        __atomic_add_fetch(&_waiters, 1, __ATOMIC_SEQ_CST);
+    }
+
+    void cancel_wait() {
+        __atomic_sub_fetch(&_waiters, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&_lock);
+    }
+
+    // may also return without a notify; callers check again anyway
+    void wait() {
+        pthread_cond_wait(&_cond, &_lock);
+        __atomic_sub_fetch(&_waiters, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&_lock);
+    }
+
+    void notify_one() {
+        _notify(false);
+    }
+
+    void notify_all() {
+        _notify(true);
+    }
+};
+
+#endif
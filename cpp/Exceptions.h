@@ -92,6 +92,31 @@ public:
 };
 
 
+class UnpicklingError : public BaseException {
+public:
+    UnpicklingError() {}
+    UnpicklingError(const std::string& msg) :
+        BaseException(msg) {
+    }
+
+    UnpicklingError(const UnpicklingError& copy) :
+        BaseException(copy) {
+    }
+
+    virtual ~UnpicklingError() throw() {}
+
+    UnpicklingError& operator=(const UnpicklingError& copy) {
+        if (this == &copy) {
+            return *this;
+        }
+
+        BaseException::operator=(copy);
+
+        return *this;
+    }
+};
+
+
 class DiskFileXattrNotSupported : public BaseException {
 public:
     virtual ~DiskFileXattrNotSupported() throw() {}
@@ -106,6 +131,13 @@ public:
 };
 
 
+class DiskFileExpired : public BaseException {
+public:
+    virtual ~DiskFileExpired() throw() {}
+
+};
+
+
 class DiskFileNotExist : public BaseException {
 public:
     virtual ~DiskFileNotExist() throw() {}
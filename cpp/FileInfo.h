@@ -1,10 +1,64 @@
 #ifndef FILEINFO_H
 #define FILEINFO_H
 
+#include "Timestamp.h"
 
+
+/**
+ * One file of a hash dir listing, e.g. "1445558400.12345.data", broken
+ * down into its timestamp and extension. The name itself stays in the
+ * listing; index says where.
+ */
 class FileInfo {
+
+public:
+    // in the order swift sorts extensions that share a timestamp
+    enum Ext {
+        OTHER,
+        DATA,
+        DURABLE,
+        META,
+        TS
+    };
+
+    Timestamp timestamp;
+    int ext;
+    // EC fragment index from "<timestamp>#<frag>.data", otherwise -1
+    int frag_index;
+    // position of the name in the listing this came from
+    int index;
+
+
+    FileInfo() :
+        ext(OTHER),
+        frag_index(-1),
+        index(-1) {
+    }
+
+    FileInfo(const FileInfo& copy) :
+        timestamp(copy.timestamp),
+        ext(copy.ext),
+        frag_index(copy.frag_index),
+        index(copy.index) {
+    }
+
+    FileInfo& operator=(const FileInfo& copy) {
+        timestamp = copy.timestamp;
+        ext = copy.ext;
+        frag_index = copy.frag_index;
+        index = copy.index;
+        return *this;
+    }
+
+    // true if this file sorts ahead of other in a newest-first listing
+    bool newer_than(const FileInfo& other) const {
+        int result = timestamp.compare(other.timestamp);
+        if (result != 0) {
+            return result > 0;
+        }
+        return ext > other.ext;
+    }
 };
 
 
 #endif
-
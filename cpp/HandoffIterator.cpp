@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "HandoffIterator.h"
+#include "MD5Hash.h"
+#include "RingSnapshot.h"
+
+using namespace std;
+
+
+HandoffIterator::HandoffIterator(const RingSnapshot& snapshot, uint32_t part) :
+    _snapshot(snapshot),
+    _handoff_part(0),
+    _range(0),
+    _replica(0),
+    _regions_hit(0),
+    _zones_hit(0),
+    _ips_hit(0),
+    _devs_used(0) {
+
+    const RingData& ring_data = snapshot.ring_data;
+    const RingTiers& tiers = snapshot.tiers;
+
+    const int bit_count = tiers.dev_count() + tiers.tier_count();
+    const size_t words = (bit_count + 63) / 64;
+    if (bit_count <= INLINE_BITS) {
+        _bits = _inline_bits;
+    } else {
+        _heap_bits.resize(words);
+        _bits = &_heap_bits[0];
+    }
+    memset(_bits, 0, words * sizeof(uint64_t));
+    _tier_bits_start = tiers.dev_count();
+
+    // the primaries are used already
+    for (int replica = 0; replica < ring_data.replica_count(); ++replica) {
+        if (part < ring_data.replica_length(replica)) {
+            const int dev_id = ring_data.part2dev_id(replica)[part];
+            if (dev_id < tiers.dev_count() && tiers.region(dev_id) > -1 &&
+                !_test(dev_id)) {
+                _use(dev_id);
+            }
+        }
+    }
+
+    // start = unpack_from(">I", md5(str(part)).digest())[0] >> part_shift
+    char part_text[16];
+    const int part_length = snprintf(part_text, sizeof(part_text), "%u", part);
+    MD5Hash hash;
+    hash.update(part_text, part_length);
+    unsigned char digest[MD5Hash::DIGEST_SIZE];
+    hash.digest(digest);
+    const uint32_t key = ((uint32_t) digest[0] << 24) |
+                         ((uint32_t) digest[1] << 16) |
+                         ((uint32_t) digest[2] << 8) |
+                         ((uint32_t) digest[3]);
+    _start = (ring_data.part_shift() >= 32) ? 0 :
+             key >> ring_data.part_shift();
+
+    const uint32_t parts = ring_data.partition_count();
+    _increment = parts / 65536;
+    if (_increment < 1) {
+        _increment = 1;
+    }
+
+    _begin_stage(NEW_REGION);
+}
+
+void HandoffIterator::_use(int dev_id) {
+    const RingTiers& tiers = _snapshot.tiers;
+
+    _set(dev_id);
+    ++_devs_used;
+
+    const int region_bit = _tier_bits_start + tiers.region(dev_id);
+    if (!_test(region_bit)) {
+        _set(region_bit);
+        ++_regions_hit;
+    }
+    const int zone_bit = _tier_bits_start + tiers.zone(dev_id);
+    if (!_test(zone_bit)) {
+        _set(zone_bit);
+        ++_zones_hit;
+    }
+    const int ip_bit = _tier_bits_start + tiers.ip(dev_id);
+    if (!_test(ip_bit)) {
+        _set(ip_bit);
+        ++_ips_hit;
+    }
+}
+
+bool HandoffIterator::_stage_finished() const {
+    switch (_stage) {
+        case NEW_REGION:
+            return _regions_hit >= _snapshot.num_regions;
+        case NEW_ZONE:
+            return _zones_hit >= _snapshot.num_zones;
+        case NEW_IP:
+            return _ips_hit >= _snapshot.num_ips;
+        case NEW_DEV:
+            return _devs_used >= _snapshot.num_devs;
+        default:
+            return true;
+    }
+}
+
+void HandoffIterator::_begin_stage(int stage) {
+    _stage = stage;
+    _range = 0;
+    _handoff_part = _start;
+    _replica = 0;
+
+    if (_handoff_part >= _snapshot.ring_data.partition_count()) {
+        _next_handoff_part();
+    }
+}
+
+/**
+ * Steps through chain(range(start, parts, inc),
+ * range(inc - ((parts - start) % inc), start, inc)); returns false at
+ * the end of it.
+ */
+bool HandoffIterator::_next_handoff_part() {
+    const uint32_t parts = _snapshot.ring_data.partition_count();
+
+    if (_range == 0) {
+        if (_handoff_part < parts && parts - _handoff_part > _increment) {
+            _handoff_part += _increment;
+            return true;
+        }
+        _range = 1;
+        _handoff_part = _increment - ((parts - _start) % _increment);
+    } else {
+        _handoff_part += _increment;
+    }
+    return _handoff_part < _start;
+}
+
+int HandoffIterator::next() {
+    const RingData& ring_data = _snapshot.ring_data;
+    const RingTiers& tiers = _snapshot.tiers;
+    const int replica_count = ring_data.replica_count();
+
+    while (_stage != DONE) {
+        if (_stage_finished()) {
+            _begin_stage(_stage + 1);
+            continue;
+        }
+
+        if (_replica == replica_count) {
+            _replica = 0;
+            if (!_next_handoff_part()) {
+                _begin_stage(_stage + 1);
+            }
+            continue;
+        }
+
+        const int replica = _replica++;
+        if (_range == 1 && _handoff_part >= _start) {
+            continue;
+        }
+        if (_handoff_part >= ring_data.replica_length(replica)) {
+            continue;
+        }
+
+        const int dev_id = ring_data.part2dev_id(replica)[_handoff_part];
+        if (dev_id >= tiers.dev_count() || tiers.region(dev_id) < 0 ||
+            _test(dev_id)) {
+            continue;
+        }
+
+        bool fresh;
+        switch (_stage) {
+            case NEW_REGION:
+                fresh = !_test(_tier_bits_start + tiers.region(dev_id));
+                break;
+            case NEW_ZONE:
+                fresh = !_test(_tier_bits_start + tiers.zone(dev_id));
+                break;
+            case NEW_IP:
+                fresh = !_test(_tier_bits_start + tiers.ip(dev_id));
+                break;
+            default:
+                fresh = true;
+        }
+        if (fresh) {
+            _use(dev_id);
+            return dev_id;
+        }
+    }
+    return -1;
+}
+
@@ -0,0 +1,80 @@
+#ifndef HANDOFFITERATOR_H
+#define HANDOFFITERATOR_H
+
+#include <stdint.h>
+#include <vector>
+
+
+class RingSnapshot;
+
+
+/**
+ * Yields the handoff devices of a partition one at a time, in the same
+ * order as swift's get_more_nodes: first devices in regions none of the
+ * nodes so far are in, then new zones, then new ips, then any unused
+ * device, each pass walking the same pseudo-random sequence of other
+ * partitions. Which devices and tiers have been used is kept in
+ * bitsets over the ids of the snapshot's RingTiers; for rings of up to
+ * INLINE_BITS devices plus tiers those live inside the iterator, so
+ * nothing is allocated.
+ *
+ * The snapshot must stay published (e.g. by holding a ReadGuard) for as
+ * long as the iterator is used.
+ */
+class HandoffIterator {
+
+private:
+    static const int INLINE_BITS = 8192;
+
+    enum Stage {
+        NEW_REGION,
+        NEW_ZONE,
+        NEW_IP,
+        NEW_DEV,
+        DONE
+    };
+
+    const RingSnapshot& _snapshot;
+    int _stage;
+    uint32_t _start;
+    uint32_t _increment;
+    uint32_t _handoff_part;
+    // 0 while walking start..parts, 1 for the wrap around to start
+    int _range;
+    int _replica;
+    int _regions_hit;
+    int _zones_hit;
+    int _ips_hit;
+    int _devs_used;
+    // devices first, then tiers
+    uint64_t* _bits;
+    int _tier_bits_start;
+    uint64_t _inline_bits[INLINE_BITS / 64];
+    std::vector<uint64_t> _heap_bits;
+
+    // disallow copies
+    HandoffIterator(const HandoffIterator&);
+    HandoffIterator& operator=(const HandoffIterator&);
+
+    bool _test(int bit) const {
+        return (_bits[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    void _set(int bit) {
+        _bits[bit >> 6] |= 1ULL << (bit & 63);
+    }
+
+    void _use(int dev_id);
+    bool _stage_finished() const;
+    void _begin_stage(int stage);
+    bool _next_handoff_part();
+
+
+public:
+    HandoffIterator(const RingSnapshot& snapshot, uint32_t part);
+
+    // next handoff device id, or -1 when there are no more
+    int next();
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include <string.h>
+#include <vector>
+
+#include "HashPathEngine.h"
+#include "Exceptions.h"
+#include "MD5MultiBuffer.h"
+
+using namespace std;
+
+
+static size_t name_length(const HashPathName& name) {
+    size_t length = name.account_length;
+    if (name.container_length > 0) {
+        length += 1 + name.container_length;
+    }
+    if (name.object_length > 0) {
+        length += 1 + name.object_length;
+    }
+    return length;
+}
+
+
+HashPathEngine::HashPathEngine(const string& prefix, const string& suffix) :
+    _suffix(suffix) {
+    _prefix_hash.update(prefix);
+    _prefix_hash.update("/", 1);
+    _block_length = _prefix_hash.block_state(_block_state);
+
+    const string joined = prefix + "/";
+    _prefix_tail = joined.substr(_block_length);
+}
+
+void HashPathEngine::digest(const HashPathName& name,
+                            unsigned char* digest_out) const {
+    MD5Hash hash(_prefix_hash);
+    hash.update(name.account, name.account_length);
+    if (name.container_length > 0) {
+        hash.update("/", 1);
+        hash.update(name.container, name.container_length);
+    }
+    if (name.object_length > 0) {
+        hash.update("/", 1);
+        hash.update(name.object, name.object_length);
+    }
+    hash.update(_suffix);
+    hash.digest(digest_out);
+}
+
+/**
+ * The multi-buffer kernels need each message in one piece, so the names
+ * are laid out back to back in a single buffer for the whole batch, each
+ * starting with the prefix bytes past the saved block state.
+ */
+void HashPathEngine::digest_batch(const HashPathName* names,
+                                  size_t name_count,
+                                  unsigned char* digests_out) const {
+    if (name_count == 0) {
+        return;
+    }
+
+    const size_t fixed_length = _prefix_tail.length() + _suffix.length();
+    size_t total_length = 0;
+    for (size_t i = 0; i < name_count; ++i) {
+        total_length += fixed_length + name_length(names[i]);
+    }
+
+    vector<unsigned char> buffer(total_length);
+    vector<MD5Job> jobs(name_count);
+    unsigned char* p = &buffer[0];
+
+    for (size_t i = 0; i < name_count; ++i) {
+        const HashPathName& name = names[i];
+        MD5Job& job = jobs[i];
+        job.data = p;
+        job.initial_state = _block_state;
+        job.initial_length = _block_length;
+
+        memcpy(p, _prefix_tail.data(), _prefix_tail.length());
+        p += _prefix_tail.length();
+        memcpy(p, name.account, name.account_length);
+        p += name.account_length;
+        if (name.container_length > 0) {
+            *p++ = '/';
+            memcpy(p, name.container, name.container_length);
+            p += name.container_length;
+        }
+        if (name.object_length > 0) {
+            *p++ = '/';
+            memcpy(p, name.object, name.object_length);
+            p += name.object_length;
+        }
+        memcpy(p, _suffix.data(), _suffix.length());
+        p += _suffix.length();
+
+        job.length = p - job.data;
+    }
+
+    MD5MultiBuffer::digest_jobs(&jobs[0], name_count);
+
+    for (size_t i = 0; i < name_count; ++i) {
+        memcpy(digests_out + i * MD5Hash::DIGEST_SIZE,
+               jobs[i].digest,
+               MD5Hash::DIGEST_SIZE);
+    }
+}
+
+string HashPathEngine::hash_path(const string& account,
+                                 const string& container,
+                                 const string& object,
+                                 bool raw_digest) const {
+    if (!object.empty() && container.empty()) {
+        throw ValueError("container is required if object is provided");
+    }
+
+    unsigned char raw[MD5Hash::DIGEST_SIZE];
+    digest(HashPathName(account, container, object), raw);
+
+    if (raw_digest) {
+        return string((const char*) raw, MD5Hash::DIGEST_SIZE);
+    }
+    char hex[MD5Hash::DIGEST_SIZE * 2];
+    MD5Hash::to_hex(raw, hex);
+    return string(hex, MD5Hash::DIGEST_SIZE * 2);
+}
+
@@ -0,0 +1,91 @@
+#ifndef HASHPATHENGINE_H
+#define HASHPATHENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "MD5Hash.h"
+
+
+// One name for HashPathEngine::digest_batch. container and object may be
+// empty; account may also hold an already joined "a/c/o".
+class HashPathName {
+
+public:
+    const char* account;
+    size_t account_length;
+    const char* container;
+    size_t container_length;
+    const char* object;
+    size_t object_length;
+
+
+    HashPathName() :
+        account(NULL),
+        account_length(0),
+        container(NULL),
+        container_length(0),
+        object(NULL),
+        object_length(0) {
+    }
+
+    HashPathName(const std::string& account_value,
+                 const std::string& container_value=std::string(),
+                 const std::string& object_value=std::string()) :
+        account(account_value.data()),
+        account_length(account_value.length()),
+        container(container_value.data()),
+        container_length(container_value.length()),
+        object(object_value.data()),
+        object_length(object_value.length()) {
+    }
+};
+
+
+/**
+ * Computes swift's hash_path, md5(prefix + "/a/c/o" + suffix), for many
+ * names with the same configured prefix and suffix. The MD5 state after
+ * the prefix is worked out once, so each name only pays for its own
+ * bytes and the suffix, and nothing is concatenated into a temporary.
+ * digest_batch() hashes many names at a time on the multi-buffer MD5
+ * engine.
+ */
+class HashPathEngine {
+
+private:
+    std::string _suffix;
+    // after prefix + "/"
+    MD5Hash _prefix_hash;
+    // the same state as of its last whole block, for MD5Job
+    uint32_t _block_state[4];
+    uint64_t _block_length;
+    // prefix + "/" bytes after that block
+    std::string _prefix_tail;
+
+    // disallow copies
+    HashPathEngine(const HashPathEngine&);
+    HashPathEngine& operator=(const HashPathEngine&);
+
+
+public:
+    HashPathEngine(const std::string& prefix, const std::string& suffix);
+
+    // digest_out must hold MD5Hash::DIGEST_SIZE bytes
+    void digest(const HashPathName& name, unsigned char* digest_out) const;
+
+    // Hash name_count names; digests_out gets MD5Hash::DIGEST_SIZE bytes
+    // per name, in order.
+    void digest_batch(const HashPathName* names,
+                      size_t name_count,
+                      unsigned char* digests_out) const;
+
+    // Throws ValueError if there's an object without a container.
+    std::string hash_path(const std::string& account,
+                          const std::string& container,
+                          const std::string& object,
+                          bool raw_digest) const;
+};
+
+
+#endif
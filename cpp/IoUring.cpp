@@ -0,0 +1,227 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <vector>
+
+#include "IoUring.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int) ::syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd,
+                              unsigned to_submit,
+                              unsigned min_complete,
+                              unsigned flags) {
+    return (int) ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                           flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd,
+                                 unsigned opcode,
+                                 void* arg,
+                                 unsigned nr_args) {
+    return (int) ::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * IORING_OP_READ came in 5.6, with the probe itself; a kernel that can't
+ * be probed can't do plain reads either (only the older READV).
+ */
+static bool supports_read(int fd) {
+    const unsigned ops_len = 256;
+    vector<char> buffer(sizeof(struct io_uring_probe) +
+                        ops_len * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe* probe = (struct io_uring_probe*) &buffer[0];
+
+    if (sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, ops_len) < 0) {
+        return false;
+    }
+    return probe->last_op >= IORING_OP_READ &&
+           (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+
+IoUring::IoUring() :
+    _ring_fd(-1),
+    _sq_entries(0),
+    _to_submit(0),
+    _sq_ring(MAP_FAILED),
+    _sq_ring_size(0),
+    _cq_ring(MAP_FAILED),
+    _cq_ring_size(0),
+    _sqes((struct io_uring_sqe*) MAP_FAILED),
+    _sqes_size(0) {
+}
+
+IoUring::~IoUring() {
+    close();
+}
+
+bool IoUring::setup(unsigned entries) {
+    close();
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = sys_io_uring_setup(entries, &params);
+    if (fd < 0) {
+        // ENOSYS on old kernels, EPERM when disabled by sysctl or seccomp
+        return false;
+    }
+    _ring_fd = fd;
+    if (!supports_read(fd)) {
+        close();
+        return false;
+    }
+    _sq_entries = params.sq_entries;
+
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_ring_size = params.cq_off.cqes +
+                    params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && _cq_ring_size > _sq_ring_size) {
+        _sq_ring_size = _cq_ring_size;
+    }
+
+    _sq_ring = ::mmap(NULL, _sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    if (single_mmap) {
+        _cq_ring = _sq_ring;
+    } else {
+        _cq_ring = ::mmap(NULL, _cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (_cq_ring == MAP_FAILED) {
+            close();
+            return false;
+        }
+    }
+
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = (struct io_uring_sqe*) ::mmap(NULL, _sqes_size,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE,
+                                          fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    char* sq = (char*) _sq_ring;
+    _sq_head = (unsigned*) (sq + params.sq_off.head);
+    _sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    _sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    _sq_array = (unsigned*) (sq + params.sq_off.array);
+
+    char* cq = (char*) _cq_ring;
+    _cq_head = (unsigned*) (cq + params.cq_off.head);
+    _cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    _cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    _to_submit = 0;
+    return true;
+}
+
+void IoUring::close() {
+    if (_sqes != MAP_FAILED) {
+        ::munmap(_sqes, _sqes_size);
+        _sqes = (struct io_uring_sqe*) MAP_FAILED;
+    }
+    if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+        ::munmap(_cq_ring, _cq_ring_size);
+    }
+    _cq_ring = MAP_FAILED;
+    if (_sq_ring != MAP_FAILED) {
+        ::munmap(_sq_ring, _sq_ring_size);
+        _sq_ring = MAP_FAILED;
+    }
+    if (_ring_fd > -1) {
+        ::close(_ring_fd);
+        _ring_fd = -1;
+    }
+}
+
+bool IoUring::queue_read(int fd,
+                         void* buffer,
+                         unsigned length,
+                         uint64_t offset,
+                         uint64_t user_data) {
+    const unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    const unsigned tail = *_sq_tail;
+    if (tail - head >= _sq_entries) {
+        return false;
+    }
+
+    const unsigned index = tail & *_sq_mask;
+    struct io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+
+    _sq_array[index] = index;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++_to_submit;
+    return true;
+}
+
+bool IoUring::_pop_completion(uint64_t& user_data, int& result) {
+    const unsigned head = *_cq_head;
+    const unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return false;
+    }
+
+    const struct io_uring_cqe* cqe = &_cqes[head & *_cq_mask];
+    user_data = cqe->user_data;
+    result = cqe->res;
+    __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool IoUring::next_completion(bool wait, uint64_t& user_data, int& result) {
+    if (_pop_completion(user_data, result)) {
+        return true;
+    }
+
+    if (_to_submit == 0 && !wait) {
+        return false;
+    }
+
+    while (true) {
+        int rc = sys_io_uring_enter(_ring_fd,
+                                    _to_submit,
+                                    wait ? 1 : 0,
+                                    wait ? IORING_ENTER_GETEVENTS : 0);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw OSError(errno);
+        }
+        _to_submit -= ((unsigned) rc < _to_submit) ? (unsigned) rc : _to_submit;
+
+        if (_pop_completion(user_data, result)) {
+            return true;
+        }
+        if (!wait) {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+
+/**
+ * Minimal io_uring wrapper using the raw system calls, just enough to
+ * queue reads and reap their completions. setup() returns false on
+ * kernels (or sandboxes) without io_uring so callers can fall back to
+ * blocking reads.
+ */
+class IoUring {
+
+private:
+    int _ring_fd;
+    unsigned _sq_entries;
+    unsigned _to_submit;
+
+    void* _sq_ring;
+    size_t _sq_ring_size;
+    void* _cq_ring;
+    size_t _cq_ring_size;
+    struct io_uring_sqe* _sqes;
+    size_t _sqes_size;
+
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned* _sq_mask;
+    unsigned* _sq_array;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned* _cq_mask;
+    struct io_uring_cqe* _cqes;
+
+    bool _pop_completion(uint64_t& user_data, int& result);
+
+    // disallow copies
+    IoUring(const IoUring&);
+    IoUring& operator=(const IoUring&);
+
+
+public:
+    IoUring();
+    ~IoUring();
+
+    bool setup(unsigned entries);
+    void close();
+
+    bool is_open() const {
+        return _ring_fd > -1;
+    }
+
+    // Queue a read; returns false if the submission queue is full.
+    bool queue_read(int fd,
+                    void* buffer,
+                    unsigned length,
+                    uint64_t offset,
+                    uint64_t user_data);
+
+    // Submit queued reads and, if wait is true and no completion is
+    // ready, block until one is. Returns false if no completion is
+    // available. result is the read's return value (-errno on failure).
+    bool next_completion(bool wait, uint64_t& user_data, int& result);
+};
+
+#endif
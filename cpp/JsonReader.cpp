@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "JsonReader.h"
+#include "Exceptions.h"
+
+using namespace std;
+
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static void append_utf8(string& s, unsigned long code_point) {
+    if (code_point < 0x80) {
+        s += (char) code_point;
+    } else if (code_point < 0x800) {
+        s += (char) (0xc0 | (code_point >> 6));
+        s += (char) (0x80 | (code_point & 0x3f));
+    } else if (code_point < 0x10000) {
+        s += (char) (0xe0 | (code_point >> 12));
+        s += (char) (0x80 | ((code_point >> 6) & 0x3f));
+        s += (char) (0x80 | (code_point & 0x3f));
+    } else {
+        s += (char) (0xf0 | (code_point >> 18));
+        s += (char) (0x80 | ((code_point >> 12) & 0x3f));
+        s += (char) (0x80 | ((code_point >> 6) & 0x3f));
+        s += (char) (0x80 | (code_point & 0x3f));
+    }
+}
+
+
+JsonReader::JsonReader(const char* text, size_t length) :
+    _pos(text),
+    _end(text + length) {
+}
+
+void JsonReader::_fail(const char* what) const {
+    throw ValueError(string("Invalid JSON: ") + what);
+}
+
+void JsonReader::_skip_whitespace() {
+    while (_pos < _end &&
+           (*_pos == ' ' || *_pos == '\t' || *_pos == '\n' || *_pos == '\r')) {
+        ++_pos;
+    }
+}
+
+void JsonReader::_expect(char c) {
+    _skip_whitespace();
+    if (_pos >= _end || *_pos != c) {
+        _fail("unexpected character");
+    }
+    ++_pos;
+}
+
+void JsonReader::_expect_word(const char* word) {
+    const size_t length = strlen(word);
+    if ((size_t) (_end - _pos) < length || memcmp(_pos, word, length) != 0) {
+        _fail("unknown literal");
+    }
+    _pos += length;
+}
+
+int JsonReader::peek() {
+    _skip_whitespace();
+    if (_pos >= _end) {
+        return END;
+    }
+
+    switch (*_pos) {
+        case '{':
+            return OBJECT;
+        case '[':
+            return ARRAY;
+        case '"':
+            return STRING;
+        case 't':
+        case 'f':
+            return BOOLEAN;
+        case 'n':
+            return NULL_VALUE;
+        default:
+            return NUMBER;
+    }
+}
+
+void JsonReader::begin_object() {
+    _expect('{');
+}
+
+bool JsonReader::next_key(string& key) {
+    _skip_whitespace();
+    if (_pos < _end && *_pos == '}') {
+        ++_pos;
+        return false;
+    }
+    if (_pos < _end && *_pos == ',') {
+        ++_pos;
+    }
+    read_string(key);
+    _expect(':');
+    return true;
+}
+
+void JsonReader::begin_array() {
+    _expect('[');
+}
+
+bool JsonReader::next_element() {
+    _skip_whitespace();
+    if (_pos < _end && *_pos == ']') {
+        ++_pos;
+        return false;
+    }
+    if (_pos < _end && *_pos == ',') {
+        ++_pos;
+    }
+    return true;
+}
+
+void JsonReader::read_string(string& value) {
+    _expect('"');
+    value.clear();
+
+    for (;;) {
+        // copy runs without escapes in one go
+        const char* start = _pos;
+        while (_pos < _end && *_pos != '"' && *_pos != '\\') {
+            ++_pos;
+        }
+        value.append(start, _pos - start);
+
+        if (_pos >= _end) {
+            _fail("unterminated string");
+        }
+        if (*_pos == '"') {
+            ++_pos;
+            return;
+        }
+
+        // backslash
+        if (++_pos >= _end) {
+            _fail("unterminated string");
+        }
+        const char c = *_pos++;
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+                value += c;
+                break;
+            case 'b':
+                value += '\b';
+                break;
+            case 'f':
+                value += '\f';
+                break;
+            case 'n':
+                value += '\n';
+                break;
+            case 'r':
+                value += '\r';
+                break;
+            case 't':
+                value += '\t';
+                break;
+            case 'u': {
+                unsigned long code_point = 0;
+                for (int i = 0; i < 4; ++i) {
+                    const int digit = (_pos < _end) ? hex_value(*_pos) : -1;
+                    if (digit < 0) {
+                        _fail("bad \\u escape");
+                    }
+                    code_point = (code_point << 4) | digit;
+                    ++_pos;
+                }
+                // json.dumps writes characters past the BMP as a
+                // surrogate pair
+                if (code_point >= 0xd800 && code_point < 0xdc00 &&
+                    _end - _pos >= 6 && _pos[0] == '\\' && _pos[1] == 'u') {
+                    unsigned long low = 0;
+                    bool valid = true;
+                    for (int i = 2; i < 6; ++i) {
+                        const int digit = hex_value(_pos[i]);
+                        if (digit < 0) {
+                            valid = false;
+                            break;
+                        }
+                        low = (low << 4) | digit;
+                    }
+                    if (valid && low >= 0xdc00 && low < 0xe000) {
+                        code_point = 0x10000 +
+                            ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                        _pos += 6;
+                    }
+                }
+                append_utf8(value, code_point);
+                break;
+            }
+            default:
+                _fail("bad escape");
+        }
+    }
+}
+
+double JsonReader::read_double() {
+    _skip_whitespace();
+    // the document isn't NUL terminated, so copy the number out first
+    char text[64];
+    size_t length = 0;
+    while (_pos + length < _end && length < sizeof(text) - 1 &&
+           strchr("+-.0123456789eE", _pos[length]) != NULL) {
+        text[length] = _pos[length];
+        ++length;
+    }
+    text[length] = '\0';
+
+    char* number_end;
+    const double value = strtod(text, &number_end);
+    if (length == 0 || number_end != text + length) {
+        _fail("bad number");
+    }
+    _pos += length;
+    return value;
+}
+
+long JsonReader::read_long() {
+    _skip_whitespace();
+    bool negative = false;
+    if (_pos < _end && *_pos == '-') {
+        negative = true;
+        ++_pos;
+    }
+
+    const char* start = _pos;
+    long value = 0;
+    while (_pos < _end && *_pos >= '0' && *_pos <= '9') {
+        value = value * 10 + (*_pos - '0');
+        ++_pos;
+    }
+    if (_pos == start) {
+        _fail("bad integer");
+    }
+    if (_pos < _end && (*_pos == '.' || *_pos == 'e' || *_pos == 'E')) {
+        // an integral value written as a float, e.g. 3.0
+        _pos = start - (negative ? 1 : 0);
+        return (long) read_double();
+    }
+    return negative ? -value : value;
+}
+
+bool JsonReader::read_bool() {
+    _skip_whitespace();
+    if (_pos < _end && *_pos == 't') {
+        _expect_word("true");
+        return true;
+    }
+    _expect_word("false");
+    return false;
+}
+
+void JsonReader::read_null() {
+    _skip_whitespace();
+    _expect_word("null");
+}
+
+void JsonReader::skip() {
+    string ignored;
+
+    switch (peek()) {
+        case OBJECT:
+            begin_object();
+            while (next_key(ignored)) {
+                skip();
+            }
+            break;
+        case ARRAY:
+            begin_array();
+            while (next_element()) {
+                skip();
+            }
+            break;
+        case STRING:
+            read_string(ignored);
+            break;
+        case BOOLEAN:
+            read_bool();
+            break;
+        case NULL_VALUE:
+            read_null();
+            break;
+        case NUMBER:
+            read_double();
+            break;
+        default:
+            _fail("unexpected end");
+    }
+}
+
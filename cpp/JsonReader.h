@@ -0,0 +1,68 @@
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <stddef.h>
+#include <string>
+
+
+/**
+ * Pull parser over a JSON document held in memory. Values are read one
+ * at a time straight into the caller's variables, so a header such as
+ * the device list of a ring is decoded without building a tree first.
+ * Malformed input throws ValueError.
+ */
+class JsonReader {
+
+private:
+    const char* _pos;
+    const char* _end;
+
+    // disallow copies
+    JsonReader(const JsonReader&);
+    JsonReader& operator=(const JsonReader&);
+
+    void _skip_whitespace();
+    void _expect(char c);
+    void _expect_word(const char* word);
+    void _fail(const char* what) const;
+
+
+public:
+    enum Type {
+        END,
+        OBJECT,
+        ARRAY,
+        STRING,
+        NUMBER,
+        BOOLEAN,
+        NULL_VALUE
+    };
+
+
+    JsonReader(const char* text, size_t length);
+
+    // type of the next value without consuming it
+    int peek();
+
+    // Enter an object, then call next_key() until it returns false at
+    // the closing brace; read or skip each key's value in between.
+    void begin_object();
+    bool next_key(std::string& key);
+
+    // Enter an array, then call next_element() until it returns false
+    // at the closing bracket; read or skip each element in between.
+    void begin_array();
+    bool next_element();
+
+    void read_string(std::string& value);
+    double read_double();
+    long read_long();
+    bool read_bool();
+    void read_null();
+
+    // skip over the next value, however deeply nested
+    void skip();
+};
+
+
+#endif
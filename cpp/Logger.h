@@ -24,7 +24,12 @@ public:
     virtual void exception(const std::string& msg) = 0;
 
     virtual void increment(const std::string& counter) = 0;
+    // adds amount to a running count in one go
+    virtual void update_stats(const std::string& counter, long amount) = 0;
     virtual long counter_value(const std::string& counter) = 0;
+    // for counters that report a current value (e.g., a rate) rather than
+    // a running count
+    virtual void set_counter(const std::string& counter, long value) = 0;
 
 };
 
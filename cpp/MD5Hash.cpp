@@ -1,18 +1,174 @@
+#include <string.h>
+
 #include "MD5Hash.h"
+#include "MD5Steps.h"
 
 using namespace std;
 
 
+static const char HEX_CHARS[] = "0123456789abcdef";
+
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_ROTL(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+
+
+static inline uint32_t load_le32(const unsigned char* p) {
+    return ((uint32_t) p[0]) |
+           ((uint32_t) p[1] << 8) |
+           ((uint32_t) p[2] << 16) |
+           ((uint32_t) p[3] << 24);
+}
+
+static inline void store_le32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+}
+
+
+MD5Hash::MD5Hash() {
+    reset();
+}
+
+void MD5Hash::reset() {
+    _state[0] = MD5_INIT_A;
+    _state[1] = MD5_INIT_B;
+    _state[2] = MD5_INIT_C;
+    _state[3] = MD5_INIT_D;
+    _length = 0;
+}
+
+void MD5Hash::reset(const uint32_t* state, uint64_t length) {
+    memcpy(_state, state, sizeof(_state));
+    _length = length;
+}
+
+void MD5Hash::compress(uint32_t* state,
+                       const unsigned char* blocks,
+                       size_t block_count) {
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t x[16];
+
+#define STEP(f, a, b, c, d, k, t, s) \
+    a += MD5_##f(b, c, d) + x[k] + (uint32_t) t; \
+    a = MD5_ROTL(a, s) + b;
+
+    for (size_t block = 0; block < block_count; ++block) {
+        const unsigned char* p = blocks + block * BLOCK_SIZE;
+        for (int i = 0; i < 16; ++i) {
+            x[i] = load_le32(p + i * 4);
+        }
+
+        const uint32_t aa = a;
+        const uint32_t bb = b;
+        const uint32_t cc = c;
+        const uint32_t dd = d;
+
+        MD5_STEPS
+
+        a += aa;
+        b += bb;
+        c += cc;
+        d += dd;
+    }
+
+#undef STEP
+
+    state[0] = a;
+    state[1] = b;
+    state[2] = c;
+    state[3] = d;
+}
+
 void MD5Hash::update(const std::string& chunk) {
-    //TODO: implement update
+    update(chunk.data(), chunk.length());
+}
+
+void MD5Hash::update(const void* data, size_t length) {
+    const unsigned char* p = (const unsigned char*) data;
+    size_t buffered = (size_t) (_length % BLOCK_SIZE);
+    _length += length;
+
+    if (buffered > 0) {
+        size_t fill = BLOCK_SIZE - buffered;
+        if (length < fill) {
+            memcpy(_buffer + buffered, p, length);
+            return;
+        }
+        memcpy(_buffer + buffered, p, fill);
+        compress(_state, _buffer, 1);
+        p += fill;
+        length -= fill;
+    }
+
+    if (length >= (size_t) BLOCK_SIZE) {
+        size_t block_count = length / BLOCK_SIZE;
+        compress(_state, p, block_count);
+        p += block_count * BLOCK_SIZE;
+        length -= block_count * BLOCK_SIZE;
+    }
+
+    if (length > 0) {
+        memcpy(_buffer, p, length);
+    }
+}
+
+void MD5Hash::digest(unsigned char* digest_out) const {
+    uint32_t state[4];
+    unsigned char tail[BLOCK_SIZE * 2];
+    size_t buffered = (size_t) (_length % BLOCK_SIZE);
+
+    memcpy(state, _state, sizeof(state));
+    memcpy(tail, _buffer, buffered);
+    tail[buffered] = 0x80;
+
+    size_t tail_length = (buffered < 56) ? BLOCK_SIZE : BLOCK_SIZE * 2;
+    memset(tail + buffered + 1, 0, tail_length - buffered - 1 - 8);
+
+    const uint64_t bit_length = _length * 8;
+    store_le32(tail + tail_length - 8, (uint32_t) bit_length);
+    store_le32(tail + tail_length - 4, (uint32_t) (bit_length >> 32));
+
+    compress(state, tail, tail_length / BLOCK_SIZE);
+
+    for (int i = 0; i < 4; ++i) {
+        store_le32(digest_out + i * 4, state[i]);
+    }
 }
 
-std::string MD5Hash::hexdigest() {
-    //TODO: implement hexdigest
+std::string MD5Hash::digest() const {
+    unsigned char raw[DIGEST_SIZE];
+    digest(raw);
+    return string((const char*) raw, DIGEST_SIZE);
 }
 
-int MD5Hash::length() {
-    //TODO: implement length
+std::string MD5Hash::hexdigest() const {
+    unsigned char raw[DIGEST_SIZE];
+    char hex[DIGEST_SIZE * 2];
+    digest(raw);
+    to_hex(raw, hex);
+    return string(hex, DIGEST_SIZE * 2);
 }
 
+uint64_t MD5Hash::length() const {
+    return _length;
+}
 
+uint64_t MD5Hash::block_state(uint32_t* state_out) const {
+    memcpy(state_out, _state, sizeof(_state));
+    return _length - _length % BLOCK_SIZE;
+}
+
+void MD5Hash::to_hex(const unsigned char* digest, char* hex_out) {
+    for (int i = 0; i < DIGEST_SIZE; ++i) {
+        hex_out[i * 2] = HEX_CHARS[digest[i] >> 4];
+        hex_out[i * 2 + 1] = HEX_CHARS[digest[i] & 0x0f];
+    }
+}
@@ -1,18 +1,54 @@
 #ifndef MD5HASH_H
 #define MD5HASH_H
 
+#include <stdint.h>
+#include <stddef.h>
 #include <string>
 
 
 class MD5Hash {
 
+private:
+    uint32_t _state[4];
+    unsigned char _buffer[64];
+    uint64_t _length;
+
+
 public:
+    static const int DIGEST_SIZE = 16;
+    static const int BLOCK_SIZE = 64;
+
+
+    MD5Hash();
+
+    void reset();
+
+    // Resume from a state saved by block_state(); length is the number
+    // of bytes that state covers and must be a whole number of blocks.
+    void reset(const uint32_t* state, uint64_t length);
+
     void update(const std::string& chunk);
-    std::string hexdigest();
-    int length();
+    void update(const void* data, size_t length);
+
+    // raw 16 byte digest; the hash can keep being updated afterwards
+    void digest(unsigned char* digest_out) const;
+    std::string digest() const;
+    std::string hexdigest() const;
+
+    // number of bytes hashed so far
+    uint64_t length() const;
 
+    // State after the whole blocks hashed so far and the number of bytes
+    // they hold; the bytes after them are still in the buffer.
+    uint64_t block_state(uint32_t* state_out) const;
+
+    // Run the compression function over whole 64 byte blocks.
+    static void compress(uint32_t* state,
+                         const unsigned char* blocks,
+                         size_t block_count);
+
+    static void to_hex(const unsigned char* digest, char* hex_out);
 };
 
 
 #endif
-
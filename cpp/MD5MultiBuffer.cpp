@@ -0,0 +1,397 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MD5_MB_X86 1
+#endif
+
+#include "MD5MultiBuffer.h"
+#include "MD5Steps.h"
+
+using namespace std;
+
+
+// Processes one 64 byte block for each of the lanes. state holds the
+// a, b, c and d words of all lanes: state[0..LANES-1] are the a words,
+// state[LANES..2*LANES-1] the b words, and so on.
+typedef void (*MD5LaneKernel)(uint32_t* state,
+                              const unsigned char* const* blocks);
+
+
+static inline void store_le32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+}
+
+
+#ifdef MD5_MB_X86
+
+#define AVX2_F(x, y, z) \
+    _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z)))
+#define AVX2_G(x, y, z) \
+    _mm256_xor_si256(y, _mm256_and_si256(z, _mm256_xor_si256(x, y)))
+#define AVX2_H(x, y, z) \
+    _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define AVX2_I(x, y, z) \
+    _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, ones)))
+#define AVX2_ROTL(x, s) \
+    _mm256_or_si256(_mm256_slli_epi32(x, s), _mm256_srli_epi32(x, 32 - (s)))
+
+// ternary logic truth tables for the MD5 round functions. The maskz
+// forms of the other AVX-512 intrinsics used below avoid GCC's
+// uninitialized warnings about _mm512_undefined_epi32.
+#define AVX512_F(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xca)
+#define AVX512_G(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xe4)
+#define AVX512_H(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define AVX512_I(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x39)
+
+
+// Load 32 bytes from each of 8 blocks and transpose, so that out[i]
+// holds 32-bit word i of every block.
+__attribute__((target("avx2"), always_inline))
+static inline void load_transpose_8x8(const unsigned char* const* blocks,
+                                      int offset,
+                                      __m256i* out) {
+    __m256i r[8];
+    for (int i = 0; i < 8; ++i) {
+        r[i] = _mm256_loadu_si256((const __m256i*) (blocks[i] + offset));
+    }
+
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    out[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    out[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    out[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    out[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    out[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    out[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    out[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    out[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+__attribute__((target("avx2")))
+static void md5_kernel_avx2(uint32_t* state,
+                            const unsigned char* const* blocks) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i x[16];
+
+    load_transpose_8x8(blocks, 0, x);
+    load_transpose_8x8(blocks, 32, x + 8);
+
+    __m256i a = _mm256_loadu_si256((const __m256i*) (state));
+    __m256i b = _mm256_loadu_si256((const __m256i*) (state + 8));
+    __m256i c = _mm256_loadu_si256((const __m256i*) (state + 16));
+    __m256i d = _mm256_loadu_si256((const __m256i*) (state + 24));
+    const __m256i aa = a;
+    const __m256i bb = b;
+    const __m256i cc = c;
+    const __m256i dd = d;
+
+#define STEP(f, a, b, c, d, k, t, s) \
+    a = _mm256_add_epi32(a, _mm256_add_epi32(AVX2_##f(b, c, d), \
+        _mm256_add_epi32(x[k], _mm256_set1_epi32((int) t)))); \
+    a = _mm256_add_epi32(AVX2_ROTL(a, s), b);
+
+    MD5_STEPS
+
+#undef STEP
+
+    _mm256_storeu_si256((__m256i*) (state), _mm256_add_epi32(a, aa));
+    _mm256_storeu_si256((__m256i*) (state + 8), _mm256_add_epi32(b, bb));
+    _mm256_storeu_si256((__m256i*) (state + 16), _mm256_add_epi32(c, cc));
+    _mm256_storeu_si256((__m256i*) (state + 24), _mm256_add_epi32(d, dd));
+}
+
+__attribute__((target("avx512f")))
+static void md5_kernel_avx512(uint32_t* state,
+                              const unsigned char* const* blocks) {
+    __m512i x[16];
+    __m256i lo[16];
+    __m256i hi[16];
+
+    // transpose lanes 0-7 and 8-15 separately, then join the halves
+    load_transpose_8x8(blocks, 0, lo);
+    load_transpose_8x8(blocks, 32, lo + 8);
+    load_transpose_8x8(blocks + 8, 0, hi);
+    load_transpose_8x8(blocks + 8, 32, hi + 8);
+    for (int i = 0; i < 16; ++i) {
+        x[i] = _mm512_maskz_inserti64x4(0xff,
+                                         _mm512_castsi256_si512(lo[i]),
+                                         hi[i],
+                                         1);
+    }
+
+    __m512i a = _mm512_loadu_si512((const void*) (state));
+    __m512i b = _mm512_loadu_si512((const void*) (state + 16));
+    __m512i c = _mm512_loadu_si512((const void*) (state + 32));
+    __m512i d = _mm512_loadu_si512((const void*) (state + 48));
+    const __m512i aa = a;
+    const __m512i bb = b;
+    const __m512i cc = c;
+    const __m512i dd = d;
+
+#define STEP(f, a, b, c, d, k, t, s) \
+    a = _mm512_add_epi32(a, _mm512_add_epi32(AVX512_##f(b, c, d), \
+        _mm512_add_epi32(x[k], _mm512_set1_epi32((int) t)))); \
+    a = _mm512_add_epi32(_mm512_maskz_rol_epi32(0xffff, a, s), b);
+
+    MD5_STEPS
+
+#undef STEP
+
+    _mm512_storeu_si512((void*) (state), _mm512_add_epi32(a, aa));
+    _mm512_storeu_si512((void*) (state + 16), _mm512_add_epi32(b, bb));
+    _mm512_storeu_si512((void*) (state + 32), _mm512_add_epi32(c, cc));
+    _mm512_storeu_si512((void*) (state + 48), _mm512_add_epi32(d, dd));
+}
+
+#endif
+
+
+// Per-lane bookkeeping for the scheduler: where the next whole block of
+// the current job is, and the padded final block(s).
+class MD5Lane {
+
+public:
+    MD5Job* job;
+    const unsigned char* next_block;
+    size_t full_blocks;
+    int tail_blocks;
+    int tail_index;
+    unsigned char tail[MD5Hash::BLOCK_SIZE * 2];
+
+
+    void load(MD5Job* lane_job) {
+        job = lane_job;
+        next_block = job->data;
+        full_blocks = job->length / MD5Hash::BLOCK_SIZE;
+
+        const size_t remainder = job->length % MD5Hash::BLOCK_SIZE;
+        if (remainder > 0) {
+            memcpy(tail,
+                   job->data + full_blocks * MD5Hash::BLOCK_SIZE,
+                   remainder);
+        }
+        tail[remainder] = 0x80;
+        tail_blocks = (remainder < 56) ? 1 : 2;
+        const size_t tail_length = tail_blocks * MD5Hash::BLOCK_SIZE;
+        memset(tail + remainder + 1, 0, tail_length - remainder - 1 - 8);
+
+        const uint64_t bit_length =
+            (job->initial_length + (uint64_t) job->length) * 8;
+        store_le32(tail + tail_length - 8, (uint32_t) bit_length);
+        store_le32(tail + tail_length - 4, (uint32_t) (bit_length >> 32));
+        tail_index = 0;
+    }
+
+    const unsigned char* current_block() const {
+        if (full_blocks > 0) {
+            return next_block;
+        }
+        return tail + tail_index * MD5Hash::BLOCK_SIZE;
+    }
+
+    // returns true once the job's last block has been processed
+    bool advance() {
+        if (full_blocks > 0) {
+            next_block += MD5Hash::BLOCK_SIZE;
+            --full_blocks;
+            return false;
+        }
+        ++tail_index;
+        return tail_index == tail_blocks;
+    }
+};
+
+
+static const uint32_t MD5_INIT[4] = {
+    MD5_INIT_A, MD5_INIT_B, MD5_INIT_C, MD5_INIT_D
+};
+
+
+template <int LANES>
+static inline void load_lane(MD5Lane& l,
+                             MD5Job* job,
+                             uint32_t* state,
+                             int lane) {
+    l.load(job);
+    const uint32_t* initial =
+        (job->initial_state != NULL) ? job->initial_state : MD5_INIT;
+    for (int w = 0; w < 4; ++w) {
+        state[w * LANES + lane] = initial[w];
+    }
+}
+
+template <int LANES>
+static void digest_jobs_lanes(MD5Job* jobs,
+                              size_t job_count,
+                              MD5LaneKernel kernel) {
+    static const unsigned char idle_block[MD5Hash::BLOCK_SIZE] = { 0 };
+
+    uint32_t state[4 * LANES];
+    const unsigned char* blocks[LANES];
+    MD5Lane lanes[LANES];
+    size_t next_job = 0;
+    int active = 0;
+
+    for (int lane = 0; lane < LANES; ++lane) {
+        for (int w = 0; w < 4; ++w) {
+            state[w * LANES + lane] = MD5_INIT[w];
+        }
+        if (next_job < job_count) {
+            load_lane<LANES>(lanes[lane], &jobs[next_job++], state, lane);
+            ++active;
+        } else {
+            lanes[lane].job = NULL;
+        }
+    }
+
+    while (active > 0) {
+        if (active == 1 && next_job == job_count) {
+            // only a straggler left; finish it without the wide kernel
+            break;
+        }
+
+        for (int lane = 0; lane < LANES; ++lane) {
+            if (lanes[lane].job != NULL) {
+                blocks[lane] = lanes[lane].current_block();
+            } else {
+                blocks[lane] = idle_block;
+            }
+        }
+
+        kernel(state, blocks);
+
+        for (int lane = 0; lane < LANES; ++lane) {
+            MD5Lane& l = lanes[lane];
+            if (l.job == NULL || !l.advance()) {
+                continue;
+            }
+
+            for (int w = 0; w < 4; ++w) {
+                store_le32(l.job->digest + w * 4, state[w * LANES + lane]);
+            }
+
+            if (next_job < job_count) {
+                load_lane<LANES>(l, &jobs[next_job++], state, lane);
+            } else {
+                l.job = NULL;
+                --active;
+            }
+        }
+    }
+
+    for (int lane = 0; lane < LANES; ++lane) {
+        MD5Lane& l = lanes[lane];
+        if (l.job == NULL) {
+            continue;
+        }
+
+        uint32_t lane_state[4];
+        for (int w = 0; w < 4; ++w) {
+            lane_state[w] = state[w * LANES + lane];
+        }
+        if (l.full_blocks > 0) {
+            MD5Hash::compress(lane_state, l.next_block, l.full_blocks);
+        }
+        MD5Hash::compress(lane_state,
+                          l.tail + l.tail_index * MD5Hash::BLOCK_SIZE,
+                          l.tail_blocks - l.tail_index);
+        for (int w = 0; w < 4; ++w) {
+            store_le32(l.job->digest + w * 4, lane_state[w]);
+        }
+    }
+}
+
+static MD5MultiBuffer::Engine detect_engine() {
+#ifdef MD5_MB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return MD5MultiBuffer::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return MD5MultiBuffer::AVX2;
+    }
+#endif
+    return MD5MultiBuffer::SCALAR;
+}
+
+
+MD5MultiBuffer::Engine MD5MultiBuffer::engine() {
+    static const Engine best_engine = detect_engine();
+    return best_engine;
+}
+
+const char* MD5MultiBuffer::engine_name(Engine engine) {
+    switch (engine) {
+        case AVX512:
+            return "avx512";
+        case AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+int MD5MultiBuffer::lanes(Engine engine) {
+    switch (engine) {
+        case AVX512:
+            return 16;
+        case AVX2:
+            return 8;
+        default:
+            return 1;
+    }
+}
+
+void MD5MultiBuffer::digest_jobs(MD5Job* jobs, size_t job_count) {
+    digest_jobs(jobs, job_count, engine());
+}
+
+void MD5MultiBuffer::digest_jobs(MD5Job* jobs,
+                                 size_t job_count,
+                                 Engine requested) {
+    const Engine best = engine();
+    if (requested > best) {
+        requested = best;
+    }
+
+#ifdef MD5_MB_X86
+    if (requested == AVX512 && job_count > 8) {
+        digest_jobs_lanes<16>(jobs, job_count, md5_kernel_avx512);
+        return;
+    }
+    if (requested >= AVX2 && job_count > 1) {
+        digest_jobs_lanes<8>(jobs, job_count, md5_kernel_avx2);
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < job_count; ++i) {
+        MD5Hash hash;
+        if (jobs[i].initial_state != NULL) {
+            hash.reset(jobs[i].initial_state, jobs[i].initial_length);
+        }
+        hash.update(jobs[i].data, jobs[i].length);
+        hash.digest(jobs[i].digest);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef MD5MULTIBUFFER_H
+#define MD5MULTIBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MD5Hash.h"
+
+
+class MD5Job {
+
+public:
+    const unsigned char* data;
+    size_t length;
+    // optional saved state (see MD5Hash::block_state) that data carries
+    // on from, e.g. a common prefix hashed once for many messages
+    const uint32_t* initial_state;
+    uint64_t initial_length;
+    unsigned char digest[MD5Hash::DIGEST_SIZE];
+
+
+    MD5Job() :
+        data(NULL),
+        length(0),
+        initial_state(NULL),
+        initial_length(0) {
+    }
+
+    MD5Job(const void* data_value, size_t length_value) :
+        data((const unsigned char*) data_value),
+        length(length_value),
+        initial_state(NULL),
+        initial_length(0) {
+    }
+};
+
+
+/**
+ * Multi-buffer MD5 engine. Hashes many independent messages at once by
+ * running one message per SIMD lane: 8 lanes with AVX2, 16 with
+ * AVX-512. Whenever a lane's message is finished the next job is loaded
+ * into it, so messages of different lengths keep all lanes busy. The
+ * kernel is picked once at runtime from what the CPU supports; machines
+ * without AVX2 fall back to hashing the jobs one at a time.
+ */
+class MD5MultiBuffer {
+
+public:
+    enum Engine {
+        SCALAR,
+        AVX2,
+        AVX512
+    };
+
+
+    // best engine supported by this CPU
+    static Engine engine();
+    static const char* engine_name(Engine engine);
+    static int lanes(Engine engine);
+
+    // Fill in the digest of every job.
+    static void digest_jobs(MD5Job* jobs, size_t job_count);
+
+    // As above with an explicit engine, e.g. to compare engines. Falls
+    // back to the best supported engine if the CPU lacks the one asked for.
+    static void digest_jobs(MD5Job* jobs, size_t job_count, Engine engine);
+};
+
+#endif
@@ -1,38 +1,109 @@
-#include <signal.h>
 #include <stdlib.h>
-#include <unistd.h>
+#include <string.h>
+#include <errno.h>
 #include <string>
 #include <vector>
 #include <algorithm>
 
 #include "MPObjectAuditor.h"
+#include "AuditorWorker.h"
+#include "AuditProcessPool.h"
+#include "AuditWorkQueue.h"
+#include "DiskFileRouter.h"
 #include "OSUtils.h"
+#include "StrUtils.h"
 #include "SwiftUtils.h"
 
 using namespace std;
 
 
-int MPObjectAuditor::fork_child(AuditorOptions& options, bool zero_byte_fps) {
-    //Child execution
-    int pid = OSUtils::fork();
-    if (pid) {
-        return pid;
-    } else {
-        signal(SIGTERM, SIG_DFL);
+MPObjectAuditor::MPObjectAuditor(ConfigParser conf) :
+    ObjectAuditor(conf) {
 
-        if (zero_byte_fps) {
-            options.zero_byte_fps = this->conf_zero_byte_fps;
-        }
+    this->pool = new AuditProcessPool(this);
+    this->diskfile_router = NULL;
+    this->worker = NULL;
+    this->zbf_worker = NULL;
+}
+
+MPObjectAuditor::~MPObjectAuditor() {
+    delete this->pool;
+    if (this->worker != NULL) {
+        delete this->worker;
+    }
+    if (this->zbf_worker != NULL) {
+        delete this->zbf_worker;
+    }
+    if (this->diskfile_router != NULL) {
+        delete this->diskfile_router;
+    }
+}
+
+AuditorWorker* MPObjectAuditor::_worker_for(bool zero_byte_fps) {
+    if (this->diskfile_router == NULL) {
+        this->diskfile_router = new DiskFileRouter(this->conf.config(),
+                                                   this->logger);
+    }
 
-        try {
-            this->run_audit(options);
-        } catch (const std::exception& e) {
-            this->logger->exception(
-                string("ERROR: Unable to run auditing: ") + e.what());
+    if (zero_byte_fps) {
+        if (this->zbf_worker == NULL) {
+            this->zbf_worker = new AuditorWorker(this->conf.config(),
+                                                 this->logger,
+                                                 this->rcache,
+                                                 this->devices,
+                                                 this->conf_zero_byte_fps,
+                                                 this->diskfile_router);
         }
+        return this->zbf_worker;
+    }
 
-        exit(0);
+    if (this->worker == NULL) {
+        this->worker = new AuditorWorker(this->conf.config(),
+                                         this->logger,
+                                         this->rcache,
+                                         this->devices,
+                                         false,
+                                         this->diskfile_router);
+        this->worker->set_rate_limiter(this->rate_limiter);
+        this->worker->set_throttle(this->throttle);
     }
+    return this->worker;
+}
+
+/**
+ * Runs in a pool process: audit one partition range of one device, or
+ * for the ZBF scanner, one pass over all devices. Other processes can be
+ * auditing ranges of the same device; AuditIndex::save merges in their
+ * saves of its index rather than overwriting them.
+ */
+void MPObjectAuditor::runAssignment(const AuditAssignment& assignment,
+                                    AuditResult& result) {
+    AuditorOptions options(this->pool_options);
+    AuditorWorker* worker = this->_worker_for(assignment.zero_byte_fps);
+
+    if (assignment.zero_byte_fps) {
+        options.zero_byte_fps = true;
+        options.device_dirs = options.override_devices;
+        worker->audit_all_objects(options);
+        result.files_processed = worker->files_processed();
+        result.bytes_processed = worker->bytes_processed_total();
+    } else {
+        const long files_before = worker->files_processed();
+        const long bytes_before = worker->bytes_processed_total();
+        options.zero_byte_fps = false;
+        options.device_dirs = assignment.device;
+        options.partition_lo = assignment.partition_lo;
+        options.partition_hi = assignment.partition_hi;
+        options.partitions.assign(
+            assignment.partitions,
+            assignment.partitions + assignment.partition_count);
+        worker->audit_locations(options);
+        result.files_processed = worker->files_processed() - files_before;
+        result.bytes_processed =
+            worker->bytes_processed_total() - bytes_before;
+    }
+
+    result.status = AuditResult::COMPLETED;
 }
 
 void MPObjectAuditor::audit_loop(bool parent,
@@ -46,77 +117,133 @@ void MPObjectAuditor::audit_loop(bool parent,
     if (parent) {
         options.zero_byte_fps = zbo_fps;
         this->run_audit(options);
+        return;
+    }
+
+    vector<string> device_list;
+    if (options.override_devices.length() > 0) {
+        device_list = SwiftUtils::list_from_csv(options.override_devices);
     } else {
-        vector<int> pids;
-        int zbf_pid;
-        if (this->conf_zero_byte_fps) {
-            options.zero_byte_fps = true;
-            zbf_pid = this->fork_child(options);
-            pids.push_back(zbf_pid);
+        device_list = SwiftUtils::listdir(this->devices);
+    }
+    std::random_shuffle(device_list.begin(), device_list.end());
+
+    // a range's partitions have to fit in one assignment
+    const int partitions_per_range = min(this->partitions_per_range,
+                                         AuditAssignment::MAX_PARTITIONS);
+    AuditWorkQueue work_queue(this->device_concurrency,
+                              options.checkpoint_interval);
+    vector<string>::const_iterator it = device_list.begin();
+    const vector<string>::const_iterator itEnd = device_list.end();
+    for (; it != itEnd; ++it) {
+        if (options.mount_check &&
+            !OSUtils::ismount(OSUtils::path_join(this->devices, *it))) {
+            continue;
         }
+        work_queue.add_device(this->devices, *it, partitions_per_range);
+    }
 
-        if (this->concurrency == 1) {
-            // Audit all devices in 1 process
-            pids.push_back(this->fork_child(options));
-        } else {
-            // Divide devices amongst parallel processes set by
-            // self.concurrency.  Total number of parallel processes
-            // is self.concurrency + 1 if zero_byte_fps.
-            int parallel_proc;
-            vector<string> device_list;
-
-            if (this->conf_zero_byte_fps) {
-                parallel_proc = this->concurrency + 1;
-            } else {
-                parallel_proc = this->concurrency;
-            }
+    // Processes forked on an earlier pass keep running; only missing or
+    // dead ones are forked. The ZBF scanner, if any, is process 0.
+    this->pool_options = options;
+    const int zbf_index = this->conf_zero_byte_fps ? 0 : -1;
+    const int first_auditor = this->conf_zero_byte_fps ? 1 : 0;
+    const int pool_size = max(this->concurrency, 1) + first_auditor;
+    this->pool->start(pool_size);
+
+    AuditAssignment assignment;
+    if (zbf_index > -1) {
+        memset(&assignment, 0, sizeof(assignment));
+        assignment.zero_byte_fps = 1;
+        this->pool->assign(zbf_index, assignment);
+    }
 
-            if (options.override_devices.length() > 0) {
-                device_list = list(options.override_devices);
-            } else {
-                device_list = SwiftUtils::listdir(this->devices);
-            }
+    vector<AuditWorkRange> assigned(pool_size);
+    vector<int> homes(pool_size, -1);
+    for (int i = first_auditor; i < pool_size; ++i) {
+        if (work_queue.device_count() > 0) {
+            homes[i] = i % work_queue.device_count();
+        }
+    }
 
-            std::random_shuffle(device_list.begin(),
-                                device_list.end());
-
-            while (!device_list.empty()) {
-                int pid = -1;
-                if (pids.size() == parallel_proc) {
-                    pid = OSUtils::wait();
-                    ObjectAuditor::erase_id(pids, pid);
-                }
-                // ZBF scanner must be restarted as soon as it finishes
-                if (this->conf_zero_byte_fps && pid == zbf_pid) {
-                    options.device_dirs = options.override_devices;
-                    // sleep between ZBF scanner forks
-                    this->_sleep();
-                    options.zero_byte_fps = true;
-                    zbf_pid = this->fork_child(options);
-                    pids.push_back(zbf_pid);
-                } else {
-                    vector<string> forked_device_dirs;
-                    forked_device_dirs.push_back(device_list.back());
-                    device_list.pop_back();
-                    options.device_dirs = forked_device_dirs;
-                    pids.push_back(this->fork_child(options));
-                }
+    while (true) {
+        bool auditing = false;
+        for (int i = first_auditor; i < pool_size; ++i) {
+            if (!this->pool->busy(i) &&
+                work_queue.next(homes[i], assigned[i], false)) {
+                memset(&assignment, 0, sizeof(assignment));
+                const string& device =
+                    work_queue.device_name(assigned[i].device);
+                strncpy(assignment.device, device.c_str(),
+                        AuditAssignment::MAX_DEVICE - 1);
+                assignment.partition_lo = assigned[i].partition_lo;
+                assignment.partition_hi = assigned[i].partition_hi;
+                const vector<long>& partitions = assigned[i].partitions;
+                assignment.partition_count = (int32_t) partitions.size();
+                std::copy(partitions.begin(), partitions.end(),
+                          assignment.partitions);
+                this->pool->assign(i, assignment);
+            }
+            if (this->pool->busy(i)) {
+                auditing = true;
             }
         }
+        if (!auditing) {
+            break;
+        }
 
-        while (!pids.empty()) {
-            int pid = OSUtils::wait();
-            // ZBF scanner must be restarted as soon as it finishes
-            if (this->conf_zero_byte_fps && pid == zbf_pid &&
-                pids.size() > 1) {
-                options.device_dirs = options.override_devices;
-                // sleep between ZBF scanner forks
-                this->_sleep();
-                options.zero_byte_fps = true;
-                pids.push_back(this->fork_child(options));
+        AuditResult result;
+        const int index = this->pool->wait_result(result);
+        if (result.status == AuditResult::DIED) {
+            this->logger->error(string("ERROR: audit process ") +
+                                StrUtils::toString(index) + " died");
+            this->pool->start(pool_size);
+        } else if (result.status == AuditResult::FAILED) {
+            this->logger->error(string("ERROR: Unable to run auditing in ") +
+                                "process " + StrUtils::toString(index));
+        }
+
+        if (index == zbf_index) {
+            // ZBF scanner must be restarted as soon as it finishes, as
+            // long as the full audit is still going
+            if (work_queue.finished()) {
+                continue;
+            }
+            memset(&assignment, 0, sizeof(assignment));
+            assignment.zero_byte_fps = 1;
+            assignment.delay = this->interval;
+            this->pool->assign(zbf_index, assignment);
+        } else if (result.status == AuditResult::DIED &&
+                   work_queue.retry(assigned[index])) {
+            // handed out again, maybe to another process
+        } else {
+            const AuditWorkRange& range = assigned[index];
+            const string& device = work_queue.device_name(range.device);
+            if (result.status == AuditResult::DIED) {
+                this->logger->error(
+                    string("ERROR: giving up on partitions ") +
+                    StrUtils::toString(range.partition_lo) + "-" +
+                    StrUtils::toString(range.partition_hi - 1) + " of " +
+                    device + " after a second audit process died on them");
+            }
+            if (!work_queue.done(range)) {
+                this->logger->warning(
+                    string("Unable to save audit checkpoint of ") + device +
+                    ": " + strerror(errno));
             }
-            ObjectAuditor::erase_id(pids, pid);
         }
     }
-}
 
+    // let a ZBF pass in progress finish, as the forked scanner used to;
+    // one still waiting out its delay is stopped
+    if (zbf_index > -1) {
+        this->pool->cancel_delay(zbf_index);
+    }
+    while (zbf_index > -1 && this->pool->busy(zbf_index)) {
+        AuditResult result;
+        if (this->pool->wait_result(result) == zbf_index &&
+            result.status == AuditResult::DIED) {
+            this->pool->start(pool_size);
+        }
+    }
+}
@@ -2,32 +2,54 @@
 #define MPOBJECTAUDITOR_H
 
 
+#include "AuditAssignmentHook.h"
+#include "AuditorOptions.h"
 #include "ObjectAuditor.h"
 
 
-class AuditorOptions;
+class AuditorWorker;
+class AuditProcessPool;
 class ConfigParser;
+class DiskFileRouter;
 
 
-class MPObjectAuditor : ObjectAuditor 
+/**
+ * Audits with a pool of concurrency worker processes (plus one for the
+ * ZBF scanner) that are forked once and then kept across passes. The
+ * parent hands them partition ranges over pipes; each process keeps its
+ * AuditorWorker and DiskFileRouter from one assignment to the next.
+ */
+class MPObjectAuditor : ObjectAuditor, public AuditAssignmentHook
 {
 
 private:
+    AuditProcessPool* pool;
+    AuditorOptions pool_options;
+    // only used inside pool processes
+    DiskFileRouter* diskfile_router;
+    AuditorWorker* worker;
+    AuditorWorker* zbf_worker;
+
     // disallow copies
     MPObjectAuditor(const MPObjectAuditor&);
     MPObjectAuditor& operator=(const MPObjectAuditor&);
     MPObjectAuditor();
 
+    AuditorWorker* _worker_for(bool zero_byte_fps);
+
+
 public:
     MPObjectAuditor(ConfigParser conf);
-
-    int fork_child(AuditorOptions& options, bool zero_byte_fps=false);
+    ~MPObjectAuditor();
 
     void audit_loop(bool parent,
                     int zbo_fps,
                     AuditorOptions& options);
 
+    // AuditAssignmentHook
+    void runAssignment(const AuditAssignment& assignment,
+                       AuditResult& result);
+
 };
 
 #endif
-
@@ -1,15 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <string>
 #include <vector>
 #include <algorithm>
 
 #include "MTObjectAuditor.h"
+#include "AuditorWorker.h"
+#include "AuditWorkQueue.h"
+#include "DiskFileRouter.h"
+#include "Exceptions.h"
 #include "OSUtils.h"
 #include "SwiftUtils.h"
+#include "Time.h"
 
 using namespace std;
 
 
-int MTObjectAuditor::run_thread(AuditorOptions& options) {
+MTObjectAuditor::MTObjectAuditor(ConfigParser conf) :
+    ObjectAuditor(conf) {
+
+    this->diskfile_router = new DiskFileRouter(conf.config(), this->logger);
+    this->work_queue = NULL;
+}
+
+MTObjectAuditor::~MTObjectAuditor() {
+    delete this->diskfile_router;
+}
+
+pthread_t MTObjectAuditor::run_thread(const AuditorOptions& options,
+                                      int home,
+                                      void* (*thread_main)(void*)) {
+    ThreadArgs* args = new ThreadArgs();
+    args->auditor = this;
+    args->options = options;
+    args->home = home;
+
+    pthread_t tid;
+    int rc = pthread_create(&tid, NULL, thread_main, args);
+    if (rc != 0) {
+        delete args;
+        throw OSError(rc);
+    }
+    return tid;
+}
+
+void* MTObjectAuditor::_audit_thread(void* arg) {
+    ThreadArgs* args = (ThreadArgs*) arg;
+    try {
+        args->auditor->_audit_ranges(args->options, args->home);
+    } catch (const std::exception& e) {
+        args->auditor->logger->exception(
+            string("ERROR: Unable to run auditing: ") + e.what());
+    }
+    delete args;
+    return NULL;
+}
+
+void* MTObjectAuditor::_zbf_thread(void* arg) {
+    ThreadArgs* args = (ThreadArgs*) arg;
+    try {
+        args->auditor->_scan_zero_byte_files(args->options);
+    } catch (const std::exception& e) {
+        args->auditor->logger->exception(
+            string("ERROR: Unable to run auditing: ") + e.what());
+    }
+    delete args;
+    return NULL;
+}
+
+/**
+ * Thread body: audit ranges from the work queue, starting on the home
+ * device, until there are none left. One worker (and so one set of read
+ * queues, buffers and stats) per thread; the router is shared.
+ */
+void MTObjectAuditor::_audit_ranges(AuditorOptions& options, int home) {
+    AuditorWorker worker(this->conf.config(),
+                         this->logger,
+                         this->rcache,
+                         this->devices,
+                         false,
+                         this->diskfile_router);
+    worker.set_rate_limiter(this->rate_limiter);
+    worker.set_throttle(this->throttle);
+
+    AuditWorkRange range;
+    while (this->work_queue->next(home, range)) {
+        options.device_dirs = this->work_queue->device_name(range.device);
+        options.partition_lo = range.partition_lo;
+        options.partition_hi = range.partition_hi;
+        options.partitions = range.partitions;
+        try {
+            worker.audit_locations(options);
+        } catch (const std::exception& e) {
+            this->logger->exception(
+                string("ERROR auditing ") + options.device_dirs + ": " +
+                e.what());
+        }
+        if (!this->work_queue->done(range)) {
+            this->logger->warning(
+                string("Unable to save audit checkpoint of ") +
+                options.device_dirs + ": " + strerror(errno));
+        }
+    }
+}
+
+/**
+ * The ZBF scanner is restarted as soon as it finishes for as long as the
+ * full audit is still running, sleeping the usual interval in between.
+ */
+void MTObjectAuditor::_scan_zero_byte_files(AuditorOptions& options) {
+    AuditorWorker worker(this->conf.config(),
+                         this->logger,
+                         this->rcache,
+                         this->devices,
+                         this->conf_zero_byte_fps,
+                         this->diskfile_router);
+
+    // checked before each pass as well as while sleeping, or an interval
+    // of 0 never looks and keeps sweeping after the pass is finished
+    while (!this->work_queue->finished()) {
+        worker.audit_all_objects(options);
+        // sleep in short steps so a finished pass isn't held up
+        for (int slept = 0; slept < this->interval; ++slept) {
+            if (this->work_queue->finished()) {
+                return;
+            }
+            Time::sleep(1);
+        }
+    }
 }
 
 void MTObjectAuditor::audit_loop(bool parent,
@@ -23,77 +142,57 @@ void MTObjectAuditor::audit_loop(bool parent,
     if (parent) {
         options.zero_byte_fps = zbo_fps;
         this->run_audit(options);
+        return;
+    }
+
+    vector<string> device_list;
+    if (options.override_devices.length() > 0) {
+        device_list = SwiftUtils::list_from_csv(options.override_devices);
     } else {
-        vector<int> tids;
-        int zbf_tid;
-        if (this->conf_zero_byte_fps) {
-            options.zero_byte_fps = true;
-            zbf_tid = this->run_thread(options);
-            tids.push_back(zbf_tid);
-        }
+        device_list = SwiftUtils::listdir(this->devices);
+    }
+    std::random_shuffle(device_list.begin(), device_list.end());
 
-        if (this->concurrency == 1) {
-            // Audit all devices in 1 process
-            tids.push_back(this->run_thread(options));
-        } else {
-            // Divide devices amongst parallel processes set by
-            // self.concurrency.  Total number of parallel processes
-            // is self.concurrency + 1 if zero_byte_fps.
-            int parallel_proc;
-            vector<string> device_list;
-
-            if (this->conf_zero_byte_fps) {
-                parallel_proc = this->concurrency + 1;
-            } else {
-                parallel_proc = this->concurrency;
-            }
+    AuditWorkQueue work_queue(this->device_concurrency,
+                              options.checkpoint_interval);
+    vector<string>::const_iterator it = device_list.begin();
+    const vector<string>::const_iterator itEnd = device_list.end();
+    for (; it != itEnd; ++it) {
+        if (options.mount_check &&
+            !OSUtils::ismount(OSUtils::path_join(this->devices, *it))) {
+            continue;
+        }
+        work_queue.add_device(this->devices, *it,
+                              this->partitions_per_range);
+    }
+    this->work_queue = &work_queue;
 
-            if (options.override_devices.length() > 0) {
-                device_list = list(options.override_devices);
-            } else {
-                device_list = SwiftUtils::listdir(this->devices);
-            }
+    vector<pthread_t> tids;
+    pthread_t zbf_tid;
+    if (this->conf_zero_byte_fps) {
+        AuditorOptions zbf_options(options);
+        zbf_options.zero_byte_fps = true;
+        zbf_tid = this->run_thread(zbf_options, -1,
+                                   MTObjectAuditor::_zbf_thread);
+    }
 
-            std::random_shuffle(device_list.begin(),
-                                device_list.end());
-
-            while (!device_list.empty()) {
-                int tid = -1;
-                if (tids.size() == parallel_proc) {
-                    tid = OSUtils::wait();
-                    ObjectAuditor::erase_id(tids, tid);
-                }
-                // ZBF scanner must be restarted as soon as it finishes
-                if (this->conf_zero_byte_fps && tid == zbf_tid) {
-                    options.device_dirs = options.override_devices;
-                    // sleep between ZBF scanner thread executions
-                    this->_sleep();
-                    options.zero_byte_fps = true;
-                    zbf_tid = this->run_thread(options);
-                    tids.push_back(zbf_tid);
-                } else {
-                    vector<string> threaded_device_dirs;
-                    threaded_device_dirs.push_back(device_list.back());
-                    device_list.pop_back();
-                    options.device_dirs = threaded_device_dirs;
-                    tids.push_back(this->run_thread(options));
-                }
-            }
-        }
+    // spread the threads' home devices; they move on by stealing
+    options.zero_byte_fps = false;
+    const int thread_count = max(this->concurrency, 1);
+    for (int i = 0; i < thread_count; ++i) {
+        const int home = work_queue.device_count() > 0 ?
+                         i % work_queue.device_count() : -1;
+        tids.push_back(this->run_thread(options, home,
+                                        MTObjectAuditor::_audit_thread));
+    }
 
-        while (!tids.empty()) {
-            int tid = OSUtils::wait();
-            // ZBF scanner must be restarted as soon as it finishes
-            if (this->conf_zero_byte_fps && tid == zbf_tid &&
-                tids.size() > 1) {
-                options.device_dirs = options.override_devices;
-                // sleep between ZBF scanner thread executions
-                this->_sleep();
-                options.zero_byte_fps = true;
-                tids.push_back(this->run_thread(options));
-            }
-            ObjectAuditor::erase_id(tids, tid);
-        }
+    vector<pthread_t>::const_iterator itTid = tids.begin();
+    const vector<pthread_t>::const_iterator itTidEnd = tids.end();
+    for (; itTid != itTidEnd; ++itTid) {
+        pthread_join(*itTid, NULL);
     }
+    if (this->conf_zero_byte_fps) {
+        pthread_join(zbf_tid, NULL);
+    }
+    this->work_queue = NULL;
 }
-
@@ -1,28 +1,57 @@
 #ifndef MTOBJECTAUDITOR_H
 #define MTOBJECTAUDITOR_H
 
+#include <pthread.h>
 
+#include "AuditorOptions.h"
 #include "ObjectAuditor.h"
 
 
-class AuditorOptions;
+class AuditWorkQueue;
 class ConfigParser;
+class DiskFileRouter;
 
 
+/**
+ * Audits all devices from one process with concurrency threads. Work is
+ * handed out as partition ranges through an AuditWorkQueue so threads that
+ * finish their own device help with the others, up to device_concurrency
+ * threads per device. Policies and the DiskFileRouter are loaded once and
+ * shared by every thread.
+ */
 class MTObjectAuditor : ObjectAuditor 
 {
 
 private:
+    class ThreadArgs {
+    public:
+        MTObjectAuditor* auditor;
+        AuditorOptions options;
+        int home;
+    };
+
+    DiskFileRouter* diskfile_router;
+    AuditWorkQueue* work_queue;
+
     // disallow copies
     MTObjectAuditor(const MTObjectAuditor&);
     MTObjectAuditor& operator=(const MTObjectAuditor&);
     MTObjectAuditor();
 
+    static void* _audit_thread(void* arg);
+    static void* _zbf_thread(void* arg);
+
+    void _audit_ranges(AuditorOptions& options, int home);
+    void _scan_zero_byte_files(AuditorOptions& options);
+
 
 public:
     MTObjectAuditor(ConfigParser conf);
+    ~MTObjectAuditor();
 
-    int run_thread(AuditorOptions& options);
+    pthread_t run_thread(const AuditorOptions& options,
+                         int home,
+                         void* (*thread_main)(void*));
 
     void audit_loop(bool parent,
                     int zbo_fps,
@@ -31,4 +60,3 @@ public:
 };
 
 #endif
-
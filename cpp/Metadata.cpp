@@ -0,0 +1,309 @@
+#include <string.h>
+#include <strings.h>
+
+#include "Metadata.h"
+
+using namespace std;
+
+// spelled the way Swift writes them; indexed by Metadata::Key
+static const char* KEY_NAMES[Metadata::KEY_COUNT] = {
+    "name",
+    "Content-Length",
+    "Content-Type",
+    "ETag",
+    "X-Timestamp",
+    "X-Delete-At",
+    "deleted"
+};
+
+// lower-cased keys of DATAFILE_SYSTEM_META
+static const char* DATAFILE_SYSTEM_META[] = {
+    "content-length",
+    "content-type",
+    "deleted",
+    "etag"
+};
+
+static const char SYSMETA_PREFIX[] = "x-object-sysmeta-";
+
+
+Metadata::Metadata() {
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        _known[i] = -1;
+    }
+}
+
+Metadata::Metadata(const Metadata& copy) :
+    _arena(copy._arena),
+    _entries(copy._entries) {
+    memcpy(_known, copy._known, sizeof(_known));
+}
+
+Metadata& Metadata::operator=(const Metadata& copy) {
+    if (this == &copy) {
+        return *this;
+    }
+
+    _arena = copy._arena;
+    _entries = copy._entries;
+    memcpy(_known, copy._known, sizeof(_known));
+
+    return *this;
+}
+
+int Metadata::key_id(const char* key, size_t key_length) {
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        if (strlen(KEY_NAMES[i]) == key_length &&
+            memcmp(KEY_NAMES[i], key, key_length) == 0) {
+            return i;
+        }
+    }
+    return OTHER;
+}
+
+const char* Metadata::key_name(int key_id) {
+    if (key_id < 0 || key_id >= KEY_COUNT) {
+        return NULL;
+    }
+    return KEY_NAMES[key_id];
+}
+
+/**
+ * Whether key is in DATAFILE_SYSTEM_META or is object sysmeta, ignoring
+ * case, without lower-casing a copy of it.
+ */
+bool Metadata::is_system_key(const char* key, size_t key_length) {
+    const size_t count =
+        sizeof(DATAFILE_SYSTEM_META) / sizeof(DATAFILE_SYSTEM_META[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (strlen(DATAFILE_SYSTEM_META[i]) == key_length &&
+            strncasecmp(DATAFILE_SYSTEM_META[i], key, key_length) == 0) {
+            return true;
+        }
+    }
+
+    const size_t prefix_length = sizeof(SYSMETA_PREFIX) - 1;
+    return key_length > prefix_length &&
+        strncasecmp(SYSMETA_PREFIX, key, prefix_length) == 0;
+}
+
+void Metadata::clear() {
+    _arena.clear();
+    _entries.clear();
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        _known[i] = -1;
+    }
+}
+
+int Metadata::_find(const char* key, size_t key_length) const {
+    const int id = key_id(key, key_length);
+    if (id != OTHER) {
+        return _known[id];
+    }
+
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        const Entry& entry = _entries[i];
+        if (entry.key == OTHER &&
+            entry.key_length == key_length &&
+            memcmp(_arena.data() + entry.key_offset, key, key_length) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+uint32_t Metadata::_append(const char* data, size_t length) {
+    const uint32_t offset = (uint32_t) _arena.length();
+    _arena.append(data, length);
+    return offset;
+}
+
+void Metadata::_set(int key_id,
+                    const char* key,
+                    size_t key_length,
+                    const char* value,
+                    size_t value_length,
+                    bool system) {
+    int index;
+    if (key_id != OTHER) {
+        index = _known[key_id];
+    } else {
+        index = _find(key, key_length);
+    }
+
+    if (index > -1) {
+        // the old value stays in the arena until the next clear()
+        Entry& entry = _entries[index];
+        entry.value_offset = _append(value, value_length);
+        entry.value_length = (uint32_t) value_length;
+        return;
+    }
+
+    Entry entry;
+    entry.key = key_id;
+    entry.key_offset = _append(key, key_length);
+    entry.key_length = (uint32_t) key_length;
+    entry.value_offset = _append(value, value_length);
+    entry.value_length = (uint32_t) value_length;
+    entry.system = system;
+    _entries.push_back(entry);
+    if (key_id != OTHER) {
+        _known[key_id] = (int) _entries.size() - 1;
+    }
+}
+
+void Metadata::_reindex() {
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        _known[i] = -1;
+    }
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        if (_entries[i].key != OTHER) {
+            _known[_entries[i].key] = (int) i;
+        }
+    }
+}
+
+void Metadata::set(const char* key,
+                   size_t key_length,
+                   const char* value,
+                   size_t value_length) {
+    _set(key_id(key, key_length), key, key_length, value, value_length,
+         is_system_key(key, key_length));
+}
+
+void Metadata::set(const string& key, const string& value) {
+    set(key.data(), key.length(), value.data(), value.length());
+}
+
+void Metadata::set(int key_id, const string& value) {
+    const char* key = KEY_NAMES[key_id];
+    const size_t key_length = strlen(key);
+    _set(key_id, key, key_length, value.data(), value.length(),
+         is_system_key(key, key_length));
+}
+
+bool Metadata::get(int key_id,
+                   const char*& value,
+                   size_t& value_length) const {
+    const int index = _known[key_id];
+    if (index < 0) {
+        return false;
+    }
+    const Entry& entry = _entries[index];
+    value = _arena.data() + entry.value_offset;
+    value_length = entry.value_length;
+    return true;
+}
+
+bool Metadata::get(const string& key,
+                   const char*& value,
+                   size_t& value_length) const {
+    const int index = _find(key.data(), key.length());
+    if (index < 0) {
+        return false;
+    }
+    const Entry& entry = _entries[index];
+    value = _arena.data() + entry.value_offset;
+    value_length = entry.value_length;
+    return true;
+}
+
+string Metadata::get(int key_id) const {
+    const char* value;
+    size_t value_length;
+    if (!get(key_id, value, value_length)) {
+        return string();
+    }
+    return string(value, value_length);
+}
+
+string Metadata::get(const string& key) const {
+    const char* value;
+    size_t value_length;
+    if (!get(key, value, value_length)) {
+        return string();
+    }
+    return string(value, value_length);
+}
+
+void Metadata::erase(int key_id) {
+    const int index = _known[key_id];
+    if (index < 0) {
+        return;
+    }
+    _entries.erase(_entries.begin() + index);
+    _reindex();
+}
+
+string Metadata::key(size_t index) const {
+    const Entry& entry = _entries[index];
+    return string(_arena.data() + entry.key_offset, entry.key_length);
+}
+
+string Metadata::value(size_t index) const {
+    const Entry& entry = _entries[index];
+    return string(_arena.data() + entry.value_offset, entry.value_length);
+}
+
+void Metadata::entry(size_t index,
+                     const char*& key,
+                     size_t& key_length,
+                     const char*& value,
+                     size_t& value_length) const {
+    const Entry& entry = _entries[index];
+    key = _arena.data() + entry.key_offset;
+    key_length = entry.key_length;
+    value = _arena.data() + entry.value_offset;
+    value_length = entry.value_length;
+}
+
+void Metadata::update(const Metadata& other) {
+    if (this == &other) {
+        return;
+    }
+
+    const char* arena = other._arena.data();
+    vector<Entry>::const_iterator it = other._entries.begin();
+    const vector<Entry>::const_iterator itEnd = other._entries.end();
+    for (; it != itEnd; ++it) {
+        const Entry& entry = *it;
+        _set(entry.key,
+             arena + entry.key_offset, entry.key_length,
+             arena + entry.value_offset, entry.value_length,
+             entry.system);
+    }
+}
+
+void Metadata::update_system(const Metadata& other) {
+    if (this == &other) {
+        return;
+    }
+
+    const char* arena = other._arena.data();
+    vector<Entry>::const_iterator it = other._entries.begin();
+    const vector<Entry>::const_iterator itEnd = other._entries.end();
+    for (; it != itEnd; ++it) {
+        const Entry& entry = *it;
+        if (entry.system) {
+            _set(entry.key,
+                 arena + entry.key_offset, entry.key_length,
+                 arena + entry.value_offset, entry.value_length,
+                 entry.system);
+        }
+    }
+}
+
+void Metadata::to_map(map<string, string>& metadata) const {
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        metadata[key(i)] = value(i);
+    }
+}
+
+void Metadata::from_map(const map<string, string>& metadata) {
+    map<string, string>::const_iterator it = metadata.begin();
+    const map<string, string>::const_iterator itEnd = metadata.end();
+    for (; it != itEnd; ++it) {
+        set((*it).first, (*it).second);
+    }
+}
+
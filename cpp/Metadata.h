@@ -0,0 +1,124 @@
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * Metadata of one object, kept flat: keys and values are copied into one
+ * arena and the entries are a small vector of offsets into it. The keys
+ * every open looks at are interned to ids so they're found without
+ * comparing strings, and whether a key is system metadata (what survives
+ * a .meta file) is worked out once when it's set. clear() keeps the
+ * memory, so a DiskFile reused across objects stops allocating.
+ */
+class Metadata {
+
+public:
+    enum Key {
+        OTHER = -1,
+        NAME = 0,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        ETAG,
+        X_TIMESTAMP,
+        X_DELETE_AT,
+        DELETED,
+        KEY_COUNT
+    };
+
+
+private:
+    struct Entry {
+        int key;
+        uint32_t key_offset;
+        uint32_t key_length;
+        uint32_t value_offset;
+        uint32_t value_length;
+        // datafile metadata that is kept when a .meta file overrides the
+        // rest: content-length, content-type, deleted, etag and sysmeta
+        bool system;
+    };
+
+    std::string _arena;
+    std::vector<Entry> _entries;
+    int _known[KEY_COUNT];
+
+    int _find(const char* key, size_t key_length) const;
+    uint32_t _append(const char* data, size_t length);
+    void _set(int key_id,
+              const char* key,
+              size_t key_length,
+              const char* value,
+              size_t value_length,
+              bool system);
+    void _reindex();
+
+
+public:
+    Metadata();
+    Metadata(const Metadata& copy);
+    Metadata& operator=(const Metadata& copy);
+
+    // id of a well-known key, OTHER for anything else
+    static int key_id(const char* key, size_t key_length);
+    static const char* key_name(int key_id);
+    static bool is_system_key(const char* key, size_t key_length);
+
+    bool empty() const {
+        return _entries.empty();
+    }
+
+    size_t size() const {
+        return _entries.size();
+    }
+
+    void clear();
+
+    void set(const char* key,
+             size_t key_length,
+             const char* value,
+             size_t value_length);
+    void set(const std::string& key, const std::string& value);
+    void set(int key_id, const std::string& value);
+
+    bool has(int key_id) const {
+        return _known[key_id] > -1;
+    }
+
+    // view of the value, valid until the metadata is next changed
+    bool get(int key_id, const char*& value, size_t& value_length) const;
+    bool get(const std::string& key,
+             const char*& value,
+             size_t& value_length) const;
+
+    // copy of the value, empty if it isn't set
+    std::string get(int key_id) const;
+    std::string get(const std::string& key) const;
+
+    void erase(int key_id);
+
+    // entries in the order they were first set
+    std::string key(size_t index) const;
+    std::string value(size_t index) const;
+    void entry(size_t index,
+               const char*& key,
+               size_t& key_length,
+               const char*& value,
+               size_t& value_length) const;
+
+    // set every entry of other, replacing values of keys already set
+    void update(const Metadata& other);
+    // as update, but only other's system metadata
+    void update_system(const Metadata& other);
+
+    void to_map(std::map<std::string, std::string>& metadata) const;
+    void from_map(const std::map<std::string, std::string>& metadata);
+};
+
+#endif
+
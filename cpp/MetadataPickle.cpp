@@ -0,0 +1,527 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "MetadataPickle.h"
+#include "Exceptions.h"
+#include "Metadata.h"
+
+using namespace std;
+
+// opcodes
+static const unsigned char MARK = '(';
+static const unsigned char STOP = '.';
+static const unsigned char BININT = 'J';
+static const unsigned char BININT1 = 'K';
+static const unsigned char BININT2 = 'M';
+static const unsigned char BINSTRING = 'T';
+static const unsigned char SHORT_BINSTRING = 'U';
+static const unsigned char BINUNICODE = 'X';
+static const unsigned char GLOBAL = 'c';
+static const unsigned char REDUCE = 'R';
+static const unsigned char TUPLE = 't';
+static const unsigned char EMPTY_TUPLE = ')';
+static const unsigned char EMPTY_DICT = '}';
+static const unsigned char DICT = 'd';
+static const unsigned char SETITEM = 's';
+static const unsigned char SETITEMS = 'u';
+static const unsigned char BINGET = 'h';
+static const unsigned char LONG_BINGET = 'j';
+static const unsigned char BINPUT = 'q';
+static const unsigned char LONG_BINPUT = 'r';
+static const unsigned char PROTO = 0x80;
+static const unsigned char TUPLE1 = 0x85;
+static const unsigned char TUPLE2 = 0x86;
+static const unsigned char BINBYTES = 'B';
+static const unsigned char SHORT_BINBYTES = 'C';
+static const unsigned char SHORT_BINUNICODE = 0x8c;
+static const unsigned char BINUNICODE8 = 0x8d;
+static const unsigned char BINBYTES8 = 0x8e;
+static const unsigned char STACK_GLOBAL = 0x93;
+static const unsigned char MEMOIZE = 0x94;
+static const unsigned char FRAME = 0x95;
+
+// python batches SETITEMS by this many pairs
+static const size_t BATCH_SIZE = 1000;
+
+
+/**
+ * Stack entry of the decoder. Strings are views of the pickle itself
+ * unless they had to be converted (bytes built by _codecs.encode, ints),
+ * in which case they're held in text.
+ */
+class PickleValue {
+
+public:
+    enum Kind {
+        MARK_VALUE,
+        STRING,
+        DICT_VALUE,
+        ENCODE,     // the _codecs.encode global
+        BYTES,      // the bytes global, called with no arguments for b""
+        ARGS,       // arguments of a call: a string and an encoding
+        NO_ARGS     // the empty tuple
+    };
+
+    int kind;
+    const char* data;
+    size_t length;
+    string text;
+    string encoding;
+
+
+    PickleValue(int kind_value) :
+        kind(kind_value),
+        data(NULL),
+        length(0) {
+    }
+
+    PickleValue(const char* data_value, size_t length_value) :
+        kind(STRING),
+        data(data_value),
+        length(length_value) {
+    }
+
+    string str() const {
+        if (data != NULL) {
+            return string(data, length);
+        }
+        return text;
+    }
+
+    const char* view() const {
+        return data != NULL ? data : text.data();
+    }
+
+    size_t view_length() const {
+        return data != NULL ? length : text.length();
+    }
+};
+
+
+class PickleReader {
+
+private:
+    const unsigned char* _pos;
+    const unsigned char* _end;
+    const size_t _length;
+    vector<PickleValue> _stack;
+    vector<PickleValue> _memo;
+    Metadata& _metadata;
+    bool _have_dict;
+
+    // disallow copies
+    PickleReader(const PickleReader&);
+    PickleReader& operator=(const PickleReader&);
+
+    const unsigned char* _take(uint64_t count) {
+        if (count > (uint64_t) (_end - _pos)) {
+            throw UnpicklingError("pickle data was truncated");
+        }
+        const unsigned char* data = _pos;
+        _pos += count;
+        return data;
+    }
+
+    uint64_t _uint(int size) {
+        // little endian
+        const unsigned char* data = _take(size);
+        uint64_t value = 0;
+        for (int i = size - 1; i >= 0; --i) {
+            value = (value << 8) | data[i];
+        }
+        return value;
+    }
+
+    string _line() {
+        const unsigned char* newline =
+            (const unsigned char*) memchr(_pos, '\n', _end - _pos);
+        if (newline == NULL) {
+            throw UnpicklingError("pickle data was truncated");
+        }
+        string line((const char*) _pos, newline - _pos);
+        _pos = newline + 1;
+        return line;
+    }
+
+    void _push_string(uint64_t length) {
+        const unsigned char* data = _take(length);
+        _stack.push_back(PickleValue((const char*) data, (size_t) length));
+    }
+
+    void _push_int(long value) {
+        char text[24];
+        snprintf(text, sizeof(text), "%ld", value);
+        PickleValue int_value(PickleValue::STRING);
+        int_value.text = text;
+        _stack.push_back(int_value);
+    }
+
+    PickleValue _pop() {
+        if (_stack.empty()) {
+            throw UnpicklingError("unpickling stack underflow");
+        }
+        PickleValue value = _stack.back();
+        _stack.pop_back();
+        return value;
+    }
+
+    // index of the topmost mark
+    size_t _marker() const {
+        for (size_t i = _stack.size(); i > 0; --i) {
+            if (_stack[i - 1].kind == PickleValue::MARK_VALUE) {
+                return i - 1;
+            }
+        }
+        throw UnpicklingError("could not find MARK");
+    }
+
+    const PickleValue& _string_value(size_t index) const {
+        if (_stack[index].kind != PickleValue::STRING) {
+            throw UnpicklingError("metadata keys and values must be strings");
+        }
+        return _stack[index];
+    }
+
+    string _string_at(size_t index) const {
+        return _string_value(index).str();
+    }
+
+    // set the key/value pairs above index into the dict
+    void _set_items(size_t index) {
+        if ((_stack.size() - index) % 2 != 0) {
+            throw UnpicklingError("odd number of items for SETITEMS");
+        }
+        for (size_t i = index; i < _stack.size(); i += 2) {
+            // copied from the pickle straight into the metadata's arena
+            const PickleValue& key = _string_value(i);
+            const PickleValue& value = _string_value(i + 1);
+            _metadata.set(key.view(), key.view_length(),
+                          value.view(), value.view_length());
+        }
+        _stack.erase(_stack.begin() + index, _stack.end());
+    }
+
+    void _new_dict() {
+        // metadata is a single flat dict
+        if (_have_dict) {
+            throw UnpicklingError("nested dicts are not supported");
+        }
+        _have_dict = true;
+    }
+
+    void _global(const string& module, const string& name) {
+        if (module == "_codecs" && name == "encode") {
+            _stack.push_back(PickleValue(PickleValue::ENCODE));
+        } else if ((module == "__builtin__" || module == "builtins") &&
+                   name == "bytes") {
+            _stack.push_back(PickleValue(PickleValue::BYTES));
+        } else {
+            throw UnpicklingError(string("global '") + module + "." + name +
+                                  "' is not allowed");
+        }
+    }
+
+    void _args(size_t count) {
+        if (count < 1 || count > 2 || _stack.size() < count) {
+            throw UnpicklingError("unsupported tuple");
+        }
+        const size_t index = _stack.size() - count;
+        PickleValue args(PickleValue::ARGS);
+        args.text = _string_at(index);
+        if (count == 2) {
+            args.encoding = _string_at(index + 1);
+        }
+        _stack.erase(_stack.begin() + index, _stack.end());
+        _stack.push_back(args);
+    }
+
+    /**
+     * Python 3 pickles bytes with protocol 2 as
+     * _codecs.encode(bytes.decode('latin1'), 'latin1'), so the text is
+     * the UTF-8 encoding of code points that are each one of the bytes.
+     * An empty value is pickled as bytes() instead.
+     */
+    void _reduce() {
+        PickleValue args = _pop();
+        PickleValue callable = _pop();
+        if (callable.kind == PickleValue::BYTES &&
+            args.kind == PickleValue::NO_ARGS) {
+            _stack.push_back(PickleValue(PickleValue::STRING));
+            return;
+        }
+        if (callable.kind != PickleValue::ENCODE ||
+            args.kind != PickleValue::ARGS) {
+            throw UnpicklingError("unsupported REDUCE");
+        }
+
+        PickleValue bytes(PickleValue::STRING);
+        if (args.encoding != "latin1" && args.encoding != "latin-1") {
+            if (args.encoding.length() > 0 && args.encoding != "utf-8" &&
+                args.encoding != "utf8") {
+                throw UnpicklingError(string("unsupported encoding ") +
+                                      args.encoding);
+            }
+            bytes.text = args.text;
+            _stack.push_back(bytes);
+            return;
+        }
+
+        const string& text = args.text;
+        bytes.text.reserve(text.length());
+        for (size_t i = 0; i < text.length(); ++i) {
+            const unsigned char c = text[i];
+            if (c < 0x80) {
+                bytes.text += (char) c;
+            } else if ((c & 0xe0) == 0xc0 && i + 1 < text.length()) {
+                const unsigned code_point =
+                    ((c & 0x1f) << 6) | (text[i + 1] & 0x3f);
+                if (code_point > 0xff) {
+                    throw UnpicklingError("text is not latin-1");
+                }
+                bytes.text += (char) code_point;
+                ++i;
+            } else {
+                throw UnpicklingError("text is not latin-1");
+            }
+        }
+        _stack.push_back(bytes);
+    }
+
+    void _put(uint64_t index) {
+        if (_stack.empty()) {
+            throw UnpicklingError("unpickling stack underflow");
+        }
+        // every memo entry takes a PUT opcode, so an index past the
+        // pickle's length wasn't written by a pickler; refuse it rather
+        // than size the memo after it
+        if (index >= _length) {
+            throw UnpicklingError("memo index out of range");
+        }
+        if (index >= _memo.size()) {
+            _memo.resize(index + 1, PickleValue(PickleValue::MARK_VALUE));
+        }
+        _memo[index] = _stack.back();
+    }
+
+    void _get(uint64_t index) {
+        if (index >= _memo.size()) {
+            throw UnpicklingError("memo key not found");
+        }
+        _stack.push_back(_memo[index]);
+    }
+
+
+public:
+    PickleReader(const char* data,
+                 size_t length,
+                 Metadata& metadata) :
+        _pos((const unsigned char*) data),
+        _end((const unsigned char*) data + length),
+        _length(length),
+        _metadata(metadata),
+        _have_dict(false) {
+    }
+
+    void load() {
+        while (true) {
+            const unsigned char opcode = *_take(1);
+            switch (opcode) {
+            case PROTO:
+                if (*_take(1) > 4) {
+                    throw UnpicklingError("unsupported pickle protocol");
+                }
+                break;
+            case FRAME:
+                _take(8);
+                break;
+            case STOP:
+                if (_stack.size() != 1 ||
+                    _stack[0].kind != PickleValue::DICT_VALUE) {
+                    throw UnpicklingError("pickle is not a dict");
+                }
+                return;
+            case MARK:
+                _stack.push_back(PickleValue(PickleValue::MARK_VALUE));
+                break;
+            case EMPTY_DICT:
+                _new_dict();
+                _stack.push_back(PickleValue(PickleValue::DICT_VALUE));
+                break;
+            case DICT: {
+                _new_dict();
+                const size_t index = _marker();
+                _stack.erase(_stack.begin() + index);
+                _set_items(index);
+                _stack.push_back(PickleValue(PickleValue::DICT_VALUE));
+                break;
+            }
+            case SETITEM:
+            case SETITEMS: {
+                const size_t index = opcode == SETITEMS ?
+                    _marker() : _stack.size() - 2;
+                if (_stack.size() < 2 || index < 1 ||
+                    _stack[index - 1].kind != PickleValue::DICT_VALUE) {
+                    throw UnpicklingError("SETITEMS without a dict");
+                }
+                if (opcode == SETITEMS) {
+                    _stack.erase(_stack.begin() + index);
+                }
+                _set_items(index);
+                break;
+            }
+            case SHORT_BINSTRING:
+            case SHORT_BINBYTES:
+            case SHORT_BINUNICODE:
+                _push_string(_uint(1));
+                break;
+            case BINSTRING:
+            case BINBYTES:
+            case BINUNICODE:
+                _push_string(_uint(4));
+                break;
+            case BINBYTES8:
+            case BINUNICODE8:
+                _push_string(_uint(8));
+                break;
+            case BININT1:
+                _push_int((long) _uint(1));
+                break;
+            case BININT2:
+                _push_int((long) _uint(2));
+                break;
+            case BININT:
+                _push_int((long) (int32_t) _uint(4));
+                break;
+            case GLOBAL: {
+                const string module = _line();
+                _global(module, _line());
+                break;
+            }
+            case STACK_GLOBAL: {
+                if (_stack.size() < 2) {
+                    throw UnpicklingError("unpickling stack underflow");
+                }
+                const string name = _string_at(_stack.size() - 1);
+                const string module = _string_at(_stack.size() - 2);
+                _stack.erase(_stack.end() - 2, _stack.end());
+                _global(module, name);
+                break;
+            }
+            case EMPTY_TUPLE:
+                _stack.push_back(PickleValue(PickleValue::NO_ARGS));
+                break;
+            case TUPLE1:
+                _args(1);
+                break;
+            case TUPLE2:
+                _args(2);
+                break;
+            case TUPLE: {
+                const size_t index = _marker();
+                _stack.erase(_stack.begin() + index);
+                _args(_stack.size() - index);
+                break;
+            }
+            case REDUCE:
+                _reduce();
+                break;
+            case BINPUT:
+                _put(_uint(1));
+                break;
+            case LONG_BINPUT:
+                _put(_uint(4));
+                break;
+            case MEMOIZE:
+                _put(_memo.size());
+                break;
+            case BINGET:
+                _get(_uint(1));
+                break;
+            case LONG_BINGET:
+                _get(_uint(4));
+                break;
+            default: {
+                char msg[48];
+                snprintf(msg, sizeof(msg),
+                         "unsupported pickle opcode 0x%02x", opcode);
+                throw UnpicklingError(msg);
+            }
+            }
+        }
+    }
+};
+
+
+void MetadataPickle::loads(const char* data,
+                           size_t length,
+                           Metadata& metadata) {
+    PickleReader reader(data, length, metadata);
+    reader.load();
+}
+
+void MetadataPickle::loads(const char* data,
+                           size_t length,
+                           map<string, string>& metadata) {
+    Metadata decoded;
+    loads(data, length, decoded);
+    decoded.to_map(metadata);
+}
+
+static void dump_string(const char* value, size_t length, string& pickle) {
+    if (length < 256) {
+        pickle += (char) SHORT_BINSTRING;
+        pickle += (char) length;
+    } else {
+        pickle += (char) BINSTRING;
+        for (int i = 0; i < 4; ++i) {
+            pickle += (char) ((length >> (i * 8)) & 0xff);
+        }
+    }
+    pickle.append(value, length);
+}
+
+void MetadataPickle::dumps(const Metadata& metadata, string& pickle) {
+    const char* key;
+    size_t key_length;
+    const char* value;
+    size_t value_length;
+
+    size_t size = 6;
+    for (size_t i = 0; i < metadata.size(); ++i) {
+        metadata.entry(i, key, key_length, value, value_length);
+        size += key_length + value_length + 10;
+    }
+
+    pickle.clear();
+    pickle.reserve(size);
+    pickle += (char) PROTO;
+    pickle += (char) 2;
+    pickle += (char) EMPTY_DICT;
+
+    size_t in_batch = 0;
+    for (size_t i = 0; i < metadata.size(); ++i) {
+        if (in_batch == 0) {
+            pickle += (char) MARK;
+        }
+        metadata.entry(i, key, key_length, value, value_length);
+        dump_string(key, key_length, pickle);
+        dump_string(value, value_length, pickle);
+        if (++in_batch == BATCH_SIZE) {
+            pickle += (char) SETITEMS;
+            in_batch = 0;
+        }
+    }
+    if (in_batch > 0) {
+        pickle += (char) SETITEMS;
+    }
+    pickle += (char) STOP;
+}
+
+void MetadataPickle::dumps(const map<string, string>& metadata,
+                           string& pickle) {
+    Metadata encoded;
+    encoded.from_map(metadata);
+    dumps(encoded, pickle);
+}
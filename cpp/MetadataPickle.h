@@ -0,0 +1,35 @@
+#ifndef METADATAPICKLE_H
+#define METADATAPICKLE_H
+
+#include <stddef.h>
+#include <map>
+#include <string>
+
+class Metadata;
+
+/**
+ * Codec for the pickled dict Swift keeps object metadata in. Only the
+ * part of the pickle format that a dict of strings needs is supported:
+ * what Python 2 writes (str and unicode) and what Python 3 writes with
+ * protocol 2 (bytes as _codecs.encode(text, 'latin1') calls), plus the
+ * string and framing opcodes of protocols 3 and 4. Anything else raises
+ * UnpicklingError.
+ */
+class MetadataPickle {
+
+public:
+    // Decode the pickle in data into metadata, straight from the buffer.
+    static void loads(const char* data, size_t length, Metadata& metadata);
+    static void loads(const char* data,
+                      size_t length,
+                      std::map<std::string, std::string>& metadata);
+
+    // Encode metadata the way Python 2 pickles a dict of str with
+    // protocol 2, which both Python 2 and Python 3 Swift can read.
+    static void dumps(const Metadata& metadata, std::string& pickle);
+    static void dumps(const std::map<std::string, std::string>& metadata,
+                      std::string& pickle);
+};
+
+#endif
+
@@ -0,0 +1,152 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/xattr.h>
+#include <vector>
+
+#include "MetadataXattr.h"
+#include "Exceptions.h"
+#include "Metadata.h"
+#include "MetadataPickle.h"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+using namespace std;
+
+// big enough for the metadata of nearly every object, so the whole
+// pickle is read into one stack buffer without allocating
+static const size_t INITIAL_BUFFER_SIZE = 4096;
+
+const char* MetadataXattr::METADATA_KEY = "user.swift.metadata";
+
+
+static void metadata_key(int index, char* key, size_t key_size) {
+    if (index == 0) {
+        snprintf(key, key_size, "%s", MetadataXattr::METADATA_KEY);
+    } else {
+        snprintf(key, key_size, "%s%d", MetadataXattr::METADATA_KEY, index);
+    }
+}
+
+static void grow(vector<char>& heap,
+                 char*& buffer,
+                 size_t& capacity,
+                 size_t used) {
+    vector<char> bigger(capacity * 2);
+    memcpy(&bigger[0], buffer, used);
+    heap.swap(bigger);
+    buffer = &heap[0];
+    capacity = heap.size();
+}
+
+void MetadataXattr::read(int fd, Metadata& metadata) {
+    _read(fd, NULL, metadata);
+}
+
+void MetadataXattr::read(const string& path, Metadata& metadata) {
+    _read(-1, path.c_str(), metadata);
+}
+
+void MetadataXattr::read(int fd, map<string, string>& metadata) {
+    Metadata decoded;
+    _read(fd, NULL, decoded);
+    decoded.to_map(metadata);
+}
+
+void MetadataXattr::read(const string& path, map<string, string>& metadata) {
+    Metadata decoded;
+    _read(-1, path.c_str(), decoded);
+    decoded.to_map(metadata);
+}
+
+/**
+ * The pieces are read one after the other into the same buffer, so the
+ * pickle is decoded where it lands instead of being joined from copies.
+ */
+void MetadataXattr::_read(int fd, const char* path, Metadata& metadata) {
+    char stack_buffer[INITIAL_BUFFER_SIZE];
+    vector<char> heap;
+    char* buffer = stack_buffer;
+    size_t capacity = sizeof(stack_buffer);
+    size_t used = 0;
+    char key[64];
+
+    for (int index = 0; ; ) {
+        if (used == capacity) {
+            // a zero size would ask for the length instead of the value
+            grow(heap, buffer, capacity, used);
+        }
+
+        metadata_key(index, key, sizeof(key));
+        ssize_t length;
+        if (path != NULL) {
+            length = ::getxattr(path, key, buffer + used, capacity - used);
+        } else {
+            length = ::fgetxattr(fd, key, buffer + used, capacity - used);
+        }
+
+        if (length < 0) {
+            if (errno == ERANGE) {
+                grow(heap, buffer, capacity, used);
+                continue;
+            }
+            if (errno == ENOATTR) {
+                break;
+            }
+            if (errno == ENOTSUP || errno == EOPNOTSUPP) {
+                throw DiskFileXattrNotSupported();
+            }
+            if (errno == ENOENT) {
+                throw DiskFileNotExist();
+            }
+            throw OSError(errno);
+        }
+
+        used += length;
+        ++index;
+    }
+
+    if (used == 0) {
+        // The file is there (ENOENT was handled above) but has no
+        // metadata. Like an unreadable pickle, that's corruption to
+        // quarantine, not an object that doesn't exist.
+        throw DiskFileQuarantined("Missing metadata");
+    }
+
+    MetadataPickle::loads(buffer, used, metadata);
+}
+
+void MetadataXattr::write(int fd, const map<string, string>& metadata) {
+    Metadata encoded;
+    encoded.from_map(metadata);
+    write(fd, encoded);
+}
+
+void MetadataXattr::write(int fd, const Metadata& metadata) {
+    string pickle;
+    MetadataPickle::dumps(metadata, pickle);
+
+    char key[64];
+    size_t offset = 0;
+    for (int index = 0; offset < pickle.length(); ++index) {
+        size_t length = pickle.length() - offset;
+        if (length > CHUNK_SIZE) {
+            length = CHUNK_SIZE;
+        }
+
+        metadata_key(index, key, sizeof(key));
+        if (::fsetxattr(fd, key, pickle.data() + offset, length, 0) != 0) {
+            if (errno == ENOTSUP || errno == EOPNOTSUPP) {
+                throw DiskFileXattrNotSupported();
+            }
+            if (errno == ENOSPC || errno == EDQUOT) {
+                throw DiskFileNoSpace();
+            }
+            throw OSError(errno);
+        }
+        offset += length;
+    }
+}
+
@@ -0,0 +1,36 @@
+#ifndef METADATAXATTR_H
+#define METADATAXATTR_H
+
+#include <map>
+#include <string>
+
+class Metadata;
+
+/**
+ * Reads and writes object metadata the way Swift keeps it: a pickled
+ * dict split into 254 byte pieces across the user.swift.metadata,
+ * user.swift.metadata1, ... xattrs of the file.
+ */
+class MetadataXattr {
+
+private:
+    static void _read(int fd, const char* path, Metadata& metadata);
+
+
+public:
+    static const char* METADATA_KEY;
+    static const size_t CHUNK_SIZE = 254;
+
+    static void read(int fd, Metadata& metadata);
+    static void read(const std::string& path, Metadata& metadata);
+    static void read(int fd, std::map<std::string, std::string>& metadata);
+    static void read(const std::string& path,
+                     std::map<std::string, std::string>& metadata);
+
+    static void write(int fd, const Metadata& metadata);
+    static void write(int fd,
+                      const std::map<std::string, std::string>& metadata);
+};
+
+#endif
+
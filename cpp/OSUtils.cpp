@@ -1,3 +1,12 @@
+#include <unistd.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+
 #include "OSUtils.h"
 
 using namespace std;
@@ -10,18 +19,27 @@ vector<string> OSUtils::listdir(const string& dir) {
 
 string OSUtils::path_join(const string& dir,
                           const string& filename) {
-    //TODO: implement path_join
-    return "";
+    // same rules as python's os.path.join for two components
+    if (dir.empty() || (!filename.empty() && filename[0] == '/')) {
+        return filename;
+    }
+    if (dir[dir.length() - 1] == '/') {
+        return dir + filename;
+    }
+    return dir + "/" + filename;
 }
 
 int OSUtils::fork() {
-    //TODO: implement fork
-    return -1;
+    return ::fork();
 }
 
 int OSUtils::wait() {
-    //TODO: implement wait
-    return -1;
+    // pid of the child that exited, -1 if there are none left
+    int pid;
+    do {
+        pid = ::wait(NULL);
+    } while (pid < 0 && errno == EINTR);
+    return pid;
 }
 
 bool OSUtils::ismount(const string& path) {
@@ -34,4 +52,42 @@ string OSUtils::path_basename(const string& path) {
     return "";
 }
 
+vector<string> OSUtils::whataremyips(const string& bind_ip) {
+    vector<string> addresses;
+    if (!bind_ip.empty() && bind_ip != "0.0.0.0" && bind_ip != "::") {
+        addresses.push_back(bind_ip);
+        return addresses;
+    }
+
+    struct ifaddrs* interfaces;
+    if (::getifaddrs(&interfaces) != 0) {
+        return addresses;
+    }
+
+    char text[INET6_ADDRSTRLEN];
+    for (struct ifaddrs* it = interfaces; it != NULL; it = it->ifa_next) {
+        if (it->ifa_addr == NULL) {
+            continue;
+        }
+        const int family = it->ifa_addr->sa_family;
+        const void* address;
+        if (family == AF_INET) {
+            address = &((struct sockaddr_in*) it->ifa_addr)->sin_addr;
+        } else if (family == AF_INET6) {
+            address = &((struct sockaddr_in6*) it->ifa_addr)->sin6_addr;
+        } else {
+            continue;
+        }
+        // inet_ntop leaves off the %scope of link local addresses, which
+        // is also how they appear in a ring
+        if (::inet_ntop(family, address, text, sizeof(text)) != NULL &&
+            std::find(addresses.begin(), addresses.end(), text) ==
+                addresses.end()) {
+            addresses.push_back(text);
+        }
+    }
+    ::freeifaddrs(interfaces);
+
+    return addresses;
+}
 
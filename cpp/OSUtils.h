@@ -14,6 +14,9 @@ public:
     static int wait();
     static bool ismount(const std::string& path);
     static std::string path_basename(const std::string& path);
+    // Addresses this host answers on: just bind_ip if it names one,
+    // otherwise those of every interface (like swift's whataremyips).
+    static std::vector<std::string> whataremyips(const std::string& bind_ip);
 };
 
 #endif
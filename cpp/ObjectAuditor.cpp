@@ -39,6 +39,65 @@ ObjectAuditor::ObjectAuditor(ConfigParser conf) :
                                      "/var/cache/swift");
     this->rcache = OSUtils::path_join(this->recon_cache_path, "object.recon");
     this->interval = atoi(conf.get("interval", "30").c_str());
+    // seconds between saves of each device's sweep checkpoint; 0 disables
+    // resuming an interrupted sweep
+    this->checkpoint_interval =
+        atoi(conf.get("checkpoint_interval", "30").c_str());
+    // files/bytes per second are budgets for the whole node, shared by
+    // every forked child and thread; the device_ ones optionally cap each
+    // device too. Created here so that children inherit the mapping.
+    this->rate_limiter = new SharedRateLimiter(
+        atof(conf.get("files_per_second", "20").c_str()),
+        atof(conf.get("bytes_per_second", "10000000").c_str()),
+        atof(conf.get("device_files_per_second", "0").c_str()),
+        atof(conf.get("device_bytes_per_second", "0").c_str()),
+        atoi(conf.get("rate_buffer", "5").c_str()));
+    // adaptive mode moves the rates between a floor and a ceiling
+    // depending on how busy the disks are. One throttle for all of a
+    // process's workers; a forked child gets its own copy.
+    this->throttle = NULL;
+    if (SwiftUtils::config_true_value(conf.get("adaptive_throttle",
+                                               "false"))) {
+        this->throttle = new AdaptiveThrottle(
+            conf.get("io_pressure_path",
+                     AdaptiveThrottle::DEFAULT_PRESSURE_PATH),
+            conf.get("block_stat_dir", AdaptiveThrottle::DEFAULT_BLOCK_DIR),
+            atof(conf.get("io_pressure_target", "10").c_str()),
+            atof(conf.get("disk_util_target", "0.8").c_str()),
+            atof(conf.get("read_latency_target", "0.05").c_str()),
+            atof(conf.get("throttle_interval", "10").c_str()));
+    }
+    // work is handed out in ranges of partitions; no more than
+    // device_concurrency workers on a device at once, since more than a
+    // couple just make a spinning disk seek
+    this->device_concurrency =
+        atoi(conf.get("device_concurrency", "2").c_str());
+    this->partitions_per_range =
+        atoi(conf.get("partitions_per_range", "16").c_str());
+    // handoff partitions are on their way to other devices; "defer"
+    // audits them after the primaries, "skip" not at all and "audit"
+    // sweeps everything in order without looking at the ring. Counting
+    // the objects and bytes of the skipped ones lists all of them every
+    // sweep, so it is off unless asked for.
+    const string handoff_audit = conf.get("handoff_audit", "defer");
+    this->partition_classifier = NULL;
+    if (AuditPartitionClassifier::parse_handoff_mode(handoff_audit) !=
+            AuditPartitionClassifier::AUDIT) {
+        this->partition_classifier = new AuditPartitionClassifier(
+            conf.get("swift_dir", "/etc/swift"),
+            conf.get("bind_ip", "0.0.0.0"),
+            atoi(conf.get("bind_port", "0").c_str()),
+            handoff_audit,
+            atoi(conf.get("ring_check_interval", "15").c_str()),
+            SwiftUtils::config_true_value(
+                conf.get("measure_skipped_handoffs", "false")));
+    }
+}
+
+ObjectAuditor::~ObjectAuditor() {
+    delete this->partition_classifier;
+    delete this->throttle;
+    delete this->rate_limiter;
 }
 
 void ObjectAuditor::_sleep() {
@@ -58,6 +117,8 @@ void ObjectAuditor::run_audit(AuditorOptions& options) {
                          this->rcache,
                          this->devices,
                          zero_byte_only_at_fps);
+    worker.set_rate_limiter(this->rate_limiter);
+    worker.set_throttle(this->throttle);
     worker.audit_all_objects(options);
 }
 
@@ -71,6 +132,8 @@ void ObjectAuditor::run_forever(AuditorOptions& options) {
     }
 
     options.mode = "forever";
+    options.checkpoint_interval = this->checkpoint_interval;
+    options.partition_classifier = this->partition_classifier;
 
     while (true) {
         try {
@@ -97,6 +160,8 @@ void ObjectAuditor::run_once(AuditorOptions& options) {
     }
 
     options.mode = "once";
+    options.checkpoint_interval = this->checkpoint_interval;
+    options.partition_classifier = this->partition_classifier;
 
     try {
         this->audit_loop(parent, zbo_fps, options);
@@ -4,10 +4,13 @@
 #include <string>
 #include <vector>
 
+#include "AdaptiveThrottle.h"
+#include "AuditPartitionClassifier.h"
 #include "AuditorOptions.h"
 #include "ConfigParser.h"
 #include "Daemon.h"
 #include "Logger.h"
+#include "SharedRateLimiter.h"
 
 
 class ObjectAuditor : Daemon
@@ -22,6 +25,12 @@ protected:
     std::string recon_cache_path;
     std::string rcache;
     int interval;
+    int checkpoint_interval;
+    SharedRateLimiter* rate_limiter;
+    AdaptiveThrottle* throttle;
+    int device_concurrency;
+    int partitions_per_range;
+    AuditPartitionClassifier* partition_classifier;
 
 
     void _sleep();
@@ -29,7 +38,7 @@ protected:
 
 public:
     ObjectAuditor(ConfigParser conf);
-    virtual ~ObjectAuditor() {}
+    virtual ~ObjectAuditor();
 
     void clear_recon_cache(const std::string& auditor_type);
 
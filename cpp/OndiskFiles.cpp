@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <string.h>
+
+#include "OndiskFiles.h"
+
+using namespace std;
+
+
+// newest first
+struct NewerFirst {
+    bool operator()(const FileInfo& a, const FileInfo& b) const {
+        if (a.newer_than(b)) {
+            return true;
+        }
+        if (b.newer_than(a)) {
+            return false;
+        }
+        return a.index < b.index;
+    }
+};
+
+
+OndiskFiles::OndiskFiles() :
+    _names(NULL),
+    _data(-1),
+    _meta(-1),
+    _ts(-1),
+    _durable(-1) {
+}
+
+bool OndiskFiles::parse_filename(const char* name,
+                                 size_t length,
+                                 FileInfo& info) {
+    size_t pos = Timestamp::parse(name, length, info.timestamp);
+    if (pos == 0 || pos >= length) {
+        return false;
+    }
+
+    info.frag_index = -1;
+    if (name[pos] == '#') {
+        int frag_index = 0;
+        size_t start = ++pos;
+        while (pos < length && name[pos] >= '0' && name[pos] <= '9') {
+            frag_index = frag_index * 10 + (name[pos] - '0');
+            ++pos;
+        }
+        if (pos == start) {
+            return false;
+        }
+        info.frag_index = frag_index;
+    }
+
+    if (pos >= length || name[pos] != '.') {
+        return false;
+    }
+    const char* ext = name + pos + 1;
+    const size_t ext_length = length - pos - 1;
+
+    if (ext_length == 4 && memcmp(ext, "data", 4) == 0) {
+        info.ext = FileInfo::DATA;
+    } else if (info.frag_index > -1) {
+        // only .data files carry a fragment index
+        return false;
+    } else if (ext_length == 4 && memcmp(ext, "meta", 4) == 0) {
+        info.ext = FileInfo::META;
+    } else if (ext_length == 2 && memcmp(ext, "ts", 2) == 0) {
+        info.ext = FileInfo::TS;
+    } else if (ext_length == 7 && memcmp(ext, "durable", 7) == 0) {
+        info.ext = FileInfo::DURABLE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void OndiskFiles::clear() {
+    _names = NULL;
+    _files.clear();
+    _obsolete.clear();
+    _unexpected.clear();
+    _fragments.clear();
+    _data = -1;
+    _meta = -1;
+    _ts = -1;
+    _durable = -1;
+}
+
+/**
+ * Walking the sorted files newest first, the first .data or .ts decides
+ * the object; anything after it is obsolete. A .meta only counts if it
+ * comes before that file and the file is a .data, since a tombstone
+ * replaces the metadata along with the data.
+ */
+void OndiskFiles::classify(const vector<string>& names,
+                           const Timestamp* reclaim_before) {
+    clear();
+    _names = &names;
+
+    FileInfo info;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const string& name = names[i];
+        if (parse_filename(name.data(), name.length(), info)) {
+            info.index = (int) i;
+            _files.push_back(info);
+        } else {
+            _unexpected.push_back((int) i);
+        }
+    }
+
+    this->_decide(reclaim_before, false);
+}
+
+/**
+ * With data_needs_durable (EC) a .data only decides the object if the
+ * newest .durable has its timestamp. A newer one is a fragment still
+ * being written and is kept; an older one is obsolete. A node can hold
+ * several fragments of the object (a handoff, or after a
+ * reconstruction), so every .data at the durable timestamp is kept as
+ * the fragment set, not only the first.
+ */
+void OndiskFiles::_decide(const Timestamp* reclaim_before,
+                          bool data_needs_durable) {
+    sort(_files.begin(), _files.end(), NewerFirst());
+
+    const int count = (int) _files.size();
+    for (int i = 0; i < count; ++i) {
+        const int ext = _files[i].ext;
+        const bool decided = _data > -1 || _ts > -1;
+
+        if (decided && data_needs_durable && _data > -1 &&
+            ext == FileInfo::DATA &&
+            _files[i].timestamp == _files[_data].timestamp) {
+            _fragments.push_back(i);
+        } else if (decided) {
+            _obsolete.push_back(i);
+        } else if (ext == FileInfo::TS) {
+            _ts = i;
+        } else if (ext == FileInfo::DATA && data_needs_durable &&
+                   (_durable == -1 ||
+                    _files[_durable].timestamp != _files[i].timestamp)) {
+            if (_durable > -1) {
+                _obsolete.push_back(i);
+            }
+        } else if (ext == FileInfo::DATA) {
+            _data = i;
+            if (data_needs_durable) {
+                _fragments.push_back(i);
+            }
+        } else if (ext == FileInfo::META && _meta == -1) {
+            _meta = i;
+        } else if (ext == FileInfo::DURABLE && _durable == -1) {
+            _durable = i;
+        } else {
+            _obsolete.push_back(i);
+        }
+    }
+
+    if (_ts > -1) {
+        if (_meta > -1) {
+            _obsolete.push_back(_meta);
+            _meta = -1;
+        }
+        if (_durable > -1) {
+            _obsolete.push_back(_durable);
+            _durable = -1;
+        }
+        if (reclaim_before != NULL && _files[_ts].timestamp < *reclaim_before) {
+            _obsolete.push_back(_ts);
+            _ts = -1;
+        }
+    }
+}
+
+void OndiskFiles::obsolete_names(vector<string>& names) const {
+    vector<int>::const_iterator it = _obsolete.begin();
+    const vector<int>::const_iterator itEnd = _obsolete.end();
+    for (; it != itEnd; ++it) {
+        names.push_back(name(_files[*it]));
+    }
+}
+
@@ -0,0 +1,128 @@
+#ifndef ONDISKFILES_H
+#define ONDISKFILES_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "FileInfo.h"
+#include "Timestamp.h"
+
+
+/**
+ * Sorts a hash dir listing newest first and works out which files
+ * describe the object: the newest .data or .ts, a .meta newer than
+ * that .data, and for EC the newest .durable. Everything older is
+ * obsolete and can be removed by cleanup. Filenames are parsed straight
+ * into Timestamp values, so no doubles or temporary strings are made;
+ * the vectors are kept between calls so reusing one OndiskFiles for a
+ * whole suffix dir doesn't allocate per hash dir either.
+ */
+class OndiskFiles {
+
+private:
+    const std::vector<std::string>* _names;
+    std::vector<FileInfo> _files;
+    std::vector<int> _obsolete;
+    std::vector<int> _unexpected;
+    std::vector<int> _fragments;
+    int _data;
+    int _meta;
+    int _ts;
+    int _durable;
+
+    // disallow copies
+    OndiskFiles(const OndiskFiles&);
+    OndiskFiles& operator=(const OndiskFiles&);
+
+    // sort the parsed files and pick out the ones that count
+    void _decide(const Timestamp* reclaim_before, bool data_needs_durable);
+
+
+public:
+    OndiskFiles();
+
+    // Parse "<timestamp>[#<frag>].<ext>". Returns false if name isn't
+    // the name of a swift object file.
+    static bool parse_filename(const char* name,
+                               size_t length,
+                               FileInfo& info);
+
+    // Classify names, which must outlive this object's use of them.
+    // A .ts older than reclaim_before is obsolete too; pass NULL to keep
+    // tombstones regardless of age.
+    void classify(const std::vector<std::string>& names,
+                  const Timestamp* reclaim_before=NULL);
+
+    // Same, but with the filename rules of one policy type (see
+    // DiskFileRules.h), which are inlined into the parsing loop.
+    template <typename Rules>
+    void classify_as(const std::vector<std::string>& names,
+                     const Timestamp* reclaim_before=NULL) {
+        clear();
+        _names = &names;
+
+        FileInfo info;
+        for (size_t i = 0; i < names.size(); ++i) {
+            const std::string& name = names[i];
+            if (Rules::parse_on_disk_filename(name.data(), name.length(),
+                                              info)) {
+                info.index = (int) i;
+                _files.push_back(info);
+            } else {
+                _unexpected.push_back((int) i);
+            }
+        }
+
+        this->_decide(reclaim_before, Rules::DATA_NEEDS_DURABLE);
+    }
+
+    void clear();
+
+    // the parsed files, newest first
+    const std::vector<FileInfo>& files() const {
+        return _files;
+    }
+
+    const std::string& name(const FileInfo& info) const {
+        return (*_names)[info.index];
+    }
+
+    // the chosen files, or NULL if there isn't one
+    const FileInfo* data_file() const {
+        return _data > -1 ? &_files[_data] : NULL;
+    }
+
+    const FileInfo* meta_file() const {
+        return _meta > -1 ? &_files[_meta] : NULL;
+    }
+
+    const FileInfo* ts_file() const {
+        return _ts > -1 ? &_files[_ts] : NULL;
+    }
+
+    const FileInfo* durable_file() const {
+        return _durable > -1 ? &_files[_durable] : NULL;
+    }
+
+    // EC only: positions in files() of every .data at the durable
+    // timestamp, data_file() among them
+    const std::vector<int>& fragments() const {
+        return _fragments;
+    }
+
+    // positions in files() of the files that can be removed
+    const std::vector<int>& obsolete() const {
+        return _obsolete;
+    }
+
+    // positions in the listing of names that couldn't be parsed
+    const std::vector<int>& unexpected() const {
+        return _unexpected;
+    }
+
+    void obsolete_names(std::vector<std::string>& names) const;
+};
+
+
+#endif
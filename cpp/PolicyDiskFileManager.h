@@ -0,0 +1,139 @@
+#ifndef POLICYDISKFILEMANAGER_H
+#define POLICYDISKFILEMANAGER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "DirReader.h"
+#include "DiskFileManager.h"
+#include "DiskFileRules.h"
+#include "Exceptions.h"
+#include "Logger.h"
+#include "MD5Hash.h"
+#include "OSUtils.h"
+#include "OndiskFiles.h"
+#include "Time.h"
+#include "Timestamp.h"
+
+
+/**
+ * DiskFileManager for one policy type. Rules (see DiskFileRules.h) is
+ * known at compile time, so parsing, classifying and hashing each file
+ * are inlined into the loops below rather than dispatched per file.
+ */
+template <typename Rules>
+class PolicyDiskFileManager : public DiskFileManager {
+
+private:
+    // a hash dir holds a handful of files
+    static const int HASH_DIR_BUFFER_SIZE = 4096;
+
+    // disallow copies
+    PolicyDiskFileManager(const PolicyDiskFileManager&);
+    PolicyDiskFileManager& operator=(const PolicyDiskFileManager&);
+
+
+public:
+    PolicyDiskFileManager(Config conf, Logger* logger) :
+        DiskFileManager(conf, logger) {
+    }
+
+    const char* policy_type() const {
+        return Rules::policy_type();
+    }
+
+    bool get_ondisk_files(const std::vector<std::string>& files,
+                          const std::string& datadir,
+                          OndiskFiles& results,
+                          bool verify=true) {
+        results.template classify_as<Rules>(files);
+        return !verify || this->_verify_ondisk_files(results);
+    }
+
+    /**
+     * Each hash dir is listed into the same vector and classified into
+     * the same OndiskFiles, so a suffix is rehashed without allocating
+     * per hash dir. Obsolete files (and tombstones older than
+     * reclaim_age) are removed, and so is a hash dir left empty.
+     */
+    void _hash_suffix_dir(const std::string& path,
+                          int reclaim_age,
+                          std::map<int, MD5Hash>& hashes) {
+        DirReader suffix_reader;
+        if (!suffix_reader.open(path)) {
+            throw OSError(errno);
+        }
+        DirReaderCloser suffix_closer(suffix_reader);
+
+        const Timestamp reclaim_before =
+            Timestamp::from_time(Time::time() - reclaim_age);
+        DirReader hash_reader(HASH_DIR_BUFFER_SIZE);
+        std::vector<std::string> names;
+        OndiskFiles results;
+        const char* hsh;
+
+        while ((hsh = suffix_reader.next()) != NULL) {
+            if (!hash_reader.openat(suffix_reader.fd(), hsh)) {
+                // gone already, or a stray file where a hash dir
+                // belongs; neither has anything to hash
+                continue;
+            }
+            DirReaderCloser hash_closer(hash_reader);
+
+            names.clear();
+            const char* name;
+            while ((name = hash_reader.next()) != NULL) {
+                names.push_back(name);
+            }
+            results.template classify_as<Rules>(names, &reclaim_before);
+
+            const std::vector<FileInfo>& files = results.files();
+            const std::vector<int>& obsolete = results.obsolete();
+            std::vector<int>::const_iterator itObsolete = obsolete.begin();
+            const std::vector<int>::const_iterator itObsoleteEnd =
+                obsolete.end();
+            for (; itObsolete != itObsoleteEnd; ++itObsolete) {
+                ::unlinkat(hash_reader.fd(),
+                           results.name(files[*itObsolete]).c_str(), 0);
+            }
+
+            if (files.size() == obsolete.size() &&
+                results.unexpected().empty()) {
+                hash_reader.close();
+                ::unlinkat(suffix_reader.fd(), hsh, AT_REMOVEDIR);
+                continue;
+            }
+
+            // obsolete is short and mostly at the end of files, so a
+            // linear check is cheaper than marking
+            const int count = (int) files.size();
+            for (int i = 0; i < count; ++i) {
+                bool removed = false;
+                for (itObsolete = obsolete.begin();
+                     itObsolete != itObsoleteEnd; ++itObsolete) {
+                    if (*itObsolete == i) {
+                        removed = true;
+                        break;
+                    }
+                }
+                if (!removed) {
+                    Rules::hash_file(files[i], results.name(files[i]),
+                                     hashes);
+                }
+            }
+        }
+
+        Rules::finish_hashes(hashes);
+    }
+};
+
+
+typedef PolicyDiskFileManager<ReplicationRules> ReplicationDiskFileManager;
+typedef PolicyDiskFileManager<ECRules> ECDiskFileManager;
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef RCUPOINTER_H
+#define RCUPOINTER_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <unistd.h>
+
+
+/**
+ * Pointer to an immutable object that readers use without locks while
+ * a writer replaces it, read-copy-update style. Readers announce
+ * themselves with an atomic increment on one of a set of padded
+ * counters (picked per thread, so readers on different threads rarely
+ * share a cache line) and never block or make a syscall. publish()
+ * swaps in the new object and waits out a grace period before deleting
+ * the old one: the counters come in two sets selected by an epoch bit,
+ * and the writer flips the bit and waits for the old set to drain,
+ * twice, so a reader that raced with the first flip is caught by the
+ * second. Writers are serialized by a mutex and may sleep.
+ */
+template <typename T>
+class RcuPointer {
+
+private:
+    static const size_t CACHE_LINE = 64;
+    static const int SLOT_COUNT = 32;
+
+    struct Slot {
+        long readers[2];
+        char pad[CACHE_LINE - 2 * sizeof(long)];
+    };
+
+    T* _current;
+    unsigned _epoch;
+    char _pad[CACHE_LINE];
+    Slot _slots[SLOT_COUNT];
+    pthread_mutex_t _update_lock;
+
+    // disallow copies
+    RcuPointer(const RcuPointer&);
+    RcuPointer& operator=(const RcuPointer&);
+
+    static int _thread_slot() {
+        static __thread int slot = -1;
+        static unsigned next_slot = 0;
+        if (slot < 0) {
+            slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) %
+                   SLOT_COUNT;
+        }
+        return slot;
+    }
+
+    void _synchronize() {
+        for (int flip = 0; flip < 2; ++flip) {
+            const unsigned epoch =
+                __atomic_fetch_add(&_epoch, 1, __ATOMIC_SEQ_CST);
+            _wait_for_readers(epoch);
+        }
+    }
+
+    void _wait_for_readers(unsigned epoch) {
+        const int parity = epoch & 1;
+        for (int i = 0; i < SLOT_COUNT; ++i) {
+            int idle = 0;
+            while (__atomic_load_n(&_slots[i].readers[parity],
+                                   __ATOMIC_SEQ_CST) != 0) {
+                // read sections are short; yield a few times before
+                // sleeping
+                if (++idle < 16) {
+                    sched_yield();
+                } else {
+                    usleep(100);
+                }
+            }
+        }
+    }
+
+
+public:
+    /**
+     * Read-side critical section: the object it returns stays valid
+     * until the guard goes out of scope. Guards may nest.
+     */
+    class ReadGuard {
+
+    private:
+        RcuPointer& _pointer;
+        long* _counter;
+        T* _value;
+
+        ReadGuard();
+        ReadGuard(const ReadGuard&);
+        ReadGuard& operator=(const ReadGuard&);
+
+    public:
+        explicit ReadGuard(RcuPointer& pointer) :
+            _pointer(pointer) {
+            const unsigned epoch =
+                __atomic_load_n(&pointer._epoch, __ATOMIC_SEQ_CST);
+            _counter = &pointer._slots[_thread_slot()].readers[epoch & 1];
+            __atomic_add_fetch(_counter, 1, __ATOMIC_SEQ_CST);
+            _value = __atomic_load_n(&pointer._current, __ATOMIC_SEQ_CST);
+        }
+
+        ~ReadGuard() {
+            __atomic_sub_fetch(_counter, 1, __ATOMIC_RELEASE);
+        }
+
+        // NULL until something has been published
+        T* get() const {
+            return _value;
+        }
+
+        T* operator->() const {
+            return _value;
+        }
+
+        T& operator*() const {
+            return *_value;
+        }
+    };
+
+
+    explicit RcuPointer(T* initial=NULL) :
+        _current(initial),
+        _epoch(0) {
+        for (int i = 0; i < SLOT_COUNT; ++i) {
+            _slots[i].readers[0] = 0;
+            _slots[i].readers[1] = 0;
+        }
+        pthread_mutex_init(&_update_lock, NULL);
+    }
+
+    // no readers may be left when this is destroyed
+    ~RcuPointer() {
+        delete _current;
+        pthread_mutex_destroy(&_update_lock);
+    }
+
+    // Replace the object and delete the old one once no reader can
+    // still be using it. Takes ownership of value.
+    void publish(T* value) {
+        pthread_mutex_lock(&_update_lock);
+        T* old = __atomic_exchange_n(&_current, value, __ATOMIC_SEQ_CST);
+        _synchronize();
+        pthread_mutex_unlock(&_update_lock);
+        delete old;
+    }
+
+    // Wait until every read section that was running when this was
+    // called has finished.
+    void synchronize() {
+        pthread_mutex_lock(&_update_lock);
+        _synchronize();
+        pthread_mutex_unlock(&_update_lock);
+    }
+
+    // for the writer side only; readers use a ReadGuard
+    T* unsafe_get() const {
+        return __atomic_load_n(&_current, __ATOMIC_ACQUIRE);
+    }
+};
+
+#endif
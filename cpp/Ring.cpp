@@ -1,310 +1,273 @@
+#include <errno.h>
+#include <sys/stat.h>
+
 #include "Ring.h"
+#include "RingReloader.h"
 #include "RingData.h"
+#include "Exceptions.h"
+#include "HandoffIterator.h"
+#include "HashPathEngine.h"
+#include "MD5Hash.h"
 #include "OSUtils.h"
+#include "SwiftUtils.h"
 
 
 using namespace std;
 
+// names hashed per call to the multi-buffer engine
+static const size_t HASH_BATCH_SIZE = 256;
 
-void Ring::_reload() {
+
+static double getmtime(const string& path) {
+    struct stat statbuf;
+    if (::stat(path.c_str(), &statbuf) != 0) {
+        throw OSError(errno);
+    }
+    return statbuf.st_mtim.tv_sec + statbuf.st_mtim.tv_nsec / 1e9;
 }
 
-void Ring::_reload(bool force) {
-    this->_rtime = time() + this->reload_time;
-    if (force or this->has_changed()) {
-        RingData ring_data = RingData::load(this->serialized_path);
-        this->_mtime = getmtime(this->serialized_path);
-        this->_devs = ring_data.devs;
-        // NOTE(akscram): Replication parameters like replication_ip
-        //                and replication_port are required for
-        //                replication process. An old replication
-        //                ring doesn't contain this parameters into
-        //                device. Old-style pickled rings won't have
-        //                region information.
-        for (dev in this->_devs) {
-            if (dev) {
-                dev.setdefault("region", 1);
-                if ("ip" in dev) {
-                    dev.setdefault("replication_ip", dev["ip"]);
-                }
-                if ("port" in dev) {
-                    dev.setdefault("replication_port", dev["port"]);
-                }
-            }
-        }
+// partition of a hash_path digest: its first 4 bytes, big endian,
+// shifted down by part_shift
+static uint32_t key_to_part(const unsigned char* key, int part_shift) {
+    if (part_shift >= 32) {
+        return 0;
+    }
+    const uint32_t value = ((uint32_t) key[0] << 24) |
+                           ((uint32_t) key[1] << 16) |
+                           ((uint32_t) key[2] << 8) |
+                           ((uint32_t) key[3]);
+    return value >> part_shift;
+}
 
-        this->_replica2part2dev_id = ring_data._replica2part2dev_id;
-        this->_part_shift = ring_data._part_shift;
-        this->_rebuild_tier_data();
-
-        // Do this now, when we know the data has changed, rather than
-        // doing it on every call to get_more_nodes().
-        //
-        // Since this is to speed up the finding of handoffs, we only
-        // consider devices with at least one partition assigned. This
-        // way, a region, zone, or server with no partitions assigned
-        // does not count toward our totals, thereby keeping the early
-        // bailouts in get_more_nodes() working.
-        dev_ids_with_parts = set();
-        for (part2dev_id in this->_replica2part2dev_id) {
-            for (dev_id in part2dev_id) {
-                dev_ids_with_parts.add(dev_id);
-            }
-        }
 
-        regions = set();
-        zones = set();
-        ips = set();
-        this->_num_devs = 0;
-        for (dev in this->_devs) {
-            if (dev and dev["id"] in dev_ids_with_parts) {
-                regions.add(dev["region"]);
-                zones.add((dev["region"], dev["zone"]));
-                ips.add((dev["region"], dev["zone"], dev["ip"]));
-                this->_num_devs += 1;
-            }
-        }
-        this->_num_regions = len(regions);
-        this->_num_zones = len(zones);
-        this->_num_ips = len(ips);
-    }
+void Ring::_reload() {
+    this->_reload(false);
 }
 
-void Ring::_rebuild_tier_data() {
-    this->tier2devs = defaultdict(list);
-    for (dev in this->_devs) {
-        if (not dev) {
-            continue;
-        }
-        for (tier in tiers_for_dev(dev)) {
-            this->tier2devs[tier].append(dev);
+void Ring::_reload(bool force) {
+    if (force || this->has_changed()) {
+        RingSnapshot* snapshot = new RingSnapshot();
+        try {
+            snapshot->load(this->serialized_path);
+        } catch (...) {
+            delete snapshot;
+            throw;
         }
+        this->_snapshot.publish(snapshot);
     }
+}
 
-    tiers_by_length = defaultdict(list);
-    for (tier in this->tier2devs) {
-        tiers_by_length[len(tier)].append(tier);
-    }
-    this->tiers_by_length = sorted(tiers_by_length.values(),
-                                  key=lambda x: len(x[0]));
-    for (tiers in this->tiers_by_length) {
-        tiers.sort();
-    }
+void Ring::reload_if_changed() {
+    this->_reload(false);
 }
 
-Ring::Ring(const string& serialized_path) {
+Ring::Ring(const string& serialized_path) :
+    _reloader(NULL) {
+    this->_init(serialized_path, DEFAULT_RELOAD_TIME);
 }
 
 Ring::Ring(const string& serialized_path,
-           int reload_time) {
+           int reload_time) :
+    _reloader(NULL) {
+    this->_init(serialized_path, reload_time);
 }
 
 Ring::Ring(const string& serialized_path,
            const string& ring_name,
-           int reload_time) {
-    // can't use the ring unless HASH_PATH_SUFFIX is set
-    validate_configuration();
-    if (ring_name) {
-        this->serialized_path = OSUtils::path_join(serialized_path,
-                                            ring_name + ".ring.gz");
+           int reload_time) :
+    _reloader(NULL) {
+    if (!ring_name.empty()) {
+        this->_init(OSUtils::path_join(serialized_path,
+                                       ring_name + ".ring.gz"),
+                    reload_time);
     } else {
-        this->serialized_path = OSUtils::path_join(serialized_path);
+        this->_init(serialized_path, reload_time);
     }
+}
+
+Ring::~Ring() {
+    // the reloader publishes snapshots, so it has to go first
+    delete this->_reloader;
+}
+
+void Ring::_init(const string& serialized_path, int reload_time) {
+    this->serialized_path = serialized_path;
     this->reload_time = reload_time;
-    this->_reload(force=true);
+    this->_reload(true);
+
+    if (reload_time > 0) {
+        this->_reloader = new RingReloader(this, serialized_path, reload_time);
+        this->_reloader->start();
+    }
 }
 
 int Ring::replica_count() {
-    return len(this->_replica2part2dev_id);
+    SnapshotGuard snapshot(this->_snapshot);
+    return snapshot->ring_data.replica_count();
 }
 
 int Ring::partition_count() {
-    return len(this->_replica2part2dev_id[0]);
+    SnapshotGuard snapshot(this->_snapshot);
+    return snapshot->ring_data.partition_count();
 }
 
-void Ring::devs() {
-    if (time() > this->_rtime) {
-        this->_reload();
-    }
-    return this->_devs;
+void Ring::devs(vector<StorageDevice>& devs) {
+    SnapshotGuard snapshot(this->_snapshot);
+    devs = snapshot->ring_data.devs();
 }
 
 bool Ring::has_changed() {
-    return getmtime(this->serialized_path) != this->_mtime;
+    SnapshotGuard snapshot(this->_snapshot);
+    return snapshot.get() == NULL ||
+           getmtime(this->serialized_path) != snapshot->mtime;
 }
 
-void Ring::_get_part_nodes(int part) {
-    part_nodes = [];
-    seen_ids = set();
-    for (r2p2d in this->_replica2part2dev_id) {
-        if (part < len(r2p2d)) {
-            dev_id = r2p2d[part];
-            if (dev_id not in seen_ids) {
-                part_nodes.append(this->devs[dev_id]);
-                seen_ids.add(dev_id);
+void Ring::_get_part_nodes(const RingSnapshot& snapshot,
+                           uint32_t part,
+                           vector<StorageDevice>& nodes) {
+    const RingData& ring_data = snapshot.ring_data;
+    const vector<StorageDevice>& devs = ring_data.devs();
+    uint16_t seen_ids[16];
+    int seen_count = 0;
+
+    nodes.clear();
+    for (int replica = 0; replica < ring_data.replica_count(); ++replica) {
+        if (part < ring_data.replica_length(replica)) {
+            const uint16_t dev_id = ring_data.part2dev_id(replica)[part];
+            bool seen = false;
+            for (int i = 0; i < seen_count; ++i) {
+                if (seen_ids[i] == dev_id) {
+                    seen = true;
+                    break;
+                }
+            }
+            if (!seen && dev_id < devs.size()) {
+                nodes.push_back(devs[dev_id]);
+                if (seen_count < 16) {
+                    seen_ids[seen_count++] = dev_id;
+                }
             }
         }
     }
-    return [dict(node, index=i) for i, node in enumerate(part_nodes)];
 }
 
-int Ring::get_part(const string& account,
-                   const string& container,
-                   const string& obj) {
-    key = SwiftUtils::hash_path(account, container, obj, true); // raw_digest
-    if (time() > this->_rtime) {
-        this->_reload();
-    }
-    part = struct.unpack_from(">I", key)[0] >> this->_part_shift;
-    return part;
+uint32_t Ring::get_part(const string& account,
+                        const string& container,
+                        const string& obj) {
+    unsigned char key[MD5Hash::DIGEST_SIZE];
+    SwiftUtils::hash_path_engine().digest(HashPathName(account, container, obj),
+                                          key);
+
+    SnapshotGuard snapshot(this->_snapshot);
+    return key_to_part(key, snapshot->ring_data.part_shift());
 }
 
-void Ring::get_part_nodes(int part) {
-    if (time() > this->_rtime) {
-        this->_reload();
-    }
-    return this->_get_part_nodes(part);
+void Ring::get_part_nodes(uint32_t part, vector<StorageDevice>& nodes) {
+    SnapshotGuard snapshot(this->_snapshot);
+    this->_get_part_nodes(*snapshot, part, nodes);
 }
 
-void Ring::get_nodes(const string& account,
-                     const string& container,
-                     const string& obj) {
-    part = this->get_part(account, container, obj);
-    return part, this->_get_part_nodes(part);
+uint32_t Ring::get_nodes(const string& account,
+                         const string& container,
+                         const string& obj,
+                         vector<StorageDevice>& nodes) {
+    unsigned char key[MD5Hash::DIGEST_SIZE];
+    SwiftUtils::hash_path_engine().digest(HashPathName(account, container, obj),
+                                          key);
+
+    // one snapshot for both, in case a reload lands in between
+    SnapshotGuard snapshot(this->_snapshot);
+    const uint32_t part = key_to_part(key, snapshot->ring_data.part_shift());
+    this->_get_part_nodes(*snapshot, part, nodes);
+    return part;
 }
 
-void Ring::get_more_nodes(int part) {
-    if (time() > this->_rtime) {
-        this->_reload();
-    }
+int Ring::get_replica(int dev_id, uint32_t part) {
+    SnapshotGuard snapshot(this->_snapshot);
+    return snapshot->ring_data.replica_of(part, dev_id);
+}
 
-    primary_nodes = this->_get_part_nodes(part);
-
-    used = set(d["id"] for d in primary_nodes);
-    same_regions = set(d["region"] for d in primary_nodes);
-    same_zones = set((d["region"], d["zone"]) for d in primary_nodes);
-    same_ips = set(
-        (d["region"], d["zone"], d["ip"]) for d in primary_nodes);
-
-    int parts = len(this->_replica2part2dev_id[0]);
-    start = struct.unpack_from(
-        ">I", md5(str(part)).digest())[0] >> this->_part_shift;
-    int inc = max(parts / 65536, 1);
-    // Multiple loops for execution speed; the checks and bookkeeping get
-    // simpler as you go along
-    bool hit_all_regions = (len(same_regions) == this->_num_regions);
-    for (handoff_part in chain(range(start, parts, inc),
-                              range(inc - ((parts - start) % inc),
-                                    start, inc))) {
-        if (hit_all_regions) {
-            // At this point, there are no regions left untouched, so we
-            // can stop looking.
-            break;
-        }
+bool Ring::is_primary(int dev_id, uint32_t part) {
+    return this->get_replica(dev_id, part) > -1;
+}
 
-        for (part2dev_id in this->_replica2part2dev_id) {
-            if (handoff_part < len(part2dev_id)) {
-                dev_id = part2dev_id[handoff_part];
-                dev = this->_devs[dev_id];
-                region = dev["region"];
-                if (dev_id not in used and region not in same_regions) {
-                    yield dev;
-                    used.add(dev_id);
-                    same_regions.add(region);
-                    zone = dev["zone"];
-                    ip = (region, zone, dev["ip"]);
-                    same_zones.add((region, zone));
-                    same_ips.add(ip);
-                    if (len(same_regions) == this->_num_regions) {
-                        hit_all_regions = true;
-                        break;
-                    }
-                }
-            }
-        }
+void Ring::get_device_partitions(int dev_id,
+                                 vector<uint32_t>& parts,
+                                 vector<int>& replicas) {
+    SnapshotGuard snapshot(this->_snapshot);
+    const RingPartitionIndex& index = snapshot->partitions;
+    const size_t count = index.count(dev_id);
+
+    parts.clear();
+    replicas.clear();
+    if (count > 0) {
+        parts.assign(index.parts(dev_id), index.parts(dev_id) + count);
+        replicas.assign(index.replicas(dev_id), index.replicas(dev_id) + count);
     }
+}
 
-    bool hit_all_zones = len(same_zones) == this->_num_zones;
-    for (handoff_part in chain(range(start, parts, inc),
-                              range(inc - ((parts - start) % inc),
-                                    start, inc))) {
-        if (hit_all_zones) {
-            // Much like we stopped looking for fresh regions before, we
-            // can now stop looking for fresh zones; there are no more.
-            break;
+/**
+ * Names are hashed in chunks so the hashing buffer stays small however
+ * big the batch is.
+ */
+int Ring::get_nodes_batch(const HashPathName* names,
+                          size_t name_count,
+                          vector<uint32_t>& parts,
+                          vector<int>& dev_ids) {
+    SnapshotGuard snapshot(this->_snapshot);
+    const RingData& ring_data = snapshot->ring_data;
+    const int replica_count = ring_data.replica_count();
+    const int part_shift = ring_data.part_shift();
+    const HashPathEngine& engine = SwiftUtils::hash_path_engine();
+
+    parts.resize(name_count);
+    dev_ids.assign(name_count * replica_count, -1);
+
+    unsigned char digests[HASH_BATCH_SIZE * MD5Hash::DIGEST_SIZE];
+    for (size_t first = 0; first < name_count; first += HASH_BATCH_SIZE) {
+        size_t count = name_count - first;
+        if (count > HASH_BATCH_SIZE) {
+            count = HASH_BATCH_SIZE;
         }
-
-        for (part2dev_id in this->_replica2part2dev_id) {
-            if (handoff_part < len(part2dev_id)) {
-                dev_id = part2dev_id[handoff_part];
-                dev = this->_devs[dev_id];
-                zone = (dev["region"], dev["zone"]);
-                if (dev_id not in used and zone not in same_zones) {
-                    yield dev;
-                    used.add(dev_id);
-                    same_zones.add(zone);
-                    ip = zone + (dev["ip"],);
-                    same_ips.add(ip);
-                    if (len(same_zones) == this->_num_zones) {
-                        hit_all_zones = true;
-                        break;
-                    }
+        engine.digest_batch(names + first, count, digests);
+
+        for (size_t i = 0; i < count; ++i) {
+            const size_t index = first + i;
+            const uint32_t part =
+                key_to_part(digests + i * MD5Hash::DIGEST_SIZE, part_shift);
+            parts[index] = part;
+
+            int* nodes = &dev_ids[0] + index * replica_count;
+            int node_count = 0;
+            for (int replica = 0; replica < replica_count; ++replica) {
+                if (part >= ring_data.replica_length(replica)) {
+                    continue;
                 }
-            }
-        }
-    }
-
-    bool hit_all_ips = len(same_ips) == this->_num_ips;
-    for (handoff_part in chain(range(start, parts, inc),
-                              range(inc - ((parts - start) % inc),
-                                    start, inc))) {
-        if (hit_all_ips) {
-            // We've exhausted the pool of unused backends, so stop
-            // looking.
-            break;
-        }
-        for (part2dev_id in this->_replica2part2dev_id) {
-            if (handoff_part < len(part2dev_id)) {
-                dev_id = part2dev_id[handoff_part];
-                dev = this->_devs[dev_id];
-                ip = (dev["region"], dev["zone"], dev["ip"]);
-                if (dev_id not in used and ip not in same_ips) {
-                    yield dev;
-                    used.add(dev_id);
-                    same_ips.add(ip);
-                    if (len(same_ips) == this->_num_ips) {
-                        hit_all_ips = true;
+                const int dev_id = ring_data.part2dev_id(replica)[part];
+                bool seen = false;
+                for (int j = 0; j < node_count; ++j) {
+                    if (nodes[j] == dev_id) {
+                        seen = true;
                         break;
                     }
                 }
-            }
-        }
-    }
-
-    bool hit_all_devs = len(used) == this->_num_devs;
-    for (handoff_part in chain(range(start, parts, inc),
-                              range(inc - ((parts - start) % inc),
-                                    start, inc))) {
-        if (hit_all_devs) {
-            // We've used every device we have, so let's stop looking for
-            // unused devices now.
-            break;
-        }
-
-        for (part2dev_id in this->_replica2part2dev_id) {
-            if (handoff_part < len(part2dev_id)) {
-                dev_id = part2dev_id[handoff_part];
-                if (dev_id not in used) {
-                    yield this->_devs[dev_id];
-                    used.add(dev_id);
-                    if (len(used) == this->_num_devs) {
-                        hit_all_devs = true;
-                        break;
-                    }
+                if (!seen) {
+                    nodes[node_count++] = dev_id;
                 }
             }
         }
     }
+
+    return replica_count;
 }
 
+void Ring::get_more_nodes(uint32_t part, vector<StorageDevice>& nodes) {
+    SnapshotGuard snapshot(this->_snapshot);
+    const vector<StorageDevice>& devs = snapshot->ring_data.devs();
 
+    nodes.clear();
+    HandoffIterator handoffs(*snapshot, part);
+    for (int dev_id = handoffs.next(); dev_id > -1; dev_id = handoffs.next()) {
+        nodes.push_back(devs[dev_id]);
+    }
+}
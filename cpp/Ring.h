@@ -2,61 +2,112 @@
 #define RING_H
 
 
+#include <stdint.h>
 #include <string>
+#include <vector>
 
-#include "RingStructure.h"
+#include "RcuPointer.h"
+#include "RingSnapshot.h"
+#include "StorageDevice.h"
 
 
+class HashPathName;
+class RingReloader;
+
+
+/**
+ * Lookups read the current RingSnapshot through an RcuPointer: they take
+ * no locks, make no syscalls and never wait for a reload. Reloading is
+ * done by a RingReloader thread, which publishes a new snapshot when the
+ * ring file changes; the old one is freed once no lookup is using it.
+ */
 class Ring {
 
 private:
     std::string serialized_path;
     int reload_time;
-    int _rtime;
-    int _mtime;
-    //Object _devs;
-    int _num_regions;
-    int _num_zones;
-    int _num_devs;
-    int _num_ips;
-    RingStructure ring_structure;
-    //int[][] _replica2part2dev_id;
-    //int _part_shift;
-    //Object tier2devs;
-    //Object tiers_by_length;
+    RcuPointer<RingSnapshot> _snapshot;
+    RingReloader* _reloader;
+
+    // disallow copies
+    Ring(const Ring&);
+    Ring& operator=(const Ring&);
+
+    void _init(const std::string& serialized_path, int reload_time);
 
 
 protected:
     void _reload();
     void _reload(bool force);
-    void _rebuild_tier_data();
+    void _get_part_nodes(const RingSnapshot& snapshot,
+                         uint32_t part,
+                         std::vector<StorageDevice>& nodes);
 
 
 public:
+    typedef RcuPointer<RingSnapshot>::ReadGuard SnapshotGuard;
+
+    static const int DEFAULT_RELOAD_TIME = 15;
+
+
     Ring(const std::string& serialized_path);
     Ring(const std::string& serialized_path,
          int reload_time);
     Ring(const std::string& serialized_path,
          const std::string& ring_name,
-         int reload_time=-1); //TODO: correct default value?
+         int reload_time=DEFAULT_RELOAD_TIME);
+    ~Ring();
+
+    // load the ring file again if it has changed since the current
+    // snapshot; this is what the reloader runs
+    void reload_if_changed();
 
     int replica_count();
     int partition_count();
-    void devs();
+    void devs(std::vector<StorageDevice>& devs);
     bool has_changed();
-    void _get_part_nodes(int part);
-    int get_part(const std::string& account,
-                 const std::string& container,
-                 const std::string& obj);
-    void get_part_nodes(int part);
-    void get_nodes(const std::string& account,
-                   const std::string& container,
-                   const std::string& obj);
-
-    void get_more_nodes(int part);
+    uint32_t get_part(const std::string& account,
+                      const std::string& container,
+                      const std::string& obj);
+    void get_part_nodes(uint32_t part, std::vector<StorageDevice>& nodes);
+    // returns the partition
+    uint32_t get_nodes(const std::string& account,
+                       const std::string& container,
+                       const std::string& obj,
+                       std::vector<StorageDevice>& nodes);
+
+    // Which replica of part dev_id holds, or -1 if part is a handoff on
+    // it. Constant time: one table read per replica.
+    int get_replica(int dev_id, uint32_t part);
+    bool is_primary(int dev_id, uint32_t part);
+
+    // Partitions assigned to dev_id, ascending, and the replica of each.
+    // Copies them out of the snapshot's RingPartitionIndex; hold a
+    // SnapshotGuard and use snapshot->partitions to avoid the copy.
+    void get_device_partitions(int dev_id,
+                               std::vector<uint32_t>& parts,
+                               std::vector<int>& replicas);
+
+    // Look up many names at once against one snapshot, hashing them on
+    // the multi-buffer path. parts gets each name's partition; dev_ids
+    // gets replica_count() entries per name (the returned stride): the
+    // primary device ids in replica order without repeats, padded with
+    // -1.
+    int get_nodes_batch(const HashPathName* names,
+                        size_t name_count,
+                        std::vector<uint32_t>& parts,
+                        std::vector<int>& dev_ids);
+
+    // All the handoffs of part. To stop after the first few, walk a
+    // HandoffIterator over a snapshot instead.
+    void get_more_nodes(uint32_t part, std::vector<StorageDevice>& nodes);
+
+    // for holding a SnapshotGuard over several lookups
+    RcuPointer<RingSnapshot>& snapshots() {
+        return this->_snapshot;
+    }
 
 };
 
 
 #endif
-
@@ -0,0 +1,412 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <vector>
+
+#include "RingCache.h"
+#include "RingData.h"
+
+using namespace std;
+
+static const char CACHE_MAGIC[8] = { 'R', '1', 'N', 'G', 'M', 'A', 'P', '\0' };
+static const uint32_t CACHE_VERSION = 1;
+// written in the host's byte order; a cache from a host of the other
+// endianness doesn't match and is rebuilt
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const char GZ_SUFFIX[] = ".gz";
+static const char CACHE_SUFFIX[] = ".cache";
+
+
+// identifies the .ring.gz a cache was made from
+struct RingSource {
+    int64_t mtime_ns;
+    uint64_t size;
+    // from the gzip trailer
+    uint32_t crc32;
+    uint32_t isize;
+};
+
+struct RingCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    RingSource source;
+    int32_t part_shift;
+    uint32_t partition_count;
+    uint32_t replica_count;
+    uint32_t dev_count;
+    // uint32_t replica_lengths[replica_count] follow the header, then
+    // the device records and their strings
+    uint64_t devs_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t table_offset;
+    uint64_t table_size;
+    // of the header up to here and everything up to table_offset
+    uint32_t metadata_crc32;
+    uint32_t reserved;
+};
+
+struct RingCacheString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct RingCacheDevice {
+    int32_t dev_id;
+    int32_t region;
+    int32_t zone;
+    int32_t port;
+    int32_t replication_port;
+    int32_t reserved;
+    double weight;
+    RingCacheString ip;
+    RingCacheString replication_ip;
+    RingCacheString device;
+    RingCacheString meta;
+};
+
+
+// for scoped closing of a file descriptor
+class FdCloser {
+private:
+    int _fd;
+
+    FdCloser();
+    FdCloser(const FdCloser&);
+    FdCloser& operator=(const FdCloser&);
+
+public:
+    FdCloser(int fd) :
+        _fd(fd) {
+    }
+
+    ~FdCloser() {
+        if (_fd > -1) {
+            ::close(_fd);
+        }
+    }
+};
+
+
+static bool read_source(const string& serialized_path, RingSource& source) {
+    const int fd = ::open(serialized_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    FdCloser closer(fd);
+
+    struct stat statbuf;
+    if (::fstat(fd, &statbuf) != 0 || statbuf.st_size < 8) {
+        return false;
+    }
+
+    // the gzip trailer: CRC32 and length of the uncompressed data, both
+    // little endian
+    unsigned char trailer[8];
+    if (::pread(fd, trailer, sizeof(trailer), statbuf.st_size - 8) != 8) {
+        return false;
+    }
+
+    memset(&source, 0, sizeof(source));
+    source.mtime_ns = (int64_t) statbuf.st_mtim.tv_sec * 1000000000LL +
+                      statbuf.st_mtim.tv_nsec;
+    source.size = statbuf.st_size;
+    source.crc32 = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) |
+                   ((uint32_t) trailer[3] << 24);
+    source.isize = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) |
+                   ((uint32_t) trailer[7] << 24);
+    return true;
+}
+
+static bool same_source(const RingSource& a, const RingSource& b) {
+    return a.mtime_ns == b.mtime_ns &&
+           a.size == b.size &&
+           a.crc32 == b.crc32 &&
+           a.isize == b.isize;
+}
+
+static uint32_t metadata_crc32(const char* base, const RingCacheHeader& header) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc,
+                (const Bytef*) base,
+                offsetof(RingCacheHeader, metadata_crc32));
+    crc = crc32(crc,
+                (const Bytef*) base + sizeof(RingCacheHeader),
+                header.strings_offset + header.strings_size -
+                    sizeof(RingCacheHeader));
+    return (uint32_t) crc;
+}
+
+static RingCacheString add_string(string& strings, const string& s) {
+    RingCacheString entry;
+    entry.offset = strings.length();
+    entry.length = s.length();
+    strings += s;
+    return entry;
+}
+
+static bool get_string(const char* strings,
+                       uint64_t strings_size,
+                       const RingCacheString& entry,
+                       string& s) {
+    if ((uint64_t) entry.offset + entry.length > strings_size) {
+        return false;
+    }
+    s.assign(strings + entry.offset, entry.length);
+    return true;
+}
+
+static bool write_fully(int fd, const void* data, size_t length) {
+    const char* p = (const char*) data;
+    while (length > 0) {
+        const ssize_t count = ::write(fd, p, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += count;
+        length -= count;
+    }
+    return true;
+}
+
+
+string RingCache::cache_path(const string& serialized_path) {
+    const size_t suffix_length = sizeof(GZ_SUFFIX) - 1;
+    if (serialized_path.length() > suffix_length &&
+        serialized_path.compare(serialized_path.length() - suffix_length,
+                                suffix_length,
+                                GZ_SUFFIX) == 0) {
+        return serialized_path.substr(0,
+                                      serialized_path.length() - suffix_length) +
+               CACHE_SUFFIX;
+    }
+    return serialized_path + CACHE_SUFFIX;
+}
+
+/**
+ * Only the small device table is copied out of the mapping; the
+ * partition tables are used where they are mapped.
+ */
+bool RingCache::load(const string& serialized_path, RingData& ring_data) {
+    RingSource source;
+    if (!read_source(serialized_path, source)) {
+        return false;
+    }
+
+    const int fd = ::open(cache_path(serialized_path).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    FdCloser closer(fd);
+
+    struct stat statbuf;
+    if (::fstat(fd, &statbuf) != 0 ||
+        (size_t) statbuf.st_size < sizeof(RingCacheHeader)) {
+        return false;
+    }
+    const size_t file_size = statbuf.st_size;
+
+    void* mapping = ::mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    RingData mapped;
+    // unmapped by mapped's destructor unless it's handed over below
+    mapped._mapping = mapping;
+    mapped._mapping_size = file_size;
+
+    const char* base = (const char*) mapping;
+    const RingCacheHeader& header = *(const RingCacheHeader*) base;
+    const uint64_t lengths_end = sizeof(RingCacheHeader) +
+        (uint64_t) header.replica_count * sizeof(uint32_t);
+    const uint64_t table_size = (uint64_t) header.replica_count *
+        header.partition_count * sizeof(uint16_t);
+
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.byte_order_mark != BYTE_ORDER_MARK ||
+        !same_source(header.source, source) ||
+        header.devs_offset < lengths_end ||
+        header.strings_offset < header.devs_offset +
+            (uint64_t) header.dev_count * sizeof(RingCacheDevice) ||
+        header.table_offset < header.strings_offset + header.strings_size ||
+        header.table_size != table_size ||
+        header.table_offset + header.table_size > file_size ||
+        header.table_offset % sizeof(uint16_t) != 0 ||
+        header.metadata_crc32 != metadata_crc32(base, header)) {
+        return false;
+    }
+
+    const uint32_t* replica_lengths =
+        (const uint32_t*) (base + sizeof(RingCacheHeader));
+    for (uint32_t replica = 0; replica < header.replica_count; ++replica) {
+        if (replica_lengths[replica] > header.partition_count) {
+            return false;
+        }
+        mapped._replica_lengths.push_back(replica_lengths[replica]);
+    }
+
+    const RingCacheDevice* devices =
+        (const RingCacheDevice*) (base + header.devs_offset);
+    const char* strings = base + header.strings_offset;
+    mapped._devs.resize(header.dev_count);
+    for (uint32_t i = 0; i < header.dev_count; ++i) {
+        const RingCacheDevice& record = devices[i];
+        StorageDevice& dev = mapped._devs[i];
+        dev.dev_id = record.dev_id;
+        dev.region = record.region;
+        dev.zone = record.zone;
+        dev.port = record.port;
+        dev.replication_port = record.replication_port;
+        dev.weight = record.weight;
+        if (!get_string(strings, header.strings_size, record.ip, dev.ip) ||
+            !get_string(strings, header.strings_size,
+                        record.replication_ip, dev.replication_ip) ||
+            !get_string(strings, header.strings_size,
+                        record.device, dev.device) ||
+            !get_string(strings, header.strings_size,
+                        record.meta, dev.meta)) {
+            return false;
+        }
+    }
+
+    mapped._part_shift = header.part_shift;
+    mapped._partition_count = header.partition_count;
+    mapped._table = (const uint16_t*) (base + header.table_offset);
+
+    ring_data.swap(mapped);
+    return true;
+}
+
+/**
+ * Written to a temporary file that's renamed into place, so processes
+ * only ever map complete caches.
+ */
+bool RingCache::save(const string& serialized_path,
+                     const RingData& ring_data) {
+    RingSource source;
+    if (!read_source(serialized_path, source)) {
+        return false;
+    }
+
+    const vector<StorageDevice>& devs = ring_data.devs();
+    const uint32_t replica_count = ring_data.replica_count();
+
+    string strings;
+    vector<RingCacheDevice> devices(devs.size());
+    for (size_t i = 0; i < devs.size(); ++i) {
+        const StorageDevice& dev = devs[i];
+        RingCacheDevice& record = devices[i];
+        memset(&record, 0, sizeof(record));
+        record.dev_id = dev.dev_id;
+        record.region = dev.region;
+        record.zone = dev.zone;
+        record.port = dev.port;
+        record.replication_port = dev.replication_port;
+        record.weight = dev.weight;
+        record.ip = add_string(strings, dev.ip);
+        record.replication_ip = add_string(strings, dev.replication_ip);
+        record.device = add_string(strings, dev.device);
+        record.meta = add_string(strings, dev.meta);
+    }
+
+    RingCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.byte_order_mark = BYTE_ORDER_MARK;
+    header.source = source;
+    header.part_shift = ring_data.part_shift();
+    header.partition_count = ring_data.partition_count();
+    header.replica_count = replica_count;
+    header.dev_count = devices.size();
+    header.devs_offset = sizeof(RingCacheHeader) +
+                         replica_count * sizeof(uint32_t);
+    // keep the device records 8 byte aligned for their doubles
+    header.devs_offset = (header.devs_offset + 7) & ~(uint64_t) 7;
+    header.strings_offset = header.devs_offset +
+                            devices.size() * sizeof(RingCacheDevice);
+    header.strings_size = strings.length();
+    const uint64_t page_size = ::sysconf(_SC_PAGESIZE);
+    header.table_offset = header.strings_offset + header.strings_size;
+    header.table_offset = (header.table_offset + page_size - 1) /
+                          page_size * page_size;
+    header.table_size = ring_data.table_size();
+
+    // everything before the table, so the CRC can be worked out over it
+    vector<char> metadata(header.table_offset, 0);
+    char* base = &metadata[0];
+    for (uint32_t replica = 0; replica < replica_count; ++replica) {
+        const uint32_t length = ring_data.replica_length(replica);
+        memcpy(base + sizeof(RingCacheHeader) + replica * sizeof(uint32_t),
+               &length,
+               sizeof(length));
+    }
+    if (!devices.empty()) {
+        memcpy(base + header.devs_offset,
+               &devices[0],
+               devices.size() * sizeof(RingCacheDevice));
+    }
+    memcpy(base + header.strings_offset, strings.data(), strings.length());
+    memcpy(base, &header, sizeof(header));
+    header.metadata_crc32 = metadata_crc32(base, header);
+    memcpy(base, &header, sizeof(header));
+
+    const string path = cache_path(serialized_path);
+    string temp_path = path + ".XXXXXX";
+    vector<char> temp_name(temp_path.begin(), temp_path.end());
+    temp_name.push_back('\0');
+    const int fd = ::mkstemp(&temp_name[0]);
+    if (fd < 0) {
+        return false;
+    }
+    temp_path = &temp_name[0];
+
+    bool written = write_fully(fd, base, metadata.size()) &&
+                   (header.table_size == 0 ||
+                    write_fully(fd, ring_data.part2dev_id(0), header.table_size)) &&
+                   ::fchmod(fd, 0644) == 0 &&
+                   ::fsync(fd) == 0;
+    if (::close(fd) != 0) {
+        written = false;
+    }
+
+    if (!written || ::rename(temp_path.c_str(), path.c_str()) != 0) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void RingCache::load_or_build(const string& serialized_path,
+                              RingData& ring_data) {
+    if (load(serialized_path, ring_data)) {
+        return;
+    }
+
+    RingSource before;
+    RingSource after;
+    const bool have_before = read_source(serialized_path, before);
+    ring_data.load(serialized_path);
+
+    // don't record a ring that was replaced while it was being read
+    // under the identity of its replacement
+    if (have_before &&
+        read_source(serialized_path, after) &&
+        same_source(before, after)) {
+        save(serialized_path, ring_data);
+    }
+}
+
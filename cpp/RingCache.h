@@ -0,0 +1,45 @@
+#ifndef RINGCACHE_H
+#define RINGCACHE_H
+
+#include <string>
+
+
+class RingData;
+
+
+/**
+ * Uncompressed copy of a .ring.gz laid out to be mapped read-only:
+ * a fixed header, the device table, then the replica2part2dev_id
+ * tables starting on a page boundary. Every process that loads the ring
+ * maps the same file, so the tables cost no private memory and the
+ * pages are shared across forks and daemons, and startup doesn't have
+ * to inflate anything.
+ *
+ * The cache records the size, mtime and gzip trailer (CRC32 and
+ * uncompressed length) of the .ring.gz it was made from and is only
+ * used while those still match.
+ */
+class RingCache {
+
+public:
+    // "object.ring.gz" -> "object.ring.cache", in the same directory
+    static std::string cache_path(const std::string& serialized_path);
+
+    // Map the cache of serialized_path into ring_data. Returns false,
+    // leaving ring_data alone, if there's no usable up to date cache.
+    static bool load(const std::string& serialized_path, RingData& ring_data);
+
+    // Write ring_data, loaded from serialized_path, out as its cache.
+    // Returns false if it couldn't be written, e.g. for lack of
+    // permission on the ring directory.
+    static bool save(const std::string& serialized_path,
+                     const RingData& ring_data);
+
+    // load() the cache, or else load the .ring.gz and save() a cache of
+    // it for next time.
+    static void load_or_build(const std::string& serialized_path,
+                              RingData& ring_data);
+};
+
+
+#endif
@@ -1,41 +1,277 @@
+#include <string.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#include <algorithm>
+
 #include "RingData.h"
+#include "Exceptions.h"
+#include "JsonReader.h"
+#include "StrUtils.h"
 
 using namespace std;
 
+static const char RING_MAGIC[] = "R1NG";
+static const int RING_FORMAT_VERSION = 1;
+// zlib's default of 8 KiB makes for a lot of read calls on a big ring
+static const unsigned GZ_BUFFER_SIZE = 256 * 1024;
+// gzread takes an unsigned length; read big tables in pieces
+static const size_t MAX_GZ_READ = 64 * 1024 * 1024;
+
+
+// for scoped closing of a gzFile
+class GzFileCloser {
+private:
+    gzFile _file;
+
+    GzFileCloser();
+    GzFileCloser(const GzFileCloser&);
+    GzFileCloser& operator=(const GzFileCloser&);
 
-RingData RingData::load(const string& filename,
-                        bool metadata_only) {
-    gz_file = GzipFile(filename, "rb");
-    // Python 2.6 GzipFile doesn't support BufferedIO
-    if (hasattr(gz_file, "_checkReadable")) {
-        gz_file = BufferedReader(gz_file);
+public:
+    GzFileCloser(gzFile file) :
+        _file(file) {
     }
 
-    // See if the file is in the new format
-    magic = gz_file.read(4);
-    if (magic == "R1NG") {
-        int format_version, = struct.unpack("!H", gz_file.read(2));
-        if (format_version == 1) {
-            ring_data = cls.deserialize_v1(
-                gz_file, metadata_only=metadata_only);
+    ~GzFileCloser() {
+        gzclose(_file);
+    }
+};
+
+
+// Read up to length bytes; returns how many were read, which is only
+// short at the end of the file.
+static size_t gz_read_fully(gzFile file,
+                            void* buffer,
+                            size_t length,
+                            const string& filename) {
+    char* p = (char*) buffer;
+    size_t total = 0;
+
+    while (total < length) {
+        size_t request = length - total;
+        if (request > MAX_GZ_READ) {
+            request = MAX_GZ_READ;
+        }
+        const int count = gzread(file, p + total, (unsigned) request);
+        if (count < 0) {
+            int errnum;
+            const char* message = gzerror(file, &errnum);
+            throw IOError(string("Error reading ") + filename + ": " +
+                          message);
+        }
+        if (count == 0) {
+            break;
+        }
+        total += count;
+    }
+    return total;
+}
+
+static uint32_t load_be32(const unsigned char* p) {
+    return ((uint32_t) p[0] << 24) |
+           ((uint32_t) p[1] << 16) |
+           ((uint32_t) p[2] << 8) |
+           ((uint32_t) p[3]);
+}
+
+static bool host_is_little_endian() {
+    const uint16_t probe = 1;
+    return *(const unsigned char*) &probe == 1;
+}
+
+static void read_device(JsonReader& reader, StorageDevice& dev) {
+    string key;
+    bool has_replication_ip = false;
+    bool has_replication_port = false;
+
+    reader.begin_object();
+    while (reader.next_key(key)) {
+        if (reader.peek() == JsonReader::NULL_VALUE) {
+            reader.read_null();
+        } else if (key == "id") {
+            dev.dev_id = (int) reader.read_long();
+        } else if (key == "region") {
+            dev.region = (int) reader.read_long();
+        } else if (key == "zone") {
+            dev.zone = (int) reader.read_long();
+        } else if (key == "ip") {
+            reader.read_string(dev.ip);
+        } else if (key == "port") {
+            dev.port = (int) reader.read_long();
+        } else if (key == "replication_ip") {
+            reader.read_string(dev.replication_ip);
+            has_replication_ip = true;
+        } else if (key == "replication_port") {
+            dev.replication_port = (int) reader.read_long();
+            has_replication_port = true;
+        } else if (key == "device") {
+            reader.read_string(dev.device);
+        } else if (key == "weight") {
+            dev.weight = reader.read_double();
+        } else if (key == "meta") {
+            reader.read_string(dev.meta);
         } else {
-            raise Exception("Unknown ring format version %d" %
-                            format_version);
+            reader.skip();
+        }
+    }
+
+    // older rings don't have the replication address
+    if (!has_replication_ip) {
+        dev.replication_ip = dev.ip;
+    }
+    if (!has_replication_port) {
+        dev.replication_port = dev.port;
+    }
+}
+
+
+RingData::RingData() :
+    _table(NULL),
+    _mapping(NULL),
+    _mapping_size(0),
+    _part_shift(32),
+    _partition_count(0) {
+}
+
+RingData::~RingData() {
+    if (_mapping != NULL) {
+        ::munmap(_mapping, _mapping_size);
+    }
+}
+
+void RingData::swap(RingData& other) {
+    _devs.swap(other._devs);
+    _replica2part2dev_id.swap(other._replica2part2dev_id);
+    std::swap(_table, other._table);
+    std::swap(_mapping, other._mapping);
+    std::swap(_mapping_size, other._mapping_size);
+    _replica_lengths.swap(other._replica_lengths);
+    std::swap(_part_shift, other._part_shift);
+    std::swap(_partition_count, other._partition_count);
+}
+
+void RingData::_parse_header(const char* json,
+                             size_t json_length,
+                             int& replica_count,
+                             bool& byteswap) {
+    JsonReader reader(json, json_length);
+    string key;
+    string byteorder;
+    bool has_part_shift = false;
+    replica_count = -1;
+
+    reader.begin_object();
+    while (reader.next_key(key)) {
+        if (key == "devs") {
+            reader.begin_array();
+            while (reader.next_element()) {
+                _devs.push_back(StorageDevice());
+                if (reader.peek() == JsonReader::NULL_VALUE) {
+                    reader.read_null();
+                } else {
+                    read_device(reader, _devs.back());
+                }
+            }
+        } else if (key == "part_shift") {
+            _part_shift = (int) reader.read_long();
+            has_part_shift = true;
+        } else if (key == "replica_count") {
+            replica_count = (int) reader.read_long();
+        } else if (key == "byteorder") {
+            reader.read_string(byteorder);
+        } else {
+            reader.skip();
         }
-    } else {
-        // Assume old-style pickled ring
-        gz_file.seek(0);
-        ring_data = pickle.load(gz_file);
     }
 
-    if (not hasattr(ring_data, "devs")) {
-        ring_data = RingData(ring_data["replica2part2dev_id"],
-                             ring_data["devs"], ring_data["part_shift"]);
+    if (!has_part_shift || _part_shift < 0 || _part_shift > 32 ||
+        replica_count < 0) {
+        throw ValueError("Ring header is missing part_shift or replica_count");
     }
-    return ring_data;
+
+    // rings from before byteorder was recorded are in the host's order
+    byteswap = !byteorder.empty() &&
+               (byteorder == "little") != host_is_little_endian();
 }
- 
-RingData::RingData(RingStructure ring) {
+
+/**
+ * The file is streamed through zlib with a large buffer: the JSON header
+ * is parsed in place and each replica's part2dev_id array is inflated
+ * directly into its slot of the contiguous table.
+ */
+void RingData::load(const string& filename, bool metadata_only) {
+    RingData loaded;
+
+    gzFile gz_file = gzopen(filename.c_str(), "rb");
+    if (gz_file == NULL) {
+        throw IOError(string("Unable to open ring file ") + filename);
+    }
+    GzFileCloser closer(gz_file);
+    gzbuffer(gz_file, GZ_BUFFER_SIZE);
+
+    // See if the file is in the new format
+    unsigned char preamble[10];
+    if (gz_read_fully(gz_file, preamble, 6, filename) != 6 ||
+        memcmp(preamble, RING_MAGIC, 4) != 0) {
+        // old-style pickled rings aren't supported
+        throw ValueError(string("Not a R1NG ring file: ") + filename);
+    }
+
+    const int format_version = (preamble[4] << 8) | preamble[5];
+    if (format_version != RING_FORMAT_VERSION) {
+        throw ValueError(string("Unknown ring format version ") +
+                         StrUtils::toString(format_version));
+    }
+
+    if (gz_read_fully(gz_file, preamble + 6, 4, filename) != 4) {
+        throw ValueError(string("Truncated ring file ") + filename);
+    }
+    const uint32_t json_length = load_be32(preamble + 6);
+    vector<char> json(json_length);
+    if (gz_read_fully(gz_file, &json[0], json_length, filename) !=
+        json_length) {
+        throw ValueError(string("Truncated ring file ") + filename);
+    }
+
+    int replica_count;
+    bool byteswap;
+    loaded._parse_header(&json[0], json_length, replica_count, byteswap);
+
+    const uint64_t partition_count = 1ULL << (32 - loaded._part_shift);
+    if (partition_count > 0xffffffffULL) {
+        throw ValueError("Ring part_shift is out of range");
+    }
+    loaded._partition_count = (uint32_t) partition_count;
+
+    if (metadata_only) {
+        loaded._replica_lengths.assign(replica_count, 0);
+    } else {
+        loaded._replica2part2dev_id.resize(
+            (size_t) replica_count * loaded._partition_count);
+
+        for (int replica = 0; replica < replica_count; ++replica) {
+            uint16_t* part2dev_id = &loaded._replica2part2dev_id[0] +
+                (size_t) replica * loaded._partition_count;
+            const size_t bytes = gz_read_fully(
+                gz_file,
+                part2dev_id,
+                loaded._partition_count * sizeof(uint16_t),
+                filename);
+            loaded._replica_lengths.push_back(bytes / sizeof(uint16_t));
+
+            if (byteswap) {
+                for (size_t i = 0; i < bytes / sizeof(uint16_t); ++i) {
+                    part2dev_id[i] = (uint16_t) ((part2dev_id[i] << 8) |
+                                                 (part2dev_id[i] >> 8));
+                }
+            }
+        }
+        if (!loaded._replica2part2dev_id.empty()) {
+            loaded._table = &loaded._replica2part2dev_id[0];
+        }
+    }
+
+    swap(loaded);
 }
 
 /*
@@ -72,4 +308,3 @@ void RingData::save(const string& filename) {
     os.rename(tempf.name, filename);
 }
 */
-
@@ -1,36 +1,111 @@
 #ifndef RINGDATA_H
 #define RINGDATA_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
-#include "RingStructure.h"
+#include "StorageDevice.h"
 
 
+/**
+ * Contents of a serialized ring: the device list and, per replica, the
+ * device id assigned to each partition. The replica2part2dev_id arrays
+ * are held back to back in one contiguous uint16 table, replica r's
+ * starting at r * partition_count(), exactly as they're laid out in the
+ * file, so loading reads them straight into place. The table can also
+ * be a read-only mapping of a ring cache file (see RingCache).
+ */
 class RingData {
 
+    // maps its cache file in place of _replica2part2dev_id
+    friend class RingCache;
+
 private:
-    RingStructure _ring;
-    //StorageDevice[] devs;
-    //int[][] _replica2part2dev_id;
-    //int _part_shift;
+    std::vector<StorageDevice> _devs;
+    std::vector<uint16_t> _replica2part2dev_id;
+    // the table in use: _replica2part2dev_id, or a mapped ring cache
+    const uint16_t* _table;
+    void* _mapping;
+    size_t _mapping_size;
+    // partitions held by each replica; only the last one of a ring with
+    // a fractional replica count is short
+    std::vector<uint32_t> _replica_lengths;
+    int _part_shift;
+    uint32_t _partition_count;
+
+    // disallow copies
+    RingData(const RingData&);
+    RingData& operator=(const RingData&);
+
+    void _parse_header(const char* json,
+                       size_t json_length,
+                       int& replica_count,
+                       bool& byteswap);
 
 
 public:
-    /*
-    static RingStructure deserialize_v1(GZIPInputStream gz_file,
-                                        bool metadata_only=false);
-    */
+    RingData();
+    ~RingData();
+
+    // Load a R1NG version 1 .ring.gz file. With metadata_only the
+    // device list is read but not the partition tables. Throws IOError
+    // if the file can't be read and ValueError if it isn't a ring.
+    void load(const std::string& filename, bool metadata_only=false);
 
-    static RingData load(const std::string& filename,
-                         bool metadata_only=false);
+    void swap(RingData& other);
 
-    RingData(RingStructure ring);
     void serialize_v1(FILE* file_obj);
 
     void save(const std::string& filename);
 
+    // indexed by device id; removed devices have dev_id -1
+    const std::vector<StorageDevice>& devs() const {
+        return _devs;
+    }
+
+    int part_shift() const {
+        return _part_shift;
+    }
+
+    int replica_count() const {
+        return (int) _replica_lengths.size();
+    }
+
+    uint32_t partition_count() const {
+        return _partition_count;
+    }
+
+    uint32_t replica_length(int replica) const {
+        return _replica_lengths[replica];
+    }
+
+    const uint16_t* part2dev_id(int replica) const {
+        return _table + (size_t) replica * _partition_count;
+    }
+
+    // replica of part that dev_id holds, or -1 if part is a handoff
+    // there; a read of each replica's table, so O(replica_count())
+    int replica_of(uint32_t part, int dev_id) const {
+        for (int replica = 0; replica < replica_count(); ++replica) {
+            if (part < _replica_lengths[replica] &&
+                part2dev_id(replica)[part] == dev_id) {
+                return replica;
+            }
+        }
+        return -1;
+    }
+
+    // bytes held by the partition tables
+    size_t table_size() const {
+        return (size_t) replica_count() * _partition_count * sizeof(uint16_t);
+    }
+
+    // true if the tables are shared pages of a ring cache file
+    bool is_mapped() const {
+        return _mapping != NULL;
+    }
 };
 
 #endif
-
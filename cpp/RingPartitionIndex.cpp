@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "RingPartitionIndex.h"
+#include "RingData.h"
+
+using namespace std;
+
+
+RingPartitionIndex::RingPartitionIndex() {
+}
+
+/**
+ * Two passes over the tables: count each device's assignments to size
+ * its row, then fill the rows walking partitions in order, so every row
+ * comes out sorted without a sort.
+ */
+void RingPartitionIndex::build(const RingData& ring_data) {
+    const size_t dev_count = ring_data.devs().size();
+    const int replica_count = ring_data.replica_count();
+    uint32_t max_length = 0;
+
+    vector<uint32_t> offsets(dev_count + 1, 0);
+    for (int replica = 0; replica < replica_count; ++replica) {
+        const uint16_t* part2dev_id = ring_data.part2dev_id(replica);
+        const uint32_t length = ring_data.replica_length(replica);
+        for (uint32_t part = 0; part < length; ++part) {
+            if (part2dev_id[part] < dev_count) {
+                ++offsets[part2dev_id[part] + 1];
+            }
+        }
+        max_length = max(max_length, length);
+    }
+    for (size_t dev_id = 0; dev_id < dev_count; ++dev_id) {
+        offsets[dev_id + 1] += offsets[dev_id];
+    }
+
+    vector<uint32_t> parts(offsets[dev_count]);
+    vector<uint8_t> replicas(offsets[dev_count]);
+    // next free slot in each row
+    vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint32_t part = 0; part < max_length; ++part) {
+        for (int replica = 0; replica < replica_count; ++replica) {
+            if (part >= ring_data.replica_length(replica)) {
+                continue;
+            }
+            const uint16_t dev_id = ring_data.part2dev_id(replica)[part];
+            if (dev_id < dev_count) {
+                const uint32_t slot = fill[dev_id]++;
+                parts[slot] = part;
+                replicas[slot] = (uint8_t) replica;
+            }
+        }
+    }
+
+    _offsets.swap(offsets);
+    _parts.swap(parts);
+    _replicas.swap(replicas);
+}
+
+int RingPartitionIndex::find(int dev_id, uint32_t part) const {
+    const size_t n = count(dev_id);
+    if (n == 0) {
+        return -1;
+    }
+
+    const uint32_t* first = parts(dev_id);
+    const uint32_t* found = lower_bound(first, first + n, part);
+    if (found == first + n || *found != part) {
+        return -1;
+    }
+    return replicas(dev_id)[found - first];
+}
+
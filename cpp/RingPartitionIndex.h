@@ -0,0 +1,64 @@
+#ifndef RINGPARTITIONINDEX_H
+#define RINGPARTITIONINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+class RingData;
+
+
+/**
+ * Reverse of replica2part2dev_id: for each device, the partitions it
+ * holds (ascending) and as which replica. Stored compressed-row style,
+ * one flat array of assignments with an offset per device, so it takes
+ * 5 bytes per assignment plus 4 per device however the partitions are
+ * spread.
+ */
+class RingPartitionIndex {
+
+private:
+    // assignments of device d are [_offsets[d], _offsets[d + 1])
+    std::vector<uint32_t> _offsets;
+    std::vector<uint32_t> _parts;
+    std::vector<uint8_t> _replicas;
+
+    // disallow copies
+    RingPartitionIndex(const RingPartitionIndex&);
+    RingPartitionIndex& operator=(const RingPartitionIndex&);
+
+
+public:
+    RingPartitionIndex();
+
+    void build(const RingData& ring_data);
+
+    // number of partitions assigned to dev_id
+    size_t count(int dev_id) const {
+        if (dev_id < 0 || (size_t) dev_id + 1 >= _offsets.size()) {
+            return 0;
+        }
+        return _offsets[dev_id + 1] - _offsets[dev_id];
+    }
+
+    // count(dev_id) partitions, ascending, and their replica numbers
+    const uint32_t* parts(int dev_id) const {
+        return &_parts[0] + _offsets[dev_id];
+    }
+
+    const uint8_t* replicas(int dev_id) const {
+        return &_replicas[0] + _offsets[dev_id];
+    }
+
+    // replica of part held by dev_id (by binary search), or -1
+    int find(int dev_id, uint32_t part) const;
+
+    size_t memory_size() const {
+        return _offsets.size() * sizeof(uint32_t) +
+               _parts.size() * sizeof(uint32_t) +
+               _replicas.size() * sizeof(uint8_t);
+    }
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "RingReloader.h"
+#include "Exceptions.h"
+#include "Ring.h"
+
+using namespace std;
+
+static const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+static const size_t EVENT_BUFFER_SIZE = 4096;
+
+
+static double monotonic_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+RingReloader::RingReloader(Ring* ring,
+                           const string& serialized_path,
+                           int reload_time) :
+    _ring(ring),
+    _reload_time(reload_time),
+    _inotify_fd(-1),
+    _running(false) {
+
+    const size_t slash = serialized_path.rfind('/');
+    if (slash == string::npos) {
+        _directory = ".";
+        _filename = serialized_path;
+    } else {
+        _directory = serialized_path.substr(0, slash > 0 ? slash : 1);
+        _filename = serialized_path.substr(slash + 1);
+    }
+
+    _stop_pipe[0] = -1;
+    _stop_pipe[1] = -1;
+}
+
+RingReloader::~RingReloader() {
+    stop();
+}
+
+bool RingReloader::start() {
+    if (_running) {
+        return true;
+    }
+
+    if (::pipe(_stop_pipe) != 0) {
+        return false;
+    }
+
+    // without inotify the periodic check still picks changes up
+    _inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify_fd > -1 &&
+        ::inotify_add_watch(_inotify_fd, _directory.c_str(), WATCH_EVENTS) < 0) {
+        ::close(_inotify_fd);
+        _inotify_fd = -1;
+    }
+
+    if (pthread_create(&_thread, NULL, reloader_main, this) != 0) {
+        stop();
+        return false;
+    }
+    _running = true;
+    return true;
+}
+
+void RingReloader::stop() {
+    if (_running) {
+        const char c = 0;
+        while (::write(_stop_pipe[1], &c, 1) < 0 && errno == EINTR) {
+        }
+        pthread_join(_thread, NULL);
+        _running = false;
+    }
+
+    if (_inotify_fd > -1) {
+        ::close(_inotify_fd);
+        _inotify_fd = -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (_stop_pipe[i] > -1) {
+            ::close(_stop_pipe[i]);
+            _stop_pipe[i] = -1;
+        }
+    }
+}
+
+void* RingReloader::reloader_main(void* arg) {
+    ((RingReloader*) arg)->_run();
+    return NULL;
+}
+
+void RingReloader::_run() {
+    while (_wait_for_change()) {
+        try {
+            _ring->reload_if_changed();
+        } catch (const std::exception&) {
+            // a half written, missing or corrupt ring (bad counts show
+            // up as bad_alloc or length_error): keep serving the current
+            // snapshot and try again on the next change
+        }
+    }
+}
+
+/**
+ * Returns true when it's time to check the ring, either because
+ * something happened to a file of that name or the reload time ran
+ * out, and false once stop() has been called.
+ */
+bool RingReloader::_wait_for_change() {
+    struct pollfd fds[2];
+    fds[0].fd = _stop_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = _inotify_fd;
+    fds[1].events = POLLIN;
+    const nfds_t fd_count = (_inotify_fd > -1) ? 2 : 1;
+    // events for other files in the directory mustn't put off the
+    // periodic check
+    const double deadline = monotonic_time() + _reload_time;
+
+    for (;;) {
+        int timeout = -1;
+        if (_reload_time > 0) {
+            const double remaining = deadline - monotonic_time();
+            timeout = (remaining > 0) ? (int) (remaining * 1000) + 1 : 0;
+        }
+        const int ready = ::poll(fds, fd_count, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (fds[0].revents != 0) {
+            return false;
+        }
+        if (ready == 0 ||
+            (_reload_time > 0 && monotonic_time() >= deadline)) {
+            return true;
+        }
+
+        // drain the events, looking for our file
+        bool changed = false;
+        char buffer[EVENT_BUFFER_SIZE]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+        for (;;) {
+            const ssize_t length = ::read(_inotify_fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (const char* p = buffer; p < buffer + length; ) {
+                const struct inotify_event* event =
+                    (const struct inotify_event*) p;
+                if (event->len > 0 && _filename == event->name) {
+                    changed = true;
+                }
+                if (event->mask & IN_Q_OVERFLOW) {
+                    changed = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (changed) {
+            return true;
+        }
+    }
+}
+
@@ -0,0 +1,52 @@
+#ifndef RINGRELOADER_H
+#define RINGRELOADER_H
+
+#include <pthread.h>
+#include <string>
+
+
+class Ring;
+
+
+/**
+ * Background thread that reloads a Ring when its file changes, so
+ * lookups never have to check for changes themselves. It watches the
+ * ring's directory with inotify (rings are replaced by rename, which
+ * a watch on the file itself would miss) and also checks every
+ * reload_time seconds, which is all it does where inotify isn't
+ * available.
+ */
+class RingReloader {
+
+private:
+    Ring* _ring;
+    std::string _directory;
+    std::string _filename;
+    int _reload_time;
+    int _inotify_fd;
+    int _stop_pipe[2];
+    pthread_t _thread;
+    bool _running;
+
+    // disallow copies
+    RingReloader(const RingReloader&);
+    RingReloader& operator=(const RingReloader&);
+
+    static void* reloader_main(void* arg);
+
+    void _run();
+    bool _wait_for_change();
+
+
+public:
+    RingReloader(Ring* ring,
+                 const std::string& serialized_path,
+                 int reload_time);
+    ~RingReloader();
+
+    // false if the thread couldn't be started
+    bool start();
+    void stop();
+};
+
+#endif
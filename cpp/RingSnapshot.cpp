@@ -0,0 +1,79 @@
+#include <errno.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#include "RingSnapshot.h"
+#include "Exceptions.h"
+#include "RingCache.h"
+
+using namespace std;
+
+
+RingSnapshot::RingSnapshot() :
+    mtime(0.0),
+    num_regions(0),
+    num_zones(0),
+    num_devs(0),
+    num_ips(0) {
+}
+
+void RingSnapshot::load(const string& serialized_path) {
+    // stat first: if the file changes while it's read, the next check
+    // sees a newer mtime and loads it again
+    struct stat statbuf;
+    if (::stat(serialized_path.c_str(), &statbuf) != 0) {
+        throw OSError(errno);
+    }
+    this->mtime = statbuf.st_mtim.tv_sec + statbuf.st_mtim.tv_nsec / 1e9;
+
+    RingCache::load_or_build(serialized_path, this->ring_data);
+
+    const vector<StorageDevice>& devs = this->ring_data.devs();
+
+    // Do this now, when we know the data has changed, rather than
+    // doing it on every call to get_more_nodes().
+    //
+    // Since this is to speed up the finding of handoffs, we only
+    // consider devices with at least one partition assigned. This
+    // way, a region, zone, or server with no partitions assigned
+    // does not count toward our totals, thereby keeping the early
+    // bailouts in get_more_nodes() working.
+    vector<bool> dev_ids_with_parts(devs.size(), false);
+    for (int replica = 0; replica < this->ring_data.replica_count(); ++replica) {
+        const uint16_t* part2dev_id = this->ring_data.part2dev_id(replica);
+        const uint32_t length = this->ring_data.replica_length(replica);
+        for (uint32_t part = 0; part < length; ++part) {
+            if (part2dev_id[part] < devs.size()) {
+                dev_ids_with_parts[part2dev_id[part]] = true;
+            }
+        }
+    }
+
+    this->tiers.build(this->ring_data);
+    this->partitions.build(this->ring_data);
+
+    vector<bool> tiers_with_parts(this->tiers.tier_count(), false);
+    this->num_devs = 0;
+    for (size_t dev_id = 0; dev_id < devs.size(); ++dev_id) {
+        if (devs[dev_id].dev_id > -1 && dev_ids_with_parts[dev_id]) {
+            tiers_with_parts[this->tiers.region(dev_id)] = true;
+            tiers_with_parts[this->tiers.zone(dev_id)] = true;
+            tiers_with_parts[this->tiers.ip(dev_id)] = true;
+            this->num_devs += 1;
+        }
+    }
+
+    const int zones_start = this->tiers.region_count();
+    const int ips_start = zones_start + this->tiers.zone_count();
+    this->num_regions = count(tiers_with_parts.begin(),
+                              tiers_with_parts.begin() + zones_start,
+                              true);
+    this->num_zones = count(tiers_with_parts.begin() + zones_start,
+                            tiers_with_parts.begin() + ips_start,
+                            true);
+    this->num_ips = count(tiers_with_parts.begin() + ips_start,
+                          tiers_with_parts.end(),
+                          true);
+}
+
@@ -0,0 +1,44 @@
+#ifndef RINGSNAPSHOT_H
+#define RINGSNAPSHOT_H
+
+#include <string>
+
+#include "RingData.h"
+#include "RingPartitionIndex.h"
+#include "RingTiers.h"
+
+
+/**
+ * Everything a Ring answers lookups from, as of one load of the ring
+ * file. A snapshot is never changed once it's published; a reload
+ * builds a new one and swaps it in (see RcuPointer).
+ */
+class RingSnapshot {
+
+private:
+    // disallow copies
+    RingSnapshot(const RingSnapshot&);
+    RingSnapshot& operator=(const RingSnapshot&);
+
+
+public:
+    RingData ring_data;
+    RingTiers tiers;
+    RingPartitionIndex partitions;
+    // of the ring file this was loaded from
+    double mtime;
+    // over devices with at least one partition assigned
+    int num_regions;
+    int num_zones;
+    int num_devs;
+    int num_ips;
+
+
+    RingSnapshot();
+
+    // Load serialized_path (through its ring cache) and work out the
+    // tiers, counts and partition index.
+    void load(const std::string& serialized_path);
+};
+
+#endif
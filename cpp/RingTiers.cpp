@@ -0,0 +1,80 @@
+#include <map>
+#include <string>
+#include <utility>
+
+#include "RingTiers.h"
+#include "RingData.h"
+
+using namespace std;
+
+
+RingTiers::RingTiers() :
+    _region_count(0),
+    _zone_count(0),
+    _ip_count(0),
+    _words_per_set(0) {
+}
+
+void RingTiers::build(const RingData& ring_data) {
+    const vector<StorageDevice>& devs = ring_data.devs();
+    map<int, int> region_ids;
+    map<pair<int, int>, int> zone_ids;
+    map<pair<int, string>, int> ip_ids;
+
+    _region.assign(devs.size(), -1);
+    _zone.assign(devs.size(), -1);
+    _ip.assign(devs.size(), -1);
+
+    // first pass numbers the tiers within each level
+    for (size_t dev_id = 0; dev_id < devs.size(); ++dev_id) {
+        const StorageDevice& dev = devs[dev_id];
+        if (dev.dev_id < 0) {
+            continue;
+        }
+
+        map<int, int>::iterator region_it = region_ids.find(dev.region);
+        if (region_it == region_ids.end()) {
+            region_it = region_ids.insert(
+                make_pair(dev.region, (int) region_ids.size())).first;
+        }
+        const pair<int, int> zone_key(dev.region, dev.zone);
+        map<pair<int, int>, int>::iterator zone_it = zone_ids.find(zone_key);
+        if (zone_it == zone_ids.end()) {
+            zone_it = zone_ids.insert(
+                make_pair(zone_key, (int) zone_ids.size())).first;
+        }
+        // ip ids are unique within their zone
+        const pair<int, string> ip_key(zone_it->second, dev.ip);
+        map<pair<int, string>, int>::iterator ip_it = ip_ids.find(ip_key);
+        if (ip_it == ip_ids.end()) {
+            ip_it = ip_ids.insert(
+                make_pair(ip_key, (int) ip_ids.size())).first;
+        }
+
+        _region[dev_id] = region_it->second;
+        _zone[dev_id] = zone_it->second;
+        _ip[dev_id] = ip_it->second;
+    }
+
+    _region_count = region_ids.size();
+    _zone_count = zone_ids.size();
+    _ip_count = ip_ids.size();
+
+    // then moves zones and ips past the regions into the shared space
+    _words_per_set = (devs.size() + 63) / 64;
+    _tier_devs.assign(tier_count() * _words_per_set, 0);
+    for (size_t dev_id = 0; dev_id < devs.size(); ++dev_id) {
+        if (_region[dev_id] < 0) {
+            continue;
+        }
+        _zone[dev_id] += _region_count;
+        _ip[dev_id] += _region_count + _zone_count;
+
+        const uint64_t bit = 1ULL << (dev_id & 63);
+        const size_t word = dev_id >> 6;
+        _tier_devs[_region[dev_id] * _words_per_set + word] |= bit;
+        _tier_devs[_zone[dev_id] * _words_per_set + word] |= bit;
+        _tier_devs[_ip[dev_id] * _words_per_set + word] |= bit;
+    }
+}
+
@@ -0,0 +1,90 @@
+#ifndef RINGTIERS_H
+#define RINGTIERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+class RingData;
+
+
+/**
+ * Integer ids for the failure domain tiers of a ring's devices. Every
+ * region, (region, zone) and (region, zone, ip) gets a dense id, and
+ * each of them a bitset of its device ids. All tier ids share one
+ * space, regions first, then zones, then ips, so a single bitset can
+ * mark tiers of any level. Built once per reload in place of
+ * tier2devs/tiers_by_length.
+ */
+class RingTiers {
+
+private:
+    std::vector<int> _region;
+    std::vector<int> _zone;
+    std::vector<int> _ip;
+    int _region_count;
+    int _zone_count;
+    int _ip_count;
+    size_t _words_per_set;
+    // one bitset of _words_per_set words per tier id
+    std::vector<uint64_t> _tier_devs;
+
+    // disallow copies
+    RingTiers(const RingTiers&);
+    RingTiers& operator=(const RingTiers&);
+
+
+public:
+    RingTiers();
+
+    void build(const RingData& ring_data);
+
+    // tier ids of a device, or -1 for an empty device slot
+    int region(int dev_id) const {
+        return _region[dev_id];
+    }
+
+    int zone(int dev_id) const {
+        return _zone[dev_id];
+    }
+
+    int ip(int dev_id) const {
+        return _ip[dev_id];
+    }
+
+    int region_count() const {
+        return _region_count;
+    }
+
+    int zone_count() const {
+        return _zone_count;
+    }
+
+    int ip_count() const {
+        return _ip_count;
+    }
+
+    int tier_count() const {
+        return _region_count + _zone_count + _ip_count;
+    }
+
+    int dev_count() const {
+        return (int) _region.size();
+    }
+
+    // bitset of the device ids in a tier, words_per_set() words long
+    const uint64_t* tier_devs(int tier_id) const {
+        return &_tier_devs[0] + tier_id * _words_per_set;
+    }
+
+    size_t words_per_set() const {
+        return _words_per_set;
+    }
+
+    bool tier_has_dev(int tier_id, int dev_id) const {
+        return (tier_devs(tier_id)[dev_id >> 6] >> (dev_id & 63)) & 1;
+    }
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "SharedRateLimiter.h"
+#include "Exceptions.h"
+#include "Time.h"
+
+using namespace std;
+
+
+static const uint32_t SLOT_EMPTY = 0;
+static const uint32_t SLOT_CLAIMING = 1;
+static const uint32_t SLOT_READY = 2;
+
+static const double NS_PER_SECOND = 1000000000.0;
+
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// FNV-1a; just needs to spread device names over the slot table
+static uint32_t hash_name(const string& name) {
+    uint32_t h = 2166136261U;
+    for (string::size_type i = 0; i < name.length(); ++i) {
+        h ^= (unsigned char) name[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+
+SharedRateLimiter::SharedRateLimiter(double files_per_second,
+                                     double bytes_per_second,
+                                     double device_files_per_second,
+                                     double device_bytes_per_second,
+                                     int rate_buffer) :
+    _region(NULL),
+    _files_per_second(files_per_second),
+    _bytes_per_second(bytes_per_second),
+    _device_files_per_second(device_files_per_second),
+    _device_bytes_per_second(device_bytes_per_second),
+    _burst_ns((int64_t) rate_buffer * 1000000000LL) {
+
+    void* region = ::mmap(NULL, sizeof(Region), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        throw OSError(errno);
+    }
+    // anonymous mappings come back zeroed: every bucket starts idle and
+    // every device slot empty
+    _region = (Region*) region;
+}
+
+SharedRateLimiter::~SharedRateLimiter() {
+    if (_region != NULL) {
+        ::munmap(_region, sizeof(Region));
+    }
+}
+
+int SharedRateLimiter::device_slot(const string& device) {
+    const string name = device.substr(0, MAX_DEVICE_NAME - 1);
+    const uint32_t start = hash_name(name) % MAX_DEVICES;
+
+    for (int probe = 0; probe < MAX_DEVICES; ++probe) {
+        const int index = (start + probe) % MAX_DEVICES;
+        DeviceSlot& slot = _region->devices[index];
+
+        uint32_t state = __atomic_load_n(&slot.state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_EMPTY) {
+            uint32_t expected = SLOT_EMPTY;
+            if (__atomic_compare_exchange_n(&slot.state, &expected,
+                                            SLOT_CLAIMING, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                memcpy(slot.name, name.c_str(), name.length() + 1);
+                __atomic_store_n(&slot.state, SLOT_READY, __ATOMIC_RELEASE);
+                return index;
+            }
+            state = expected;
+        }
+
+        // another process is writing the name; it only takes a moment
+        while (state == SLOT_CLAIMING) {
+            state = __atomic_load_n(&slot.state, __ATOMIC_ACQUIRE);
+        }
+
+        if (strcmp(slot.name, name.c_str()) == 0) {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Take amount from the bucket and return the time at which the caller
+ * may go ahead. A bucket that has been idle can lag at most the burst
+ * allowance behind now, which is what lets a burst through.
+ */
+int64_t SharedRateLimiter::_reserve(Bucket& bucket,
+                                    double rate,
+                                    long amount,
+                                    int64_t now) {
+    const int64_t cost = (int64_t) (NS_PER_SECOND * amount / rate);
+    int64_t tat = __atomic_load_n(&bucket.tat, __ATOMIC_RELAXED);
+
+    while (true) {
+        int64_t start = tat;
+        if (now - start > _burst_ns) {
+            start = now - _burst_ns;
+        }
+        if (__atomic_compare_exchange_n(&bucket.tat, &tat, start + cost,
+                                        true,
+                                        __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+            return start;
+        }
+    }
+}
+
+void SharedRateLimiter::_wait(int device_slot,
+                              double node_rate,
+                              double device_rate,
+                              long amount,
+                              bool bytes) {
+    if (amount <= 0) {
+        return;
+    }
+
+    const int64_t now = monotonic_ns();
+    int64_t go = now;
+
+    if (node_rate > 0) {
+        Bucket& bucket = bytes ? _region->node_bytes : _region->node_files;
+        int64_t start = _reserve(bucket, node_rate, amount, now);
+        if (start > go) {
+            go = start;
+        }
+    }
+
+    if (device_rate > 0 && device_slot > -1) {
+        DeviceSlot& slot = _region->devices[device_slot];
+        Bucket& bucket = bytes ? slot.bytes : slot.files;
+        int64_t start = _reserve(bucket, device_rate, amount, now);
+        if (start > go) {
+            go = start;
+        }
+    }
+
+    if (go > now) {
+        Time::sleep((go - now) / NS_PER_SECOND);
+    }
+}
+
+void SharedRateLimiter::files_done(int device_slot, long count) {
+    double files_per_second;
+    __atomic_load(&_files_per_second, &files_per_second, __ATOMIC_RELAXED);
+    _wait(device_slot, files_per_second, _device_files_per_second,
+          count, false);
+}
+
+void SharedRateLimiter::bytes_done(int device_slot, long bytes) {
+    double bytes_per_second;
+    __atomic_load(&_bytes_per_second, &bytes_per_second, __ATOMIC_RELAXED);
+    _wait(device_slot, bytes_per_second, _device_bytes_per_second,
+          bytes, true);
+}
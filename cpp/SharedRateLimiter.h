@@ -0,0 +1,94 @@
+#ifndef SHAREDRATELIMITER_H
+#define SHAREDRATELIMITER_H
+
+#include <stdint.h>
+#include <string>
+
+
+/**
+ * Token bucket rate limits that hold across threads and forked processes.
+ * The buckets live in an anonymous shared mapping, so the limiter must be
+ * created before forking; every child then draws from the same node-wide
+ * file and byte budgets, plus optional per-device budgets. Buckets are
+ * updated with compare-and-swap only (GCRA), so there is no lock for a
+ * crashed child to leave held.
+ */
+class SharedRateLimiter {
+
+public:
+    static const int MAX_DEVICES = 256;
+    static const int MAX_DEVICE_NAME = 64;
+
+
+private:
+    struct Bucket {
+        // theoretical arrival time: when the budget is next free, in
+        // CLOCK_MONOTONIC nanoseconds
+        int64_t tat;
+        char pad[56];
+    };
+
+    struct DeviceSlot {
+        uint32_t state;
+        char name[MAX_DEVICE_NAME];
+        Bucket files;
+        Bucket bytes;
+    };
+
+    struct Region {
+        Bucket node_files;
+        Bucket node_bytes;
+        DeviceSlot devices[MAX_DEVICES];
+    };
+
+    Region* _region;
+    double _files_per_second;
+    double _bytes_per_second;
+    double _device_files_per_second;
+    double _device_bytes_per_second;
+    int64_t _burst_ns;
+
+    // disallow copies
+    SharedRateLimiter(const SharedRateLimiter&);
+    SharedRateLimiter& operator=(const SharedRateLimiter&);
+
+    int64_t _reserve(Bucket& bucket, double rate, long amount, int64_t now);
+    void _wait(int device_slot,
+               double node_rate,
+               double device_rate,
+               long amount,
+               bool bytes);
+
+
+public:
+    // A rate of 0 means no limit. rate_buffer is the number of seconds of
+    // unused budget that may be spent as a burst.
+    SharedRateLimiter(double files_per_second,
+                      double bytes_per_second,
+                      double device_files_per_second,
+                      double device_bytes_per_second,
+                      int rate_buffer);
+    ~SharedRateLimiter();
+
+    // Slot for the device's buckets, shared by every process that asks
+    // for the same name; -1 if the table is full (only node-wide limits
+    // then apply).
+    int device_slot(const std::string& device);
+
+    // Change the node-wide rates this process draws with, e.g. when an
+    // adaptive throttle picks new ones. Other threads may be drawing at
+    // the time, so the rates are stored atomically.
+    void set_rates(double files_per_second, double bytes_per_second) {
+        __atomic_store(&_files_per_second, &files_per_second,
+                       __ATOMIC_RELAXED);
+        __atomic_store(&_bytes_per_second, &bytes_per_second,
+                       __ATOMIC_RELAXED);
+    }
+
+    // Sleep until the node and device budgets allow another count files
+    // or bytes.
+    void files_done(int device_slot, long count=1);
+    void bytes_done(int device_slot, long bytes);
+};
+
+#endif
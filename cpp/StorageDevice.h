@@ -9,18 +9,25 @@
 class StorageDevice {
 
 public:
+    // -1 for an empty slot (a removed device) in a ring's device list
     int dev_id;
     int region;
     int zone;
     std::string ip;
     std::string replication_ip;
     int port;
+    int replication_port;
+    std::string device;
+    double weight;
+    std::string meta;
 
     StorageDevice() :
         dev_id(-1),
         region(1),
         zone(-1),
-        port(-1) {
+        port(-1),
+        replication_port(-1),
+        weight(0.0) {
     }
 
     StorageDevice(const StorageDevice& copy) :
@@ -29,7 +36,11 @@ public:
         zone(copy.zone),
         ip(copy.ip),
         replication_ip(copy.replication_ip),
-        port(copy.port) {
+        port(copy.port),
+        replication_port(copy.replication_port),
+        device(copy.device),
+        weight(copy.weight),
+        meta(copy.meta) {
     }
 
     StorageDevice& operator=(const StorageDevice& copy) {
@@ -43,10 +54,13 @@ public:
         ip = copy.ip;
         replication_ip = copy.replication_ip;
         port = copy.port;
+        replication_port = copy.replication_port;
+        device = copy.device;
+        weight = copy.weight;
+        meta = copy.meta;
 
         return *this;
     }
 };
 
 #endif
-
@@ -89,6 +89,15 @@ std::string StrUtils::upper(const std::string& s) {
     return s_upper;
 }
 
+std::string StrUtils::lower(const std::string& s) {
+    string s_lower(s);
+    std::transform(s_lower.begin(),
+                   s_lower.end(),
+                   s_lower.begin(),
+    ::tolower);
+    return s_lower;
+}
+
 bool StrUtils::contains_only_chars_in(const std::string& s_test,
                                       const std::string& valid_chars) {
     return string::npos == s_test.find_first_not_of(valid_chars);
@@ -16,6 +16,7 @@ public:
     static std::string toString(double d);
     static std::string toString(bool b);
     static std::string upper(const std::string& s);
+    static std::string lower(const std::string& s);
     static bool contains_only_chars_in(const std::string& s_test,
                                        const std::string& valid_chars);
     static std::string lstrip(const std::string& s,
@@ -4,9 +4,12 @@
 
 #include "SwiftUtils.h"
 #include "OSUtils.h"
+#include "StrUtils.h"
 #include "Time.h"
 #include "errno.h"
 #include "Exceptions.h"
+#include "HashPathEngine.h"
+#include "MD5Hash.h"
 
 
 using namespace std;
@@ -32,6 +35,19 @@ vector<string> SwiftUtils::list_from_csv(const string& comma_separated_str) {
     return l;
 }
 
+/**
+Returns true if the value is either true or a string in TRUE_VALUES.
+*/
+bool SwiftUtils::config_true_value(const string& value) {
+    const string lower_value = StrUtils::lower(value);
+    return (lower_value == "true" ||
+            lower_value == "1" ||
+            lower_value == "yes" ||
+            lower_value == "on" ||
+            lower_value == "t" ||
+            lower_value == "y");
+}
+
 /**
 Test whether a path is a mount point. This will catch any
 exceptions and translate them into a False return value
@@ -135,13 +151,20 @@ void SwiftUtils::mkdirs(const std::string& dirPath) {
 }
 
 string SwiftUtils::md5_digest(const std::string& s) {
-    //TODO: implement SwiftUtils::md5_digest
-    return "";
+    MD5Hash hash;
+    hash.update(s);
+    return hash.digest();
 }
 
 string SwiftUtils::md5_hexdigest(const std::string& s) {
-    //TODO: implement SwiftUtils::md5_hexdigest
-    return "";
+    MD5Hash hash;
+    hash.update(s);
+    return hash.hexdigest();
+}
+
+const HashPathEngine& SwiftUtils::hash_path_engine() {
+    static const HashPathEngine engine(HASH_PATH_PREFIX, HASH_PATH_SUFFIX);
+    return engine;
 }
 
 /**
@@ -156,31 +179,9 @@ string SwiftUtils::hash_path(const string& account,
                              const string& container,
                              const string& object,
                              bool raw_digest) {
-    if (!object.empty() && container.empty()) {
-        throw ValueError("container is required if object is provided");
-    }
-
-    string path = HASH_PATH_PREFIX;
-    path += FORWARD_SLASH;
-    path += account;
-
-    if (!container.empty()) {
-        path += FORWARD_SLASH;
-        path += container;
-    }
-
-    if (!object.empty()) {
-        path += FORWARD_SLASH;
-        path += object;
-    }
-
-    path += FORWARD_SLASH;
-    path += HASH_PATH_SUFFIX;
-
-    if (raw_digest) {
-        return md5_digest(path);
-    } else {
-        return md5_hexdigest(path);
-    }
+    return hash_path_engine().hash_path(account,
+                                        container,
+                                        object,
+                                        raw_digest);
 }
 
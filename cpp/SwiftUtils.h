@@ -5,10 +5,14 @@
 #include <vector>
 
 
+class HashPathEngine;
+
+
 class SwiftUtils {
 
 public:
     static std::vector<std::string> list_from_csv(const std::string& comma_separated_str);
+    static bool config_true_value(const std::string& value);
     static bool ismount(const std::string& path);
     static bool ismount_raw(const std::string& path);
     static double ratelimit_sleep(double running_time,
@@ -26,6 +30,8 @@ public:
                                  const std::string& container,
                                  const std::string& object,
                                  bool raw_digest);
+    // engine for the configured hash path prefix and suffix
+    static const HashPathEngine& hash_path_engine();
     static std::string md5_digest(const std::string& s);
     static std::string md5_hexdigest(const std::string& s);
 
@@ -0,0 +1,137 @@
+#include "Timestamp.h"
+
+using namespace std;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+// integer part of the normal form is zero padded to this width
+static const int SECONDS_WIDTH = 10;
+// swift refuses timestamps from here on, and anything bigger wouldn't
+// format in INTERNAL_LENGTH
+static const int64_t MAX_SECONDS = 10000000000LL;
+static const int OFFSET_DIGITS = 16;
+
+
+Timestamp Timestamp::from_time(double seconds) {
+    return Timestamp((int64_t) (seconds * TICKS_PER_SECOND + 0.5));
+}
+
+size_t Timestamp::parse(const char* text, size_t length, Timestamp& result) {
+    size_t i = 0;
+    int64_t seconds = 0;
+    int digits = 0;
+
+    while (i < length && text[i] >= '0' && text[i] <= '9') {
+        // leading zeros are fine, as they are to float()
+        seconds = seconds * 10 + (text[i] - '0');
+        if (seconds >= MAX_SECONDS) {
+            return 0;
+        }
+        ++digits;
+        ++i;
+    }
+    if (digits == 0) {
+        return 0;
+    }
+
+    int64_t fraction = 0;
+    int fraction_digits = 0;
+    bool round_up = false;
+    if (i < length && text[i] == '.') {
+        ++i;
+        while (i < length && text[i] >= '0' && text[i] <= '9') {
+            if (fraction_digits < PRECISION) {
+                fraction = fraction * 10 + (text[i] - '0');
+            } else if (fraction_digits == PRECISION) {
+                // round to the nearest tick like the float formatting did
+                round_up = text[i] >= '5';
+            }
+            ++fraction_digits;
+            ++i;
+        }
+    }
+    for (int j = fraction_digits; j < PRECISION; ++j) {
+        fraction *= 10;
+    }
+
+    uint64_t offset = 0;
+    if (i < length && text[i] == '_') {
+        size_t start = ++i;
+        while (i < length && i - start < (size_t) OFFSET_DIGITS) {
+            const char c = text[i];
+            int value;
+            if (c >= '0' && c <= '9') {
+                value = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                value = c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                value = c - 'A' + 10;
+            } else {
+                break;
+            }
+            offset = (offset << 4) | value;
+            ++i;
+        }
+        if (i == start) {
+            return 0;
+        }
+    }
+
+    result._ticks = seconds * TICKS_PER_SECOND + fraction + (round_up ? 1 : 0);
+    result._offset = offset;
+    return i;
+}
+
+bool Timestamp::parse(const string& text, Timestamp& result) {
+    return parse(text.data(), text.length(), result) == text.length();
+}
+
+size_t Timestamp::format_normal(char* out) const {
+    int64_t seconds = _ticks / TICKS_PER_SECOND;
+    int64_t fraction = _ticks % TICKS_PER_SECOND;
+
+    // seconds, right to left, zero padded
+    char digits[24];
+    int count = 0;
+    do {
+        digits[count++] = (char) ('0' + seconds % 10);
+        seconds /= 10;
+    } while (seconds > 0);
+    while (count < SECONDS_WIDTH) {
+        digits[count++] = '0';
+    }
+
+    size_t pos = 0;
+    while (count > 0) {
+        out[pos++] = digits[--count];
+    }
+    out[pos++] = '.';
+    for (int i = PRECISION - 1; i >= 0; --i) {
+        out[pos + i] = (char) ('0' + fraction % 10);
+        fraction /= 10;
+    }
+    return pos + PRECISION;
+}
+
+size_t Timestamp::format_internal(char* out) const {
+    size_t pos = format_normal(out);
+    if (_offset == 0) {
+        return pos;
+    }
+
+    out[pos++] = '_';
+    for (int i = OFFSET_DIGITS - 1; i >= 0; --i) {
+        out[pos++] = HEX_DIGITS[(_offset >> (i * 4)) & 0xf];
+    }
+    return pos;
+}
+
+string Timestamp::normal() const {
+    char text[INTERNAL_LENGTH + 8];
+    return string(text, format_normal(text));
+}
+
+string Timestamp::internal() const {
+    char text[INTERNAL_LENGTH + 8];
+    return string(text, format_internal(text));
+}
+
@@ -1,8 +1,121 @@
 #ifndef TIMESTAMP_H
 #define TIMESTAMP_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
 
+
+/**
+ * Swift timestamp held as fixed point: whole 10 microsecond ticks since
+ * the epoch plus the optional offset that orders several operations
+ * with the same time. The text forms are "1445558400.12345" (normal)
+ * and "1445558400.12345_000000000000000a" (internal, only when there is
+ * an offset). Parsing and formatting work on caller buffers and never
+ * go through a double, so sorting filenames stays exact and cheap.
+ */
 class Timestamp {
+
+private:
+    int64_t _ticks;
+    uint64_t _offset;
+
+
+public:
+    static const int PRECISION = 5;
+    static const int64_t TICKS_PER_SECOND = 100000;
+    // "%016.05f"
+    static const size_t NORMAL_LENGTH = 16;
+    // normal + "_" + "%016x"
+    static const size_t INTERNAL_LENGTH = 33;
+
+
+    Timestamp() :
+        _ticks(0),
+        _offset(0) {
+    }
+
+    explicit Timestamp(int64_t ticks, uint64_t offset=0) :
+        _ticks(ticks),
+        _offset(offset) {
+    }
+
+    Timestamp(const Timestamp& copy) :
+        _ticks(copy._ticks),
+        _offset(copy._offset) {
+    }
+
+    Timestamp& operator=(const Timestamp& copy) {
+        _ticks = copy._ticks;
+        _offset = copy._offset;
+        return *this;
+    }
+
+    static Timestamp from_seconds(int64_t seconds) {
+        return Timestamp(seconds * TICKS_PER_SECOND);
+    }
+
+    // for the current time and the like; rounds to the nearest tick
+    static Timestamp from_time(double seconds);
+
+    // Parse the timestamp at the start of text. Returns the number of
+    // characters it took up, or 0 if text doesn't start with one.
+    static size_t parse(const char* text, size_t length, Timestamp& result);
+    static bool parse(const std::string& text, Timestamp& result);
+
+    int64_t ticks() const {
+        return _ticks;
+    }
+
+    uint64_t offset() const {
+        return _offset;
+    }
+
+    int64_t seconds() const {
+        return _ticks / TICKS_PER_SECOND;
+    }
+
+    // Write the text form into out (not NUL terminated) and return its
+    // length. out must hold INTERNAL_LENGTH characters.
+    size_t format_normal(char* out) const;
+    size_t format_internal(char* out) const;
+
+    std::string normal() const;
+    std::string internal() const;
+
+    int compare(const Timestamp& other) const {
+        if (_ticks != other._ticks) {
+            return _ticks < other._ticks ? -1 : 1;
+        }
+        if (_offset != other._offset) {
+            return _offset < other._offset ? -1 : 1;
+        }
+        return 0;
+    }
+
+    bool operator==(const Timestamp& other) const {
+        return compare(other) == 0;
+    }
+
+    bool operator!=(const Timestamp& other) const {
+        return compare(other) != 0;
+    }
+
+    bool operator<(const Timestamp& other) const {
+        return compare(other) < 0;
+    }
+
+    bool operator<=(const Timestamp& other) const {
+        return compare(other) <= 0;
+    }
+
+    bool operator>(const Timestamp& other) const {
+        return compare(other) > 0;
+    }
+
+    bool operator>=(const Timestamp& other) const {
+        return compare(other) >= 0;
+    }
 };
 
 
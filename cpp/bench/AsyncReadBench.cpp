@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "AsyncReadQueue.h"
+#include "MD5Hash.h"
+
+using namespace std;
+
+
+/*
+ * Reads and hashes a set of files the two ways DiskFileReader can: one
+ * blocking read per chunk, as _iter_chunked does, and through an
+ * AsyncReadQueue, as _iter_queued does, with the next file's stream
+ * opened before the current one is hashed (what prefetch() allows).
+ * Files are dropped from the page cache before every pass, so the reads
+ * go to the device as the auditor's do.
+ *
+ *   DIR     where to make the files (default /tmp); put it on the disk
+ *           to measure
+ *   FILES   number of files (default 256)
+ *   SIZE    bytes per file (default 1 MB)
+ *   CHUNK   read size, as disk_chunk_size (default 65536)
+ *   DEPTHS  comma separated audit_io_depth values (default 1,2,4,8,16)
+ */
+
+
+static double wall_seconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static long env_long(const char* name, long default_value) {
+    const char* value = getenv(name);
+    return value != NULL ? atol(value) : default_value;
+}
+
+
+static void drop_cache(const vector<int>& fds) {
+    for (size_t i = 0; i < fds.size(); ++i) {
+        ::posix_fadvise(fds[i], 0, 0, POSIX_FADV_DONTNEED);
+    }
+}
+
+static void read_blocking(const vector<int>& fds,
+                          long size,
+                          int chunk_size,
+                          unsigned char* digest) {
+    vector<char> buffer(chunk_size);
+    for (size_t i = 0; i < fds.size(); ++i) {
+        MD5Hash hash;
+        for (long offset = 0; offset < size; ) {
+            const ssize_t got = ::pread(fds[i], &buffer[0], chunk_size,
+                                        offset);
+            if (got <= 0) {
+                break;
+            }
+            hash.update(&buffer[0], got);
+            offset += got;
+        }
+        hash.digest(digest + i * MD5Hash::DIGEST_SIZE);
+    }
+}
+
+static void read_queued(AsyncReadQueue& queue,
+                        const vector<int>& fds,
+                        long size,
+                        unsigned char* digest) {
+    int stream = fds.empty() ? -1 : queue.open_stream(fds[0], 0, size);
+    for (size_t i = 0; i < fds.size(); ++i) {
+        // the next object's reads start as soon as slots free up
+        const int next = i + 1 < fds.size() ?
+            queue.open_stream(fds[i + 1], 0, size) : -1;
+        MD5Hash hash;
+        const char* data;
+        int length;
+        while (queue.next_chunk(stream, data, length)) {
+            hash.update(data, length);
+        }
+        queue.close_stream(stream);
+        hash.digest(digest + i * MD5Hash::DIGEST_SIZE);
+        stream = next;
+    }
+}
+
+
+int main() {
+    const string dir = getenv("DIR") ? getenv("DIR") : "/tmp";
+    const long file_count = env_long("FILES", 256);
+    const long size = env_long("SIZE", 1024 * 1024);
+    const int chunk_size = (int) env_long("CHUNK", 65536);
+    const string depths = getenv("DEPTHS") ? getenv("DEPTHS") : "1,2,4,8,16";
+
+    char root[4096];
+    snprintf(root, sizeof(root), "%s/AsyncReadBench.XXXXXX", dir.c_str());
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    vector<int> fds;
+    vector<string> paths;
+    vector<char> data(size);
+    for (long i = 0; i < file_count; ++i) {
+        char path[4200];
+        snprintf(path, sizeof(path), "%s/%ld.data", root, i);
+        const int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        for (long j = 0; j < size; ++j) {
+            data[j] = (char) (i * 31 + j);
+        }
+        if (fd < 0 || ::write(fd, &data[0], size) != size) {
+            perror("write");
+            return 1;
+        }
+        ::fsync(fd);
+        fds.push_back(fd);
+        paths.push_back(path);
+    }
+
+    const double mb = (double) file_count * size / (1024 * 1024);
+    vector<unsigned char> expected(file_count * MD5Hash::DIGEST_SIZE);
+    vector<unsigned char> digest(file_count * MD5Hash::DIGEST_SIZE);
+    int failures = 0;
+
+    printf("AsyncReadBench: %ld files of %ld bytes in %s, %d byte "
+           "chunks (wall time, cold cache)\n",
+           file_count, size, dir.c_str(), chunk_size);
+    drop_cache(fds);
+    double start = wall_seconds();
+    read_blocking(fds, size, chunk_size, &expected[0]);
+    const double blocking = wall_seconds() - start;
+    printf("  %-16s %8.1f MB/s\n", "blocking reads", mb / blocking);
+
+    for (size_t pos = 0; pos < depths.length(); ) {
+        const int depth = atoi(depths.c_str() + pos);
+        const size_t comma = depths.find(',', pos);
+        pos = comma == string::npos ? depths.length() : comma + 1;
+
+        AsyncReadQueue queue(depth, chunk_size);
+        if (!queue.available()) {
+            printf("  io_uring not available\n");
+            break;
+        }
+        drop_cache(fds);
+        start = wall_seconds();
+        read_queued(queue, fds, size, &digest[0]);
+        const double queued = wall_seconds() - start;
+        char label[32];
+        snprintf(label, sizeof(label), "io_uring depth %d", depth);
+        printf("  %-16s %8.1f MB/s  %.2fx\n", label, mb / queued,
+               blocking / queued);
+        if (digest != expected) {
+            ++failures;
+        }
+    }
+
+    for (size_t i = 0; i < fds.size(); ++i) {
+        ::close(fds[i]);
+        ::unlink(paths[i].c_str());
+    }
+    ::rmdir(root);
+
+    if (failures > 0) {
+        fprintf(stderr, "AsyncReadBench: queued digests differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef BENCHRING_H
+#define BENCHRING_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+
+/**
+ * Writes a synthetic R1NG version 1 .ring.gz for the ring benchmarks:
+ * devices_per_ip devices on each of ips_per_zone hosts in each zone of
+ * each region, with replica r of a partition placed a replica's share
+ * of the device list away from replica 0, so a partition's replicas
+ * land in different zones (and regions) whenever there are enough.
+ */
+class BenchRing {
+
+private:
+    static void _put_be(std::string& out, uint32_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) {
+            out.push_back((char) ((value >> (i * 8)) & 0xff));
+        }
+    }
+
+
+public:
+    static int device_count(int regions, int zones, int ips,
+                            int devices_per_ip) {
+        return regions * zones * ips * devices_per_ip;
+    }
+
+    // Returns false if the file couldn't be written.
+    static bool write(const std::string& path,
+                      int part_power,
+                      int replicas,
+                      int regions,
+                      int zones,
+                      int ips,
+                      int devices_per_ip) {
+        const int devs = device_count(regions, zones, ips, devices_per_ip);
+        std::string json = "{\"devs\": [";
+        for (int id = 0; id < devs; ++id) {
+            const int region = id / (zones * ips * devices_per_ip);
+            const int zone = id / (ips * devices_per_ip) % zones;
+            const int host = id / devices_per_ip % ips;
+            char dev[320];
+            snprintf(dev, sizeof(dev),
+                     "%s{\"id\": %d, \"region\": %d, \"zone\": %d, "
+                     "\"ip\": \"10.%d.%d.%d\", \"port\": 6200, "
+                     "\"replication_ip\": \"10.%d.%d.%d\", "
+                     "\"replication_port\": 6200, \"device\": \"d%d\", "
+                     "\"weight\": 100.0, \"meta\": \"\"}",
+                     id > 0 ? ", " : "", id, region, zone,
+                     region, zone, host, region, zone, host,
+                     id % devices_per_ip);
+            json += dev;
+        }
+        char tail[128];
+        snprintf(tail, sizeof(tail),
+                 "], \"part_shift\": %d, \"replica_count\": %d, "
+                 "\"byteorder\": \"little\"}",
+                 32 - part_power, replicas);
+        json += tail;
+
+        std::string header = "R1NG";
+        _put_be(header, 1, 2);
+        _put_be(header, (uint32_t) json.length(), 4);
+        header += json;
+
+        gzFile file = gzopen(path.c_str(), "wb");
+        if (file == NULL) {
+            return false;
+        }
+        bool ok = gzwrite(file, header.data(), header.length()) ==
+                  (int) header.length();
+
+        const uint32_t partitions = 1U << part_power;
+        std::vector<unsigned char> table(partitions * 2);
+        for (int replica = 0; replica < replicas && ok; ++replica) {
+            const int offset = devs / replicas * replica;
+            for (uint32_t part = 0; part < partitions; ++part) {
+                // mixed so any stride of partitions still spreads over
+                // every device
+                uint32_t x = part * 0x9e3779b1U;
+                x ^= x >> 16;
+                x *= 0x85ebca6bU;
+                x ^= x >> 13;
+                x *= 0xc2b2ae35U;
+                x ^= x >> 16;
+                const uint32_t dev = (x % devs + offset) % devs;
+                table[part * 2] = (unsigned char) (dev & 0xff);
+                table[part * 2 + 1] = (unsigned char) (dev >> 8);
+            }
+            ok = gzwrite(file, &table[0], table.size()) ==
+                 (int) table.size();
+        }
+        return gzclose(file) == Z_OK && ok;
+    }
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "DiskFileRules.h"
+#include "OndiskFiles.h"
+
+using namespace std;
+
+
+/*
+ * Classifies typical hash dir listings with the policy's rules inlined
+ * (OndiskFiles::classify_as<Rules>, as PolicyDiskFileManager does) and
+ * with each filename parsed through a virtual call, as
+ * DiskFileManager::parse_on_disk_filename was before. Everything else
+ * (sorting, deciding) is the same code in both.
+ *
+ *   LISTINGS  hash dirs per policy type (default 4096)
+ *   PASSES    passes over them; the best is kept (default 20)
+ */
+
+
+// clock() ticks too coarsely for one pass
+static double cpu_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long env_long(const char* name, long default_value) {
+    const char* value = getenv(name);
+    return value != NULL ? atol(value) : default_value;
+}
+
+
+// the per-file virtual of the old DiskFileManager
+class FileRules {
+public:
+    virtual ~FileRules() {}
+    virtual bool parse_on_disk_filename(const char* name,
+                                        size_t length,
+                                        FileInfo& info) const = 0;
+};
+
+template <typename Rules>
+class VirtualFileRules : public FileRules {
+public:
+    bool parse_on_disk_filename(const char* name,
+                                size_t length,
+                                FileInfo& info) const {
+        return Rules::parse_on_disk_filename(name, length, info);
+    }
+};
+
+// made at run time, so the compiler can't see which rules they are
+static FileRules* replication_rules;
+static FileRules* ec_rules;
+
+static FileRules* __attribute__((noinline)) make_rules(bool ec) {
+    if (ec) {
+        return new VirtualFileRules<ECRules>();
+    }
+    return new VirtualFileRules<ReplicationRules>();
+}
+
+// Rules for classify_as that go through a FileRules per file
+template <typename Rules, FileRules** rules>
+class DispatchedRules {
+public:
+    static const bool DATA_NEEDS_DURABLE = Rules::DATA_NEEDS_DURABLE;
+
+    static bool parse_on_disk_filename(const char* name,
+                                       size_t length,
+                                       FileInfo& info) {
+        return (*rules)->parse_on_disk_filename(name, length, info);
+    }
+};
+
+typedef DispatchedRules<ReplicationRules, &replication_rules>
+    VirtualReplicationRules;
+typedef DispatchedRules<ECRules, &ec_rules> VirtualECRules;
+
+
+static string timestamp_name(long seconds, const char* suffix) {
+    char name[64];
+    snprintf(name, sizeof(name), "%ld.%05ld%s", seconds, seconds % 100000,
+             suffix);
+    return name;
+}
+
+// the shapes of hash dir a sweep mostly finds
+static void make_listings(bool ec, long count,
+                          vector<vector<string> >& listings) {
+    listings.resize(count);
+    for (long i = 0; i < count; ++i) {
+        vector<string>& names = listings[i];
+        const long t = 1500000000L + i * 17;
+        char frag[16];
+        snprintf(frag, sizeof(frag), "#%ld.data", i % 14);
+        const char* data = ec ? frag : ".data";
+        switch (i % 8) {
+        case 0:
+        case 1:
+        case 2:
+            names.push_back(timestamp_name(t, data));
+            break;
+        case 3:
+            names.push_back(timestamp_name(t, data));
+            names.push_back(timestamp_name(t + 5, ".meta"));
+            break;
+        case 4:
+            names.push_back(timestamp_name(t, ".ts"));
+            break;
+        case 5:
+            // overwritten, the old one not cleaned up yet
+            names.push_back(timestamp_name(t, data));
+            names.push_back(timestamp_name(t + 9, data));
+            break;
+        case 6:
+            names.push_back(timestamp_name(t, data));
+            names.push_back(timestamp_name(t + 9, ".ts"));
+            break;
+        default:
+            names.push_back(timestamp_name(t, data));
+            names.push_back(timestamp_name(t + 3, ".meta"));
+            names.push_back(timestamp_name(t + 7, ".meta"));
+            break;
+        }
+        if (ec) {
+            // every .data of an EC hash dir has its .durable
+            const size_t files = names.size();
+            for (size_t f = 0; f < files; ++f) {
+                const size_t hash = names[f].find('#');
+                if (hash != string::npos) {
+                    names.push_back(names[f].substr(0, hash) + ".durable");
+                }
+            }
+        }
+    }
+}
+
+template <typename Rules>
+static double classify_pass(const vector<vector<string> >& listings,
+                            OndiskFiles& results,
+                            long& chosen) {
+    const double start = cpu_seconds();
+    for (size_t i = 0; i < listings.size(); ++i) {
+        results.template classify_as<Rules>(listings[i]);
+        chosen += results.data_file() != NULL ? 1 :
+                  results.ts_file() != NULL ? 2 : 3;
+    }
+    return cpu_seconds() - start;
+}
+
+template <typename Inlined, typename Virtual>
+static bool compare(const char* label,
+                    const vector<vector<string> >& listings,
+                    long passes) {
+    OndiskFiles results;
+    double best[2] = {1e9, 1e9};
+    long chosen[2] = {0, 0};
+    for (long pass = 0; pass < passes; ++pass) {
+        const double inlined = classify_pass<Inlined>(listings, results,
+                                                      chosen[0]);
+        const double dispatched = classify_pass<Virtual>(listings, results,
+                                                         chosen[1]);
+        best[0] = inlined < best[0] ? inlined : best[0];
+        best[1] = dispatched < best[1] ? dispatched : best[1];
+    }
+    const double count = (double) listings.size();
+    printf("  %-12s virtual %6.1f ns/hash dir, inlined %6.1f ns/hash dir, "
+           "%.2fx\n", label, best[1] / count * 1e9, best[0] / count * 1e9,
+           best[1] / best[0]);
+    return chosen[0] == chosen[1];
+}
+
+
+int main() {
+    const long count = env_long("LISTINGS", 4096);
+    const long passes = env_long("PASSES", 20);
+    replication_rules = make_rules(false);
+    ec_rules = make_rules(true);
+
+    vector<vector<string> > replicated;
+    vector<vector<string> > ec;
+    make_listings(false, count, replicated);
+    make_listings(true, count, ec);
+
+    printf("ClassifyBench: %ld hash dir listings, best of %ld passes "
+           "(cpu time)\n", count, passes);
+    bool same = compare<ReplicationRules, VirtualReplicationRules>(
+        "replication", replicated, passes);
+    same = compare<ECRules, VirtualECRules>("EC", ec, passes) && same;
+
+    delete replication_rules;
+    delete ec_rules;
+    if (!same) {
+        fprintf(stderr, "ClassifyBench: results differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BenchRing.h"
+#include "HandoffIterator.h"
+#include "MD5Hash.h"
+#include "RingCache.h"
+#include "RingSnapshot.h"
+
+using namespace std;
+
+
+/*
+ * Latency of the first handoff, the first two and all handoffs of a
+ * partition: HandoffIterator against the set based get_more_nodes it
+ * replaced, ported as it was (sets of region, (region, zone) and
+ * (region, zone, ip) tuples, one walk of replica2part2dev_id per stage)
+ * and stopping once it has yielded enough, as the generator did. Both
+ * must yield the same devices in the same order.
+ *
+ *   PART_POWERS  comma separated (default 18,20,22)
+ *   REPLICAS     (default 3)
+ *   REGIONS, ZONES (per region), IPS (per zone), DEVICES (per ip)
+ *                topology (default 2, 4, 8, 12: 768 devices)
+ *   PARTS        partitions looked up per measurement (default 2000)
+ */
+
+
+static double cpu_seconds() {
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static long env_long(const char* name, long default_value) {
+    const char* value = getenv(name);
+    return value != NULL ? atol(value) : default_value;
+}
+
+
+typedef pair<int, int> Zone;
+typedef pair<Zone, string> Ip;
+
+// get_more_nodes as it was, with up to limit handoffs put in handoffs
+static void set_handoffs(const RingSnapshot& snapshot,
+                         uint32_t part,
+                         size_t limit,
+                         vector<int>& handoffs) {
+    const RingData& ring_data = snapshot.ring_data;
+    const vector<StorageDevice>& devs = ring_data.devs();
+    handoffs.clear();
+
+    set<int> used;
+    set<int> same_regions;
+    set<Zone> same_zones;
+    set<Ip> same_ips;
+    for (int replica = 0; replica < ring_data.replica_count(); ++replica) {
+        if (part < ring_data.replica_length(replica)) {
+            const StorageDevice& dev = devs[ring_data.part2dev_id(replica)[part]];
+            used.insert(dev.dev_id);
+            same_regions.insert(dev.region);
+            same_zones.insert(Zone(dev.region, dev.zone));
+            same_ips.insert(Ip(Zone(dev.region, dev.zone), dev.ip));
+        }
+    }
+
+    const uint32_t parts = ring_data.partition_count();
+    char part_text[16];
+    const int part_length = snprintf(part_text, sizeof(part_text), "%u", part);
+    MD5Hash hash;
+    hash.update(part_text, part_length);
+    unsigned char digest[MD5Hash::DIGEST_SIZE];
+    hash.digest(digest);
+    const uint32_t key = ((uint32_t) digest[0] << 24) |
+                         ((uint32_t) digest[1] << 16) |
+                         ((uint32_t) digest[2] << 8) |
+                         ((uint32_t) digest[3]);
+    const uint32_t start = key >> ring_data.part_shift();
+    const uint32_t inc = parts / 65536 > 0 ? parts / 65536 : 1;
+    // chain(range(start, parts, inc), range(inc - ((parts - start) % inc),
+    // start, inc)), walked lazily as the generator did
+    const uint32_t wrap_begin = inc - ((parts - start) % inc);
+    const uint32_t first_count = (parts - start + inc - 1) / inc;
+    const uint32_t count = first_count +
+        (wrap_begin < start ? (start - wrap_begin + inc - 1) / inc : 0);
+
+    for (int stage = 0; stage < 4; ++stage) {
+        const size_t total = stage == 0 ? (size_t) snapshot.num_regions :
+                             stage == 1 ? (size_t) snapshot.num_zones :
+                             stage == 2 ? (size_t) snapshot.num_ips :
+                                          (size_t) snapshot.num_devs;
+        size_t hit_count = 0;
+        bool hit_all = false;
+        for (uint32_t n = 0; n < count && !hit_all; ++n) {
+            const uint32_t handoff_part = n < first_count ?
+                start + n * inc : wrap_begin + (n - first_count) * inc;
+            hit_count = stage == 0 ? same_regions.size() :
+                        stage == 1 ? same_zones.size() :
+                        stage == 2 ? same_ips.size() : used.size();
+            if (hit_count == total) {
+                break;
+            }
+            for (int replica = 0; replica < ring_data.replica_count();
+                 ++replica) {
+                if (handoff_part >= ring_data.replica_length(replica)) {
+                    continue;
+                }
+                const int dev_id =
+                    ring_data.part2dev_id(replica)[handoff_part];
+                const StorageDevice& dev = devs[dev_id];
+                // only the tuple the stage looks at is made, as before
+                if (used.count(dev_id) > 0 ||
+                    (stage == 0 && same_regions.count(dev.region) > 0) ||
+                    (stage == 1 &&
+                     same_zones.count(Zone(dev.region, dev.zone)) > 0) ||
+                    (stage == 2 &&
+                     same_ips.count(Ip(Zone(dev.region, dev.zone),
+                                       dev.ip)) > 0)) {
+                    continue;
+                }
+                handoffs.push_back(dev_id);
+                if (handoffs.size() >= limit) {
+                    return;
+                }
+                used.insert(dev_id);
+                same_regions.insert(dev.region);
+                same_zones.insert(Zone(dev.region, dev.zone));
+                same_ips.insert(Ip(Zone(dev.region, dev.zone), dev.ip));
+                hit_count = stage == 0 ? same_regions.size() :
+                            stage == 1 ? same_zones.size() :
+                            stage == 2 ? same_ips.size() : used.size();
+                if (hit_count == total) {
+                    hit_all = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void iterator_handoffs(const RingSnapshot& snapshot,
+                              uint32_t part,
+                              size_t limit,
+                              vector<int>& handoffs) {
+    handoffs.clear();
+    HandoffIterator it(snapshot, part);
+    for (int dev_id = it.next(); dev_id > -1; dev_id = it.next()) {
+        handoffs.push_back(dev_id);
+        if (handoffs.size() >= limit) {
+            return;
+        }
+    }
+}
+
+
+int main() {
+    const string part_powers = getenv("PART_POWERS") ?
+        getenv("PART_POWERS") : "18,20,22";
+    const int replicas = (int) env_long("REPLICAS", 3);
+    const int regions = (int) env_long("REGIONS", 2);
+    const int zones = (int) env_long("ZONES", 4);
+    const int ips = (int) env_long("IPS", 8);
+    const int devices_per_ip = (int) env_long("DEVICES", 12);
+    const long lookups = env_long("PARTS", 2000);
+    const size_t ALL = (size_t) -1;
+    const size_t LIMITS[] = {1, 2, ALL};
+
+    char root[] = "/tmp/HandoffBench.XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    const string path = string(root) + "/object.ring.gz";
+    int failures = 0;
+
+    printf("HandoffBench: %d replicas, %d devices (%d regions, %d zones, "
+           "%d ips), %ld partitions each (cpu time, us per partition)\n",
+           replicas,
+           BenchRing::device_count(regions, zones, ips, devices_per_ip),
+           regions, regions * zones, regions * zones * ips, lookups);
+    printf("  %-6s %-10s %10s %10s %7s\n", "ring", "handoffs", "sets",
+           "iterator", "gain");
+    for (size_t pos = 0; pos < part_powers.length(); ) {
+        const int part_power = atoi(part_powers.c_str() + pos);
+        const size_t comma = part_powers.find(',', pos);
+        pos = comma == string::npos ? part_powers.length() : comma + 1;
+
+        if (!BenchRing::write(path, part_power, replicas, regions, zones,
+                              ips, devices_per_ip)) {
+            perror("write ring");
+            return 1;
+        }
+        RingSnapshot snapshot;
+        snapshot.load(path);
+
+        vector<uint32_t> parts(lookups);
+        unsigned int seed = (unsigned int) part_power;
+        for (long i = 0; i < lookups; ++i) {
+            parts[i] = (uint32_t) rand_r(&seed) % (1U << part_power);
+        }
+
+        vector<int> expected;
+        vector<int> handoffs;
+        for (size_t l = 0; l < sizeof(LIMITS) / sizeof(LIMITS[0]); ++l) {
+            double start = cpu_seconds();
+            for (long i = 0; i < lookups; ++i) {
+                set_handoffs(snapshot, parts[i], LIMITS[l], handoffs);
+            }
+            const double sets = cpu_seconds() - start;
+
+            start = cpu_seconds();
+            for (long i = 0; i < lookups; ++i) {
+                iterator_handoffs(snapshot, parts[i], LIMITS[l], handoffs);
+            }
+            const double iterator = cpu_seconds() - start;
+
+            for (long i = 0; i < lookups; ++i) {
+                set_handoffs(snapshot, parts[i], LIMITS[l], expected);
+                iterator_handoffs(snapshot, parts[i], LIMITS[l], handoffs);
+                if (handoffs != expected) {
+                    ++failures;
+                }
+            }
+
+            char ring[16];
+            snprintf(ring, sizeof(ring), "2^%d", part_power);
+            char label[16];
+            if (LIMITS[l] == ALL) {
+                snprintf(label, sizeof(label), "all %d",
+                         (int) handoffs.size());
+            } else {
+                snprintf(label, sizeof(label), "first %d", (int) LIMITS[l]);
+            }
+            printf("  %-6s %-10s %10.2f %10.2f %6.1fx\n", ring, label,
+                   sets / lookups * 1e6, iterator / lookups * 1e6,
+                   sets / iterator);
+        }
+        ::unlink(RingCache::cache_path(path).c_str());
+        ::unlink(path.c_str());
+    }
+    ::rmdir(root);
+
+    if (failures > 0) {
+        fprintf(stderr, "HandoffBench: %d partitions' handoffs differ\n",
+                failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "MD5Hash.h"
+#include "MD5MultiBuffer.h"
+
+using namespace std;
+
+
+/*
+ * Hashes a batch of objects with MD5Hash one at a time and with each
+ * MD5MultiBuffer engine the CPU supports, for several object size
+ * distributions, and checks every engine's digests against MD5Hash.
+ *
+ *   BYTES  total bytes hashed per distribution and engine (default 256 MB)
+ */
+
+
+static double cpu_seconds() {
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+
+class Distribution {
+public:
+    const char* name;
+    size_t min_size;
+    size_t max_size;
+    // sizes spread evenly over log2(size) rather than over size, which
+    // is closer to how object sizes fall on a node
+    bool log_uniform;
+};
+
+static const Distribution DISTRIBUTIONS[] = {
+    {"256 B",             256,       256, false},
+    {"1 KB",             1024,      1024, false},
+    {"4 KB",             4096,      4096, false},
+    {"16 KB",           16384,     16384, false},
+    {"64 KB",           65536,     65536, false},
+    {"1 B - 64 KB log",     1,     65536, true},
+    {"0 - 64 KB even",      0,     65536, false},
+};
+
+
+static size_t pick_size(const Distribution& dist, unsigned int& seed) {
+    if (dist.min_size == dist.max_size) {
+        return dist.min_size;
+    }
+    const double r = (double) rand_r(&seed) / RAND_MAX;
+    if (dist.log_uniform) {
+        const double lo = log((double) dist.min_size);
+        const double hi = log((double) dist.max_size);
+        return (size_t) exp(lo + r * (hi - lo));
+    }
+    return dist.min_size + (size_t) (r * (dist.max_size - dist.min_size));
+}
+
+static double hash_scalar(vector<MD5Job>& jobs) {
+    const double start = cpu_seconds();
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        MD5Hash hash;
+        hash.update(jobs[i].data, jobs[i].length);
+        hash.digest(jobs[i].digest);
+    }
+    return cpu_seconds() - start;
+}
+
+static double hash_engine(vector<MD5Job>& jobs,
+                          MD5MultiBuffer::Engine engine) {
+    const double start = cpu_seconds();
+    MD5MultiBuffer::digest_jobs(&jobs[0], jobs.size(), engine);
+    return cpu_seconds() - start;
+}
+
+
+int main() {
+    const double total = getenv("BYTES") ?
+        atof(getenv("BYTES")) : 256.0 * 1024 * 1024;
+    const MD5MultiBuffer::Engine best = MD5MultiBuffer::engine();
+    // one object's bytes, shared by every job; MD5 doesn't care
+    vector<unsigned char> data(65536);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (unsigned char) (i * 131 + 7);
+    }
+
+    printf("MD5Bench: best engine %s, %.0f MB per run (cpu time, MB/s)\n",
+           MD5MultiBuffer::engine_name(best), total / (1024 * 1024));
+    printf("  %-16s %9s", "object sizes", "MD5Hash");
+    for (int engine = MD5MultiBuffer::AVX2; engine <= best; ++engine) {
+        printf(" %9s",
+               MD5MultiBuffer::engine_name((MD5MultiBuffer::Engine) engine));
+    }
+    printf("\n");
+
+    // MD5Hash itself against RFC 1321
+    int failures = 0;
+    MD5Hash abc;
+    abc.update("abc", 3);
+    if (abc.hexdigest() != "900150983cd24fb0d6963f7d28e17f72") {
+        ++failures;
+    }
+    const size_t dist_count = sizeof(DISTRIBUTIONS) / sizeof(DISTRIBUTIONS[0]);
+    for (size_t d = 0; d < dist_count; ++d) {
+        unsigned int seed = 1;
+        vector<MD5Job> jobs;
+        double bytes = 0;
+        while (bytes < total) {
+            const size_t size = pick_size(DISTRIBUTIONS[d], seed);
+            jobs.push_back(MD5Job(&data[0], size));
+            bytes += size;
+        }
+        const double mb = bytes / (1024 * 1024);
+
+        printf("  %-16s %9.0f", DISTRIBUTIONS[d].name,
+               mb / hash_scalar(jobs));
+        vector<MD5Job> expected(jobs);
+        for (int engine = MD5MultiBuffer::AVX2; engine <= best; ++engine) {
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                memset(jobs[i].digest, 0, MD5Hash::DIGEST_SIZE);
+            }
+            printf(" %9.0f",
+                   mb / hash_engine(jobs, (MD5MultiBuffer::Engine) engine));
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                if (memcmp(jobs[i].digest, expected[i].digest,
+                           MD5Hash::DIGEST_SIZE) != 0) {
+                    ++failures;
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    if (failures > 0) {
+        fprintf(stderr, "MD5Bench: %d digests are wrong\n",
+                failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/xattr.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Exceptions.h"
+#include "Metadata.h"
+#include "MetadataPickle.h"
+#include "MetadataXattr.h"
+
+using namespace std;
+
+
+/*
+ * Per object cost of reading object metadata the way an open does:
+ * fgetxattr of every user.swift.metadata piece plus MetadataPickle::loads,
+ * through MetadataXattr::read, at a few typical metadata sizes. The two
+ * halves are also timed on their own: the fgetxattr calls alone (the
+ * floor for any decoder) and loads of a pickle already in memory.
+ *
+ *   DIR        where to make the files (default /tmp); needs user xattrs
+ *   FILES      files per size (default 2000)
+ *   USER_META  comma separated X-Object-Meta-* counts, one size each
+ *              (default 0,4,16,64: 1 to 12 pieces; ext4 keeps at most a
+ *              block of xattrs per file, so larger ones need XFS)
+ *   PASSES     passes over the files; the best is kept (default 5)
+ */
+
+
+// clock() ticks too coarsely for one pass
+static double cpu_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long env_long(const char* name, long default_value) {
+    const char* value = getenv(name);
+    return value != NULL ? atol(value) : default_value;
+}
+
+
+// what the object server writes for a PUT, plus user_meta user keys
+static void make_metadata(long file, int user_meta, Metadata& metadata) {
+    char timestamp[32];
+    snprintf(timestamp, sizeof(timestamp), "%ld.%05ld",
+             1500000000L + file, file % 100000);
+    char name[64];
+    snprintf(name, sizeof(name), "/AUTH_test/photos/2017/img_%06ld.jpg",
+             file);
+    metadata.clear();
+    metadata.set("name", name);
+    metadata.set(Metadata::X_TIMESTAMP, timestamp);
+    metadata.set(Metadata::CONTENT_TYPE, "image/jpeg");
+    metadata.set("ETag", "5d41402abc4b2a76b9719d911017c592");
+    metadata.set("Content-Length", "1048576");
+    for (int i = 0; i < user_meta; ++i) {
+        char key[64];
+        char value[64];
+        snprintf(key, sizeof(key), "X-Object-Meta-Key%d", i);
+        snprintf(value, sizeof(value), "value %d of object %ld", i, file);
+        metadata.set(key, value);
+    }
+}
+
+// the raw fgetxattr calls of MetadataXattr::read, into one buffer. The
+// sizes asked for are the same too (4 KiB, doubled as needed), since the
+// kernel allocates whatever size it is asked for.
+static size_t getxattr_only(int fd, vector<char>& buffer) {
+    size_t capacity = 4096;
+    size_t length = 0;
+    for (int piece = 0; ; ) {
+        char key[64];
+        if (piece == 0) {
+            snprintf(key, sizeof(key), "%s", MetadataXattr::METADATA_KEY);
+        } else {
+            snprintf(key, sizeof(key), "%s%d", MetadataXattr::METADATA_KEY,
+                     piece);
+        }
+        if (capacity > buffer.size()) {
+            buffer.resize(capacity);
+        }
+        const ssize_t got = ::fgetxattr(fd, key, &buffer[length],
+                                        capacity - length);
+        if (got < 0) {
+            if (errno == ERANGE || length == capacity) {
+                capacity *= 2;
+                continue;
+            }
+            break;
+        }
+        length += got;
+        ++piece;
+    }
+    return length;
+}
+
+static bool same(const Metadata& a, const Metadata& b) {
+    map<string, string> a_map;
+    map<string, string> b_map;
+    a.to_map(a_map);
+    b.to_map(b_map);
+    return a_map == b_map;
+}
+
+
+int main() {
+    const string dir = getenv("DIR") ? getenv("DIR") : "/tmp";
+    const long file_count = env_long("FILES", 2000);
+    const string user_metas = getenv("USER_META") ?
+        getenv("USER_META") : "0,4,16,64";
+    const long passes = env_long("PASSES", 5);
+
+    char root[4096];
+    snprintf(root, sizeof(root), "%s/MetadataXattrBench.XXXXXX",
+             dir.c_str());
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    int failures = 0;
+
+    printf("MetadataXattrBench: %ld files per size in %s, best of %ld "
+           "passes (cpu time, us per object)\n", file_count, dir.c_str(),
+           passes);
+    printf("  %-9s %7s %6s %10s %10s %10s\n", "user meta", "pickle",
+           "pieces", "fgetxattr", "loads", "both");
+    for (size_t pos = 0; pos < user_metas.length(); ) {
+        const int user_meta = atoi(user_metas.c_str() + pos);
+        const size_t comma = user_metas.find(',', pos);
+        pos = comma == string::npos ? user_metas.length() : comma + 1;
+
+        vector<int> fds;
+        vector<string> paths;
+        vector<string> pickles(file_count);
+        vector<Metadata> expected(file_count);
+        for (long i = 0; i < file_count; ++i) {
+            char path[4200];
+            snprintf(path, sizeof(path), "%s/%d-%ld.data", root, user_meta,
+                     i);
+            const int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+            if (fd < 0) {
+                perror("open");
+                return 1;
+            }
+            fds.push_back(fd);
+            paths.push_back(path);
+            make_metadata(i, user_meta, expected[i]);
+            MetadataPickle::dumps(expected[i], pickles[i]);
+            try {
+                MetadataXattr::write(fd, expected[i]);
+            } catch (const BaseException&) {
+                fprintf(stderr, "MetadataXattrBench: can't set %d user "
+                        "meta keys in %s\n", user_meta, dir.c_str());
+                return 1;
+            }
+        }
+
+        double best[3] = {1e9, 1e9, 1e9};
+        vector<char> buffer;
+        Metadata metadata;
+        for (long pass = 0; pass < passes; ++pass) {
+            double start = cpu_seconds();
+            for (long i = 0; i < file_count; ++i) {
+                getxattr_only(fds[i], buffer);
+            }
+            double elapsed = cpu_seconds() - start;
+            best[0] = elapsed < best[0] ? elapsed : best[0];
+
+            start = cpu_seconds();
+            for (long i = 0; i < file_count; ++i) {
+                metadata.clear();
+                MetadataPickle::loads(pickles[i].data(), pickles[i].length(),
+                                      metadata);
+            }
+            elapsed = cpu_seconds() - start;
+            best[1] = elapsed < best[1] ? elapsed : best[1];
+
+            start = cpu_seconds();
+            for (long i = 0; i < file_count; ++i) {
+                metadata.clear();
+                MetadataXattr::read(fds[i], metadata);
+            }
+            elapsed = cpu_seconds() - start;
+            best[2] = elapsed < best[2] ? elapsed : best[2];
+        }
+
+        // every file reads back as written, whichever way
+        for (long i = 0; i < file_count; ++i) {
+            metadata.clear();
+            MetadataXattr::read(fds[i], metadata);
+            const size_t length = getxattr_only(fds[i], buffer);
+            if (!same(metadata, expected[i]) ||
+                length != pickles[i].length() ||
+                memcmp(&buffer[0], pickles[i].data(), length) != 0) {
+                ++failures;
+            }
+        }
+
+        const size_t pickle_length = pickles.empty() ? 0 :
+                                     pickles[0].length();
+        char label[16];
+        snprintf(label, sizeof(label), "%d", user_meta);
+        printf("  %-9s %7lu %6lu %10.2f %10.2f %10.2f\n", label,
+               (unsigned long) pickle_length,
+               (unsigned long) ((pickle_length + MetadataXattr::CHUNK_SIZE -
+                                 1) / MetadataXattr::CHUNK_SIZE),
+               best[0] / file_count * 1e6, best[1] / file_count * 1e6,
+               best[2] / file_count * 1e6);
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            ::close(fds[i]);
+            ::unlink(paths[i].c_str());
+        }
+    }
+    ::rmdir(root);
+
+    if (failures > 0) {
+        fprintf(stderr, "MetadataXattrBench: %d objects read back wrong\n",
+                failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "BenchRing.h"
+#include "RingCache.h"
+#include "RingData.h"
+
+using namespace std;
+
+
+/*
+ * Cold load time and resident memory of a large ring. Every load is
+ * done in a forked child, with the ring file dropped from the page
+ * cache first, so each one starts from the same empty process. Timed:
+ *
+ *   inflate only   gzread of the whole file into a scratch buffer,
+ *                  the floor for any loader of a .ring.gz
+ *   RingData       RingData::load
+ *   devices only   RingData::load with metadata_only
+ *   ring cache     RingCache::load of a cache built beforehand
+ *
+ *   PART_POWERS  comma separated (default 18,20,22)
+ *   REPLICAS     (default 3)
+ *   DEVICES      devices in the ring (default 1024)
+ */
+
+
+static double wall_seconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static long env_long(const char* name, long default_value) {
+    const char* value = getenv(name);
+    return value != NULL ? atol(value) : default_value;
+}
+
+// resident KB of this process
+static long resident_kb() {
+    long size = 0;
+    long resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%ld %ld", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void drop_cache(const string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd > -1) {
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+enum Loader {
+    INFLATE_ONLY,
+    RING_DATA,
+    DEVICES_ONLY,
+    RING_CACHE
+};
+
+// runs in the child; the table is read through once after the load so
+// that a mapped one counts as resident too
+static void load(int loader, const string& path, double& seconds,
+                 long& resident, long& checksum) {
+    const long resident_before = resident_kb();
+    const double start = wall_seconds();
+    RingData ring_data;
+    vector<char> scratch;
+    if (loader == INFLATE_ONLY) {
+        gzFile file = gzopen(path.c_str(), "rb");
+        scratch.resize(1 << 20);
+        gzbuffer(file, 1 << 20);
+        while (gzread(file, &scratch[0], scratch.size()) > 0) {
+        }
+        gzclose(file);
+    } else if (loader == RING_CACHE) {
+        if (!RingCache::load(path, ring_data)) {
+            fprintf(stderr, "RingLoadBench: no ring cache\n");
+            exit(1);
+        }
+    } else {
+        ring_data.load(path, loader == DEVICES_ONLY);
+    }
+    seconds = wall_seconds() - start;
+
+    checksum = 0;
+    for (int replica = 0; replica < ring_data.replica_count(); ++replica) {
+        const uint16_t* part2dev_id = ring_data.part2dev_id(replica);
+        for (uint32_t part = 0; part < ring_data.replica_length(replica);
+             ++part) {
+            checksum += part2dev_id[part];
+        }
+    }
+    resident = resident_kb() - resident_before;
+}
+
+static bool run(int loader, const string& path, double& seconds,
+                long& resident, long& checksum) {
+    drop_cache(path);
+    drop_cache(RingCache::cache_path(path));
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+        ::close(fds[0]);
+        double values[3];
+        long child_resident;
+        long child_checksum;
+        load(loader, path, values[0], child_resident, child_checksum);
+        values[1] = child_resident;
+        values[2] = child_checksum;
+        const bool ok = ::write(fds[1], values, sizeof(values)) ==
+                        (ssize_t) sizeof(values);
+        _exit(ok ? 0 : 1);
+    }
+    ::close(fds[1]);
+    double values[3];
+    const bool ok = ::read(fds[0], values, sizeof(values)) ==
+                    (ssize_t) sizeof(values);
+    ::close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    seconds = values[0];
+    resident = (long) values[1];
+    checksum = (long) values[2];
+    return ok;
+}
+
+
+int main() {
+    const string part_powers = getenv("PART_POWERS") ?
+        getenv("PART_POWERS") : "18,20,22";
+    const int replicas = (int) env_long("REPLICAS", 3);
+    const int devices = (int) env_long("DEVICES", 1024);
+    static const char* LOADER_NAMES[] = {
+        "inflate only", "RingData", "devices only", "ring cache"
+    };
+
+    char root[] = "/tmp/RingLoadBench.XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    const string path = string(root) + "/object.ring.gz";
+    int failures = 0;
+
+    printf("RingLoadBench: %d replicas, %d devices (wall time, cold "
+           "cache, forked child per load)\n", replicas, devices);
+    for (size_t pos = 0; pos < part_powers.length(); ) {
+        const int part_power = atoi(part_powers.c_str() + pos);
+        const size_t comma = part_powers.find(',', pos);
+        pos = comma == string::npos ? part_powers.length() : comma + 1;
+
+        // 16 devices a host, 8 hosts a zone, the rest in zones of one
+        // region
+        if (!BenchRing::write(path, part_power, replicas, 1,
+                              devices / 128 > 0 ? devices / 128 : 1,
+                              8, 16)) {
+            perror("write ring");
+            return 1;
+        }
+        {
+            RingData ring_data;
+            ring_data.load(path);
+            RingCache::save(path, ring_data);
+        }
+
+        printf("  2^%d partitions, %.1f MB table:\n", part_power,
+               (double) replicas * (1 << part_power) * 2 / (1024 * 1024));
+        long expected = -1;
+        for (int loader = INFLATE_ONLY; loader <= RING_CACHE; ++loader) {
+            double seconds;
+            long resident;
+            long checksum;
+            if (!run(loader, path, seconds, resident, checksum)) {
+                ++failures;
+                continue;
+            }
+            if (loader == RING_DATA) {
+                expected = checksum;
+            } else if (loader == RING_CACHE && checksum != expected) {
+                ++failures;
+            }
+            printf("    %-14s %8.1f ms %8ld KB resident\n",
+                   LOADER_NAMES[loader], seconds * 1000, resident);
+        }
+        ::unlink(RingCache::cache_path(path).c_str());
+        ::unlink(path.c_str());
+    }
+    ::rmdir(root);
+
+    if (failures > 0) {
+        fprintf(stderr, "RingLoadBench: %d loads failed or differ\n",
+                failures);
+        return 1;
+    }
+    return 0;
+}
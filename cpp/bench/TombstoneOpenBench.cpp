@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "DirReader.h"
+#include "DiskFileRules.h"
+#include "DiskFileStatus.h"
+#include "Exceptions.h"
+#include "Metadata.h"
+#include "MetadataXattr.h"
+#include "OndiskFiles.h"
+
+using namespace std;
+
+
+/*
+ * Opens every hash dir of a tombstone-heavy tree the way DiskFile::open
+ * does (list the hash dir, classify it, read the metadata of the file
+ * that counts) and reports a deleted object either by throwing
+ * DiskFileDeleted, as open() did before, or by returning a
+ * DiskFileStatus, as try_open() does now. DiskFile itself doesn't build
+ * outside the daemon, so the steps are repeated here with the same
+ * classes.
+ *
+ *   COUNT       hash dirs (default 20000)
+ *   TOMBSTONES  percent of them holding only a .ts (default 90)
+ *   PASSES      timed passes of each kind (default 5)
+ */
+
+
+static double cpu_seconds() {
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static long env_long(const char* name, long default_value) {
+    const char* value = getenv(name);
+    return value != NULL ? atol(value) : default_value;
+}
+
+
+class HashDir {
+public:
+    string path;
+    vector<string> names;
+};
+
+
+static void make_tree(const char* root,
+                      long count,
+                      long tombstone_percent,
+                      vector<HashDir>& dirs) {
+    dirs.resize(count);
+    for (long i = 0; i < count; ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s/%08lx", root, i);
+        mkdir(name, 0755);
+        dirs[i].path = name;
+
+        const bool tombstone = (i * 7919) % 100 < tombstone_percent;
+        char timestamp[32];
+        snprintf(timestamp, sizeof(timestamp), "%ld.%05ld",
+                 1400000000L + i, i % 100000);
+        const string filename = string(timestamp) +
+                                (tombstone ? ".ts" : ".data");
+        const string path = dirs[i].path + "/" + filename;
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        Metadata metadata;
+        metadata.set(Metadata::X_TIMESTAMP, timestamp);
+        metadata.set("name", string("/a/c/o") + timestamp);
+        if (!tombstone) {
+            metadata.set("Content-Length", "0");
+            metadata.set("ETag", "d41d8cd98f00b204e9800998ecf8427e");
+        }
+        MetadataXattr::write(fd, metadata);
+        ::close(fd);
+    }
+}
+
+static void remove_tree(const char* root, vector<HashDir>& dirs) {
+    const vector<HashDir>::const_iterator itEnd = dirs.end();
+    vector<HashDir>::const_iterator it = dirs.begin();
+    DirReader reader(4096);
+    for (; it != itEnd; ++it) {
+        if (reader.open(it->path)) {
+            const char* name;
+            while ((name = reader.next()) != NULL) {
+                ::unlinkat(reader.fd(), name, 0);
+            }
+            reader.close();
+        }
+        ::rmdir(it->path.c_str());
+    }
+    ::rmdir(root);
+}
+
+
+// list the hash dir, or use the listing already made when from_disk is
+// false, then classify it and read the metadata of what counts
+static const FileInfo* open_hash_dir(HashDir& dir,
+                                     bool from_disk,
+                                     DirReader& reader,
+                                     OndiskFiles& results,
+                                     Metadata& metadata) {
+    if (from_disk) {
+        dir.names.clear();
+        if (reader.open(dir.path)) {
+            const char* name;
+            while ((name = reader.next()) != NULL) {
+                dir.names.push_back(name);
+            }
+            reader.close();
+        }
+    }
+    results.classify_as<ReplicationRules>(dir.names);
+
+    const FileInfo* info = results.data_file();
+    if (info == NULL) {
+        info = results.ts_file();
+    }
+    metadata.clear();
+    if (info != NULL) {
+        if (from_disk) {
+            MetadataXattr::read(dir.path + "/" + results.name(*info),
+                                metadata);
+        } else {
+            metadata.set(Metadata::X_TIMESTAMP,
+                         info->timestamp.internal());
+        }
+    }
+    return info;
+}
+
+// the frames open() threw through before
+static void __attribute__((noinline))
+open_throwing(HashDir& dir, bool from_disk, DirReader& reader,
+              OndiskFiles& results, Metadata& metadata) {
+    const FileInfo* info = open_hash_dir(dir, from_disk, reader, results,
+                                         metadata);
+    if (info == NULL) {
+        throw DiskFileNotExist();
+    }
+    if (info->ext == FileInfo::TS) {
+        DiskFileDeleted deleted;
+        deleted._msg = metadata.get(Metadata::X_TIMESTAMP);
+        throw deleted;
+    }
+}
+
+static DiskFileStatus __attribute__((noinline))
+open_status(HashDir& dir, bool from_disk, DirReader& reader,
+            OndiskFiles& results, Metadata& metadata) {
+    const FileInfo* info = open_hash_dir(dir, from_disk, reader, results,
+                                         metadata);
+    if (info == NULL) {
+        return DiskFileStatus(DiskFileStatus::NOT_EXIST);
+    }
+    if (info->ext == FileInfo::TS) {
+        DiskFileStatus status(DiskFileStatus::DELETED);
+        status.timestamp = metadata.get(Metadata::X_TIMESTAMP);
+        return status;
+    }
+    return DiskFileStatus();
+}
+
+// one pass over the tree as the auditor makes it; returns objects gone
+static long audit_pass(vector<HashDir>& dirs,
+                       bool throwing,
+                       bool from_disk) {
+    DirReader reader(4096);
+    OndiskFiles results;
+    Metadata metadata;
+    long gone = 0;
+    const vector<HashDir>::iterator itEnd = dirs.end();
+    vector<HashDir>::iterator it = dirs.begin();
+    for (; it != itEnd; ++it) {
+        if (throwing) {
+            try {
+                open_throwing(*it, from_disk, reader, results, metadata);
+            } catch (const DiskFileDeleted&) {
+                ++gone;
+            } catch (const DiskFileNotExist&) {
+                ++gone;
+            }
+        } else if (open_status(*it, from_disk, reader, results,
+                               metadata).not_found()) {
+            ++gone;
+        }
+    }
+    return gone;
+}
+
+static void compare(vector<HashDir>& dirs, long passes, bool from_disk) {
+    // warm the caches, and check both ways agree
+    const long gone = audit_pass(dirs, true, from_disk);
+    if (audit_pass(dirs, false, from_disk) != gone) {
+        fprintf(stderr, "TombstoneOpenBench: results differ\n");
+        exit(1);
+    }
+
+    double elapsed[2] = {0.0, 0.0};
+    for (long pass = 0; pass < passes; ++pass) {
+        // interleaved, so drift hits both the same
+        for (int throwing = 1; throwing >= 0; --throwing) {
+            const double start = cpu_seconds();
+            audit_pass(dirs, throwing == 1, from_disk);
+            elapsed[throwing] += cpu_seconds() - start;
+        }
+    }
+
+    const double objects = (double) dirs.size() * passes;
+    printf("  %-26s throw %6.2f us/object, status %6.2f us/object, "
+           "%.2fx\n",
+           from_disk ? "list + xattr read:" : "classify (names cached):",
+           elapsed[1] / objects * 1e6, elapsed[0] / objects * 1e6,
+           elapsed[1] / elapsed[0]);
+}
+
+
+int main() {
+    const long count = env_long("COUNT", 20000);
+    const long tombstones = env_long("TOMBSTONES", 90);
+    const long passes = env_long("PASSES", 5);
+
+    char root[] = "/tmp/TombstoneOpenBench.XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    vector<HashDir> dirs;
+    make_tree(root, count, tombstones, dirs);
+
+    printf("TombstoneOpenBench: %ld hash dirs, %ld%% tombstones, "
+           "%ld passes (cpu time)\n", count, tombstones, passes);
+    compare(dirs, passes, true);
+    compare(dirs, passes, false);
+
+    remove_tree(root, dirs);
+    return 0;
+}
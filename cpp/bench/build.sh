@@ -0,0 +1,36 @@
+#!/bin/sh
+# Benchmarks, built apart from ../build.sh and ../tests. Run from
+# cpp/bench; each prints its own numbers and takes its sizes from the
+# environment (see the comment at the top of each).
+set -e
+g++ -O2 -Wall -iquote .. -o TombstoneOpenBench TombstoneOpenBench.cpp \
+    ../DirReader.cpp ../OndiskFiles.cpp ../Timestamp.cpp ../MD5Hash.cpp \
+    ../Metadata.cpp ../MetadataPickle.cpp ../MetadataXattr.cpp
+./TombstoneOpenBench
+rm -f TombstoneOpenBench
+g++ -O2 -Wall -iquote .. -o MetadataXattrBench MetadataXattrBench.cpp \
+    ../Metadata.cpp ../MetadataPickle.cpp ../MetadataXattr.cpp
+./MetadataXattrBench
+rm -f MetadataXattrBench
+g++ -O2 -Wall -iquote .. -o MD5Bench MD5Bench.cpp \
+    ../MD5Hash.cpp ../MD5MultiBuffer.cpp
+./MD5Bench
+rm -f MD5Bench
+g++ -O2 -Wall -iquote .. -o AsyncReadBench AsyncReadBench.cpp \
+    ../AsyncReadQueue.cpp ../IoUring.cpp ../BufferPool.cpp ../MD5Hash.cpp
+./AsyncReadBench
+rm -f AsyncReadBench
+g++ -O2 -Wall -iquote .. -o RingLoadBench RingLoadBench.cpp \
+    ../RingData.cpp ../RingCache.cpp ../JsonReader.cpp ../StrUtils.cpp -lz
+./RingLoadBench
+rm -f RingLoadBench
+g++ -O2 -Wall -iquote .. -o HandoffBench HandoffBench.cpp \
+    ../HandoffIterator.cpp ../RingSnapshot.cpp ../RingTiers.cpp \
+    ../RingPartitionIndex.cpp ../RingCache.cpp ../RingData.cpp \
+    ../JsonReader.cpp ../StrUtils.cpp ../MD5Hash.cpp -lz
+./HandoffBench
+rm -f HandoffBench
+g++ -O2 -Wall -iquote .. -o ClassifyBench ClassifyBench.cpp \
+    ../OndiskFiles.cpp ../Timestamp.cpp ../MD5Hash.cpp
+./ClassifyBench
+rm -f ClassifyBench
@@ -1,8 +1,39 @@
 #!/bin/sh
+g++ -c AdaptiveThrottle.cpp
+g++ -c AsyncReadQueue.cpp
+g++ -c AuditCheckpoint.cpp
+g++ -c AuditIndex.cpp
+g++ -c AuditPartitionClassifier.cpp
+g++ -c AuditPipeline.cpp
+g++ -c AuditProcessPool.cpp
+g++ -c AuditRangeCheckpoint.cpp
+g++ -c AuditWorkQueue.cpp
+g++ -c BufferPool.cpp
 g++ -c Daemon.cpp
+g++ -c DirReader.cpp
+g++ -c DiskFileRouter.cpp
+g++ -c DiskFileWriter.cpp
+g++ -c HandoffIterator.cpp
+g++ -c HashPathEngine.cpp
+g++ -c IoUring.cpp
+g++ -c JsonReader.cpp
 g++ -c MD5Hash.cpp
+g++ -c MD5MultiBuffer.cpp
+g++ -c Metadata.cpp
+g++ -c MetadataPickle.cpp
+g++ -c MetadataXattr.cpp
 g++ -c OSUtils.cpp
+g++ -c OndiskFiles.cpp
+g++ -c Ring.cpp
+g++ -c RingCache.cpp
+g++ -c RingData.cpp
+g++ -c RingPartitionIndex.cpp
+g++ -c RingReloader.cpp
+g++ -c RingSnapshot.cpp
+g++ -c RingTiers.cpp
+g++ -c SharedRateLimiter.cpp
 g++ -c StoragePolicyCollection.cpp
 g++ -c StoragePolicy.cpp
 g++ -c StrUtils.cpp
 g++ -c SwiftUtils.cpp
+g++ -c Timestamp.cpp
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <string>
+
+#include "AdaptiveThrottle.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+static const double INTERVAL = 10.0;
+
+// a /proc/pressure/io and a /sys/block with one disk, sda
+class FakeKernel {
+public:
+    string dir;
+    string pressure_path;
+    string block_dir;
+    string stat_path;
+
+    FakeKernel() {
+        char root[] = "/tmp/AdaptiveThrottleTest.XXXXXX";
+        CHECK(mkdtemp(root) != NULL);
+        dir = root;
+        pressure_path = dir + "/io";
+        block_dir = dir + "/block";
+        stat_path = block_dir + "/sda/stat";
+        mkdir(block_dir.c_str(), 0755);
+        mkdir((block_dir + "/sda").c_str(), 0755);
+        set(0.0, 0);
+    }
+
+    ~FakeKernel() {
+        unlink(stat_path.c_str());
+        rmdir((block_dir + "/sda").c_str());
+        rmdir(block_dir.c_str());
+        unlink(pressure_path.c_str());
+        rmdir(dir.c_str());
+    }
+
+    // io_ticks is the 10th field of the stat file
+    void set(double avg10, unsigned long io_ticks) {
+        FILE* f = fopen(pressure_path.c_str(), "w");
+        fprintf(f, "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\n"
+                "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", avg10);
+        fclose(f);
+        f = fopen(stat_path.c_str(), "w");
+        fprintf(f, "100 0 800 50 20 0 160 30 0 %lu 80\n", io_ticks);
+        fclose(f);
+    }
+};
+
+static AdaptiveThrottle* make_throttle(const FakeKernel& kernel) {
+    // 10% pressure, 80% busy, 50 ms a chunk
+    return new AdaptiveThrottle(kernel.pressure_path, kernel.block_dir,
+                                10.0, 0.8, 0.05, INTERVAL);
+}
+
+static bool near(double a, double b) {
+    return a - b < 1e-9 && b - a < 1e-9;
+}
+
+
+static void test_first_update() {
+    FakeKernel kernel;
+    AdaptiveThrottle* throttle = make_throttle(kernel);
+    // utilisation needs two samples
+    CHECK(!throttle->update(100.0));
+    CHECK(near(throttle->level(), 0.5));
+    // nor is the interval up yet
+    CHECK(!throttle->update(105.0));
+    CHECK(throttle->update(100.0 + INTERVAL));
+    delete throttle;
+}
+
+static void test_back_off() {
+    FakeKernel kernel;
+    AdaptiveThrottle* throttle = make_throttle(kernel);
+    double now = 100.0;
+    throttle->update(now);
+
+    // io pressure over its target
+    kernel.set(20.0, 0);
+    now += INTERVAL;
+    CHECK(throttle->update(now));
+    CHECK(near(throttle->pressure(), 20.0));
+    CHECK(near(throttle->level(), 0.25));
+
+    // the disk busy 9 of the last 10 seconds
+    kernel.set(0.0, 9000);
+    now += INTERVAL;
+    CHECK(throttle->update(now));
+    CHECK(near(throttle->util(), 0.9));
+    CHECK(near(throttle->level(), 0.125));
+
+    // chunk reads slower than their target
+    kernel.set(0.0, 9000);
+    throttle->record_latency(0.2);
+    now += INTERVAL;
+    CHECK(throttle->update(now));
+    CHECK(near(throttle->util(), 0.0));
+    CHECK(near(throttle->level(), 0.0625));
+    delete throttle;
+}
+
+static void test_ramp_up() {
+    FakeKernel kernel;
+    AdaptiveThrottle* throttle = make_throttle(kernel);
+    double now = 100.0;
+    throttle->update(now);
+
+    // between idle and the target: held where it is
+    kernel.set(7.0, 0);
+    now += INTERVAL;
+    CHECK(throttle->update(now));
+    CHECK(near(throttle->level(), 0.5));
+    CHECK(near(throttle->rate(10.0, 110.0), 60.0));
+
+    // idle: a step an interval, up to 1
+    const double expected[] = {0.6, 0.7, 0.8, 0.9, 1.0, 1.0};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        now += INTERVAL;
+        kernel.set(1.0, 1000 * (i + 2));
+        CHECK(throttle->update(now));
+        CHECK(near(throttle->level(), expected[i]));
+    }
+    CHECK(near(throttle->rate(10.0, 110.0), 110.0));
+    delete throttle;
+}
+
+struct UpdateArgs {
+    AdaptiveThrottle* throttle;
+    double now;
+    int updated;
+};
+
+static void* update_thread(void* arg) {
+    UpdateArgs* args = (UpdateArgs*) arg;
+    for (int i = 0; i < 1000; ++i) {
+        args->throttle->record_latency(0.001);
+        if (args->throttle->update(args->now)) {
+            ++args->updated;
+        }
+    }
+    return NULL;
+}
+
+static void test_shared() {
+    FakeKernel kernel;
+    AdaptiveThrottle* throttle = make_throttle(kernel);
+    throttle->update(100.0);
+
+    // every worker of a process shares it; one of them re-evaluates
+    const int THREADS = 4;
+    pthread_t threads[THREADS];
+    UpdateArgs args[THREADS];
+    for (int t = 0; t < THREADS; ++t) {
+        args[t].throttle = throttle;
+        args[t].now = 100.0 + INTERVAL;
+        args[t].updated = 0;
+        pthread_create(&threads[t], NULL, update_thread, &args[t]);
+    }
+    int updated = 0;
+    for (int t = 0; t < THREADS; ++t) {
+        pthread_join(threads[t], NULL);
+        updated += args[t].updated;
+    }
+    CHECK(updated == 1);
+    CHECK(near(throttle->latency(), 0.001));
+    CHECK(near(throttle->level(), 0.6));
+    delete throttle;
+}
+
+
+int main() {
+    test_first_update();
+    test_back_off();
+    test_ramp_up();
+    test_shared();
+
+    if (failures > 0) {
+        fprintf(stderr, "AdaptiveThrottleTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("AdaptiveThrottleTest: ok\n");
+    return 0;
+}
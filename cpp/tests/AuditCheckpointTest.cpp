@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <string>
+
+#include "AuditCheckpoint.h"
+#include "Time.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+double Time::time() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+static void test_save_and_load() {
+    char dir[] = "/tmp/AuditCheckpointTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+    AuditCheckpoint checkpoint(dir_fd, "ALL");
+    CHECK(checkpoint.update(17, 0xabc, 1));
+
+    AuditCheckpoint resumed(dir_fd, "ALL");
+    CHECK(resumed.load());
+    CHECK(resumed.partition_done(16));
+    CHECK(!resumed.partition_done(17));
+    CHECK(resumed.suffix_done(17, 0xabc));
+    CHECK(!resumed.suffix_done(17, 0xabd));
+
+    CHECK(resumed.clear());
+    CHECK(!resumed.load());
+    close(dir_fd);
+    rmdir(dir);
+}
+
+// a directory the checkpoint can't be written to doesn't stop the sweep
+static void test_failed_save() {
+    int dir_fd = open("/proc/self", O_RDONLY | O_DIRECTORY);
+    CHECK(dir_fd > -1);
+
+    AuditCheckpoint checkpoint(dir_fd, "ALL");
+    CHECK(!checkpoint.update(17, 0xabc, 1));
+    CHECK(checkpoint.partition() == 17);
+    // not retried until the interval has passed again
+    CHECK(checkpoint.update(17, 0xabd, 3600));
+    CHECK(checkpoint.suffix() == 0xabd);
+    CHECK(!checkpoint.save());
+    close(dir_fd);
+}
+
+
+int main() {
+    test_save_and_load();
+    test_failed_save();
+
+    if (failures > 0) {
+        fprintf(stderr, "AuditCheckpointTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("AuditCheckpointTest: ok\n");
+    return 0;
+}
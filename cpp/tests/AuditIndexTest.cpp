@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <string>
+
+#include "AuditIndex.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+static void make_hash(long n, unsigned char* hash) {
+    // spread the keys so inserts don't arrive in order
+    unsigned long x = (unsigned long) n * 2654435761UL;
+    memset(hash, 0, 16);
+    memcpy(hash, &x, sizeof(x));
+    memcpy(hash + 8, &n, sizeof(n));
+}
+
+static double cpu_seconds() {
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+
+static void test_round_trip() {
+    char dir[] = "/tmp/AuditIndexTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    // COUNT=2000000 times a bigger sweep
+    const long count = getenv("COUNT") ? atol(getenv("COUNT")) : 200000;
+    unsigned char hash[16];
+
+    {
+        AuditIndex index(dir);
+        index.load();
+        const double start = cpu_seconds();
+        for (long i = 0; i < count; ++i) {
+            make_hash(i, hash);
+            index.update(hash, i, i, i, 1);
+        }
+        // the end of the sweep
+        index.save();
+        // every key again, as the next sweep would
+        for (long i = 0; i < count; ++i) {
+            make_hash(i, hash);
+            index.update(hash, i, i, i, 2);
+        }
+        const double elapsed = cpu_seconds() - start;
+        printf("AuditIndexTest: %ld entries, two sweeps in %.3f s\n",
+               count, elapsed);
+        CHECK(count > 200000 || elapsed < 2.0);
+        CHECK(index.size() == (size_t) count);
+        index.save();
+    }
+
+    AuditIndex index(dir);
+    index.load();
+    CHECK(index.size() == (size_t) count);
+    for (long i = 0; i < count; i += 997) {
+        make_hash(i, hash);
+        const AuditIndexEntry* entry = index.find(hash);
+        CHECK(entry != NULL && entry->inode == (uint64_t) i &&
+              entry->last_verified == 2);
+    }
+    make_hash(count, hash);
+    CHECK(index.find(hash) == NULL);
+
+    unlink(index.path().c_str());
+    rmdir(dir);
+}
+
+// a header whose count doesn't match the file is dropped before anything
+// is allocated for it
+static void test_corrupt_count() {
+    char dir[] = "/tmp/AuditIndexTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    unsigned char hash[16];
+
+    {
+        AuditIndex index(dir);
+        make_hash(1, hash);
+        index.update(hash, 1, 1, 1, 1);
+        index.save();
+    }
+
+    const string path = string(dir) + "/" + AuditIndex::INDEX_FILENAME;
+    int fd = open(path.c_str(), O_WRONLY);
+    const uint64_t count = 0x0fffffffffffffffULL;
+    CHECK(pwrite(fd, &count, sizeof(count), 8) == sizeof(count));
+    close(fd);
+
+    AuditIndex index(dir);
+    index.load();
+    CHECK(index.size() == 0);
+
+    unlink(path.c_str());
+    rmdir(dir);
+}
+
+// two workers indexing the same datadir, each saving what it verified,
+// end up with both sets of entries; the later verification of a hash
+// both have wins
+static void test_shared_datadir() {
+    char dir[] = "/tmp/AuditIndexTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    unsigned char hash[16];
+
+    AuditIndex first(dir);
+    AuditIndex second(dir);
+    first.load();
+    second.load();
+    for (long i = 0; i < 100; ++i) {
+        make_hash(i, hash);
+        first.update(hash, i, i, i, 10);
+        make_hash(i + 100, hash);
+        second.update(hash, i, i, i, 10);
+    }
+    make_hash(500, hash);
+    first.update(hash, 1, 1, 1, 20);
+    second.update(hash, 2, 2, 2, 30);
+    second.save();
+    first.save();
+
+    AuditIndex index(dir);
+    index.load();
+    CHECK(index.size() == 201);
+    make_hash(500, hash);
+    const AuditIndexEntry* entry = index.find(hash);
+    CHECK(entry != NULL && entry->inode == 2 && entry->last_verified == 30);
+
+    // what a worker pruned isn't brought back from the other's save
+    first.update(hash, 1, 1, 1, 40);
+    first.prune(15);
+    first.save();
+    index.load();
+    CHECK(index.size() == 1);
+
+    unlink(index.path().c_str());
+    rmdir(dir);
+}
+
+// pool processes saving the same datadir's index at once, as the
+// prefork auditor's do, lose none of each other's entries
+static void test_concurrent_processes() {
+    char dir[] = "/tmp/AuditIndexTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    const int PROCESSES = 4;
+    const long PER_SAVE = 50;
+    const int SAVES = 20;
+
+    for (int p = 0; p < PROCESSES; ++p) {
+        if (fork() == 0) {
+            AuditIndex index(dir);
+            index.load();
+            unsigned char hash[16];
+            for (int save = 0; save < SAVES; ++save) {
+                for (long i = 0; i < PER_SAVE; ++i) {
+                    make_hash((p * SAVES + save) * PER_SAVE + i, hash);
+                    index.update(hash, p, i, i, 1);
+                }
+                index.save();
+            }
+            _exit(0);
+        }
+    }
+    for (int p = 0; p < PROCESSES; ++p) {
+        int status;
+        CHECK(wait(&status) > 0 && WIFEXITED(status) &&
+              WEXITSTATUS(status) == 0);
+    }
+
+    AuditIndex index(dir);
+    index.load();
+    CHECK(index.size() == (size_t) (PROCESSES * SAVES * PER_SAVE));
+
+    unlink(index.path().c_str());
+    rmdir(dir);
+}
+
+
+int main() {
+    test_round_trip();
+    test_corrupt_count();
+    test_shared_datadir();
+    test_concurrent_processes();
+
+    if (failures > 0) {
+        fprintf(stderr, "AuditIndexTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("AuditIndexTest: ok\n");
+    return 0;
+}
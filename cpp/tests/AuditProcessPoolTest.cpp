@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "AuditAssignmentHook.h"
+#include "AuditProcessPool.h"
+#include "Time.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+double Time::time() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+class CountingHook : public AuditAssignmentHook {
+
+public:
+    void runAssignment(const AuditAssignment& assignment,
+                       AuditResult& result) {
+        result.files_processed = assignment.partition_count;
+        result.status = AuditResult::COMPLETED;
+    }
+};
+
+
+// the end of a pass doesn't wait for a ZBF delay to run out
+static void test_cancel_delay() {
+    CountingHook hook;
+    AuditProcessPool pool(&hook);
+    pool.start(1);
+
+    AuditAssignment assignment;
+    memset(&assignment, 0, sizeof(assignment));
+    assignment.delay = 60;
+    pool.assign(0, assignment);
+
+    const double start = Time::time();
+    pool.cancel_delay(0);
+    AuditResult result;
+    CHECK(pool.wait_result(result) == 0);
+    CHECK(result.status == AuditResult::CANCELLED);
+    CHECK(Time::time() - start < 5);
+
+    // a cancel that arrives after the delay is ignored
+    memset(&assignment, 0, sizeof(assignment));
+    assignment.partition_count = 3;
+    pool.assign(0, assignment);
+    CHECK(pool.wait_result(result) == 0);
+    CHECK(result.status == AuditResult::COMPLETED);
+    pool.assign(0, assignment);
+    pool.cancel_delay(0);
+    CHECK(pool.wait_result(result) == 0);
+    CHECK(result.status == AuditResult::COMPLETED);
+    CHECK(result.files_processed == 3);
+
+    pool.assign(0, assignment);
+    CHECK(pool.wait_result(result) == 0);
+    CHECK(result.status == AuditResult::COMPLETED);
+}
+
+
+int main() {
+    test_cancel_delay();
+
+    if (failures > 0) {
+        fprintf(stderr, "AuditProcessPoolTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("AuditProcessPoolTest: ok\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "AuditRangeCheckpoint.h"
+#include "AuditWorkQueue.h"
+#include "Time.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+double Time::time() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+static void make_dirs(const string& devices) {
+    const char* dirs[] = {
+        "/sda", "/sda/objects", "/sda/objects-1",
+        "/sda/objects/1", "/sda/objects/5", "/sda/objects/9",
+        "/sda/objects/12", "/sda/objects-1/5", "/sda/objects-1/20",
+        NULL
+    };
+    for (int i = 0; dirs[i] != NULL; ++i) {
+        mkdir((devices + dirs[i]).c_str(), 0755);
+    }
+}
+
+static bool exists(const string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// ranges know their partitions, and a restarted pass only gets the ones
+// between the two cursors
+static void test_resume() {
+    char dir[] = "/tmp/AuditWorkQueueTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    const string devices(dir);
+    make_dirs(devices);
+    const string checkpoint_path =
+        devices + "/sda/" + AuditRangeCheckpoint::checkpoint_filename("ALL");
+
+    {
+        AuditWorkQueue queue(1, 1);
+        CHECK(queue.add_device(devices, "sda", 2) == 3);
+
+        int home = 0;
+        AuditWorkRange first;
+        CHECK(queue.next(home, first));
+        CHECK(first.partitions.size() == 2);
+        CHECK(first.partitions[0] == 1 && first.partitions[1] == 5);
+        CHECK(queue.done(first));
+
+        // another device's thread steals the last range
+        int thief = -1;
+        AuditWorkRange last;
+        CHECK(queue.next(thief, last));
+        CHECK(last.partitions.size() == 1 && last.partitions[0] == 20);
+        // saves are at most once per interval
+        sleep(1);
+        CHECK(queue.done(last));
+        CHECK(exists(checkpoint_path));
+        // the middle range is never done: the process is restarted
+    }
+
+    {
+        AuditWorkQueue queue(1, 1);
+        CHECK(queue.add_device(devices, "sda", 2) == 1);
+
+        int home = 0;
+        AuditWorkRange range;
+        CHECK(queue.next(home, range));
+        CHECK(range.partitions.size() == 2);
+        CHECK(range.partitions[0] == 9 && range.partitions[1] == 12);
+        CHECK(queue.done(range));
+        CHECK(queue.finished());
+        CHECK(!exists(checkpoint_path));
+    }
+
+    // the next pass starts over
+    {
+        AuditWorkQueue queue(1, 1);
+        CHECK(queue.add_device(devices, "sda", 2) == 3);
+    }
+
+    system((string("rm -rf ") + devices).c_str());
+}
+
+// without a checkpoint_interval nothing is written
+static void test_no_checkpoint() {
+    char dir[] = "/tmp/AuditWorkQueueTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    const string devices(dir);
+    make_dirs(devices);
+
+    AuditWorkQueue queue(1);
+    CHECK(queue.add_device(devices, "sda", 16) == 1);
+    int home = 0;
+    AuditWorkRange range;
+    CHECK(queue.next(home, range));
+    CHECK(range.partitions.size() == 5);
+    CHECK(queue.done(range));
+    CHECK(!exists(devices + "/sda/" +
+                  AuditRangeCheckpoint::checkpoint_filename("ALL")));
+
+    system((string("rm -rf ") + devices).c_str());
+}
+
+// a range whose process died is handed out once more, before the rest
+static void test_retry() {
+    char dir[] = "/tmp/AuditWorkQueueTest.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    const string devices(dir);
+    make_dirs(devices);
+
+    AuditWorkQueue queue(2);
+    CHECK(queue.add_device(devices, "sda", 2) == 3);
+    int home = 0;
+    AuditWorkRange range;
+    CHECK(queue.next(home, range));
+    CHECK(range.partition_lo == 1);
+
+    CHECK(queue.retry(range));
+    CHECK(!queue.finished());
+    AuditWorkRange again;
+    CHECK(queue.next(home, again, false));
+    CHECK(again.index == range.index);
+    CHECK(again.partitions == range.partitions);
+
+    CHECK(!queue.retry(again));
+    CHECK(queue.done(again));
+
+    while (queue.next(home, range, false)) {
+        CHECK(range.partition_lo != 1);
+        CHECK(queue.done(range));
+    }
+    CHECK(queue.finished());
+
+    system((string("rm -rf ") + devices).c_str());
+}
+
+
+int main() {
+    test_resume();
+    test_no_checkpoint();
+    test_retry();
+
+    if (failures > 0) {
+        fprintf(stderr, "AuditWorkQueueTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("AuditWorkQueueTest: ok\n");
+    return 0;
+}
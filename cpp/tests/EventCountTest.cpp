@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "BoundedQueue.h"
+#include "EventCount.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+static const long ITEMS = 200000;
+static const long STOP = -1;
+
+class Channel {
+public:
+    BoundedQueue<long> queue;
+    EventCount not_empty;
+    EventCount not_full;
+
+    Channel() :
+        queue(8) {
+    }
+
+    void push(long value) {
+        while (!queue.try_push(value)) {
+            not_full.prepare_wait();
+            if (queue.try_push(value)) {
+                not_full.cancel_wait();
+                break;
+            }
+            not_full.wait();
+        }
+        not_empty.notify_one();
+    }
+
+    long pop() {
+        long value;
+        while (!queue.try_pop(value)) {
+            not_empty.prepare_wait();
+            if (queue.try_pop(value)) {
+                not_empty.cancel_wait();
+                break;
+            }
+            not_empty.wait();
+        }
+        not_full.notify_one();
+        return value;
+    }
+};
+
+static Channel channel;
+static long sums[2];
+
+static void* produce(void* arg) {
+    for (long i = 1; i <= ITEMS; ++i) {
+        channel.push(i);
+    }
+    return NULL;
+}
+
+static void* consume(void* arg) {
+    long* sum = (long*) arg;
+    long value;
+    while ((value = channel.pop()) != STOP) {
+        *sum += value;
+    }
+    return NULL;
+}
+
+static double cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// nothing is lost through a queue far smaller than what goes through it,
+// and consumers waiting on an empty queue don't burn CPU
+static void test_handoff() {
+    pthread_t consumers[2];
+    pthread_t producers[2];
+    for (int i = 0; i < 2; ++i) {
+        pthread_create(&consumers[i], NULL, consume, &sums[i]);
+    }
+
+    const double cpu_before = cpu_seconds();
+    usleep(200000);
+    CHECK(cpu_seconds() - cpu_before < 0.05);
+
+    for (int i = 0; i < 2; ++i) {
+        pthread_create(&producers[i], NULL, produce, NULL);
+    }
+    for (int i = 0; i < 2; ++i) {
+        pthread_join(producers[i], NULL);
+    }
+    for (int i = 0; i < 2; ++i) {
+        channel.push(STOP);
+    }
+    for (int i = 0; i < 2; ++i) {
+        pthread_join(consumers[i], NULL);
+    }
+    CHECK(sums[0] + sums[1] == ITEMS * (ITEMS + 1));
+}
+
+
+int main() {
+    test_handoff();
+
+    if (failures > 0) {
+        fprintf(stderr, "EventCountTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("EventCountTest: ok\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string>
+
+#include "Exceptions.h"
+#include "Metadata.h"
+#include "MetadataPickle.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+// CPython 3 pickle.dumps(metadata, protocol=2) of
+// {b'name': b'/a/c/o', 'X-Object-Meta-Foo': b'', 'Content-Length': '0'};
+// the empty bytes value comes out as __builtin__.bytes()
+static const char PY3_EMPTY_BYTES[] =
+    "\x80\x02\x7d\x71\x00\x28\x63\x5f\x63\x6f\x64\x65\x63\x73\x0a\x65"
+    "\x6e\x63\x6f\x64\x65\x0a\x71\x01\x58\x04\x00\x00\x00\x6e\x61\x6d"
+    "\x65\x71\x02\x58\x06\x00\x00\x00\x6c\x61\x74\x69\x6e\x31\x71\x03"
+    "\x86\x71\x04\x52\x71\x05\x68\x01\x58\x06\x00\x00\x00\x2f\x61\x2f"
+    "\x63\x2f\x6f\x71\x06\x68\x03\x86\x71\x07\x52\x71\x08\x58\x11\x00"
+    "\x00\x00\x58\x2d\x4f\x62\x6a\x65\x63\x74\x2d\x4d\x65\x74\x61\x2d"
+    "\x46\x6f\x6f\x71\x09\x63\x5f\x5f\x62\x75\x69\x6c\x74\x69\x6e\x5f"
+    "\x5f\x0a\x62\x79\x74\x65\x73\x0a\x71\x0a\x29\x52\x71\x0b\x58\x0e"
+    "\x00\x00\x00\x43\x6f\x6e\x74\x65\x6e\x74\x2d\x4c\x65\x6e\x67\x74"
+    "\x68\x71\x0c\x58\x01\x00\x00\x00\x30\x71\x0d\x75\x2e";
+
+// the same with fix_imports=False: builtins.bytes()
+static const char PY3_EMPTY_BYTES_NO_FIX_IMPORTS[] =
+    "\x80\x02\x7d\x71\x00\x58\x11\x00\x00\x00\x58\x2d\x4f\x62\x6a\x65"
+    "\x63\x74\x2d\x4d\x65\x74\x61\x2d\x46\x6f\x6f\x71\x01\x63\x62\x75"
+    "\x69\x6c\x74\x69\x6e\x73\x0a\x62\x79\x74\x65\x73\x0a\x71\x02\x29"
+    "\x52\x71\x03\x73\x2e";
+
+// bytes() with an argument could build anything; still refused
+static const char BYTES_WITH_ARGS[] =
+    "\x80\x02\x7d\x71\x00\x58\x01\x00\x00\x00\x6b\x63\x62\x75\x69\x6c"
+    "\x74\x69\x6e\x73\x0a\x62\x79\x74\x65\x73\x0a\x58\x01\x00\x00\x00"
+    "\x78\x85\x52\x73\x2e";
+
+// {} memoized by LONG_BINPUT at 0xfffffff0, far past anything the pickle
+// could have stored
+static const char HUGE_MEMO_INDEX[] =
+    "\x80\x02\x7d\x72\xf0\xff\xff\xff\x2e";
+
+
+static void test_empty_bytes_value() {
+    Metadata metadata;
+    MetadataPickle::loads(PY3_EMPTY_BYTES, sizeof(PY3_EMPTY_BYTES) - 1,
+                          metadata);
+    CHECK(metadata.size() == 3);
+    CHECK(metadata.get("name") == "/a/c/o");
+    CHECK(metadata.get("Content-Length") == "0");
+
+    const char* value;
+    size_t value_length;
+    CHECK(metadata.get("X-Object-Meta-Foo", value, value_length));
+    CHECK(value_length == 0);
+}
+
+static void test_empty_bytes_builtins() {
+    Metadata metadata;
+    MetadataPickle::loads(PY3_EMPTY_BYTES_NO_FIX_IMPORTS,
+                          sizeof(PY3_EMPTY_BYTES_NO_FIX_IMPORTS) - 1,
+                          metadata);
+    const char* value;
+    size_t value_length;
+    CHECK(metadata.get("X-Object-Meta-Foo", value, value_length));
+    CHECK(value_length == 0);
+}
+
+static void test_bytes_with_args_refused() {
+    Metadata metadata;
+    bool refused = false;
+    try {
+        MetadataPickle::loads(BYTES_WITH_ARGS, sizeof(BYTES_WITH_ARGS) - 1,
+                              metadata);
+    } catch (const UnpicklingError&) {
+        refused = true;
+    }
+    CHECK(refused);
+}
+
+static void test_huge_memo_index_refused() {
+    Metadata metadata;
+    bool refused = false;
+    try {
+        MetadataPickle::loads(HUGE_MEMO_INDEX, sizeof(HUGE_MEMO_INDEX) - 1,
+                              metadata);
+    } catch (const UnpicklingError&) {
+        refused = true;
+    }
+    CHECK(refused);
+}
+
+
+int main() {
+    test_empty_bytes_value();
+    test_empty_bytes_builtins();
+    test_bytes_with_args_refused();
+    test_huge_memo_index_refused();
+
+    if (failures > 0) {
+        fprintf(stderr, "MetadataPickleTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("MetadataPickleTest: ok\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "DiskFileRules.h"
+#include "OndiskFiles.h"
+#include "Timestamp.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+                __FILE__, __LINE__, #condition); \
+        ++failures; \
+    }
+
+
+static bool is_obsolete(const OndiskFiles& results, const string& name) {
+    const vector<int>& obsolete = results.obsolete();
+    for (size_t i = 0; i < obsolete.size(); ++i) {
+        if (results.name(results.files()[obsolete[i]]) == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// a node holding two fragments of the same durable object keeps both
+static void test_ec_multiple_fragments() {
+    vector<string> names;
+    names.push_back("1445558400.12345#0.data");
+    names.push_back("1445558400.12345#3.data");
+    names.push_back("1445558400.12345.durable");
+    names.push_back("1445558300.00000#3.data");
+
+    OndiskFiles results;
+    results.classify_as<ECRules>(names);
+
+    CHECK(results.data_file() != NULL);
+    CHECK(results.durable_file() != NULL);
+    CHECK(results.fragments().size() == 2);
+    CHECK(!is_obsolete(results, "1445558400.12345#0.data"));
+    CHECK(!is_obsolete(results, "1445558400.12345#3.data"));
+    CHECK(!is_obsolete(results, "1445558400.12345.durable"));
+    CHECK(is_obsolete(results, "1445558300.00000#3.data"));
+    CHECK(results.obsolete().size() == 1);
+
+    // each kept fragment goes into its own suffix hash
+    map<int, MD5Hash> hashes;
+    const vector<FileInfo>& files = results.files();
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!is_obsolete(results, results.name(files[i]))) {
+            ECRules::hash_file(files[i], results.name(files[i]), hashes);
+        }
+    }
+    CHECK(hashes.count(0) == 1);
+    CHECK(hashes.count(3) == 1);
+    CHECK(hashes.count(-1) == 1);
+}
+
+// a fragment newer than the durable one is still being written
+static void test_ec_fragment_in_flight() {
+    vector<string> names;
+    names.push_back("1445558500.00000#1.data");
+    names.push_back("1445558400.12345#1.data");
+    names.push_back("1445558400.12345.durable");
+
+    OndiskFiles results;
+    results.classify_as<ECRules>(names);
+
+    CHECK(results.data_file() != NULL);
+    CHECK(results.name(*results.data_file()) == "1445558400.12345#1.data");
+    CHECK(results.fragments().size() == 1);
+    CHECK(results.obsolete().empty());
+}
+
+// replication keeps one .data; fragments aren't allowed there
+static void test_replication() {
+    vector<string> names;
+    names.push_back("1445558400.12345.data");
+    names.push_back("1445558300.00000.data");
+    names.push_back("1445558400.12345#3.data");
+
+    OndiskFiles results;
+    results.classify_as<ReplicationRules>(names);
+
+    CHECK(results.data_file() != NULL);
+    CHECK(results.fragments().empty());
+    CHECK(is_obsolete(results, "1445558300.00000.data"));
+    CHECK(results.unexpected().size() == 1);
+}
+
+// swift's timestamps stop short of 10^10 seconds, and so every one fits
+// in INTERNAL_LENGTH
+static void test_timestamp_range() {
+    Timestamp timestamp;
+    CHECK(Timestamp::parse("9999999999.99999_ffffffffffffffff", timestamp));
+    CHECK(timestamp.internal().length() == Timestamp::INTERNAL_LENGTH);
+    CHECK(!Timestamp::parse("10000000000.00000", timestamp));
+    CHECK(!Timestamp::parse("99999999999999999999.00000", timestamp));
+    CHECK(Timestamp::parse("0001445558400.12345", timestamp));
+    CHECK(timestamp.normal() == "1445558400.12345");
+
+    vector<string> names;
+    names.push_back("10000000000.00000.data");
+    OndiskFiles results;
+    results.classify_as<ReplicationRules>(names);
+    CHECK(results.data_file() == NULL);
+}
+
+
+int main() {
+    test_ec_multiple_fragments();
+    test_ec_fragment_in_flight();
+    test_replication();
+    test_timestamp_range();
+
+    if (failures > 0) {
+        fprintf(stderr, "OndiskFilesTest: %d failed\n", failures);
+        return 1;
+    }
+    printf("OndiskFilesTest: ok\n");
+    return 0;
+}
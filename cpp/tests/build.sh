@@ -0,0 +1,27 @@
+#!/bin/sh
+# Standalone checks, built apart from ../build.sh. Run from cpp/tests.
+set -e
+g++ -Wall -iquote .. -o OndiskFilesTest OndiskFilesTest.cpp \
+    ../OndiskFiles.cpp ../Timestamp.cpp ../MD5Hash.cpp
+./OndiskFilesTest
+g++ -Wall -iquote .. -pthread -o EventCountTest EventCountTest.cpp
+./EventCountTest
+g++ -Wall -iquote .. -o MetadataPickleTest MetadataPickleTest.cpp \
+    ../Metadata.cpp ../MetadataPickle.cpp
+./MetadataPickleTest
+g++ -Wall -iquote .. -o AuditCheckpointTest AuditCheckpointTest.cpp \
+    ../AuditCheckpoint.cpp
+./AuditCheckpointTest
+g++ -Wall -iquote .. -o AuditIndexTest AuditIndexTest.cpp \
+    ../AuditIndex.cpp ../OSUtils.cpp
+./AuditIndexTest
+g++ -Wall -iquote .. -o AuditProcessPoolTest AuditProcessPoolTest.cpp \
+    ../AuditProcessPool.cpp ../OSUtils.cpp
+./AuditProcessPoolTest
+g++ -Wall -iquote .. -o AuditWorkQueueTest AuditWorkQueueTest.cpp \
+    ../AuditWorkQueue.cpp ../AuditRangeCheckpoint.cpp \
+    ../AuditCheckpoint.cpp ../DirReader.cpp ../OSUtils.cpp
+./AuditWorkQueueTest
+g++ -Wall -iquote .. -pthread -o AdaptiveThrottleTest AdaptiveThrottleTest.cpp \
+    ../AdaptiveThrottle.cpp ../DirReader.cpp
+./AdaptiveThrottleTest